@@ -0,0 +1,150 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RACING_LQR__RACING_ILQR_HPP_
+#define RACING_LQR__RACING_ILQR_HPP_
+
+#include <Eigen/Dense>
+
+#include <memory>
+#include <vector>
+
+#include <casadi/casadi.hpp>
+#include <lmpc_utils/casadi_evaluator.hpp>
+
+#include "racing_lqr/racing_ilqr_config.hpp"
+#include "single_track_planar_model/single_track_planar_model.hpp"
+#include "single_track_planar_model/single_track_planar_model_types.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_lqr
+{
+using lmpc::vehicle_model::single_track_planar_model::SingleTrackPlanarModel;
+using lmpc::vehicle_model::single_track_planar_model::XIndex;
+using lmpc::vehicle_model::single_track_planar_model::UIndex;
+using lmpc::utils::CasadiEvaluator;
+using lmpc::vehicle_model::base_vehicle_model::from_dm;
+
+/**
+ * @brief Iterative LQR on the nonlinear single-track model.
+ *
+ * Each iteration linearizes the RK4 discrete dynamics along the current rollout,
+ * runs a regularized Riccati sweep and rolls out the new policy with a backtracking line search.
+ * The input bounds are handled as in box-DDP, by clamping the rollout and solving the policy
+ * on the free controls, and the track boundary with an augmented Lagrangian.
+ * The sweeps are O(N) and only use stack-allocated matrices, since the single-track model
+ * has 6 states and at most 3 controls.
+ */
+class RacingILQR
+{
+public:
+  typedef std::shared_ptr<RacingILQR> SharedPtr;
+  typedef std::unique_ptr<RacingILQR> UniquePtr;
+
+  typedef lmpc::vehicle_model::single_track_planar_model::SingleTrackTypes Types;
+  static constexpr int NX = Types::NX;
+  static constexpr int MAX_NU = Types::MAX_NU;
+  typedef Types::State StateVector;
+  typedef Types::StateMatrix StateMatrix;
+  typedef Types::Control ControlVector;
+  typedef Types::ControlMatrix ControlMatrix;
+  typedef Types::InputMatrix InputMatrix;
+  typedef Types::GainMatrix GainMatrix;
+
+  explicit RacingILQR(
+    RacingILQRConfig::SharedPtr ilqr_config,
+    SingleTrackPlanarModel::SharedPtr model);
+  const RacingILQRConfig & get_config() const;
+
+  /**
+   * @brief Solve the tracking problem.
+   *
+   * @param in x_ic, X_ref (nx x N) and U_ref (nu x N-1), same as RacingLQR.
+   * curvatures (1 x N) are optional (default 0).
+   * bound_left and bound_right (1 x N), if given, constrain the lateral position
+   * in the Frenet frame.
+   * @param out u, X_optm and U_optm.
+   * @param stats success, iter_count, cost and constraint_violation.
+   * @throws std::invalid_argument if an input has the wrong size, or curvatures,
+   * bound_left or bound_right have fewer than N elements.
+   */
+  void solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::Dict & stats);
+
+  SingleTrackPlanarModel & get_model();
+
+  const bool & solved() const;
+
+protected:
+  RacingILQRConfig::SharedPtr config_ {};
+  SingleTrackPlanarModel::SharedPtr model_ {};
+  casadi::Function rk4_;
+  int nu_;
+  bool solved_ = false;
+  bool has_boundary_ = false;
+  double margin_;
+  double penalty_;
+  double regularization_;
+
+  CasadiEvaluator::UniquePtr rk4_eval_;
+  // jacobians of all the steps in one call
+  CasadiEvaluator::UniquePtr jacobian_eval_;
+
+  StateMatrix Q_;
+  StateMatrix Qf_;
+  ControlMatrix R_;
+  ControlVector u_max_;
+  ControlVector u_min_;
+
+  // references
+  std::vector<StateVector> X_ref_;
+  std::vector<ControlVector> U_ref_;
+  std::vector<double> curvatures_;
+  std::vector<double> bound_left_;
+  std::vector<double> bound_right_;
+
+  // current and candidate trajectories
+  std::vector<StateVector> X_;
+  std::vector<ControlVector> U_;
+  std::vector<StateVector> X_new_;
+  std::vector<ControlVector> U_new_;
+
+  // linearization and policy
+  std::vector<StateMatrix> A_;
+  std::vector<InputMatrix> B_;
+  std::vector<GainMatrix> K_;
+  std::vector<ControlVector> k_;
+
+  // augmented Lagrangian multipliers of the left and right track boundary of each state
+  std::vector<Eigen::Vector2d> lambda_x_;
+
+  void step(const StateVector & x, const ControlVector & u, const size_t & k, StateVector & xip1);
+  // roll out U_ from x_ic into X_
+  void simulate();
+  // roll out the current policy with step size alpha into X_new_ and U_new_
+  void forward_pass(const double & alpha);
+  void linearize();
+  bool backward_pass(double & dV1, double & dV2);
+  double cost(const std::vector<StateVector> & X, const std::vector<ControlVector> & U) const;
+  double constraint_violation() const;
+  void update_multipliers();
+};
+}  // namespace racing_lqr
+}  // namespace mpc
+}  // namespace lmpc
+#endif  // RACING_LQR__RACING_ILQR_HPP_
@@ -0,0 +1,55 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RACING_LQR__RACING_ILQR_CONFIG_HPP_
+#define RACING_LQR__RACING_ILQR_CONFIG_HPP_
+
+#include <memory>
+
+#include <casadi/casadi.hpp>
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_lqr
+{
+struct RacingILQRConfig
+{
+  typedef std::shared_ptr<RacingILQRConfig> SharedPtr;
+
+  size_t N;  // steps
+  double dt;  // delta t between steps
+  casadi::DM Q;  // state cost-to-go
+  casadi::DM R;  // control cost-to-go
+  casadi::DM Qf;  // final state cost
+  casadi::DM u_max;  // control upper bound
+  casadi::DM u_min;  // control lower bound
+  double margin;  // safety margin to the track boundary
+  size_t max_iter;  // iLQR iterations per augmented Lagrangian iteration
+  size_t max_al_iter;  // augmented Lagrangian iterations per solve
+  double tol;  // relative cost decrease to stop the iLQR iterations
+  double constraint_tol;  // constraint violation to stop the augmented Lagrangian iterations
+  double penalty_init;  // initial augmented Lagrangian penalty
+  double penalty_scale;  // penalty growth per augmented Lagrangian iteration
+  double penalty_max;  // maximum augmented Lagrangian penalty
+  double regularization;  // initial regularization of the control hessian
+  bool warm_start;  // start from the previous solution shifted by one step
+};
+}  // namespace racing_lqr
+}  // namespace mpc
+}  // namespace lmpc
+#endif  // RACING_LQR__RACING_ILQR_CONFIG_HPP_
@@ -22,6 +22,7 @@
 #include <rclcpp/rclcpp.hpp>
 
 #include "racing_lqr/racing_lqr_config.hpp"
+#include "racing_lqr/racing_ilqr_config.hpp"
 
 namespace lmpc
 {
@@ -30,6 +31,7 @@ namespace mpc
 namespace racing_lqr
 {
 RacingLQRConfig::SharedPtr load_parameters(rclcpp::Node * node);
+RacingILQRConfig::SharedPtr load_ilqr_parameters(rclcpp::Node * node);
 }  // namespace racing_lqr
 }  // namespace mpc
 }  // namespace lmpc
@@ -0,0 +1,455 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "racing_lqr/racing_ilqr.hpp"
+#include "lmpc_utils/utils.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_lqr
+{
+namespace
+{
+constexpr double MAX_REGULARIZATION = 1e10;
+constexpr size_t MAX_LINE_SEARCH = 10;
+constexpr double BOUND_TOL = 1e-9;
+
+// augmented Lagrangian of the constraint c <= 0, and its derivatives w.r.t. c
+inline double al_value(const double & c, const double & lambda, const double & penalty)
+{
+  const auto v = std::max(0.0, lambda + penalty * c);
+  return (v * v - lambda * lambda) / (2.0 * penalty);
+}
+
+inline double al_gradient(const double & c, const double & lambda, const double & penalty)
+{
+  return std::max(0.0, lambda + penalty * c);
+}
+
+inline double al_hessian(const double & c, const double & lambda, const double & penalty)
+{
+  return lambda + penalty * c > 0.0 ? penalty : 0.0;
+}
+}  // namespace
+
+RacingILQR::RacingILQR(
+  RacingILQRConfig::SharedPtr ilqr_config,
+  SingleTrackPlanarModel::SharedPtr model)
+: config_(ilqr_config), model_(model),
+  rk4_(utils::rk4_function(model_->nx(), model_->nu(), model_->dynamics())),
+  nu_(static_cast<int>(model_->nu())),
+  margin_(config_->margin + model_->get_base_config().chassis_config->b / 2.0),
+  penalty_(config_->penalty_init),
+  regularization_(config_->regularization)
+{
+  using casadi::DM;
+  using casadi::SX;
+
+  if (model_->nx() != static_cast<size_t>(NX) || nu_ > MAX_NU) {
+    throw std::invalid_argument("RacingILQR: the model must have 6 states and at most 3 controls.");
+  }
+  if (config_->N < 2) {
+    throw std::invalid_argument("RacingILQR: N must be at least 2.");
+  }
+  if (config_->Q.size1() != NX || config_->Qf.size1() != NX || config_->R.size1() != nu_ ||
+    config_->u_max.numel() != nu_ || config_->u_min.numel() != nu_)
+  {
+    throw std::invalid_argument("RacingILQR: cost matrices or control bounds have the wrong size.");
+  }
+
+  const auto Q = DM::densify(config_->Q);
+  const auto Qf = DM::densify(config_->Qf);
+  const auto R = DM::densify(config_->R);
+  from_dm(Q, Q_);
+  from_dm(Qf, Qf_);
+  from_dm(R, R_);
+  u_max_ = Eigen::Map<const Eigen::VectorXd>(config_->u_max.ptr(), nu_);
+  u_min_ = Eigen::Map<const Eigen::VectorXd>(config_->u_min.ptr(), nu_);
+
+  // exact jacobians of the rollout dynamics, dense so they can be mapped into fixed-size matrices
+  const auto x = SX::sym("x", NX);
+  const auto u = SX::sym("u", nu_);
+  const auto k = SX::sym("k");
+  const auto dt = SX::sym("dt");
+  const auto xip1 = rk4_(casadi::SXDict{{"x", x}, {"u", u}, {"k", k}, {"dt", dt}}).at("xip1");
+  const auto step = casadi::Function(
+    "ilqr_step", {x, u, k, dt}, {SX::densify(xip1)},
+    {"x", "u", "k", "dt"}, {"xip1"});
+  const auto jacobian = casadi::Function(
+    "ilqr_jacobian", {x, u, k, dt},
+    {SX::densify(SX::jacobian(xip1, x)), SX::densify(SX::jacobian(xip1, u))},
+    {"x", "u", "k", "dt"}, {"A", "B"});
+  rk4_eval_ = std::make_unique<CasadiEvaluator>(step);
+  jacobian_eval_ = std::make_unique<CasadiEvaluator>(
+    jacobian.map(static_cast<casadi_int>(config_->N - 1)));
+  // the mapped jacobian takes one time step per stage
+  rk4_eval_->input("dt") = config_->dt;
+  auto & dts = jacobian_eval_->input("dt").nonzeros();
+  std::fill(dts.begin(), dts.end(), config_->dt);
+
+  const auto N = config_->N;
+  X_ref_.assign(N, StateVector::Zero());
+  U_ref_.assign(N - 1, ControlVector::Zero(nu_));
+  curvatures_.assign(N, 0.0);
+  bound_left_.assign(N, 0.0);
+  bound_right_.assign(N, 0.0);
+  X_.assign(N, StateVector::Zero());
+  U_.assign(N - 1, ControlVector::Zero(nu_));
+  X_new_ = X_;
+  U_new_ = U_;
+  A_.assign(N - 1, StateMatrix::Zero());
+  B_.assign(N - 1, InputMatrix::Zero(NX, nu_));
+  K_.assign(N - 1, GainMatrix::Zero(nu_, NX));
+  k_.assign(N - 1, ControlVector::Zero(nu_));
+  lambda_x_.assign(N, Eigen::Vector2d::Zero());
+}
+
+const RacingILQRConfig & RacingILQR::get_config() const
+{
+  return *config_.get();
+}
+
+void RacingILQR::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::Dict & stats)
+{
+  using casadi::DM;
+  using casadi::Slice;
+
+  const auto N = config_->N;
+  const auto x_ic = DM::densify(in.at("x_ic"));
+  const auto X_ref = DM::densify(in.at("X_ref"));
+  const auto U_ref = DM::densify(in.at("U_ref"));
+  if (x_ic.numel() != NX || X_ref.size1() != NX ||
+    X_ref.size2() != static_cast<casadi_int>(N) || U_ref.size1() != nu_ ||
+    U_ref.size2() != static_cast<casadi_int>(N - 1))
+  {
+    throw std::invalid_argument("RacingILQR: x_ic, X_ref or U_ref has the wrong size.");
+  }
+  // an optional stage-wise input, zero if absent
+  const auto num_stages = static_cast<casadi_int>(N);
+  const auto stage_input = [&in, &num_stages](const std::string & name) {
+      const auto value = in.count(name) ? DM::densify(in.at(name)) : DM::zeros(1, num_stages);
+      if (value.numel() < num_stages) {
+        throw std::invalid_argument("RacingILQR: " + name + " has fewer than N elements.");
+      }
+      return value;
+    };
+  const auto curvatures = stage_input("curvatures");
+  has_boundary_ = in.count("bound_left") && in.count("bound_right");
+  const auto bound_left = stage_input("bound_left");
+  const auto bound_right = stage_input("bound_right");
+  for (size_t k = 0; k < N; k++) {
+    X_ref_[k] = Eigen::Map<const StateVector>(X_ref.ptr() + NX * k);
+    curvatures_[k] = curvatures.ptr()[k];
+    bound_left_[k] = bound_left.ptr()[k];
+    bound_right_[k] = bound_right.ptr()[k];
+    if (k < N - 1) {
+      U_ref_[k] = Eigen::Map<const Eigen::VectorXd>(U_ref.ptr() + nu_ * k, nu_);
+    }
+  }
+
+  // initial guess, the multipliers are not warm started since an infeasible
+  // initial state would carry inflated multipliers over to the next solve
+  if (config_->warm_start && solved_) {
+    std::rotate(U_.begin(), U_.begin() + 1, U_.end());
+    if (U_.size() > 1) {
+      U_.back() = U_[U_.size() - 2];
+    }
+  } else {
+    U_ = U_ref_;
+  }
+  for (auto & u : U_) {
+    u = u.cwiseMax(u_min_).cwiseMin(u_max_);
+  }
+  for (auto & lambda : lambda_x_) {
+    lambda.setZero();
+  }
+  penalty_ = config_->penalty_init;
+  regularization_ = config_->regularization;
+  X_[0] = Eigen::Map<const StateVector>(x_ic.ptr());
+  simulate();
+
+  auto J = cost(X_, U_);
+  size_t iter_count = 0;
+  for (size_t al_iter = 0; al_iter < config_->max_al_iter; al_iter++) {
+    for (size_t iter = 0; iter < config_->max_iter; iter++) {
+      iter_count++;
+      linearize();
+      double dV1 = 0.0;
+      double dV2 = 0.0;
+      while (!backward_pass(dV1, dV2) && regularization_ < MAX_REGULARIZATION) {
+        regularization_ *= 10.0;
+      }
+      // converged, or the control hessian cannot be regularized
+      if (regularization_ >= MAX_REGULARIZATION || -dV1 < config_->tol * std::abs(J)) {
+        break;
+      }
+
+      // backtracking line search on the nonlinear rollout
+      auto alpha = 1.0;
+      auto J_new = J;
+      for (size_t i = 0; i < MAX_LINE_SEARCH; i++) {
+        forward_pass(alpha);
+        J_new = cost(X_new_, U_new_);
+        if (J_new < J) {
+          break;
+        }
+        alpha *= 0.5;
+      }
+      if (!(J_new < J)) {
+        regularization_ *= 10.0;
+        continue;
+      }
+      std::swap(X_, X_new_);
+      std::swap(U_, U_new_);
+      regularization_ = std::max(regularization_ / 10.0, config_->regularization);
+      const auto decrease = J - J_new;
+      J = J_new;
+      if (decrease < config_->tol * std::abs(J)) {
+        break;
+      }
+    }
+    if (constraint_violation() <= config_->constraint_tol) {
+      break;
+    }
+    update_multipliers();
+    penalty_ = std::min(penalty_ * config_->penalty_scale, config_->penalty_max);
+    regularization_ = config_->regularization;
+    J = cost(X_, U_);
+  }
+  solved_ = true;
+
+  auto X_optm = DM::zeros(NX, N);
+  auto U_optm = DM::zeros(nu_, N - 1);
+  for (size_t k = 0; k < N; k++) {
+    Eigen::Map<StateVector>(X_optm.ptr() + NX * k) = X_[k];
+    if (k < N - 1) {
+      Eigen::Map<Eigen::VectorXd>(U_optm.ptr() + nu_ * k, nu_) = U_[k];
+    }
+  }
+  out["u"] = U_optm(Slice(), 0);
+  out["U_optm"] = U_optm;
+  out["X_optm"] = X_optm;
+
+  const auto violation = constraint_violation();
+  stats["success"] = violation <= config_->constraint_tol;
+  stats["iter_count"] = static_cast<casadi_int>(iter_count);
+  stats["cost"] = J;
+  stats["constraint_violation"] = violation;
+}
+
+SingleTrackPlanarModel & RacingILQR::get_model()
+{
+  return *model_;
+}
+
+const bool & RacingILQR::solved() const
+{
+  return solved_;
+}
+
+void RacingILQR::step(
+  const StateVector & x, const ControlVector & u, const size_t & k,
+  StateVector & xip1)
+{
+  Eigen::Map<StateVector>(rk4_eval_->input(0).ptr()) = x;
+  Eigen::Map<Eigen::VectorXd>(rk4_eval_->input(1).ptr(), nu_) = u;
+  rk4_eval_->input(2).nonzeros()[0] = curvatures_[k];
+  rk4_eval_->evaluate();
+  xip1 = Eigen::Map<const StateVector>(rk4_eval_->output(0).ptr());
+}
+
+void RacingILQR::simulate()
+{
+  for (size_t k = 0; k < config_->N - 1; k++) {
+    step(X_[k], U_[k], k, X_[k + 1]);
+  }
+}
+
+void RacingILQR::forward_pass(const double & alpha)
+{
+  X_new_[0] = X_[0];
+  for (size_t k = 0; k < config_->N - 1; k++) {
+    U_new_[k] = (U_[k] + alpha * k_[k] + K_[k] * (X_new_[k] - X_[k]))
+      .cwiseMax(u_min_).cwiseMin(u_max_);
+    step(X_new_[k], U_new_[k], k, X_new_[k + 1]);
+  }
+}
+
+void RacingILQR::linearize()
+{
+  auto * x = jacobian_eval_->input(0).ptr();
+  auto * u = jacobian_eval_->input(1).ptr();
+  auto * k = jacobian_eval_->input(2).ptr();
+  for (size_t i = 0; i < config_->N - 1; i++) {
+    Eigen::Map<StateVector>(x + NX * i) = X_[i];
+    Eigen::Map<Eigen::VectorXd>(u + nu_ * i, nu_) = U_[i];
+    k[i] = curvatures_[i];
+  }
+  jacobian_eval_->evaluate();
+  const auto * A = jacobian_eval_->output(0).ptr();
+  const auto * B = jacobian_eval_->output(1).ptr();
+  for (size_t i = 0; i < config_->N - 1; i++) {
+    A_[i] = Eigen::Map<const StateMatrix>(A + NX * NX * i);
+    B_[i] = Eigen::Map<const Eigen::MatrixXd>(B + NX * nu_ * i, NX, nu_);
+  }
+}
+
+bool RacingILQR::backward_pass(double & dV1, double & dV2)
+{
+  const auto N = config_->N;
+  auto add_boundary = [&](const size_t & k, StateVector & lx, StateMatrix & lxx) {
+      if (!has_boundary_) {
+        return;
+      }
+      const auto py = X_[k](XIndex::PY);
+      const auto c_left = py - (bound_left_[k] - margin_);
+      const auto c_right = bound_right_[k] + margin_ - py;
+      lx(XIndex::PY) += al_gradient(c_left, lambda_x_[k](0), penalty_) -
+        al_gradient(c_right, lambda_x_[k](1), penalty_);
+      lxx(XIndex::PY, XIndex::PY) += al_hessian(c_left, lambda_x_[k](0), penalty_) +
+        al_hessian(c_right, lambda_x_[k](1), penalty_);
+    };
+
+  StateVector Vx = Qf_ * (X_[N - 1] - X_ref_[N - 1]);
+  StateMatrix Vxx = Qf_;
+  add_boundary(N - 1, Vx, Vxx);
+  dV1 = 0.0;
+  dV2 = 0.0;
+  for (int k = static_cast<int>(N) - 2; k >= 0; k--) {
+    StateVector lx = Q_ * (X_[k] - X_ref_[k]);
+    StateMatrix lxx = Q_;
+    if (k > 0) {
+      add_boundary(k, lx, lxx);
+    }
+    const ControlVector lu = R_ * (U_[k] - U_ref_[k]);
+    const ControlMatrix & luu = R_;
+
+    const auto & A = A_[k];
+    const auto & B = B_[k];
+    const StateVector Qx = lx + A.transpose() * Vx;
+    const ControlVector Qu = lu + B.transpose() * Vx;
+    const StateMatrix Qxx = lxx + A.transpose() * Vxx * A;
+    const ControlMatrix Quu = luu + B.transpose() * Vxx * B;
+    const GainMatrix Qux = B.transpose() * Vxx * A;
+
+    // box-DDP: a control on a bound that the gradient pushes further out is clamped,
+    // the policy is solved on the remaining free controls
+    std::array<int, MAX_NU> free_index;
+    int num_free = 0;
+    for (int i = 0; i < nu_; i++) {
+      const auto at_upper = U_[k](i) >= u_max_(i) - BOUND_TOL && Qu(i) < 0.0;
+      const auto at_lower = U_[k](i) <= u_min_(i) + BOUND_TOL && Qu(i) > 0.0;
+      if (!at_upper && !at_lower) {
+        free_index[num_free++] = i;
+      }
+    }
+    k_[k].setZero();
+    K_[k].setZero();
+    if (num_free > 0) {
+      ControlMatrix Quu_free(num_free, num_free);
+      ControlVector Qu_free(num_free);
+      GainMatrix Qux_free(num_free, NX);
+      for (int i = 0; i < num_free; i++) {
+        Qu_free(i) = Qu(free_index[i]);
+        Qux_free.row(i) = Qux.row(free_index[i]);
+        for (int j = 0; j < num_free; j++) {
+          Quu_free(i, j) = Quu(free_index[i], free_index[j]);
+        }
+      }
+      Quu_free.diagonal().array() += regularization_;
+      const Eigen::LLT<ControlMatrix> llt(Quu_free);
+      if (llt.info() != Eigen::Success) {
+        return false;
+      }
+      const ControlVector k_free = -llt.solve(Qu_free);
+      const GainMatrix K_free = -llt.solve(Qux_free);
+      for (int i = 0; i < num_free; i++) {
+        k_[k](free_index[i]) = k_free(i);
+        K_[k].row(free_index[i]) = K_free.row(i);
+      }
+    }
+
+    dV1 += k_[k].dot(Qu);
+    dV2 += 0.5 * k_[k].dot(Quu * k_[k]);
+    Vx = Qx + K_[k].transpose() * Quu * k_[k] + K_[k].transpose() * Qu + Qux.transpose() * k_[k];
+    Vxx = Qxx + K_[k].transpose() * Quu * K_[k] + K_[k].transpose() * Qux +
+      Qux.transpose() * K_[k];
+    Vxx = 0.5 * (Vxx + Vxx.transpose()).eval();
+  }
+  return true;
+}
+
+double RacingILQR::cost(
+  const std::vector<StateVector> & X,
+  const std::vector<ControlVector> & U) const
+{
+  const auto N = config_->N;
+  double J = 0.0;
+  for (size_t k = 0; k < N; k++) {
+    const StateVector dx = X[k] - X_ref_[k];
+    if (k < N - 1) {
+      const ControlVector du = U[k] - U_ref_[k];
+      J += 0.5 * dx.dot(Q_ * dx) + 0.5 * du.dot(R_ * du);
+    } else {
+      J += 0.5 * dx.dot(Qf_ * dx);
+    }
+    if (has_boundary_ && k > 0) {
+      const auto py = X[k](XIndex::PY);
+      J += al_value(py - (bound_left_[k] - margin_), lambda_x_[k](0), penalty_);
+      J += al_value(bound_right_[k] + margin_ - py, lambda_x_[k](1), penalty_);
+    }
+  }
+  return J;
+}
+
+double RacingILQR::constraint_violation() const
+{
+  double violation = 0.0;
+  if (!has_boundary_) {
+    return violation;
+  }
+  for (size_t k = 1; k < config_->N; k++) {
+    const auto py = X_[k](XIndex::PY);
+    violation = std::max(violation, py - (bound_left_[k] - margin_));
+    violation = std::max(violation, bound_right_[k] + margin_ - py);
+  }
+  return violation;
+}
+
+void RacingILQR::update_multipliers()
+{
+  if (!has_boundary_) {
+    return;
+  }
+  for (size_t k = 1; k < config_->N; k++) {
+    const auto py = X_[k](XIndex::PY);
+    lambda_x_[k](0) = al_gradient(py - (bound_left_[k] - margin_), lambda_x_[k](0), penalty_);
+    lambda_x_[k](1) = al_gradient(bound_right_[k] + margin_ - py, lambda_x_[k](1), penalty_);
+  }
+}
+}  // namespace racing_lqr
+}  // namespace mpc
+}  // namespace lmpc
@@ -13,6 +13,7 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <cmath>
 #include <string>
 #include <memory>
 #include <vector>
@@ -49,6 +50,49 @@ RacingLQRConfig::SharedPtr load_parameters(rclcpp::Node * node)
         }
   );
 }
+
+RacingILQRConfig::SharedPtr load_ilqr_parameters(rclcpp::Node * node)
+{
+  auto declare_double = [&](const char * name) {
+      return lmpc::utils::declare_parameter<double>(node, name);
+    };
+  auto declare_vec = [&](const char * name) {
+      return lmpc::utils::declare_parameter<std::vector<double>>(node, name);
+    };
+  auto declare_int = [&](const char * name) {
+      return lmpc::utils::declare_parameter<int64_t>(node, name);
+    };
+  auto declare_bool = [&](const char * name) {
+      return lmpc::utils::declare_parameter<bool>(node, name);
+    };
+  auto declare_square = [&](const char * name) {
+      const auto m = casadi::DM(declare_vec(name));
+      const auto n = static_cast<casadi_int>(sqrt(m.size1()));
+      return casadi::DM::reshape(m, n, n);
+    };
+
+  return std::make_shared<RacingILQRConfig>(
+    RacingILQRConfig{
+          static_cast<size_t>(declare_int("racing_ilqr.n")),
+          declare_double("racing_ilqr.dt"),
+          declare_square("racing_ilqr.q"),
+          declare_square("racing_ilqr.r"),
+          declare_square("racing_ilqr.qf"),
+          casadi::DM(declare_vec("racing_ilqr.u_max")),
+          casadi::DM(declare_vec("racing_ilqr.u_min")),
+          declare_double("racing_ilqr.margin"),
+          static_cast<size_t>(declare_int("racing_ilqr.max_iter")),
+          static_cast<size_t>(declare_int("racing_ilqr.max_al_iter")),
+          declare_double("racing_ilqr.tol"),
+          declare_double("racing_ilqr.constraint_tol"),
+          declare_double("racing_ilqr.penalty_init"),
+          declare_double("racing_ilqr.penalty_scale"),
+          declare_double("racing_ilqr.penalty_max"),
+          declare_double("racing_ilqr.regularization"),
+          declare_bool("racing_ilqr.warm_start")
+        }
+  );
+}
 }  // namespace racing_lqr
 }  // namespace mpc
 }  // namespace lmpc
@@ -16,6 +16,7 @@
 #include <gtest/gtest.h>
 
 #include <math.h>
+#include <cmath>
 #include <iostream>
 #include <chrono>
 #include <rclcpp/rclcpp.hpp>
@@ -24,9 +25,11 @@
 #include "base_vehicle_model/ros_param_loader.hpp"
 #include "single_track_planar_model/ros_param_loader.hpp"
 #include "racing_lqr/racing_lqr.hpp"
+#include "racing_lqr/racing_ilqr.hpp"
 #include "racing_lqr/ros_param_loader.hpp"
 
 using lmpc::mpc::racing_lqr::RacingLQR;
+using lmpc::mpc::racing_lqr::RacingILQR;
 using lmpc::vehicle_model::single_track_planar_model::SingleTrackPlanarModel;
 using lmpc::vehicle_model::single_track_planar_model::XIndex;
 using lmpc::vehicle_model::single_track_planar_model::UIndex;
@@ -126,3 +129,101 @@ TEST(RacingLQRTest, RacingLQRSolveTest) {
   T_optm_ref_intp.T().to_file("test_T_optm.txt", "txt");
   SUCCEED();
 }
+
+RacingILQR::SharedPtr get_ilqr()
+{
+  rclcpp::init(0, nullptr);
+  const auto base_share_dir = ament_index_cpp::get_package_share_directory("base_vehicle_model");
+  const auto model_share_dir = ament_index_cpp::get_package_share_directory(
+    "single_track_planar_model");
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle_2.param.yaml",
+    "--params-file", model_share_dir + "/param/sample_vehicle_2.param.yaml",
+    "--params-file", share_dir + "/param/sample_ilqr_2.param.yaml"
+  });
+  auto test_node = rclcpp::Node("test_racing_ilqr_node", options);
+
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(&test_node);
+  auto model_config = lmpc::vehicle_model::single_track_planar_model::load_parameters(&test_node);
+  auto model = std::make_shared<SingleTrackPlanarModel>(base_config, model_config);
+
+  auto config = lmpc::mpc::racing_lqr::load_ilqr_parameters(&test_node);
+  auto ilqr = std::make_shared<RacingILQR>(config, model);
+
+  rclcpp::shutdown();
+  return ilqr;
+}
+
+TEST(RacingLQRTest, RacingILQRSolveTest) {
+  using casadi::DM;
+  using casadi::Slice;
+  auto ilqr = get_ilqr();
+  const auto & config = ilqr->get_config();
+  const auto N = static_cast<casadi_int>(config.N);
+  const auto nu = static_cast<casadi_int>(ilqr->get_model().nu());
+
+  // straight track of 4 m width in the Frenet frame, starting off the centerline
+  const auto v_ref = 8.0;
+  auto X_ref = DM::zeros(ilqr->get_model().nx(), N);
+  for (casadi_int i = 0; i < N; i++) {
+    X_ref(XIndex::PX, i) = v_ref * config.dt * i;
+    X_ref(XIndex::VX, i) = v_ref;
+  }
+  auto sol_in = casadi::DMDict{
+    {"x_ic", DM{0.0, 1.0, 0.05, v_ref, 0.0, 0.0}},
+    {"X_ref", X_ref},
+    {"U_ref", DM::zeros(nu, N - 1)},
+    {"curvatures", DM::zeros(1, N)},
+    {"bound_left", DM::zeros(1, N) + 2.0},
+    {"bound_right", DM::zeros(1, N) - 2.0}
+  };
+
+  auto sol_out = casadi::DMDict{};
+  auto stats = casadi::Dict{};
+  for (int i = 0; i < 10; i++) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    ilqr->solve(sol_in, sol_out, stats);
+    const auto stop = std::chrono::high_resolution_clock::now();
+    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+    std::cout << "iLQR Execution Time: " << duration.count() << "us, iterations: " <<
+      stats.at("iter_count") << std::endl;
+  }
+  EXPECT_TRUE(stats.at("success").as_bool());
+
+  // the lateral error is reduced without leaving the track or exceeding the control bounds
+  const auto & X_optm = sol_out.at("X_optm");
+  const auto & U_optm = sol_out.at("U_optm");
+  EXPECT_LT(
+    std::abs(static_cast<double>(X_optm(XIndex::PY, N - 1))),
+    std::abs(static_cast<double>(sol_in.at("x_ic")(XIndex::PY))));
+  const auto half_width = 2.0 - ilqr->get_model().get_base_config().chassis_config->b / 2.0;
+  EXPECT_LE(static_cast<double>(DM::mmax(X_optm(XIndex::PY, Slice()))), half_width + 1e-2);
+  for (casadi_int i = 0; i < nu; i++) {
+    EXPECT_LE(static_cast<double>(DM::mmax(U_optm(i, Slice()))), config.u_max.nonzeros()[i]);
+    EXPECT_GE(static_cast<double>(DM::mmin(U_optm(i, Slice()))), config.u_min.nonzeros()[i]);
+  }
+}
+
+TEST(RacingLQRTest, RacingILQRInputSizeTest) {
+  using casadi::DM;
+  auto ilqr = get_ilqr();
+  const auto N = static_cast<casadi_int>(ilqr->get_config().N);
+  const auto nu = static_cast<casadi_int>(ilqr->get_model().nu());
+  auto sol_in = casadi::DMDict{
+    {"x_ic", DM::zeros(ilqr->get_model().nx(), 1)},
+    {"X_ref", DM::zeros(ilqr->get_model().nx(), N)},
+    {"U_ref", DM::zeros(nu, N - 1)},
+    {"bound_left", DM::zeros(1, N) + 2.0},
+    {"bound_right", DM::zeros(1, N - 1) - 2.0}
+  };
+
+  auto sol_out = casadi::DMDict{};
+  auto stats = casadi::Dict{};
+  EXPECT_THROW(ilqr->solve(sol_in, sol_out, stats), std::invalid_argument);
+  sol_in["bound_right"] = DM::zeros(1, N) - 2.0;
+  sol_in["curvatures"] = DM::zeros(1, 1);
+  EXPECT_THROW(ilqr->solve(sol_in, sol_out, stats), std::invalid_argument);
+}
@@ -0,0 +1,94 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RACING_MPC__APPROX_MPC_HPP_
+#define RACING_MPC__APPROX_MPC_HPP_
+
+#include <Eigen/Dense>
+
+#include <memory>
+
+#include <casadi/casadi.hpp>
+#include <lmpc_utils/casadi_evaluator.hpp>
+
+#include "racing_mpc/mlp.hpp"
+#include "racing_mpc/racing_mpc_config.hpp"
+#include "vehicle_model_factory/vehicle_model_factory.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+using lmpc::vehicle_model::base_vehicle_model::BaseVehicleModel;
+
+/**
+ * @brief Approximate MPC, an MLP policy distilled from RacingMPC.
+ *
+ * The features are the state without the abscissa, the current control and the track
+ * references of the horizon. The output is the control sequence U_optm.
+ */
+class ApproxMPC
+{
+public:
+  typedef std::shared_ptr<ApproxMPC> SharedPtr;
+  typedef std::unique_ptr<ApproxMPC> UniquePtr;
+
+  ApproxMPC(
+    RacingMPCConfig::SharedPtr mpc_config,
+    BaseVehicleModel::SharedPtr model,
+    MLP::SharedPtr policy);
+
+  static Eigen::Index num_features(const size_t & N, const size_t & nu);
+  static Eigen::Index num_outputs(const size_t & N, const size_t & nu);
+
+  /**
+   * @brief Write the features of an MPC problem.
+   *
+   * @param in x_ic, u_ic, curvatures, bound_left, bound_right and vel_ref,
+   * lateral_ref is optional (default 0)
+   * @param features output of size num_features()
+   */
+  static void features(
+    const casadi::DMDict & in, const size_t & N, const size_t & nu,
+    Eigen::Ref<Eigen::VectorXd> features);
+
+  /**
+   * @brief Evaluate the policy.
+   *
+   * @param in same as RacingMPC::solve(), the features and T_ref are used.
+   * @param out X_optm, U_optm and dU_optm. X_optm is the rollout of U_optm.
+   * @param stats success
+   */
+  void solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::Dict & stats);
+
+  MLP & get_policy();
+
+protected:
+  RacingMPCConfig::SharedPtr config_ {};
+  BaseVehicleModel::SharedPtr model_ {};
+  MLP::SharedPtr policy_ {};
+  Eigen::VectorXd features_;
+  lmpc::utils::CasadiEvaluator::UniquePtr dynamics_eval_;
+  casadi::DM X_optm_;
+  casadi::DM U_optm_;
+  casadi::DM dU_optm_;
+};
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
+#endif  // RACING_MPC__APPROX_MPC_HPP_
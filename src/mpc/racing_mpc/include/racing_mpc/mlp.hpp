@@ -0,0 +1,92 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RACING_MPC__MLP_HPP_
+#define RACING_MPC__MLP_HPP_
+
+#include <Eigen/Dense>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+/**
+ * @brief Multilayer perceptron with tanh hidden layers and a linear output layer.
+ *
+ * The inputs and the outputs are normalized with the statistics of the training data.
+ * All the buffers are allocated on construction, so forward() does not allocate.
+ * forward() writes into these buffers, so an instance must not be shared between threads.
+ */
+class MLP
+{
+public:
+  typedef std::shared_ptr<MLP> SharedPtr;
+  typedef std::unique_ptr<MLP> UniquePtr;
+
+  /**
+   * @brief Construct a new MLP with random weights.
+   *
+   * @param layer_sizes sizes of all the layers, from the input to the output layer
+   * @param seed seed of the weight initialization
+   */
+  explicit MLP(const std::vector<int> & layer_sizes, const unsigned int & seed = 0);
+
+  /**
+   * @brief Load an MLP saved by save(). Throws std::runtime_error if the file is invalid.
+   */
+  explicit MLP(const std::string & path);
+
+  void save(const std::string & path) const;
+
+  /**
+   * @brief Evaluate the MLP. The returned output is overwritten by the next call.
+   */
+  const Eigen::VectorXd & forward(const Eigen::Ref<const Eigen::VectorXd> & input);
+
+  int num_inputs() const;
+  int num_outputs() const;
+  size_t num_layers() const;  // number of weight layers
+
+  std::vector<Eigen::MatrixXd> & weights();
+  std::vector<Eigen::VectorXd> & biases();
+  const std::vector<Eigen::MatrixXd> & weights() const;
+  const std::vector<Eigen::VectorXd> & biases() const;
+
+  // normalization, the network maps (input - input_mean) / input_std
+  // to (output - output_mean) / output_std
+  Eigen::VectorXd input_mean;
+  Eigen::VectorXd input_std;
+  Eigen::VectorXd output_mean;
+  Eigen::VectorXd output_std;
+
+protected:
+  std::vector<Eigen::MatrixXd> weights_;
+  std::vector<Eigen::VectorXd> biases_;
+  std::vector<Eigen::VectorXd> activations_;
+  Eigen::VectorXd output_;
+
+  void allocate(const std::vector<int> & layer_sizes);
+};
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
+#endif  // RACING_MPC__MLP_HPP_
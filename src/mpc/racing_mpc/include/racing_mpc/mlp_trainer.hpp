@@ -0,0 +1,74 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RACING_MPC__MLP_TRAINER_HPP_
+#define RACING_MPC__MLP_TRAINER_HPP_
+
+#include <Eigen/Dense>
+
+#include <ostream>
+#include <vector>
+
+#include "racing_mpc/mlp.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+struct MLPTrainerConfig
+{
+  size_t epochs;
+  size_t batch_size;
+  double learning_rate;  // Adam step size
+  double validation_fraction;  // fraction of the samples held out for validation
+  unsigned int seed;  // seed of the shuffling
+};
+
+/**
+ * @brief Fit an MLP to a dataset by minimizing the mean squared error with Adam.
+ */
+class MLPTrainer
+{
+public:
+  MLPTrainer(MLP & mlp, const MLPTrainerConfig & config);
+
+  /**
+   * @brief Set the normalization of the MLP from the data and train it.
+   *
+   * @param inputs one sample per column (num_inputs x M)
+   * @param outputs one sample per column (num_outputs x M)
+   * @param log if not nullptr, the losses are printed every epoch
+   * @return mean squared error of the normalized outputs on the validation samples,
+   * or on the training samples if there are no validation samples
+   */
+  double train(
+    const Eigen::MatrixXd & inputs, const Eigen::MatrixXd & outputs,
+    std::ostream * log = nullptr);
+
+protected:
+  MLP & mlp_;
+  MLPTrainerConfig config_;
+
+  // activations of each layer for a batch of normalized inputs
+  std::vector<Eigen::MatrixXd> forward(const Eigen::MatrixXd & inputs) const;
+  double loss(const Eigen::MatrixXd & inputs, const Eigen::MatrixXd & outputs) const;
+};
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
+#endif  // RACING_MPC__MLP_TRAINER_HPP_
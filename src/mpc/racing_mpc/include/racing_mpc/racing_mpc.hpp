@@ -16,11 +16,15 @@
 #ifndef RACING_MPC__RACING_MPC_HPP_
 #define RACING_MPC__RACING_MPC_HPP_
 
+#include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <casadi/casadi.hpp>
 
 #include "racing_mpc/racing_mpc_config.hpp"
+#include "racing_mpc/solution_cache.hpp"
 #include "vehicle_model_factory/vehicle_model_factory.hpp"
 #include "racing_trajectory/safe_set.hpp"
 
@@ -36,6 +40,22 @@ using lmpc::vehicle_model::base_vehicle_model::XIndex;
 using lmpc::vehicle_model::base_vehicle_model::UIndex;
 using lmpc::vehicle_model::racing_trajectory::SafeSetManager;
 using lmpc::vehicle_model::racing_trajectory::SafeSetRecorder;
+using lmpc::vehicle_model::racing_trajectory::RacingTrajectory;
+
+// size of the optimization problem of a RacingMPC
+struct RacingMPCProblemSize
+{
+  casadi_int num_variables = 0;
+  casadi_int num_constraints = 0;
+  casadi_int num_parameters = 0;
+  // structural nonzeros of the constraint jacobian and the lagrangian hessian as passed to the
+  // solver (the lower triangle for IPOPT). 0 until the first solve builds the solver
+  casadi_int jacobian_nnz = 0;
+  casadi_int hessian_nnz = 0;
+  casadi_int num_mx_nodes = 0;  // {x, p} -> {f, g}
+  casadi_int num_sx_nodes = 0;  // {x, p} -> {f, g} after expand
+  size_t jit_size = 0;  // bytes of the JIT compiled solver, 0 if not compiled
+};
 
 class RacingMPC
 {
@@ -43,20 +63,101 @@ public:
   typedef std::shared_ptr<RacingMPC> SharedPtr;
   typedef std::unique_ptr<RacingMPC> UniquePtr;
 
+  /**
+   * @param safe_set_manager safe set of another MPC to query, which records it. nullptr to own
+   * and record the safe set.
+   */
   explicit RacingMPC(
     RacingMPCConfig::SharedPtr mpc_config,
     BaseVehicleModel::SharedPtr model,
-    const bool & full_dynamics = false);
+    const bool & full_dynamics = false,
+    SafeSetManager::SharedPtr safe_set_manager = nullptr);
+  ~RacingMPC();
   const RacingMPCConfig & get_config() const;
 
   void solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::Dict & stats);
 
+  /**
+   * @brief Add the current state to the safe set. Called by solve().
+   * Call it directly on steps where the solve is skipped to keep the lap sampling uniform.
+   *
+   * @param in x_ic, u_ic, t_ic, curvatures and total_length, same as solve().
+   */
+  void record(const casadi::DMDict & in);
+
   void create_warm_start(const casadi::DMDict & in, casadi::DMDict & out);
 
   BaseVehicleModel & get_model();
 
+  SafeSetManager & get_safe_set_manager();
+  SafeSetManager::SharedPtr share_safe_set_manager();
+
+  /**
+   * @brief Discard the lap in progress of the safe set recording, e.g. when it started
+   * before this MPC took over the recording.
+   */
+  void discard_lap();
+
+  /**
+   * @brief Journal the safe set recording to a file, so that the laps survive a crash.
+   * See SafeSetRecorder::open_journal().
+   */
+  void open_journal(
+    const std::string & path, const double & commit_period,
+    const double & resume_timeout);
+
+  /**
+   * @brief Move the safe set to the partition of another trajectory.
+   * The laps recorded on the previous trajectory are reprojected into the new frame in the
+   * background, and the lap in progress is discarded since it spans both frames.
+   *
+   * @param from_idx index of the previous trajectory
+   * @param from previous trajectory
+   * @param to_idx index of the new trajectory
+   * @param to new trajectory
+   */
+  void change_trajectory(
+    const int & from_idx, RacingTrajectory::SharedPtr from,
+    const int & to_idx, RacingTrajectory::SharedPtr to);
+
+  /**
+   * @brief Drop the warm start cache and size it for a track, whose velocity profile
+   * bounds the speed bins. The cache is unused until it is reset for the solved track.
+   * change_trajectory() resets it for the new trajectory.
+   */
+  void reset_solution_cache(const RacingTrajectory & track);
+
   const bool & solved() const;
 
+  /**
+   * @brief Measure the size of the problem. The symbolic graph is expanded, so call it outside
+   * of the control loop, and after the first solve to include the solver sparsity.
+   */
+  RacingMPCProblemSize problem_size() const;
+
+  /**
+   * @brief Fill the solver sparsity and the JIT size of a problem size, once the first solve
+   * has built the solver. Nothing is expanded.
+   *
+   * @return false if the solver is not built yet.
+   */
+  bool solver_size(RacingMPCProblemSize & size) const;
+
+  /**
+   * @brief Wall time of each function of a solve (ms), from the t_wall_* solver statistics,
+   * e.g. nlp_f, nlp_g, nlp_jac_g, nlp_hess_l and total. "solver" is the time of the solver
+   * outside of the functions.
+   *
+   * @param stats statistics of solve()
+   * @param times filled in place, so that the entries are only allocated by the first call
+   */
+  static void function_times(const casadi::Dict & stats, std::map<std::string, double> & times);
+
+  /**
+   * @brief Warm start cache, or nullptr if disabled.
+   */
+  const SolutionCache * get_solution_cache() const;
+
 protected:
   RacingMPCConfig::SharedPtr config_ {};
   BaseVehicleModel::SharedPtr model_ {};
@@ -76,6 +177,7 @@ protected:
   casadi::MX boundary_slack_;
   casadi::MX convex_hull_slack_;
   casadi::MX convex_combi_;
+  casadi::MX Xc_;  // all the collocation states, scaled
 
   // optimization parameters
   casadi::MX X_ref_;  // reference states, unscaled
@@ -88,6 +190,7 @@ protected:
   casadi::MX total_length_;
   casadi::MX curvatures_;
   casadi::MX vel_ref_;
+  casadi::MX lateral_ref_;  // reference lateral offset from the racing line, unscaled
   casadi::MX ss_;
   casadi::MX ss_costs_;  // J in LMPC paper
 
@@ -96,14 +199,26 @@ protected:
   std::shared_ptr<casadi::OptiSol> sol_;
 
   // LMPC
-  SafeSetManager::UniquePtr ss_manager_;
-  SafeSetRecorder::UniquePtr ss_recorder_;
+  SafeSetManager::SharedPtr ss_manager_;
+  SafeSetRecorder::UniquePtr ss_recorder_;  // nullptr if the safe set is shared
   bool ss_loaded = false;
 
+  // warm start from previous laps
+  SolutionCache::UniquePtr solution_cache_;
+
+  // directory of the JIT compiled objects, empty if not JIT compiled
+  std::string jit_directory_;
+
+  // collocation transcription of the full dynamics
+  // defect of a step, null for the shooting transcription or if the model enforces the dynamics
+  casadi::Function collocation_;
+  std::vector<double> collocation_tau_;  // collocation points in a step, in [0, 1]
+
   // helper functions
   void build_tracking_cost(casadi::MX & cost);
   void build_lmpc_cost(casadi::MX & cost);
   void build_boundary_constraint(casadi::MX & cost);
+  void initialize_collocation_states(const casadi::DM & X);
 };
 }  // namespace racing_mpc
 }  // namespace mpc
@@ -34,6 +34,13 @@ enum RacingMPCStepMode
   CONTINUOUS
 };
 
+enum RacingMPCTranscription
+{
+  SHOOTING,  // discrete dynamics of the vehicle model
+  HERMITE_SIMPSON,  // Hermite-Simpson collocation
+  LEGENDRE  // Legendre collocation
+};
+
 struct RacingMPCConfig
 {
   typedef std::shared_ptr<RacingMPCConfig> SharedPtr;
@@ -79,6 +86,17 @@ struct RacingMPCConfig
 
   bool load;
   std::vector<std::string> load_path;
+
+  // warm start cache
+  bool warm_start_cache;  // warm start from previous laps at the same track position
+  double cache_ds;  // abscissa bin size (m)
+  double cache_dv;  // speed bin size (m/s)
+  casadi_int cache_depth;  // solutions kept per bin
+  casadi_int cache_max_bins;  // cap of the number of bins, coarsens the abscissa bins
+
+  // dynamics constraints of the full dynamics MPC
+  RacingMPCTranscription transcription = RacingMPCTranscription::SHOOTING;
+  casadi_int collocation_degree = 3;  // collocation points per step of the legendre transcription
 };
 }  // namespace racing_mpc
 }  // namespace mpc
@@ -16,8 +16,15 @@
 #ifndef RACING_MPC__RACING_MPC_NODE_HPP_
 #define RACING_MPC__RACING_MPC_NODE_HPP_
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <casadi/casadi.hpp>
@@ -31,13 +38,22 @@
 #include <mpclab_msgs/msg/vehicle_actuation_msg.hpp>
 #include <lmpc_msgs/msg/trajectory_command.hpp>
 #include <lmpc_msgs/msg/mpc_telemetry.hpp>
+#include <lmpc_msgs/msg/solve_heatmap.hpp>
 #include <lmpc_transform_helper/lmpc_transform_helper.hpp>
 #include <racing_trajectory/racing_trajectory_map.hpp>
 #include <racing_trajectory/ros_trajectory_visualizer.hpp>
+#include <lmpc_utils/casadi_evaluator.hpp>
 #include <lmpc_utils/cycle_profiler.hpp>
+#include <lmpc_utils/deadline_scheduler.hpp>
+#include <lmpc_utils/latency_histogram.hpp>
+#include <lmpc_utils/perf_counters.hpp>
+#include <lmpc_utils/shared_memory_mirror.hpp>
+#include <lmpc_utils/triple_buffer.hpp>
 
+#include "racing_mpc/approx_mpc.hpp"
 #include "racing_mpc/racing_mpc_config.hpp"
 #include "racing_mpc/racing_mpc.hpp"
+#include "racing_mpc/solve_heatmap.hpp"
 
 namespace lmpc
 {
@@ -48,10 +64,51 @@ namespace racing_mpc
 using lmpc::vehicle_model::racing_trajectory::RacingTrajectoryMap;
 using lmpc::vehicle_model::racing_trajectory::RacingTrajectory;
 using lmpc::vehicle_model::racing_trajectory::ROSTrajectoryVisualizer;
+using lmpc::vehicle_model::racing_trajectory::SSTrajectory;
+
+// latest vehicle state handed from the tracking MPC to the planner
+struct RacingMPCPlannerRequest
+{
+  int traj_idx = -1;
+  RacingTrajectory::SharedPtr track {};
+  casadi::DM x_ic;
+  casadi::DM u_ic;
+  double t_ic = 0.0;
+};
+
+// long-horizon plan handed from the planner to the tracking MPC, in base state
+struct RacingMPCPlan
+{
+  int traj_idx = -1;
+  double t_ic = 0.0;  // time of the state the plan started from
+  std::vector<double> abscissa;
+  std::vector<double> lateral;
+  std::vector<double> velocity;
+};
+
+// phases of the control cycle sampled by the performance counters
+enum RacingMPCCyclePhase : size_t
+{
+  STATE_PHASE = 0,  // state conversion
+  REFERENCE_PHASE = 1,  // plan shift and reference interpolation
+  SOLVE_PHASE = 2,  // MPC solve
+  PUBLISH_PHASE = 3,  // actuation, visualization and telemetry
+  NUM_CYCLE_PHASES = 4
+};
+
+// role of the process in the hot-standby replication of the controller
+enum class RacingMPCReplicationRole
+{
+  NONE,
+  PRIMARY,  // controls the vehicle and mirrors its state
+  STANDBY  // mirrors the primary, and takes over when the primary misses its heartbeat
+};
+
 class RacingMPCNode : public rclcpp::Node
 {
 public:
   explicit RacingMPCNode(const rclcpp::NodeOptions & options);
+  ~RacingMPCNode();
 
 protected:
   double dt_;
@@ -66,6 +123,12 @@ protected:
   RacingMPC::SharedPtr mpc_full_ {};
   lmpc::utils::CycleProfiler<double>::UniquePtr profiler_ {};
   lmpc::utils::CycleProfiler<double>::UniquePtr profiler_iter_count_ {};
+  // problem size measured at construction and completed by the first solve, and the wall time
+  // of each solver function
+  std::unique_ptr<RacingMPCProblemSize> problem_size_ {};
+  bool problem_size_reported_ = false;  // the solver sparsity is filled in
+  std::map<std::string, double> function_times_ {};
+  std::map<std::string, lmpc::utils::CycleProfiler<double>::UniquePtr> function_time_profilers_ {};
   double speed_limit_ = config_->x_max(XIndex::VX).get_elements()[0];
   double speed_scale_ = 1.0;
   std::shared_mutex state_msg_mutex_;
@@ -81,6 +144,80 @@ protected:
   casadi::Function f2g_;
   casadi::Function discrete_dynamics_ {};
 
+  // preallocated buffers of the control cycle, so that steady-state cycles only allocate
+  // inside the solver and the frenet projection
+  lmpc::utils::CasadiEvaluator::UniquePtr from_base_state_eval_ {};
+  lmpc::utils::CasadiEvaluator::UniquePtr from_base_control_eval_ {};
+  lmpc::utils::CasadiEvaluator::UniquePtr to_base_control_eval_ {};
+  lmpc::utils::CasadiEvaluator::UniquePtr dynamics_eval_ {};
+  lmpc::utils::CasadiEvaluator::UniquePtr reference_eval_ {};  // boundaries, curvature, speed
+  lmpc::utils::CasadiEvaluator::UniquePtr f2g_eval_ {};  // solution to global
+  lmpc::utils::CasadiEvaluator::UniquePtr ref_f2g_eval_ {};  // reference to global
+  lmpc::utils::CasadiEvaluator::UniquePtr ss_f2g_eval_ {};  // safe set point to global
+  lmpc_msgs::msg::MPCTelemetry telemetry_msg_;
+  nav_msgs::msg::Path mpc_vis_msg_;
+  nav_msgs::msg::Path ref_vis_msg_;
+  visualization_msgs::msg::MarkerArray ss_vis_msg_;
+
+  // hierarchical planner: a coarse long-horizon MPC replanning in the background
+  bool planner_enabled_ = false;
+  double planner_dt_ = 0.0;
+  double planner_rate_ = 0.0;
+  RacingMPC::SharedPtr planner_mpc_ {};
+  lmpc::utils::CycleProfiler<double>::UniquePtr planner_profiler_ {};
+  lmpc::utils::TripleBuffer<RacingMPCPlannerRequest> planner_request_buffer_ {};
+  lmpc::utils::TripleBuffer<RacingMPCPlan> plan_buffer_ {};
+  std::atomic<bool> planner_running_ {false};
+  std::mutex planner_mutex_;  // only used to wake up the planner for shutdown
+  std::condition_variable planner_cv_;
+  std::thread planner_thread_;
+
+  // event-triggered MPC: skip the solve while the shifted plan is still valid
+  bool event_trigger_enabled_ = false;
+  casadi::DM event_state_threshold_;  // max deviation of each state from the plan
+  double event_ref_threshold_ = 0.0;  // max change of the velocity and lateral references
+  int event_max_skip_ = 0;  // max consecutive skipped solves
+  int skip_count_ = 0;
+  int last_solve_traj_idx_ = -1;
+  casadi::DM last_solve_vel_ref_;
+  casadi::DM last_solve_lateral_ref_;
+  lmpc::utils::CycleProfiler<double>::UniquePtr skip_profiler_ {};
+  lmpc::utils::CycleProfiler<double>::UniquePtr tracking_error_profiler_ {};
+
+  // hardware performance counters per cycle phase and safe set query
+  bool perf_counters_enabled_ = false;
+  std::array<lmpc::utils::PerfProfiler::UniquePtr, NUM_CYCLE_PHASES> phase_perf_profilers_ {};
+  lmpc::utils::PerfProfiler::SharedPtr ss_perf_profiler_ {};
+  lmpc::utils::PerfSample phase_start_ {};
+
+  // solve statistics binned by track position, one heatmap per trajectory.
+  // the control thread uses heatmap_ under traj_mutex_, the publisher under heatmap_mutex_
+  bool heatmap_enabled_ = false;
+  double heatmap_bin_size_ = 0.0;
+  std::map<int, SolveHeatmap::SharedPtr> heatmaps_ {};
+  SolveHeatmap::SharedPtr heatmap_ {};
+  int heatmap_traj_idx_ = 0;
+  std::mutex heatmap_mutex_;
+
+  // MLP approximation of the MPC, used when the MPC fails to solve. nullptr if disabled
+  ApproxMPC::SharedPtr approx_mpc_ {};
+
+  // hot-standby replication: the primary mirrors its warm start, profiler state and safe set
+  // laps into shared memory every cycle, and the standby keeps its solver built and warm
+  RacingMPCReplicationRole replication_role_ = RacingMPCReplicationRole::NONE;
+  std::string warm_start_segment_name_;
+  std::string ss_segment_name_;
+  int64_t heartbeat_timeout_ = 0;  // ns
+  lmpc::utils::SharedMemoryMirror::UniquePtr warm_start_mirror_ {};
+  lmpc::utils::SharedMemoryMirror::UniquePtr ss_mirror_ {};
+  std::vector<double> mirror_buffer_ {};
+  uint64_t ss_revision_ = 0;  // primary: safe set revision last mirrored
+  uint64_t warm_start_version_ = 0;  // standby: mirror versions last read
+  uint64_t ss_version_ = 0;
+  bool warm_start_mirrored_ = false;  // standby: the warm start comes from the primary
+  bool standby_active_ = false;  // standby: took over from the primary
+  bool standby_warmed_up_ = false;  // standby: the first, unpublished solve is done
+
   mpclab_msgs::msg::VehicleStateMsg::SharedPtr vehicle_state_msg_ {};
   mpclab_msgs::msg::VehicleActuationMsg::SharedPtr vehicle_actuation_msg_ {};
 
@@ -90,6 +227,7 @@ protected:
   rclcpp::Publisher<nav_msgs::msg::Path>::SharedPtr ref_vis_pub_ {};
   rclcpp::Publisher<visualization_msgs::msg::MarkerArray>::SharedPtr ss_vis_pub_ {};
   rclcpp::Publisher<lmpc_msgs::msg::MPCTelemetry>::SharedPtr mpc_telemetry_pub_ {};
+  rclcpp::Publisher<lmpc_msgs::msg::SolveHeatmap>::SharedPtr solve_heatmap_pub_ {};
 
   // publishers (to diagnostics)
   rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_pub_ {};
@@ -99,12 +237,15 @@ protected:
   rclcpp::Subscription<lmpc_msgs::msg::TrajectoryCommand>::SharedPtr trajectory_command_sub_ {};
 
   // timers
-  // republish vehicle state (TODO(haoru): to be replaced by a service)
-  rclcpp::TimerBase::SharedPtr step_timer_;
+  rclcpp::TimerBase::SharedPtr heatmap_timer_;
+
+  // control loop of the continuous step mode, on its own thread
+  lmpc::utils::DeadlineScheduler::UniquePtr step_scheduler_ {};
 
   // callback groups
   rclcpp::CallbackGroup::SharedPtr state_callback_group_;
   rclcpp::CallbackGroup::SharedPtr trajectory_command_callback_group_;
+  rclcpp::CallbackGroup::SharedPtr heatmap_callback_group_;
 
   // parameter callback handle
   OnSetParametersCallbackHandle::SharedPtr callback_handle_;
@@ -113,13 +254,38 @@ protected:
   void on_new_state(const mpclab_msgs::msg::VehicleStateMsg::SharedPtr msg);
   void on_new_trajectory_command(const lmpc_msgs::msg::TrajectoryCommand::SharedPtr msg);
   void on_step_timer();
+  void on_heatmap_timer();
   rcl_interfaces::msg::SetParametersResult on_set_parameters(
     std::vector<rclcpp::Parameter> const & parameters);
 
   // helpers
   void change_trajectory(const int & traj_idx);
+  void switch_heatmap(const int & traj_idx);
   void set_speed_limit(const double & speed_limit);
   void set_speed_scale(const double & speed_scale);
+  // bring the laps of a partition recorded on a trajectory to the frame of the trajectory now
+  // loaded under its index, or drop them if it is removed
+  void update_partition_frame(
+    const int & traj_idx, RacingTrajectory::SharedPtr recorded_on,
+    RacingTrajectory::SharedPtr current);
+  casadi::Function build_discrete_dynamics(RacingTrajectory & track, const double & dt);
+  void build_track_evaluators();
+  // clip the velocity reference around the speeds of the state horizon x
+  void clip_velocity_reference(
+    casadi::DM & vel_ref, const casadi::DM & x,
+    const bool & apply_scale);
+  bool apply_plan(const casadi::DM & abscissa, casadi::DM & vel_ref, casadi::DM & lateral_ref);
+  void planner_loop();
+  bool plan_still_valid(const casadi::DM & x_ic, double & tracking_error);
+  void start_phase();
+  void end_phase(const RacingMPCCyclePhase & phase);
+  // primary: mirror the state and beat after the actuation is published
+  void write_mirrors();
+  // standby: mirror the primary. return true if the cycle should go on to solve, i.e. to
+  // build the solver with the first solve, or to take over from the primary
+  bool follow_primary();
+  bool read_warm_start_mirror();
+  void read_ss_mirror();
 };
 }  // namespace racing_mpc
 }  // namespace mpc
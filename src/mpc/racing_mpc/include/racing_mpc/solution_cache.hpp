@@ -0,0 +1,128 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RACING_MPC__SOLUTION_CACHE_HPP_
+#define RACING_MPC__SOLUTION_CACHE_HPP_
+
+#include <memory>
+#include <vector>
+
+#include <casadi/casadi.hpp>
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+struct SolutionCacheEntry
+{
+  casadi::DM x0;  // initial state of the solution
+  casadi::DM abscissa;  // abscissa of the solution over the horizon
+  casadi::DM primal;  // all decision variables
+  casadi::DM dual;  // all constraint multipliers
+};
+
+/**
+ * @brief Solutions from previous laps, binned by abscissa and speed of the initial state.
+ *
+ * Each bin is a ring of fixed depth, so the most recent laps are kept. All entries are
+ * allocated on reset(), so storing a solution only copies it. States are dense.
+ */
+class SolutionCache
+{
+public:
+  typedef std::shared_ptr<SolutionCache> SharedPtr;
+  typedef std::unique_ptr<SolutionCache> UniquePtr;
+
+  /**
+   * @brief Construct a new solution cache.
+   *
+   * @param ds abscissa bin size (m), coarsened if the bins exceed max_bins
+   * @param dv speed bin size (m/s)
+   * @param depth number of solutions kept per bin
+   * @param max_bins cap of the number of bins
+   * @param scale_x state scaling used to compare initial states
+   * @param entry_shape entry with the sizes of the stored solutions
+   */
+  SolutionCache(
+    const double & ds, const double & dv, const size_t & depth, const size_t & max_bins,
+    const casadi::DM & scale_x, const SolutionCacheEntry & entry_shape);
+
+  /**
+   * @brief Drop all entries and allocate the bins for a track.
+   *
+   * @param total_length length of the track (m)
+   * @param v_max speed of the last speed bin (m/s), e.g. the top speed of the velocity profile.
+   * Faster states are binned with it.
+   */
+  void reset(const double & total_length, const double & v_max);
+
+  /**
+   * @brief Store a solution. Only the first solution after entering a bin is stored,
+   * so each pass through a bin (i.e. each lap) adds one entry.
+   */
+  void insert(
+    const casadi::DM & x0, const casadi::DM & abscissa,
+    const casadi::DM & primal, const casadi::DM & dual);
+
+  /**
+   * @brief Find the entry in the bin of x0 whose initial state is closest to x0.
+   *
+   * @param x0 initial state
+   * @param distance scaled distance between x0 and the entry
+   * @return the closest entry, or nullptr if the bin is empty
+   */
+  const SolutionCacheEntry * query(const casadi::DM & x0, double & distance) const;
+
+  /**
+   * @brief Scaled distance between two states, with the abscissa wrapped around the track.
+   */
+  double distance(const casadi::DM & x1, const casadi::DM & x2) const;
+
+  // bookkeeping of the warm start outcome
+  void record_result(const bool & hit, const double & iter_count);
+  double hit_rate() const;
+  double mean_iterations(const bool & hit) const;
+
+  const double & total_length() const;
+
+protected:
+  double ds_;
+  double dv_;
+  size_t depth_;
+  size_t max_bins_;
+  casadi::DM scale_x_;
+  SolutionCacheEntry entry_shape_;
+  double total_length_ = 0.0;
+  double bin_ds_ = 0.0;  // abscissa bin size of the track, at least ds_
+  size_t num_s_bins_ = 0;
+  size_t num_v_bins_ = 0;
+  std::vector<SolutionCacheEntry> entries_ {};  // depth_ entries per bin
+  std::vector<size_t> bin_sizes_ {};  // number of entries stored in each bin
+  std::vector<size_t> bin_heads_ {};  // next entry to overwrite in each bin
+  size_t last_bin_ = 0;  // bin of the last insertion
+
+  size_t num_queries_ = 0;
+  size_t num_hits_ = 0;
+  double iter_hits_ = 0.0;
+  double iter_misses_ = 0.0;
+
+  size_t bin_index(const casadi::DM & x0) const;
+};
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
+#endif  // RACING_MPC__SOLUTION_CACHE_HPP_
@@ -0,0 +1,112 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RACING_MPC__SOLVE_HEATMAP_HPP_
+#define RACING_MPC__SOLVE_HEATMAP_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+// running totals of one bin, written by the control thread and read by the publisher
+struct SolveHeatmapAccumulator
+{
+  std::atomic<uint64_t> count {0};
+  std::atomic<uint64_t> solve_time_us {0};
+  std::atomic<uint64_t> max_solve_time_us {0};
+  std::atomic<uint64_t> iter_count {0};
+  std::atomic<uint64_t> slack_active {0};
+  std::atomic<uint64_t> failures {0};
+};
+
+// statistics of one bin at the time it was read
+struct SolveHeatmapBin
+{
+  uint64_t count = 0;
+  double mean_solve_time = 0.0;  // ms
+  double max_solve_time = 0.0;  // ms
+  double mean_iter_count = 0.0;
+  double slack_active_rate = 0.0;  // fraction of solves with the boundary slack in use
+  double failure_rate = 0.0;  // fraction of failed solves
+};
+
+/**
+ * @brief Solve statistics binned by abscissa and by the region of the trajectory.
+ *
+ * All bins are allocated on construction. add() only does relaxed atomic updates,
+ * so it can be called from the control thread while another thread reads the bins.
+ */
+class SolveHeatmap
+{
+public:
+  typedef std::shared_ptr<SolveHeatmap> SharedPtr;
+  typedef std::unique_ptr<SolveHeatmap> UniquePtr;
+
+  /**
+   * @brief Construct a new solve heatmap.
+   *
+   * @param bin_size abscissa bin size (m)
+   * @param total_length length of the track (m)
+   * @param num_regions number of regions of the trajectory
+   */
+  SolveHeatmap(const double & bin_size, const double & total_length, const int & num_regions);
+
+  /**
+   * @brief Record one solve.
+   *
+   * @param abscissa abscissa of the initial state (m), wrapped around the track
+   * @param region region of the initial state, out of range regions are only binned by abscissa
+   * @param solve_time solve time (ms)
+   * @param iter_count number of solver iterations
+   * @param slack_active if the boundary slack is in use
+   * @param failed if the solve failed
+   */
+  void add(
+    const double & abscissa, const int & region, const double & solve_time,
+    const double & iter_count, const bool & slack_active, const bool & failed);
+
+  // statistics of all abscissa bins and all region bins
+  std::vector<SolveHeatmapBin> abscissa_bins() const;
+  std::vector<SolveHeatmapBin> region_bins() const;
+
+  const double & bin_size() const;
+  size_t num_abscissa_bins() const;
+  size_t num_regions() const;
+
+protected:
+  double bin_size_;
+  double total_length_;
+  // std::atomic is not movable, so the bins are fixed-size arrays
+  std::unique_ptr<SolveHeatmapAccumulator[]> abscissa_bins_;
+  size_t num_abscissa_bins_;
+  std::unique_ptr<SolveHeatmapAccumulator[]> region_bins_;
+  size_t num_regions_;
+
+  static void accumulate(
+    SolveHeatmapAccumulator & bin, const uint64_t & solve_time_us,
+    const uint64_t & iter_count, const bool & slack_active, const bool & failed);
+  static SolveHeatmapBin read(const SolveHeatmapAccumulator & bin);
+};
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
+#endif  // RACING_MPC__SOLVE_HEATMAP_HPP_
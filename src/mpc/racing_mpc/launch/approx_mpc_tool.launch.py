@@ -0,0 +1,85 @@
+# Copyright 2023 Haoru Xue
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+import os
+from ament_index_python import get_package_share_directory
+from launch import LaunchDescription
+from launch_ros.actions import Node
+from launch.substitutions import LaunchConfiguration
+from launch.actions import DeclareLaunchArgument
+
+
+def get_share_file(package_name, *args):
+    return os.path.join(get_package_share_directory(package_name), *args)
+
+
+def generate_launch_description():
+    mode = LaunchConfiguration("mode")
+    dataset_file = LaunchConfiguration("dataset_file")
+    policy_file = LaunchConfiguration("policy_file")
+    declare_mode_cmd = DeclareLaunchArgument(
+        "mode", default_value="dataset", description="dataset, train or evaluate"
+    )
+    declare_dataset_file_cmd = DeclareLaunchArgument(
+        "dataset_file", default_value="approx_mpc_dataset.txt"
+    )
+    declare_policy_file_cmd = DeclareLaunchArgument(
+        "policy_file", default_value="approx_mpc_policy.txt"
+    )
+
+    mpc_config = get_share_file(
+        "racing_mpc", "param", "sample_mpc_2.param.yaml")
+    tool_config = get_share_file(
+        "racing_mpc", "param", "approx_mpc_tool.param.yaml")
+    dt_model_config = (
+        get_share_file("single_track_planar_model"),
+        "/param/",
+        "sample_vehicle_2.param.yaml",
+    )
+    base_model_config = (
+        get_share_file("base_vehicle_model"),
+        "/param/",
+        "sample_vehicle_2.param.yaml",
+    )
+    track_file = get_share_file(
+        "racing_trajectory", "test_data", "mgkt_optm.txt")
+
+    return LaunchDescription(
+        [
+            declare_mode_cmd,
+            declare_dataset_file_cmd,
+            declare_policy_file_cmd,
+            Node(
+                package="racing_mpc",
+                executable="approx_mpc_tool",
+                name="approx_mpc_tool",
+                output="screen",
+                parameters=[
+                    mpc_config,
+                    tool_config,
+                    dt_model_config,
+                    base_model_config,
+                    {
+                        "approx_mpc_tool.mode": mode,
+                        "approx_mpc_tool.vehicle_model_name": "single_track_planar_model",
+                        "approx_mpc_tool.traj_file": track_file,
+                        "approx_mpc_tool.dataset_file": dataset_file,
+                        "approx_mpc_tool.policy_file": policy_file,
+                    },
+                ],
+                emulate_tty=True,
+            ),
+        ]
+    )
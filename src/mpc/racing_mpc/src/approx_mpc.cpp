@@ -0,0 +1,141 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "racing_mpc/approx_mpc.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+using lmpc::vehicle_model::base_vehicle_model::XIndex;
+
+ApproxMPC::ApproxMPC(
+  RacingMPCConfig::SharedPtr mpc_config,
+  BaseVehicleModel::SharedPtr model,
+  MLP::SharedPtr policy)
+: config_(mpc_config), model_(model), policy_(policy),
+  features_(Eigen::VectorXd::Zero(num_features(config_->N, model_->nu()))),
+  dynamics_eval_(std::make_unique<lmpc::utils::CasadiEvaluator>(model_->discrete_dynamics())),
+  X_optm_(casadi::DM::zeros(model_->nx(), config_->N)),
+  U_optm_(casadi::DM::zeros(model_->nu(), config_->N - 1)),
+  dU_optm_(casadi::DM::zeros(model_->nu(), config_->N - 1))
+{
+  if (policy_->num_inputs() != features_.size() ||
+    policy_->num_outputs() != num_outputs(config_->N, model_->nu()))
+  {
+    throw std::invalid_argument("ApproxMPC: the policy does not match the horizon or the model.");
+  }
+}
+
+Eigen::Index ApproxMPC::num_features(const size_t & N, const size_t & nu)
+{
+  // state without the abscissa, control, curvature, bounds, velocity and lateral references
+  return static_cast<Eigen::Index>(5 + nu + 5 * N);
+}
+
+Eigen::Index ApproxMPC::num_outputs(const size_t & N, const size_t & nu)
+{
+  return static_cast<Eigen::Index>(nu * (N - 1));
+}
+
+void ApproxMPC::features(
+  const casadi::DMDict & in, const size_t & N, const size_t & nu,
+  Eigen::Ref<Eigen::VectorXd> features)
+{
+  if (features.size() != num_features(N, nu)) {
+    throw std::invalid_argument("ApproxMPC: the features have the wrong size.");
+  }
+  Eigen::Index i = 0;
+  auto append = [&](const casadi::DM & m, const size_t & begin, const size_t & size) {
+      const auto & nz = m.nonzeros();
+      if (nz.size() < begin + size) {
+        throw std::invalid_argument("ApproxMPC: an input has the wrong size.");
+      }
+      std::copy_n(nz.begin() + begin, size, features.data() + i);
+      i += static_cast<Eigen::Index>(size);
+    };
+  append(in.at("x_ic"), XIndex::PY, 5);
+  append(in.at("u_ic"), 0, nu);
+  append(in.at("curvatures"), 0, N);
+  append(in.at("bound_left"), 0, N);
+  append(in.at("bound_right"), 0, N);
+  append(in.at("vel_ref"), 0, N);
+  if (in.count("lateral_ref")) {
+    append(in.at("lateral_ref"), 0, N);
+  } else {
+    features.tail(N).setZero();
+  }
+}
+
+void ApproxMPC::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::Dict & stats)
+{
+  const auto N = config_->N;
+  const auto nx = model_->nx();
+  const auto nu = model_->nu();
+  features(in, N, nu, features_);
+  const auto & U = policy_->forward(features_);
+
+  // the policy is only approximately feasible, so the bounds are enforced here
+  const auto & u_min = config_->u_min.nonzeros();
+  const auto & u_max = config_->u_max.nonzeros();
+  auto & U_optm = U_optm_.nonzeros();
+  for (size_t i = 0; i < U_optm.size(); i++) {
+    U_optm[i] = std::clamp(U[i], u_min[i % nu], u_max[i % nu]);
+  }
+
+  const auto & T_ref = in.at("T_ref").nonzeros();
+  const auto & curvatures = in.at("curvatures").nonzeros();
+  const auto & u_ic = in.at("u_ic").nonzeros();
+  auto & X_optm = X_optm_.nonzeros();
+  auto & dU_optm = dU_optm_.nonzeros();
+  const auto & x_ic = in.at("x_ic").nonzeros();
+  std::copy_n(x_ic.begin(), nx, X_optm.begin());
+  for (size_t k = 0; k < N - 1; k++) {
+    auto & x = dynamics_eval_->input("x").nonzeros();
+    auto & u = dynamics_eval_->input("u").nonzeros();
+    std::copy_n(X_optm.begin() + k * nx, nx, x.begin());
+    std::copy_n(U_optm.begin() + k * nu, nu, u.begin());
+    dynamics_eval_->input("k").nonzeros()[0] = curvatures[k];
+    dynamics_eval_->input("dt").nonzeros()[0] = T_ref[k];
+    dynamics_eval_->evaluate();
+    const auto & xip1 = dynamics_eval_->output("xip1").nonzeros();
+    std::copy(xip1.begin(), xip1.end(), X_optm.begin() + (k + 1) * nx);
+    for (size_t j = 0; j < nu; j++) {
+      const auto u_prev = k == 0 ? u_ic[j] : U_optm[(k - 1) * nu + j];
+      dU_optm[k * nu + j] = (U_optm[k * nu + j] - u_prev) / T_ref[k];
+    }
+  }
+
+  out["X_optm"] = X_optm_;
+  out["U_optm"] = U_optm_;
+  out["dU_optm"] = dU_optm_;
+  stats["success"] = std::all_of(
+    X_optm.begin(), X_optm.end(), [](const double & x) {return std::isfinite(x);});
+}
+
+MLP & ApproxMPC::get_policy()
+{
+  return *policy_;
+}
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
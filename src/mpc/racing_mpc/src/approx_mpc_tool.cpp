@@ -0,0 +1,366 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Distill RacingMPC into an ApproxMPC policy.
+//   dataset:  solve full dynamics MPC problems at states sampled around the racing line
+//   train:    fit the MLP policy to the dataset
+//   evaluate: drive closed-loop laps with RacingMPC and ApproxMPC and compare them
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+#include <lmpc_utils/ros_param_helper.hpp>
+#include <racing_trajectory/racing_trajectory.hpp>
+#include <vehicle_model_factory/vehicle_model_factory.hpp>
+
+#include "racing_mpc/approx_mpc.hpp"
+#include "racing_mpc/mlp_trainer.hpp"
+#include "racing_mpc/racing_mpc.hpp"
+#include "racing_mpc/ros_param_loader.hpp"
+
+using casadi::DM;
+using lmpc::mpc::racing_mpc::ApproxMPC;
+using lmpc::mpc::racing_mpc::MLP;
+using lmpc::mpc::racing_mpc::MLPTrainer;
+using lmpc::mpc::racing_mpc::MLPTrainerConfig;
+using lmpc::mpc::racing_mpc::RacingMPC;
+using lmpc::mpc::racing_mpc::RacingMPCConfig;
+using lmpc::vehicle_model::base_vehicle_model::BaseVehicleModel;
+using lmpc::vehicle_model::base_vehicle_model::XIndex;
+using lmpc::vehicle_model::racing_trajectory::RacingTrajectory;
+
+namespace
+{
+// fill the references of an MPC problem along the given abscissa
+void set_references(
+  RacingTrajectory & traj, const DM & X_ref, const DM & U_ref, casadi::DMDict & in)
+{
+  const auto s = X_ref(XIndex::PX, casadi::Slice());
+  in["X_ref"] = X_ref;
+  in["U_ref"] = U_ref;
+  in["X_optm_ref"] = X_ref;
+  in["U_optm_ref"] = U_ref;
+  in["bound_left"] = traj.left_boundary_interpolation_function()(s)[0];
+  in["bound_right"] = traj.right_boundary_interpolation_function()(s)[0];
+  in["curvatures"] = traj.curvature_interpolation_function()(s)[0];
+  in["vel_ref"] = traj.velocity_interpolation_function()(s)[0];
+}
+
+// constant speed guess of the horizon from the initial state
+DM straight_guess(const DM & x_ic, const size_t & N, const double & dt)
+{
+  auto X = DM::repmat(x_ic, 1, N);
+  for (size_t i = 1; i < N; i++) {
+    X(XIndex::PX, i) = X(XIndex::PX, i - 1) + dt * x_ic(XIndex::VX);
+  }
+  return X;
+}
+
+casadi::DMDict base_inputs(
+  const DM & x_ic, const DM & u_ic, const size_t & N, const double & dt,
+  const double & total_length)
+{
+  const auto T_ref = DM::zeros(1, N - 1) + dt;
+  return casadi::DMDict{
+    {"x_ic", x_ic},
+    {"u_ic", u_ic},
+    {"t_ic", 0.0},
+    {"T_ref", T_ref},
+    {"T_optm_ref", T_ref},
+    {"dU_optm_ref", DM::zeros(u_ic.size1(), N - 1)},
+    {"total_length", total_length},
+    {"lateral_ref", DM::zeros(N, 1)}
+  };
+}
+
+void generate_dataset(
+  rclcpp::Node * node, RacingMPCConfig::SharedPtr config,
+  BaseVehicleModel::SharedPtr model, RacingTrajectory & traj)
+{
+  using lmpc::utils::declare_parameter;
+  const auto dataset_file = declare_parameter<std::string>(node, "approx_mpc_tool.dataset_file");
+  const auto num_samples = declare_parameter<int>(node, "approx_mpc_tool.num_samples");
+  const auto num_threads = static_cast<size_t>(
+    std::max(declare_parameter<int>(node, "approx_mpc_tool.num_threads"), 1));
+  const auto seed = declare_parameter<int>(node, "approx_mpc_tool.seed");
+  const auto dt = declare_parameter<double>(node, "approx_mpc_tool.dt");
+  const auto lateral_range = declare_parameter<double>(node, "approx_mpc_tool.lateral_range");
+  const auto yaw_range = declare_parameter<double>(node, "approx_mpc_tool.yaw_range");
+  const auto vel_scale_min = declare_parameter<double>(node, "approx_mpc_tool.vel_scale_min");
+  const auto vel_scale_max = declare_parameter<double>(node, "approx_mpc_tool.vel_scale_max");
+  const auto control_range = declare_parameter<double>(node, "approx_mpc_tool.control_range");
+
+  const auto N = config->N;
+  const auto nu = model->nu();
+  const auto nin = ApproxMPC::num_features(N, nu);
+  const auto nout = ApproxMPC::num_outputs(N, nu);
+
+  // casadi graph construction is not thread safe, so the solvers are built here
+  std::vector<RacingMPC::SharedPtr> solvers;
+  for (size_t i = 0; i < num_threads; i++) {
+    solvers.push_back(std::make_shared<RacingMPC>(config, model, true));
+  }
+
+  // the samples are drawn up front so the dataset does not depend on the thread count
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::vector<casadi::DMDict> problems(num_samples);
+  for (auto & in : problems) {
+    const auto s = (uniform(rng) + 1.0) * 0.5 * traj.total_length();
+    const auto v_ref = static_cast<double>(traj.velocity_interpolation_function()(DM(s))[0]);
+    const auto scale = vel_scale_min + (uniform(rng) + 1.0) * 0.5 * (vel_scale_max - vel_scale_min);
+    const auto vx = std::max(v_ref * scale, 1.0);
+    const auto k = static_cast<double>(traj.curvature_interpolation_function()(DM(s))[0]);
+    const auto x_ic = DM{
+      s, uniform(rng) * lateral_range, uniform(rng) * yaw_range, vx, 0.0, vx * k};
+    auto u_ic = DM::zeros(nu, 1);
+    for (size_t j = 0; j < nu; j++) {
+      const auto u_min = static_cast<double>(config->u_min(j));
+      const auto u_max = static_cast<double>(config->u_max(j));
+      u_ic(j) = control_range * (u_min + (uniform(rng) + 1.0) * 0.5 * (u_max - u_min));
+    }
+    in = base_inputs(x_ic, u_ic, N, dt, traj.total_length());
+    set_references(traj, straight_guess(x_ic, N, dt), DM::zeros(nu, N - 1) + 1e-9, in);
+  }
+
+  Eigen::MatrixXd inputs(nin, num_samples);
+  Eigen::MatrixXd outputs(nout, num_samples);
+  std::vector<char> solved(num_samples, 0);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back(
+      [&, t]() {
+        for (size_t i = t; i < problems.size(); i += num_threads) {
+          auto out = casadi::DMDict{};
+          auto stats = casadi::Dict{};
+          solvers[t]->solve(problems[i], out, stats);
+          if (!out.count("X_optm") || !solvers[t]->solved()) {
+            continue;
+          }
+          ApproxMPC::features(problems[i], N, nu, inputs.col(i));
+          const auto & U = out.at("U_optm").nonzeros();
+          std::copy(U.begin(), U.end(), outputs.col(i).data());
+          solved[i] = 1;
+        }
+      });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+
+  std::ofstream file(dataset_file);
+  if (!file) {
+    throw std::runtime_error("Cannot write the dataset to " + dataset_file);
+  }
+  const auto num_solved = std::count(solved.begin(), solved.end(), 1);
+  file.precision(17);
+  file << "approx_mpc_dataset " << nin << " " << nout << " " << num_solved << "\n";
+  for (int i = 0; i < num_samples; i++) {
+    if (solved[i]) {
+      file << inputs.col(i).transpose() << " " << outputs.col(i).transpose() << "\n";
+    }
+  }
+  RCLCPP_INFO(
+    node->get_logger(), "Wrote %ld of %d samples to %s.", num_solved, num_samples,
+    dataset_file.c_str());
+}
+
+void train_policy(rclcpp::Node * node)
+{
+  using lmpc::utils::declare_parameter;
+  const auto dataset_file = declare_parameter<std::string>(node, "approx_mpc_tool.dataset_file");
+  const auto policy_file = declare_parameter<std::string>(node, "approx_mpc_tool.policy_file");
+  const auto hidden_layers =
+    declare_parameter<std::vector<int64_t>>(node, "approx_mpc_tool.hidden_layers");
+  const auto trainer_config = MLPTrainerConfig{
+    static_cast<size_t>(declare_parameter<int>(node, "approx_mpc_tool.epochs")),
+    static_cast<size_t>(declare_parameter<int>(node, "approx_mpc_tool.batch_size")),
+    declare_parameter<double>(node, "approx_mpc_tool.learning_rate"),
+    declare_parameter<double>(node, "approx_mpc_tool.validation_fraction"),
+    static_cast<unsigned int>(declare_parameter<int>(node, "approx_mpc_tool.seed"))
+  };
+
+  std::ifstream file(dataset_file);
+  std::string tag;
+  Eigen::Index nin = 0, nout = 0, num_samples = 0;
+  if (!(file >> tag >> nin >> nout >> num_samples) || tag != "approx_mpc_dataset") {
+    throw std::runtime_error("Cannot read the dataset from " + dataset_file);
+  }
+  Eigen::MatrixXd inputs(nin, num_samples);
+  Eigen::MatrixXd outputs(nout, num_samples);
+  for (Eigen::Index i = 0; i < num_samples; i++) {
+    for (Eigen::Index j = 0; j < nin; j++) {
+      file >> inputs(j, i);
+    }
+    for (Eigen::Index j = 0; j < nout; j++) {
+      file >> outputs(j, i);
+    }
+  }
+  if (!file) {
+    throw std::runtime_error("The dataset " + dataset_file + " is truncated.");
+  }
+
+  std::vector<int> layer_sizes{static_cast<int>(nin)};
+  for (const auto & size : hidden_layers) {
+    layer_sizes.push_back(static_cast<int>(size));
+  }
+  layer_sizes.push_back(static_cast<int>(nout));
+  MLP mlp(layer_sizes, trainer_config.seed);
+  MLPTrainer trainer(mlp, trainer_config);
+  const auto loss = trainer.train(inputs, outputs, &std::cout);
+  mlp.save(policy_file);
+  RCLCPP_INFO(
+    node->get_logger(), "Saved the policy to %s. Validation loss: %f.", policy_file.c_str(),
+    loss);
+}
+
+struct LapResult
+{
+  double lap_time = 0.0;  // s, 0 if the lap was not completed
+  double mean_latency = 0.0;  // ms
+  double max_latency = 0.0;  // ms
+  size_t failures = 0;
+  bool off_track = false;
+};
+
+// drive a lap from the start line on the racing line with the discrete dynamics
+template<typename Controller>
+LapResult drive_lap(
+  Controller & controller, BaseVehicleModel & model, RacingTrajectory & traj,
+  const size_t & N, const double & dt, const size_t & max_steps)
+{
+  LapResult result;
+  const auto nu = model.nu();
+  const auto v0 = static_cast<double>(traj.velocity_interpolation_function()(DM(0.0))[0]);
+  auto x = DM{0.0, 0.0, 0.0, v0, 0.0, 0.0};
+  auto u = DM::zeros(nu, 1);
+  auto X_guess = straight_guess(x, N, dt);
+  auto U_guess = DM::zeros(nu, N - 1) + 1e-9;
+  auto dynamics = model.discrete_dynamics();
+
+  size_t step = 0;
+  for (; step < max_steps; step++) {
+    auto in = base_inputs(x, u, N, dt, traj.total_length());
+    set_references(traj, X_guess, U_guess, in);
+    auto out = casadi::DMDict{};
+    auto stats = casadi::Dict{};
+    const auto start = std::chrono::steady_clock::now();
+    controller.solve(in, out, stats);
+    const std::chrono::duration<double, std::milli> latency =
+      std::chrono::steady_clock::now() - start;
+    result.mean_latency += latency.count();
+    result.max_latency = std::max(result.max_latency, latency.count());
+    if (out.count("X_optm")) {
+      X_guess = out.at("X_optm");
+      U_guess = out.at("U_optm");
+    } else {
+      result.failures++;
+    }
+    u = U_guess(casadi::Slice(), 0);
+    x = dynamics(casadi::DMDict{{"x", x}, {"u", u}, {"k", in.at("curvatures")(0)}, {"dt", dt}})
+      .at("xip1");
+
+    const auto s = static_cast<double>(x(XIndex::PX));
+    const auto t = static_cast<double>(x(XIndex::PY));
+    const auto left = static_cast<double>(traj.left_boundary_interpolation_function()(DM(s))[0]);
+    const auto right = static_cast<double>(traj.right_boundary_interpolation_function()(DM(s))[0]);
+    if (t > left || t < right) {
+      result.off_track = true;
+      break;
+    }
+    if (s >= traj.total_length()) {
+      result.lap_time = (step + 1) * dt;
+      break;
+    }
+  }
+  result.mean_latency /= static_cast<double>(std::min(step + 1, max_steps));
+  return result;
+}
+
+void print_lap(const std::string & name, const LapResult & lap)
+{
+  std::cout << name << ": lap time " << lap.lap_time << " s, latency mean " <<
+    lap.mean_latency << " ms max " << lap.max_latency << " ms, failures " << lap.failures <<
+    (lap.off_track ? ", left the track" : "") << std::endl;
+}
+
+void evaluate_policy(
+  rclcpp::Node * node, RacingMPCConfig::SharedPtr config,
+  BaseVehicleModel::SharedPtr model, RacingTrajectory & traj)
+{
+  using lmpc::utils::declare_parameter;
+  const auto policy_file = declare_parameter<std::string>(node, "approx_mpc_tool.policy_file");
+  const auto dt = declare_parameter<double>(node, "approx_mpc_tool.dt");
+  const auto max_steps = static_cast<size_t>(
+    declare_parameter<int>(node, "approx_mpc_tool.max_steps"));
+
+  RacingMPC mpc(config, model, true);
+  ApproxMPC approx(config, model, std::make_shared<MLP>(policy_file));
+  const auto mpc_lap = drive_lap(mpc, *model, traj, config->N, dt, max_steps);
+  const auto approx_lap = drive_lap(approx, *model, traj, config->N, dt, max_steps);
+  print_lap("RacingMPC", mpc_lap);
+  print_lap("ApproxMPC", approx_lap);
+  if (mpc_lap.lap_time > 0.0 && approx_lap.lap_time > 0.0) {
+    std::cout << "Lap time gap: " <<
+      100.0 * (approx_lap.lap_time - mpc_lap.lap_time) / mpc_lap.lap_time << " %" << std::endl;
+  }
+}
+}  // namespace
+
+int main(int argc, char * argv[])
+{
+  rclcpp::init(argc, argv);
+  auto node = std::make_shared<rclcpp::Node>("approx_mpc_tool");
+  const auto mode = lmpc::utils::declare_parameter<std::string>(
+    node.get(), "approx_mpc_tool.mode");
+  if (mode == "train") {
+    train_policy(node.get());
+    rclcpp::shutdown();
+    return 0;
+  }
+
+  // the solver is only used offline, so the safe set and the solution cache are disabled
+  auto config = lmpc::mpc::racing_mpc::load_parameters(node.get());
+  config->learning = false;
+  config->record = false;
+  config->load = false;
+  config->warm_start_cache = false;
+  auto model = lmpc::vehicle_model::vehicle_model_factory::load_vehicle_model(
+    lmpc::utils::declare_parameter<std::string>(node.get(), "approx_mpc_tool.vehicle_model_name"),
+    node.get());
+  RacingTrajectory traj(
+    lmpc::utils::declare_parameter<std::string>(node.get(), "approx_mpc_tool.traj_file"));
+
+  if (mode == "dataset") {
+    generate_dataset(node.get(), config, model, traj);
+  } else if (mode == "evaluate") {
+    evaluate_policy(node.get(), config, model, traj);
+  } else {
+    RCLCPP_FATAL(node->get_logger(), "Unknown mode %s.", mode.c_str());
+  }
+  rclcpp::shutdown();
+  return 0;
+}
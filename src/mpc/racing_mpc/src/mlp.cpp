@@ -0,0 +1,195 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "racing_mpc/mlp.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+MLP::MLP(const std::vector<int> & layer_sizes, const unsigned int & seed)
+{
+  if (layer_sizes.size() < 2) {
+    throw std::invalid_argument("MLP: at least an input and an output layer are required.");
+  }
+  allocate(layer_sizes);
+
+  // Xavier initialization
+  std::mt19937 gen(seed);
+  for (size_t l = 0; l < weights_.size(); l++) {
+    const auto limit = std::sqrt(6.0 / (weights_[l].rows() + weights_[l].cols()));
+    std::uniform_real_distribution<double> dist(-limit, limit);
+    weights_[l] = weights_[l].unaryExpr([&](const double &) {return dist(gen);});
+    biases_[l].setZero();
+  }
+}
+
+MLP::MLP(const std::string & path)
+{
+  std::ifstream file(path);
+  if (!file) {
+    throw std::runtime_error("MLP: could not open " + path + ".");
+  }
+  std::string tag;
+  size_t num_sizes = 0;
+  file >> tag >> num_sizes;
+  if (!file || tag != "mlp" || num_sizes < 2) {
+    throw std::runtime_error("MLP: " + path + " is not an MLP file.");
+  }
+  std::vector<int> layer_sizes(num_sizes);
+  for (auto & size : layer_sizes) {
+    file >> size;
+    if (!file || size <= 0) {
+      throw std::runtime_error("MLP: invalid layer size in " + path + ".");
+    }
+  }
+  allocate(layer_sizes);
+
+  auto read = [&](auto & m) {
+      for (Eigen::Index i = 0; i < m.rows(); i++) {
+        for (Eigen::Index j = 0; j < m.cols(); j++) {
+          file >> m(i, j);
+        }
+      }
+    };
+  read(input_mean);
+  read(input_std);
+  read(output_mean);
+  read(output_std);
+  for (size_t l = 0; l < weights_.size(); l++) {
+    read(weights_[l]);
+    read(biases_[l]);
+  }
+  if (!file) {
+    throw std::runtime_error("MLP: " + path + " is truncated.");
+  }
+}
+
+void MLP::save(const std::string & path) const
+{
+  std::ofstream file(path);
+  if (!file) {
+    throw std::runtime_error("MLP: could not open " + path + ".");
+  }
+  file << std::setprecision(std::numeric_limits<double>::max_digits10);
+  file << "mlp " << activations_.size() << "\n";
+  for (const auto & activation : activations_) {
+    file << activation.size() << " ";
+  }
+  file << "\n";
+  auto write = [&](const auto & m) {
+      for (Eigen::Index i = 0; i < m.rows(); i++) {
+        for (Eigen::Index j = 0; j < m.cols(); j++) {
+          file << m(i, j) << " ";
+        }
+      }
+      file << "\n";
+    };
+  write(input_mean);
+  write(input_std);
+  write(output_mean);
+  write(output_std);
+  for (size_t l = 0; l < weights_.size(); l++) {
+    write(weights_[l]);
+    write(biases_[l]);
+  }
+}
+
+const Eigen::VectorXd & MLP::forward(const Eigen::Ref<const Eigen::VectorXd> & input)
+{
+  if (input.size() != num_inputs()) {
+    throw std::invalid_argument("MLP: the input has the wrong size.");
+  }
+  activations_[0] = (input - input_mean).cwiseQuotient(input_std);
+  const auto num_weight_layers = weights_.size();
+  for (size_t l = 0; l < num_weight_layers; l++) {
+    activations_[l + 1].noalias() = weights_[l] * activations_[l];
+    activations_[l + 1] += biases_[l];
+    if (l + 1 < num_weight_layers) {
+      activations_[l + 1] = activations_[l + 1].array().tanh();
+    }
+  }
+  output_ = activations_.back().cwiseProduct(output_std) + output_mean;
+  return output_;
+}
+
+int MLP::num_inputs() const
+{
+  return static_cast<int>(activations_.front().size());
+}
+
+int MLP::num_outputs() const
+{
+  return static_cast<int>(activations_.back().size());
+}
+
+size_t MLP::num_layers() const
+{
+  return weights_.size();
+}
+
+std::vector<Eigen::MatrixXd> & MLP::weights()
+{
+  return weights_;
+}
+
+std::vector<Eigen::VectorXd> & MLP::biases()
+{
+  return biases_;
+}
+
+const std::vector<Eigen::MatrixXd> & MLP::weights() const
+{
+  return weights_;
+}
+
+const std::vector<Eigen::VectorXd> & MLP::biases() const
+{
+  return biases_;
+}
+
+void MLP::allocate(const std::vector<int> & layer_sizes)
+{
+  weights_.clear();
+  biases_.clear();
+  activations_.clear();
+  for (size_t l = 0; l < layer_sizes.size(); l++) {
+    activations_.push_back(Eigen::VectorXd::Zero(layer_sizes[l]));
+    if (l > 0) {
+      weights_.push_back(Eigen::MatrixXd::Zero(layer_sizes[l], layer_sizes[l - 1]));
+      biases_.push_back(Eigen::VectorXd::Zero(layer_sizes[l]));
+    }
+  }
+  input_mean = Eigen::VectorXd::Zero(layer_sizes.front());
+  input_std = Eigen::VectorXd::Ones(layer_sizes.front());
+  output_mean = Eigen::VectorXd::Zero(layer_sizes.back());
+  output_std = Eigen::VectorXd::Ones(layer_sizes.back());
+  output_ = Eigen::VectorXd::Zero(layer_sizes.back());
+}
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
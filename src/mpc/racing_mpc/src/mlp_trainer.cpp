@@ -0,0 +1,161 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "racing_mpc/mlp_trainer.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+MLPTrainer::MLPTrainer(MLP & mlp, const MLPTrainerConfig & config)
+: mlp_(mlp), config_(config)
+{
+  if (config_.batch_size == 0) {
+    throw std::invalid_argument("MLPTrainer: the batch size must be positive.");
+  }
+}
+
+double MLPTrainer::train(
+  const Eigen::MatrixXd & inputs, const Eigen::MatrixXd & outputs,
+  std::ostream * log)
+{
+  if (inputs.rows() != mlp_.num_inputs() || outputs.rows() != mlp_.num_outputs() ||
+    inputs.cols() != outputs.cols() || inputs.cols() == 0)
+  {
+    throw std::invalid_argument("MLPTrainer: the dataset does not match the MLP.");
+  }
+
+  // normalize, constant features are only centered
+  auto normalize = [](const Eigen::MatrixXd & data, Eigen::VectorXd & mean, Eigen::VectorXd & std) {
+      mean = data.rowwise().mean();
+      std = ((data.colwise() - mean).array().square().rowwise().mean()).sqrt().matrix();
+      std = std.unaryExpr([](const double & s) {return s > 1e-6 ? s : 1.0;});
+      return Eigen::MatrixXd((data.colwise() - mean).array().colwise() / std.array());
+    };
+  const auto X = normalize(inputs, mlp_.input_mean, mlp_.input_std);
+  const auto Y = normalize(outputs, mlp_.output_mean, mlp_.output_std);
+
+  // hold out the validation samples
+  std::mt19937 gen(config_.seed);
+  std::vector<Eigen::Index> index(X.cols());
+  std::iota(index.begin(), index.end(), 0);
+  std::shuffle(index.begin(), index.end(), gen);
+  const auto num_validation = static_cast<Eigen::Index>(
+    std::floor(config_.validation_fraction * X.cols()));
+  const auto num_train = X.cols() - num_validation;
+  const std::vector<Eigen::Index> validation_index(index.begin() + num_train, index.end());
+  index.resize(num_train);
+  const Eigen::MatrixXd X_validation = X(Eigen::all, validation_index);
+  const Eigen::MatrixXd Y_validation = Y(Eigen::all, validation_index);
+
+  // Adam moments
+  auto & W = mlp_.weights();
+  auto & b = mlp_.biases();
+  const auto L = W.size();
+  std::vector<Eigen::MatrixXd> mW, vW;
+  std::vector<Eigen::VectorXd> mb, vb;
+  for (size_t l = 0; l < L; l++) {
+    mW.push_back(Eigen::MatrixXd::Zero(W[l].rows(), W[l].cols()));
+    vW.push_back(Eigen::MatrixXd::Zero(W[l].rows(), W[l].cols()));
+    mb.push_back(Eigen::VectorXd::Zero(b[l].size()));
+    vb.push_back(Eigen::VectorXd::Zero(b[l].size()));
+  }
+  constexpr double beta1 = 0.9;
+  constexpr double beta2 = 0.999;
+  constexpr double epsilon = 1e-8;
+  size_t t = 0;
+
+  std::vector<Eigen::MatrixXd> dW(L);
+  std::vector<Eigen::VectorXd> db(L);
+  for (size_t epoch = 0; epoch < config_.epochs; epoch++) {
+    std::shuffle(index.begin(), index.end(), gen);
+    for (Eigen::Index start = 0; start < num_train;
+      start += static_cast<Eigen::Index>(config_.batch_size))
+    {
+      const auto end = std::min(num_train, start + static_cast<Eigen::Index>(config_.batch_size));
+      const std::vector<Eigen::Index> batch(index.begin() + start, index.begin() + end);
+      const auto A = forward(X(Eigen::all, batch));
+
+      // backpropagation of the mean squared error
+      Eigen::MatrixXd dZ = 2.0 * (A.back() - Y(Eigen::all, batch)) / static_cast<double>(
+        A.back().size());
+      for (size_t l = L; l-- > 0; ) {
+        dW[l] = dZ * A[l].transpose();
+        db[l] = dZ.rowwise().sum();
+        if (l > 0) {
+          dZ = ((W[l].transpose() * dZ).array() * (1.0 - A[l].array().square())).matrix();
+        }
+      }
+
+      t++;
+      const auto lr = config_.learning_rate * std::sqrt(1.0 - std::pow(beta2, t)) /
+        (1.0 - std::pow(beta1, t));
+      for (size_t l = 0; l < L; l++) {
+        mW[l] = beta1 * mW[l] + (1.0 - beta1) * dW[l];
+        vW[l] = beta2 * vW[l] + (1.0 - beta2) * dW[l].array().square().matrix();
+        W[l].array() -= lr * mW[l].array() / (vW[l].array().sqrt() + epsilon);
+        mb[l] = beta1 * mb[l] + (1.0 - beta1) * db[l];
+        vb[l] = beta2 * vb[l] + (1.0 - beta2) * db[l].array().square().matrix();
+        b[l].array() -= lr * mb[l].array() / (vb[l].array().sqrt() + epsilon);
+      }
+    }
+    if (log) {
+      *log << "epoch " << epoch << ", training loss " <<
+        loss(X(Eigen::all, index), Y(Eigen::all, index));
+      if (num_validation > 0) {
+        *log << ", validation loss " << loss(X_validation, Y_validation);
+      }
+      *log << std::endl;
+    }
+  }
+  if (num_validation > 0) {
+    return loss(X_validation, Y_validation);
+  }
+  return loss(X(Eigen::all, index), Y(Eigen::all, index));
+}
+
+std::vector<Eigen::MatrixXd> MLPTrainer::forward(const Eigen::MatrixXd & inputs) const
+{
+  const auto & W = mlp_.weights();
+  const auto & b = mlp_.biases();
+  std::vector<Eigen::MatrixXd> A{inputs};
+  for (size_t l = 0; l < W.size(); l++) {
+    Eigen::MatrixXd Z = (W[l] * A.back()).colwise() + b[l];
+    if (l + 1 < W.size()) {
+      Z = Z.array().tanh();
+    }
+    A.push_back(std::move(Z));
+  }
+  return A;
+}
+
+double MLPTrainer::loss(const Eigen::MatrixXd & inputs, const Eigen::MatrixXd & outputs) const
+{
+  return (forward(inputs).back() - outputs).array().square().mean();
+}
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
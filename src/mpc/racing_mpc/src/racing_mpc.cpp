@@ -14,7 +14,13 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <math.h>
+#include <stdlib.h>
+#include <algorithm>
 #include <exception>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
 #include <vector>
 #include <iostream>
 #include <chrono>
@@ -28,10 +34,24 @@ namespace mpc
 {
 namespace racing_mpc
 {
+namespace
+{
+// a new directory for the objects of the JIT compiler, ending with a separator
+std::string make_jit_directory()
+{
+  auto path = (std::filesystem::temp_directory_path() / "racing_mpc_jit_XXXXXX").string();
+  if (!mkdtemp(path.data())) {
+    throw std::runtime_error("RacingMPC: failed to create the JIT directory " + path);
+  }
+  return path + "/";
+}
+}  // namespace
+
 RacingMPC::RacingMPC(
   RacingMPCConfig::SharedPtr mpc_config,
   BaseVehicleModel::SharedPtr model,
-  const bool & full_dynamics)
+  const bool & full_dynamics,
+  SafeSetManager::SharedPtr safe_set_manager)
 : config_(mpc_config), model_(model),
   scale_x_(casadi::DM{2000.0, 10.0, 0.1, 80.0, 2.0, 2.0}),
   scale_u_(casadi::DM{10.0, 0.3}),
@@ -53,10 +73,12 @@ RacingMPC::RacingMPC(
   total_length_(opti_.parameter(1, 1)),
   curvatures_(opti_.parameter(1, config_->N)),
   vel_ref_(opti_.parameter(1, config_->N)),
+  lateral_ref_(opti_.parameter(1, config_->N)),
   solved_(false),
   sol_(),
-  ss_manager_(std::make_unique<SafeSetManager>(config_->max_lap_stored)),
-  ss_recorder_(std::make_unique<SafeSetRecorder>(
+  ss_manager_(safe_set_manager ? safe_set_manager :
+    std::make_shared<SafeSetManager>(config_->max_lap_stored)),
+  ss_recorder_(safe_set_manager ? nullptr : std::make_unique<SafeSetRecorder>(
       *ss_manager_, config_->record,
       config_->path_prefix))
 {
@@ -95,8 +117,14 @@ RacingMPC::RacingMPC(
       }
     };
     if (config_->jit) {
+      // Opti builds the expanded QP as one internal function on the first solve, so it is
+      // compiled as a single unit. lmpc::utils::parallel_jit would need the QP and its
+      // derivatives as separate functions. Keep the compiled objects until destruction
+      // to measure their size.
+      jit_directory_ = make_jit_directory();
       p_opts["jit"] = true;
-      p_opts["jit_options"] = casadi::Dict{{"flags", "-Ofast"}};
+      p_opts["jit_options"] = casadi::Dict{
+        {"flags", "-Ofast"}, {"directory", jit_directory_}, {"cleanup", false}};
       p_opts["compiler"] = "shell";
     }
     const auto s_opts = casadi::Dict{};
@@ -122,6 +150,33 @@ RacingMPC::RacingMPC(
 
   opti_.minimize(cost);
 
+  // collocation states of each step, on which the full dynamics are enforced
+  // by either the model or this class. a model that enforces its dynamics is never
+  // constrained a second time by another integrator
+  const bool model_dynamics = model_->enforces_dynamics();
+  if (full_dynamics && config_->transcription != RacingMPCTranscription::SHOOTING) {
+    const auto nx = static_cast<casadi_int>(model_->nx());
+    const auto nu = static_cast<casadi_int>(model_->nu());
+    if (config_->transcription == RacingMPCTranscription::HERMITE_SIMPSON) {
+      collocation_tau_ = {0.5};
+    } else if (model_dynamics && config_->collocation_degree < 2) {
+      // the model reads a single collocation state as the Hermite-Simpson midpoint
+      throw std::invalid_argument(
+        "RacingMPC: the model collocates Legendre dynamics of degree 2 or more only.");
+    } else {
+      collocation_tau_ = casadi::collocation_points(config_->collocation_degree, "legendre");
+    }
+    if (!model_dynamics) {
+      collocation_ = config_->transcription == RacingMPCTranscription::HERMITE_SIMPSON ?
+        utils::hermite_simpson_function(nx, nu, model_->dynamics()) :
+        utils::legendre_collocation_function(
+        nx, nu, config_->collocation_degree, model_->dynamics());
+    }
+    Xc_ = opti_.variable(
+      nx, static_cast<casadi_int>((config_->N - 1) * collocation_tau_.size()));
+  }
+  const auto nc = static_cast<casadi_int>(collocation_tau_.size());
+
   // --- model constraints ---
   for (size_t i = 0; i < config_->N - 1; i++) {
     const auto xi = X_(Slice(), i) * scale_x_;
@@ -141,6 +196,15 @@ RacingMPC::RacingMPC(
     const auto dui = dU_(Slice(), i) * scale_u_;
     constraint_in["dui"] = dui;
 
+    MX xci;
+    if (full_dynamics && nc > 0) {
+      const auto i_c = static_cast<casadi_int>(i) * nc;
+      xci = Xc_(Slice(), Slice(i_c, i_c + nc)) * MX::repmat(scale_x_, 1, nc);
+      if (model_dynamics) {
+        constraint_in["xc"] = xci;
+      }
+    }
+
     model_->add_nlp_constraints(opti_, constraint_in);
 
     // primal bounds
@@ -159,7 +223,15 @@ RacingMPC::RacingMPC(
     //     lmpc::utils::align_yaw<casadi::MX>(xip1_temp(XIndex::YAW), xi(XIndex::YAW));
     // }
 
-    if (full_dynamics) {
+    if (model_dynamics) {
+      // already enforced by the model constraints
+    } else if (full_dynamics && !collocation_.is_null()) {
+      // enforce the full dynamics at the collocation states of the step
+      const auto defect = collocation_(
+        casadi::MXDict{{"x", xi}, {"xc", xci}, {"xip1", xip1}, {"u", ui}, {"k", k},
+          {"dt", ti}}).at("defect");
+      opti_.subject_to(defect == 0);
+    } else if (full_dynamics) {
       // use full dynamics for dynamics constraints
       const auto xip1_pred =
         model_->discrete_dynamics()({{"x", xi}, {"u", ui}, {"k", k}, {"dt", ti}}).at("xip1");
@@ -199,6 +271,24 @@ RacingMPC::RacingMPC(
   // --- initial state constraint ---
   const auto x0 = X_(Slice(), 0) * scale_x_;
   opti_.subject_to(x0 == x_ic_);
+
+  // the cached solutions are preallocated with the size of the problem
+  if (config_->warm_start_cache) {
+    solution_cache_ = std::make_unique<SolutionCache>(
+      config_->cache_ds, config_->cache_dv, static_cast<size_t>(config_->cache_depth),
+      static_cast<size_t>(config_->cache_max_bins), scale_x_,
+      SolutionCacheEntry{
+        casadi::DM::zeros(model_->nx()), casadi::DM::zeros(1, config_->N),
+        casadi::DM::zeros(opti_.nx()), casadi::DM::zeros(opti_.ng())});
+  }
+}
+
+RacingMPC::~RacingMPC()
+{
+  if (!jit_directory_.empty()) {
+    std::error_code error;
+    std::filesystem::remove_all(jit_directory_, error);
+  }
 }
 
 const RacingMPCConfig & RacingMPC::get_config() const
@@ -212,10 +302,17 @@ void RacingMPC::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::D
   using casadi::MX;
   using casadi::Slice;
 
+  // the first solve builds the solver, which must not race with another thread building
+  // CasADi functions
+  std::unique_lock<std::mutex> construction_lock(
+    utils::casadi_construction_mutex(), std::defer_lock);
+  if (!sol_) {
+    construction_lock.lock();
+  }
+
   const auto & total_length = in.at("total_length");
   const auto & x_ic = in.at("x_ic");
   const auto & u_ic = in.at("u_ic");
-  const auto & t_ic = in.at("t_ic");
   auto X_ref = in.at("X_ref");
   X_ref(XIndex::PX, Slice()) = align_abscissa_(
     casadi::DMDict{{"abscissa_1", X_ref(XIndex::PX, Slice())},
@@ -237,13 +334,8 @@ void RacingMPC::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::D
   // std::cout << "[curvatures]\n:" << curvatures << std::endl;
   // std::cout << "[vel_ref]\n:" << vel_ref << std::endl;
 
-  if (!ss_loaded && config_->load) {
-    ss_recorder_->load(config_->load_path, static_cast<double>(total_length));
-    ss_loaded = true;
-  }
-
   // add current state to safe set
-  ss_recorder_->step(x_ic, u_ic, curvatures(0), t_ic, static_cast<double>(total_length));
+  record(in);
 
   // compute new safe set
   const auto query = lmpc::vehicle_model::racing_trajectory::SSQuery{
@@ -290,6 +382,7 @@ void RacingMPC::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::D
 
   // if optimal reference is given, typically from last MPC solution,
   // initialize with this reference.
+  DM x0_warm_start;
   if (in.count("X_optm_ref")) {
     auto X_optm_ref = in.at("X_optm_ref");
     X_optm_ref(XIndex::PX, Slice()) = align_abscissa_(
@@ -303,6 +396,7 @@ void RacingMPC::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::D
     opti_.set_initial(U_ * scale_u_, U_optm_ref);
     opti_.set_initial(dU_ * scale_u_, dU_optm_ref);
     opti_.set_value(T_ref_, T_optm_ref);
+    x0_warm_start = X_optm_ref(Slice(), 0);
     // if (sol_) {
     //   const auto lam_g0 = sol_->value(opti_.lam_g());
     //   opti_.set_initial(opti_.lam_g(), lam_g0);
@@ -322,10 +416,35 @@ void RacingMPC::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::D
       casadi::DMDict{{"abscissa_1", last_abscissa_optm},
         {"abscissa_2", P0}, {"total_distance", total_lengths}}).at("abscissa_1_aligned");
     opti_.set_initial((X_ * scale_x_)(XIndex::PX, Slice()), this_abscissa_optm);
+    x0_warm_start = (sol_->value(X_) * scale_x_)(Slice(), 0);
     // const auto lam_g0 = sol_->value(opti_.lam_g());
     // opti_.set_initial(opti_.lam_g(), lam_g0);
   }
 
+  // warm start from a previous lap at the same track position if it is closer than the plan
+  bool cache_hit = false;
+  // the cache is only used on the track it was reset for
+  const bool use_cache = solution_cache_ &&
+    solution_cache_->total_length() == static_cast<double>(total_length);
+  if (use_cache) {
+    double cache_distance = 0.0;
+    const auto entry = solution_cache_->query(x_ic, cache_distance);
+    if (entry && cache_distance < solution_cache_->distance(x0_warm_start, x_ic)) {
+      opti_.set_initial(opti_.x(), entry->primal);
+      opti_.set_initial(opti_.lam_g(), entry->dual);
+      // move the cached abscissa to start from the current one
+      opti_.set_initial(
+        (X_ * scale_x_)(XIndex::PX, Slice()),
+        entry->abscissa - entry->x0(XIndex::PX) + x_ic(XIndex::PX));
+      cache_hit = true;
+    }
+  }
+
+  // the collocation states follow the initial guess of the steps
+  if (!collocation_tau_.empty()) {
+    initialize_collocation_states(opti_.value(X_ * scale_x_, opti_.initial()));
+  }
+
   // starting state must match
   opti_.set_value(x_ic_, x_ic);
   opti_.set_value(u_ic_, u_ic);
@@ -338,16 +457,39 @@ void RacingMPC::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::D
   opti_.set_value(total_length_, total_length);
   opti_.set_value(curvatures_, curvatures);
   opti_.set_value(vel_ref_, vel_ref);
+  // lateral reference is optional (e.g. from a long-horizon planner). default to the racing line.
+  if (in.count("lateral_ref")) {
+    opti_.set_value(lateral_ref_, in.at("lateral_ref"));
+  } else {
+    opti_.set_value(lateral_ref_, DM::zeros(1, config_->N));
+  }
 
   // solve problem
   try {
     sol_ = std::make_shared<casadi::OptiSol>(opti_.solve_limited());
+    if (construction_lock.owns_lock()) {
+      construction_lock.unlock();
+    }
     // const auto sol = opti.solve();
     solved_ = true;
     out["X_optm"] = sol_->value(X_) * scale_x_;
     out["U_optm"] = sol_->value(U_) * scale_u_;
     out["dU_optm"] = sol_->value(dU_) * scale_u_;
+    if (static_cast<double>(config_->q_boundary) > 0.0) {
+      out["boundary_slack_optm"] = sol_->value(boundary_slack_);
+    }
     stats = sol_->stats();
+    if (use_cache) {
+      if (stats.count("success") && stats.at("success").as_bool()) {
+        solution_cache_->insert(
+          x_ic, out.at("X_optm")(XIndex::PX, Slice()),
+          sol_->value(opti_.x()), sol_->value(opti_.lam_g()));
+      }
+      solution_cache_->record_result(
+        cache_hit,
+        stats.count("iter_count") ? static_cast<double>(stats.at("iter_count")) : 0.0);
+      stats["cache_hit"] = cache_hit;
+    }
     if (config_->learning) {
       out["convex_combi_optm"] = sol_->value(convex_combi_);
       // std::cout << DM::mtimes(out["ss_x"], out["convex_combi_optm"])(XIndex::VX) << std::endl;
@@ -371,6 +513,22 @@ void RacingMPC::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::D
   }
 }
 
+void RacingMPC::record(const casadi::DMDict & in)
+{
+  // the owner of a shared safe set records it
+  if (!ss_recorder_) {
+    return;
+  }
+  const auto total_length = static_cast<double>(in.at("total_length"));
+  if (!ss_loaded && config_->load) {
+    ss_recorder_->load(config_->load_path, total_length);
+    ss_loaded = true;
+  }
+  ss_recorder_->step(
+    in.at("x_ic"), in.at("u_ic"), in.at("curvatures")(0), in.at("t_ic"),
+    total_length);
+}
+
 void RacingMPC::create_warm_start(const casadi::DMDict & in, casadi::DMDict & out)
 {
   using casadi::DM;
@@ -434,11 +592,139 @@ BaseVehicleModel & RacingMPC::get_model()
   return *model_;
 }
 
+SafeSetManager & RacingMPC::get_safe_set_manager()
+{
+  return *ss_manager_;
+}
+
+SafeSetManager::SharedPtr RacingMPC::share_safe_set_manager()
+{
+  return ss_manager_;
+}
+
+void RacingMPC::discard_lap()
+{
+  if (ss_recorder_) {
+    ss_recorder_->discard_lap();
+  }
+}
+
+void RacingMPC::open_journal(
+  const std::string & path, const double & commit_period,
+  const double & resume_timeout)
+{
+  if (!ss_recorder_) {
+    throw std::runtime_error("RacingMPC: the safe set is recorded by the MPC sharing it.");
+  }
+  ss_recorder_->open_journal(path, model_->nx(), model_->nu(), commit_period, resume_timeout);
+}
+
+void RacingMPC::change_trajectory(
+  const int & from_idx, RacingTrajectory::SharedPtr from,
+  const int & to_idx, RacingTrajectory::SharedPtr to)
+{
+  discard_lap();
+  ss_manager_->set_active_partition(to_idx);
+  ss_manager_->reproject(from_idx, from, to_idx, to);
+  if (to) {
+    reset_solution_cache(*to);
+  }
+}
+
+void RacingMPC::reset_solution_cache(const RacingTrajectory & track)
+{
+  if (solution_cache_) {
+    solution_cache_->reset(track.total_length(), track.max_speed());
+  }
+}
+
 const bool & RacingMPC::solved() const
 {
   return solved_;
 }
 
+RacingMPCProblemSize RacingMPC::problem_size() const
+{
+  RacingMPCProblemSize size;
+  size.num_variables = opti_.nx();
+  size.num_constraints = opti_.ng();
+  size.num_parameters = opti_.np();
+  const auto nlp = casadi::Function(
+    "nlp", {opti_.x(), opti_.p()}, {opti_.f(), opti_.g()});
+  size.num_mx_nodes = nlp.n_nodes();
+  size.num_sx_nodes = nlp.expand().n_nodes();
+
+  solver_size(size);
+  return size;
+}
+
+bool RacingMPC::solver_size(RacingMPCProblemSize & size) const
+{
+  // the solver is built by the first solve. IPOPT evaluates the jacobian and the hessian
+  // functions, while the QP solver takes them as the inputs "a" and "h"
+  casadi::Function solver;
+  try {
+    solver = opti_.debug().casadi_solver();
+  } catch (const std::exception &) {
+    return false;
+  }
+  const auto inputs = solver.name_in();
+  auto has_input = [&inputs](const std::string & name) {
+      return std::find(inputs.begin(), inputs.end(), name) != inputs.end();
+    };
+  if (solver.has_function("nlp_jac_g")) {
+    const auto jac_g = solver.get_function("nlp_jac_g");
+    size.jacobian_nnz = jac_g.sparsity_out(jac_g.n_out() - 1).nnz();
+  } else if (has_input("a")) {
+    size.jacobian_nnz = solver.sparsity_in("a").nnz();
+  }
+  if (solver.has_function("nlp_hess_l")) {
+    const auto hess_l = solver.get_function("nlp_hess_l");
+    size.hessian_nnz = hess_l.sparsity_out(hess_l.n_out() - 1).nnz();
+  } else if (has_input("h")) {
+    size.hessian_nnz = solver.sparsity_in("h").nnz();
+  }
+
+  size.jit_size = 0;
+  if (!jit_directory_.empty()) {
+    std::error_code error;
+    for (const auto & entry : std::filesystem::directory_iterator(jit_directory_, error)) {
+      if (entry.is_regular_file() && entry.path().extension() == ".so") {
+        size.jit_size += entry.file_size();
+      }
+    }
+  }
+  return true;
+}
+
+void RacingMPC::function_times(const casadi::Dict & stats, std::map<std::string, double> & times)
+{
+  static const std::string prefix = "t_wall_";
+  double function_time = 0.0;
+  double total_time = -1.0;
+  for (const auto & [key, value] : stats) {
+    if (key.compare(0, prefix.size(), prefix) != 0 || !value.is_double()) {
+      continue;
+    }
+    const auto name = key.substr(prefix.size());
+    const auto time = value.to_double() * 1e3;
+    times[name] = time;
+    if (name == "total") {
+      total_time = time;
+    } else if (name.compare(0, 4, "nlp_") == 0) {
+      function_time += time;
+    }
+  }
+  if (total_time >= 0.0) {
+    times["solver"] = total_time - function_time;
+  }
+}
+
+const SolutionCache * RacingMPC::get_solution_cache() const
+{
+  return solution_cache_.get();
+}
+
 void RacingMPC::build_tracking_cost(casadi::MX & cost)
 {
   using casadi::MX;
@@ -455,8 +741,9 @@ void RacingMPC::build_tracking_cost(casadi::MX & cost)
     // utils::align_abscissa<MX>(xi(XIndex::PX), x0(XIndex::PX), total_length_) - x0(XIndex::PX);
     const auto x_base = model_->to_base_state()(casadi::MXDict{{"x", xi}, {"u", ui}}).at("x_out");
     const auto dv = x_base(XIndex::VX) - vel_ref_(i);
+    const auto dy = x_base(XIndex::PY) - lateral_ref_(i);
     // const auto dv = x_base(XIndex::VX) - 10.0;
-    cost += x_base(XIndex::PY) * x_base(XIndex::PY) * config_->q_contour;
+    cost += dy * dy * config_->q_contour;
     cost += x_base(XIndex::YAW) * x_base(XIndex::YAW) * config_->q_heading;
     cost += dv * dv * config_->q_vel;
     cost += x_base(XIndex::VY) * x_base(XIndex::VY) * config_->q_vy;
@@ -471,7 +758,8 @@ void RacingMPC::build_tracking_cost(casadi::MX & cost)
   const auto uN = U_(Slice(), config_->N - 2) * scale_u_;
   const auto x_base_N = model_->to_base_state()(casadi::MXDict{{"x", xN}, {"u", uN}}).at("x_out");
   const auto dv = x_base_N(XIndex::VX) - vel_ref_(config_->N - 1);
-  cost += x_base_N(XIndex::PY) * x_base_N(XIndex::PY) * config_->q_contour * 10.0;
+  const auto dy = x_base_N(XIndex::PY) - lateral_ref_(config_->N - 1);
+  cost += dy * dy * config_->q_contour * 10.0;
   cost += x_base_N(XIndex::YAW) * x_base_N(XIndex::YAW) * config_->q_heading * 10.0;
   cost += dv * dv * config_->q_vel * 10.0;
 }
@@ -521,6 +809,23 @@ void RacingMPC::build_lmpc_cost(casadi::MX & cost)
   }
 }
 
+void RacingMPC::initialize_collocation_states(const casadi::DM & X)
+{
+  using casadi::DM;
+  using casadi::Slice;
+
+  // interpolate linearly between the states of each step
+  const auto nc = static_cast<casadi_int>(collocation_tau_.size());
+  auto Xc = DM::zeros(model_->nx(), Xc_.size2());
+  for (casadi_int i = 0; i < static_cast<casadi_int>(config_->N) - 1; i++) {
+    for (casadi_int j = 0; j < nc; j++) {
+      const auto & tau = collocation_tau_[j];
+      Xc(Slice(), i * nc + j) = (1.0 - tau) * X(Slice(), i) + tau * X(Slice(), i + 1);
+    }
+  }
+  opti_.set_initial(Xc_, Xc / DM::repmat(scale_x_, 1, Xc.size2()));
+}
+
 void RacingMPC::build_boundary_constraint(casadi::MX & cost)
 {
   using casadi::MX;
@@ -13,6 +13,11 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
 #include <lmpc_utils/ros_param_helper.hpp>
 #include <lmpc_utils/utils.hpp>
 #include <base_vehicle_model/ros_param_loader.hpp>
@@ -32,7 +37,9 @@ RacingMPCNode::RacingMPCNode(const rclcpp::NodeOptions & options)
   config_(lmpc::mpc::racing_mpc::load_parameters(this)),
   tracks_(std::make_shared<RacingTrajectoryMap>(
       utils::declare_parameter<std::string>(
-        this, "racing_mpc_node.traj_folder")
+        this, "racing_mpc_node.traj_folder"),
+      utils::declare_parameter<bool>(
+        this, "racing_mpc_node.watch_traj_folder")
     )),
   traj_idx_(utils::declare_parameter<int>(
       this, "racing_mpc_node.default_traj_idx")),
@@ -54,6 +61,144 @@ RacingMPCNode::RacingMPCNode(const rclcpp::NodeOptions & options)
   full_config->max_cpu_time = 10.0;
   full_config->max_iter = 1000;
   mpc_full_ = std::make_shared<RacingMPC>(full_config, model_, true);
+  // expand the problem here rather than in the control loop. the solver sparsity is added
+  // once the first solve has built the solver
+  problem_size_ = std::make_unique<RacingMPCProblemSize>(mpc_->problem_size());
+  // the safe set is partitioned by the frenet frame of the trajectory it is recorded on
+  mpc_->get_safe_set_manager().set_active_partition(traj_idx_);
+  mpc_->reset_solution_cache(*track_);
+  mpc_->get_safe_set_manager().set_error_callback(
+    [this](const int & from_idx, const int & to_idx, const std::string & error) {
+      RCLCPP_WARN(
+        this->get_logger(), "Failed to reproject a lap from trajectory %d to trajectory %d: %s",
+        from_idx, to_idx, error.c_str());
+    });
+
+  // add a coarse long-horizon planner that feeds the velocity and lateral references
+  planner_enabled_ = utils::declare_parameter<bool>(this, "racing_mpc_node.planner.enable");
+  if (planner_enabled_) {
+    planner_dt_ = utils::declare_parameter<double>(this, "racing_mpc_node.planner.dt");
+    planner_rate_ = utils::declare_parameter<double>(this, "racing_mpc_node.planner.rate");
+    auto planner_config = std::make_shared<RacingMPCConfig>(*config_);
+    planner_config->N = static_cast<size_t>(
+      utils::declare_parameter<int>(this, "racing_mpc_node.planner.n"));
+    planner_config->learning =
+      utils::declare_parameter<bool>(this, "racing_mpc_node.planner.learning");
+    planner_config->max_cpu_time = 1.0 / planner_rate_;
+    // the planner queries the safe set recorded and reprojected by the tracking MPC
+    planner_config->record = false;
+    planner_mpc_ = std::make_shared<RacingMPC>(
+      planner_config, model_, false, mpc_->share_safe_set_manager());
+    planner_profiler_ = std::make_unique<lmpc::utils::CycleProfiler<double>>(10);
+    if (config_->learning) {
+      RCLCPP_WARN(
+        this->get_logger(),
+        "Planner is enabled but the MPC uses the LMPC cost, which ignores the planned reference.");
+    }
+  }
+
+  // skip solves while the previous plan is still valid
+  event_trigger_enabled_ =
+    utils::declare_parameter<bool>(this, "racing_mpc_node.event_trigger.enable");
+  if (event_trigger_enabled_) {
+    event_state_threshold_ = casadi::DM(
+      utils::declare_parameter<std::vector<double>>(
+        this, "racing_mpc_node.event_trigger.state_threshold"));
+    event_ref_threshold_ =
+      utils::declare_parameter<double>(this, "racing_mpc_node.event_trigger.ref_threshold");
+    event_max_skip_ =
+      utils::declare_parameter<int>(this, "racing_mpc_node.event_trigger.max_skip");
+    if (event_state_threshold_.size1() != model_->nx()) {
+      throw std::invalid_argument(
+              "racing_mpc_node.event_trigger.state_threshold must have one entry per state.");
+    }
+    skip_profiler_ = std::make_unique<lmpc::utils::CycleProfiler<double>>(10);
+    tracking_error_profiler_ = std::make_unique<lmpc::utils::CycleProfiler<double>>(10);
+  }
+
+  // sample hardware performance counters around the cycle phases and safe set queries
+  perf_counters_enabled_ = utils::declare_parameter<bool>(this, "racing_mpc_node.perf_counters");
+  if (perf_counters_enabled_) {
+    for (auto & profiler : phase_perf_profilers_) {
+      profiler = std::make_unique<lmpc::utils::PerfProfiler>(10);
+    }
+    ss_perf_profiler_ = std::make_shared<lmpc::utils::PerfProfiler>(10);
+    mpc_->get_safe_set_manager().set_perf_profiler(ss_perf_profiler_);
+    if (!lmpc::utils::PerfCounters::this_thread().available()) {
+      RCLCPP_WARN(
+        this->get_logger(),
+        "Performance counters are not available. Check perf_event_paranoid.");
+    }
+  }
+
+  // bin the solve statistics by track position
+  heatmap_enabled_ = utils::declare_parameter<bool>(this, "racing_mpc_node.heatmap.enable");
+  if (heatmap_enabled_) {
+    heatmap_bin_size_ =
+      utils::declare_parameter<double>(this, "racing_mpc_node.heatmap.bin_size");
+    switch_heatmap(traj_idx_);
+  }
+
+  // fall back to the approximate MPC when the MPC fails to solve
+  const auto approx_policy =
+    utils::declare_parameter<std::string>(this, "racing_mpc_node.approx_policy");
+  if (!approx_policy.empty()) {
+    approx_mpc_ = std::make_shared<ApproxMPC>(
+      config_, model_, std::make_shared<MLP>(approx_policy));
+    RCLCPP_INFO(this->get_logger(), "Loaded the approximate MPC %s.", approx_policy.c_str());
+  }
+
+  // mirror the controller state to a hot standby process, or be that standby
+  const auto replication_role =
+    utils::declare_parameter<std::string>(this, "racing_mpc_node.replication.role");
+  if (replication_role == "none") {
+    replication_role_ = RacingMPCReplicationRole::NONE;
+  } else if (replication_role == "primary") {
+    replication_role_ = RacingMPCReplicationRole::PRIMARY;
+  } else if (replication_role == "standby") {
+    replication_role_ = RacingMPCReplicationRole::STANDBY;
+  } else {
+    throw std::invalid_argument("Invalid replication role: " + replication_role);
+  }
+  if (replication_role_ != RacingMPCReplicationRole::NONE) {
+    const auto segment_name =
+      utils::declare_parameter<std::string>(this, "racing_mpc_node.replication.segment_name");
+    warm_start_segment_name_ = segment_name + "_warm_start";
+    ss_segment_name_ = segment_name + "_safe_set";
+    heartbeat_timeout_ = static_cast<int64_t>(std::llround(
+        utils::declare_parameter<double>(
+          this, "racing_mpc_node.replication.heartbeat_timeout") * dt_ * 1e9));
+  }
+  if (replication_role_ == RacingMPCReplicationRole::PRIMARY) {
+    // trajectory index, warm start, and the size and samples of each profiler
+    const auto N = mpc_->get_config().N;
+    const auto num_convex_combi = config_->learning ? config_->num_ss_pts : 0;
+    const auto warm_start_capacity = 1 + model_->nx() * N + 2 * model_->nu() * (N - 1) +
+      static_cast<size_t>(num_convex_combi) + 2 + profiler_->capacity() +
+      profiler_iter_count_->capacity();
+    warm_start_mirror_ = std::make_unique<lmpc::utils::SharedMemoryMirror>(
+      warm_start_segment_name_, warm_start_capacity);
+    ss_mirror_ = std::make_unique<lmpc::utils::SharedMemoryMirror>(
+      ss_segment_name_, static_cast<size_t>(
+        utils::declare_parameter<int>(
+          this, "racing_mpc_node.replication.ss_segment_size")) / sizeof(double));
+    RCLCPP_INFO(
+      this->get_logger(), "Mirroring the controller state to %s and %s.",
+      warm_start_segment_name_.c_str(), ss_segment_name_.c_str());
+  }
+
+  // journal the recorded laps so that a crash does not lose them. the standby mirrors the laps
+  // of the primary, which journals them
+  if (utils::declare_parameter<bool>(this, "racing_mpc_node.journal.enable") &&
+    replication_role_ != RacingMPCReplicationRole::STANDBY)
+  {
+    const auto journal_path = config_->path_prefix + "journal.bin";
+    mpc_->open_journal(
+      journal_path,
+      utils::declare_parameter<double>(this, "racing_mpc_node.journal.commit_period"),
+      utils::declare_parameter<double>(this, "racing_mpc_node.journal.resume_timeout"));
+    RCLCPP_INFO(this->get_logger(), "Journaling the recorded laps to %s.", journal_path.c_str());
+  }
 
   // add visualizations for the trajectory
   vis_->attach_ros_publishers(this, 1.0, true, true);
@@ -61,19 +206,45 @@ RacingMPCNode::RacingMPCNode(const rclcpp::NodeOptions & options)
   // initialize the actuation message
   vehicle_actuation_msg_ = std::make_shared<mpclab_msgs::msg::VehicleActuationMsg>();
 
-  // initialize the mpc inputs
+  // initialize the mpc inputs. the entries updated every cycle are preallocated
+  // and written in place afterwards.
   const auto N = static_cast<casadi_int>(mpc_->get_config().N);
   sol_in_["T_ref"] = casadi::DM::zeros(1, N - 1) + dt_;
   sol_in_["total_length"] = track_->total_length();
+  sol_in_["x_ic"] = casadi::DM::zeros(model_->nx());
+  sol_in_["u_ic"] = casadi::DM::zeros(model_->nu());
+  sol_in_["t_ic"] = 0.0;
+  sol_in_["vel_ref"] = casadi::DM::zeros(1, N);
+  sol_in_["lateral_ref"] = casadi::DM::zeros(1, N);
 
   // build discrete dynamics
-  const auto x_sym = casadi::MX::sym("x", model_->nx());
-  const auto u_sym = casadi::MX::sym("u", model_->nu());
-  const auto k = track_->curvature_interpolation_function()(x_sym(XIndex::PX))[0];
-  const auto xip1 = model_->discrete_dynamics()(
-    casadi::MXDict{{"x", x_sym}, {"u", u_sym}, {"k", k}, {"dt", dt_}}
-  ).at("xip1");
-  discrete_dynamics_ = casadi::Function("discrete_dynamics", {x_sym, u_sym}, {xip1});
+  discrete_dynamics_ = build_discrete_dynamics(*track_, dt_);
+
+  // preallocate the evaluation buffers and messages of the control cycle
+  from_base_state_eval_ = std::make_unique<utils::CasadiEvaluator>(model_->from_base_state());
+  from_base_control_eval_ =
+    std::make_unique<utils::CasadiEvaluator>(model_->from_base_control());
+  to_base_control_eval_ = std::make_unique<utils::CasadiEvaluator>(model_->to_base_control());
+  build_track_evaluators();
+  for (auto * vis_msg : {&mpc_vis_msg_, &ref_vis_msg_}) {
+    vis_msg->header.frame_id = "map";
+    vis_msg->poses.resize(N);
+    for (auto & pose : vis_msg->poses) {
+      pose.header.frame_id = "map";
+    }
+  }
+  auto & ss_marker = ss_vis_msg_.markers.emplace_back();
+  ss_marker.header.frame_id = "map";
+  ss_marker.ns = "safe_set";
+  ss_marker.id = 0;
+  ss_marker.type = visualization_msgs::msg::Marker::SPHERE_LIST;
+  const auto ss_marker_scale = model_->get_base_config().chassis_config->wheel_base / 10.0;
+  ss_marker.scale.x = ss_marker_scale;
+  ss_marker.scale.y = ss_marker_scale;
+  ss_marker.scale.z = ss_marker_scale;
+  ss_marker.action = visualization_msgs::msg::Marker::MODIFY;
+  ss_marker.points.reserve(config_->num_ss_pts);
+  ss_marker.colors.reserve(config_->num_ss_pts);
 
   // initialize the publishers
   vehicle_actuation_pub_ = this->create_publisher<mpclab_msgs::msg::VehicleActuationMsg>(
@@ -84,6 +255,9 @@ RacingMPCNode::RacingMPCNode(const rclcpp::NodeOptions & options)
     "diagnostics", 1);
   ss_vis_pub_ = this->create_publisher<visualization_msgs::msg::MarkerArray>("ss_visualization", 1);
   mpc_telemetry_pub_ = this->create_publisher<lmpc_msgs::msg::MPCTelemetry>("mpc_telemetry", 1);
+  if (heatmap_enabled_) {
+    solve_heatmap_pub_ = this->create_publisher<lmpc_msgs::msg::SolveHeatmap>("solve_heatmap", 1);
+  }
 
   // initialize the subscribers
   // state subscription is on a separate callback group
@@ -106,15 +280,92 @@ RacingMPCNode::RacingMPCNode(const rclcpp::NodeOptions & options)
     "lmpc_trajectory_command", 1, std::bind(
       &RacingMPCNode::on_new_trajectory_command, this,
       std::placeholders::_1), trajectory_command_sub_options);
+  if (tracks_->is_watching()) {
+    // the new lines are built off the control thread, and a trajectory command switches to them
+    tracks_->set_update_callback(
+      [this](const int & traj_idx, RacingTrajectory::SharedPtr previous,
+      RacingTrajectory::SharedPtr traj) {
+        if (traj) {
+          RCLCPP_INFO(
+            this->get_logger(), "Trajectory %d is ready. Length: %f m.", traj_idx,
+            traj->total_length());
+        } else {
+          RCLCPP_WARN(this->get_logger(), "Trajectory %d is removed.", traj_idx);
+        }
+        // the laps of the active trajectory stay in its frame until it is switched away from
+        std::shared_lock<std::shared_mutex> traj_lock(traj_mutex_);
+        if (traj_idx != traj_idx_) {
+          update_partition_frame(traj_idx, previous, traj);
+        }
+      });
+  }
 
   // initialize the parameter callback
   callback_handle_ = add_on_set_parameters_callback(
     std::bind(&RacingMPCNode::on_set_parameters, this, std::placeholders::_1));
 
   if (config_->step_mode == RacingMPCStepMode::CONTINUOUS) {
-    // initialize the timers
-    step_timer_ = this->create_wall_timer(
-      std::chrono::duration<double>(dt_), std::bind(&RacingMPCNode::on_step_timer, this));
+    // step at absolute deadlines, optionally phase-locked to the vehicle state messages
+    lmpc::utils::DeadlineSchedulerConfig scheduler_config;
+    scheduler_config.period = dt_;
+    const auto overrun_policy = utils::declare_parameter<std::string>(
+      this, "racing_mpc_node.scheduler.overrun_policy");
+    if (overrun_policy == "skip") {
+      scheduler_config.overrun_policy = lmpc::utils::OverrunPolicy::SKIP;
+    } else if (overrun_policy == "catch_up") {
+      scheduler_config.overrun_policy = lmpc::utils::OverrunPolicy::CATCH_UP;
+    } else {
+      throw std::invalid_argument("Invalid scheduler overrun policy: " + overrun_policy);
+    }
+    if (utils::declare_parameter<bool>(this, "racing_mpc_node.scheduler.phase_lock")) {
+      scheduler_config.phase_offset =
+        utils::declare_parameter<double>(this, "racing_mpc_node.scheduler.phase_offset");
+      scheduler_config.phase_gain =
+        utils::declare_parameter<double>(this, "racing_mpc_node.scheduler.phase_gain");
+    }
+    step_scheduler_ = std::make_unique<lmpc::utils::DeadlineScheduler>(scheduler_config);
+  }
+
+  if (heatmap_enabled_) {
+    // publish on a separate callback group so that reading the bins never waits for a solve
+    heatmap_callback_group_ = this->create_callback_group(
+      rclcpp::CallbackGroupType::MutuallyExclusive);
+    heatmap_timer_ = this->create_wall_timer(
+      std::chrono::duration<double>(
+        utils::declare_parameter<double>(this, "racing_mpc_node.heatmap.publish_period")),
+      std::bind(&RacingMPCNode::on_heatmap_timer, this), heatmap_callback_group_);
+  }
+
+  if (planner_enabled_) {
+    planner_running_ = true;
+    planner_thread_ = std::thread(&RacingMPCNode::planner_loop, this);
+  }
+
+  // the scheduler steps on its own thread, so it starts once the node is fully constructed
+  if (step_scheduler_) {
+    step_scheduler_->start(
+      [this]() {
+        if (rclcpp::ok()) {
+          on_step_timer();
+        }
+      });
+  }
+}
+
+RacingMPCNode::~RacingMPCNode()
+{
+  tracks_->set_update_callback(nullptr);
+  mpc_->get_safe_set_manager().set_error_callback(nullptr);
+  if (step_scheduler_) {
+    step_scheduler_->stop();
+  }
+  if (planner_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(planner_mutex_);
+      planner_running_ = false;
+    }
+    planner_cv_.notify_all();
+    planner_thread_.join();
   }
 }
 
@@ -125,6 +376,8 @@ void RacingMPCNode::on_new_state(const mpclab_msgs::msg::VehicleStateMsg::Shared
   lock.unlock();
   if (config_->step_mode == RacingMPCStepMode::STEP) {
     on_step_timer();
+  } else if (step_scheduler_) {
+    step_scheduler_->notify_arrival();
   }
 }
 
@@ -153,10 +406,9 @@ void RacingMPCNode::on_step_timer()
   using casadi::Slice;
   static bool jitted = !config_->jit;  // if JIT is done
 
-  lmpc_msgs::msg::MPCTelemetry telemetry_msg;
-
+  const auto step_start_time = utils::trace_clock();
   std::unique_lock<std::shared_mutex> traj_lock(traj_mutex_);
-  telemetry_msg.trajectory_index = traj_idx_;
+  telemetry_msg_.trajectory_index = traj_idx_;
   // return if no state message is received
   std::shared_lock<std::shared_mutex> state_msg_lock(state_msg_mutex_);
   if (!vehicle_state_msg_) {
@@ -166,48 +418,64 @@ void RacingMPCNode::on_step_timer()
     state_msg_lock.unlock();
     return;
   }
-  const auto & p = vehicle_state_msg_->p;
+  // the pose is filled in by the frenet projection below
   const auto & v = vehicle_state_msg_->v;
   const auto & w = vehicle_state_msg_->w;
-  auto x_ic_base = DM{
-    p.s, p.x_tran, p.e_psi, v.v_long, v.v_tran, w.w_psi
-  };
+  auto & x_ic_base = from_base_state_eval_->input("x").nonzeros();
+  x_ic_base[XIndex::VX] = v.v_long;
+  x_ic_base[XIndex::VY] = v.v_tran;
+  x_ic_base[XIndex::VYAW] = w.w_psi;
   const Pose2D current_global_pose{{vehicle_state_msg_->x.x, vehicle_state_msg_->x.y},
     vehicle_state_msg_->e.psi};
+  // the sample time of the state identifies it in the latency trace
+  const auto state_source_time = vehicle_state_msg_->timing.source_time;
   state_msg_lock.unlock();
 
   const auto mpc_solve_start = std::chrono::system_clock::now();
+  start_phase();
 
   FrenetPose2D current_frenet_pose;
   track_->global_to_frenet(current_global_pose, current_frenet_pose);
-  x_ic_base(XIndex::PX) = current_frenet_pose.position.s;
-  x_ic_base(XIndex::PY) = current_frenet_pose.position.t;
-  x_ic_base(XIndex::YAW) = current_frenet_pose.yaw;
+  x_ic_base[XIndex::PX] = current_frenet_pose.position.s;
+  x_ic_base[XIndex::PY] = current_frenet_pose.position.t;
+  x_ic_base[XIndex::YAW] = current_frenet_pose.yaw;
 
   static size_t profile_step_count = 0;
   const auto N = static_cast<casadi_int>(mpc_->get_config().N);
 
   // prepare the mpc inputs
-  const auto u_ic_base = casadi::DM {
-    vehicle_actuation_msg_->u_a > 0.0 ? vehicle_actuation_msg_->u_a : 0.0,
-    vehicle_actuation_msg_->u_a < 0.0 ? vehicle_actuation_msg_->u_a : 0.0,
-    vehicle_actuation_msg_->u_steer
-  };
-  const auto x_ic =
-    model_->from_base_state()(casadi::DMDict{{"x", x_ic_base}, {"u", u_ic_base}}).at("x_out");
-  const auto u_ic =
-    model_->from_base_control()(
-    casadi::DMDict{{"x", x_ic_base},
-      {"u", u_ic_base}}).at("u_out");
+  auto & u_ic_base = from_base_state_eval_->input("u").nonzeros();
+  u_ic_base[UIndex::FD] = vehicle_actuation_msg_->u_a > 0.0 ? vehicle_actuation_msg_->u_a : 0.0;
+  u_ic_base[UIndex::FB] = vehicle_actuation_msg_->u_a < 0.0 ? vehicle_actuation_msg_->u_a : 0.0;
+  u_ic_base[UIndex::STEER] = vehicle_actuation_msg_->u_steer;
+  from_base_state_eval_->evaluate();
+  from_base_control_eval_->input("x") = from_base_state_eval_->input("x");
+  from_base_control_eval_->input("u") = from_base_state_eval_->input("u");
+  from_base_control_eval_->evaluate();
+  const auto & x_ic = from_base_state_eval_->output("x_out");
+  const auto & u_ic = from_base_control_eval_->output("u_out");
   // current input
-  sol_in_["u_ic"] = u_ic;
+  sol_in_.at("u_ic") = u_ic;
   // current time
-  sol_in_["t_ic"] = vehicle_state_msg_->t;
+  *sol_in_.at("t_ic").ptr() = vehicle_state_msg_->t;
 
   // std::cout << "x_ic: " << x_ic << std::endl;
+  end_phase(STATE_PHASE);
+
+  // a hot standby follows the primary instead of controlling the vehicle
+  if (replication_role_ == RacingMPCReplicationRole::STANDBY && !standby_active_ &&
+    !follow_primary())
+  {
+    return;
+  }
+  // the standby builds its solver with an unpublished solve, not during a takeover
+  const bool standby_warm_up =
+    replication_role_ == RacingMPCReplicationRole::STANDBY && !standby_warmed_up_;
+  // the warm start mirrored from the primary replaces the full dynamics solve
+  const bool bootstrapped = mpc_full_->solved() || warm_start_mirrored_;
 
   // if the mpc is not solved, pass the initial guess
-  if (!mpc_full_->solved()) {
+  if (!bootstrapped) {
     last_x_ = DM::zeros(mpc_->get_model().nx(), N);
     last_u_ = DM::zeros(mpc_->get_model().nu(), N - 1) + 1e-9;
     last_du_ = DM::zeros(mpc_->get_model().nu(), N - 1);
@@ -236,17 +504,25 @@ void RacingMPCNode::on_step_timer()
   } else {
     // prepare the next reference
     if (config_->step_mode == RacingMPCStepMode::CONTINUOUS) {
-      sol_in_["x_ic"] = discrete_dynamics_(casadi::DMVector{x_ic, last_u_(Slice(), 0)})[0];
+      dynamics_eval_->input(0) = x_ic;
+      utils::copy_column(last_u_, 0, dynamics_eval_->input(1));
+      dynamics_eval_->evaluate();
+      sol_in_.at("x_ic") = dynamics_eval_->output(0);
     } else if (config_->step_mode == RacingMPCStepMode::STEP) {
-      sol_in_["x_ic"] = x_ic;
+      sol_in_.at("x_ic") = x_ic;
     } else {
       throw std::runtime_error("Unknown RacingMPCStepMode");
     }
-    last_x_ = DM::horzcat({last_x_(Slice(), Slice(1, N)), DM::zeros(model_->nx(), 1)});
-    last_u_ = DM::horzcat({last_u_(Slice(), Slice(1, N - 1)), last_u_(Slice(), Slice(N - 2))});
-    last_du_ = DM::horzcat({last_du_(Slice(), Slice(1, N - 1)), DM::zeros(model_->nu(), 1)});
-    last_x_(Slice(), -1) =
-      discrete_dynamics_(casadi::DMVector{last_x_(Slice(), -2), last_u_(Slice(), -1)})[0];
+    // shift the previous solution in place. the last control is repeated
+    // and the last state is propagated with it.
+    utils::shift_columns(last_x_);
+    utils::shift_columns(last_u_);
+    utils::shift_columns(last_du_);
+    std::fill_n(last_du_.ptr() + (N - 2) * model_->nu(), model_->nu(), 0.0);
+    utils::copy_column(last_x_, N - 2, dynamics_eval_->input(0));
+    utils::copy_column(last_u_, N - 2, dynamics_eval_->input(1));
+    dynamics_eval_->evaluate();
+    utils::copy_to_column(dynamics_eval_->output(0), N - 1, last_x_);
     sol_in_["X_ref"] = last_x_;
     sol_in_["U_ref"] = last_u_;
     sol_in_["X_optm_ref"] = last_x_;
@@ -257,46 +533,41 @@ void RacingMPCNode::on_step_timer()
     }
   }
 
+  // hand the latest state to the planner
+  if (planner_enabled_) {
+    auto & request = planner_request_buffer_.back();
+    request.traj_idx = traj_idx_;
+    request.track = track_;
+    request.x_ic = x_ic;
+    request.u_ic = u_ic;
+    request.t_ic = static_cast<double>(sol_in_.at("t_ic"));
+    planner_request_buffer_.publish();
+  }
+
   // prepare the reference trajectory
-  const auto abscissa = last_x_(XIndex::PX, Slice());
-  const auto left_ref = track_->left_boundary_interpolation_function()(abscissa)[0];
-  const auto right_ref = track_->right_boundary_interpolation_function()(abscissa)[0];
-  const auto curvature_ref = track_->curvature_interpolation_function()(abscissa)[0];
-  auto vel_ref = track_->velocity_interpolation_function()(abscissa)[0];
-  // cap the velocity by the speed limit
-  std::shared_lock<std::shared_mutex> speed_limit_lock(speed_limit_mutex_);
-  std::shared_lock<std::shared_mutex> speed_scale_lock(speed_scale_mutex_);
-  for (int i = 0; i < config_->N; i++) {
-    // clip the velocity reference within +- 20m/s of current speed
-    const auto current_speed = static_cast<double>(last_x_(XIndex::VX, i));
-    const auto ref_speed = static_cast<double>(vel_ref(i)) * speed_scale_;
-    const auto speed_limit_clipped = std::clamp(
-      this->speed_limit_, current_speed - config_->max_vel_ref_diff,
-      current_speed + config_->max_vel_ref_diff);
-    // valid TTL has positive velocity profile.
-    // if the velocity profile is negative, set it to the speed limit
-    if (ref_speed > 0.0) {
-      const auto ref_speed_clipped = std::clamp(
-        ref_speed, current_speed - config_->max_vel_ref_diff,
-        current_speed + config_->max_vel_ref_diff);
-      vel_ref(i) = std::min(ref_speed_clipped, speed_limit_clipped);
-    } else {
-      vel_ref(i) = speed_limit_clipped;
-    }
+  auto & abscissa = reference_eval_->input("s");
+  for (casadi_int i = 0; i < N; i++) {
+    abscissa.nonzeros()[i] = last_x_.nonzeros()[i * model_->nx() + XIndex::PX];
   }
-  speed_limit_lock.unlock();
-  speed_scale_lock.unlock();
-  sol_in_["bound_left"] = left_ref;
-  sol_in_["bound_right"] = right_ref;
-  sol_in_["curvatures"] = curvature_ref;
-  sol_in_["vel_ref"] = vel_ref;
+  reference_eval_->evaluate();
+  sol_in_["bound_left"] = reference_eval_->output("bound_left");
+  sol_in_["bound_right"] = reference_eval_->output("bound_right");
+  sol_in_["curvatures"] = reference_eval_->output("curvatures");
+  auto & vel_ref = sol_in_.at("vel_ref");
+  auto & lateral_ref = sol_in_.at("lateral_ref");
+  vel_ref = reference_eval_->output("vel_ref");
+  std::fill(lateral_ref.nonzeros().begin(), lateral_ref.nonzeros().end(), 0.0);
+  // follow the planner if a fresh plan is available, otherwise the racing line.
+  // the plan is already scaled and capped by the speed limit.
+  const bool use_plan = planner_enabled_ && apply_plan(abscissa, vel_ref, lateral_ref);
+  clip_velocity_reference(vel_ref, last_x_, !use_plan);
 
   // solve the mpc
   auto sol_out = casadi::DMDict{};
   auto stats = casadi::Dict{};
 
   // solve the first time with full dynamics
-  if (!mpc_full_->solved()) {
+  if (!bootstrapped) {
     RCLCPP_INFO(this->get_logger(), "Get initial solution with full dynamics.");
     mpc_full_->solve(sol_in_, sol_out, stats);
     last_x_ = sol_out["X_optm"];
@@ -314,58 +585,150 @@ void RacingMPCNode::on_step_timer()
   }
 
   // const auto mpc_start = std::chrono::high_resolution_clock::now();
+  double jit_time = 0.0;  // ms
   if (!jitted) {
     RCLCPP_INFO(this->get_logger(), "Using the first solve to execute just-in-time compilation.");
   }
-  mpc_->solve(sol_in_, sol_out, stats);
+  end_phase(REFERENCE_PHASE);
 
-  if (sol_out.count("X_optm")) {
-    last_x_ = sol_out["X_optm"];
-    last_u_ = sol_out["U_optm"];
-    last_du_ = sol_out["dU_optm"];
-    telemetry_msg.solved = true;
+  // in event-triggered mode, keep the shifted plan if it is still valid
+  bool skip_solve = false;
+  if (event_trigger_enabled_ && jitted && !standby_warm_up) {
+    double tracking_error = 0.0;
+    skip_solve = plan_still_valid(sol_in_.at("x_ic"), tracking_error);
+    tracking_error_profiler_->add_cycle_stats(tracking_error);
+    skip_profiler_->add_cycle_stats(skip_solve ? 1.0 : 0.0);
+  }
+
+  if (skip_solve) {
+    skip_count_++;
+    mpc_->record(sol_in_);
+    telemetry_msg_.solved = true;
   } else {
-    RCLCPP_ERROR_THROTTLE(
-      this->get_logger(), *this->get_clock(), 1000,
-      "MPC could not be solved.");
-    telemetry_msg.solved = false;
+    const auto solve_start = std::chrono::steady_clock::now();
+    mpc_->solve(sol_in_, sol_out, stats);
+    const std::chrono::duration<double, std::milli> solve_time =
+      std::chrono::steady_clock::now() - solve_start;
+    skip_count_ = 0;
+    last_solve_traj_idx_ = traj_idx_;
+    // the first solve also builds and compiles the solver, before the solver's own timing starts
+    if (!jitted) {
+      jit_time = solve_time.count() -
+        (stats.count("t_wall_total") ? stats.at("t_wall_total").to_double() * 1e3 : 0.0);
+    }
+
+    // the first successful solve builds the solver, whose sparsity is looked up without any
+    // expansion, with or without JIT
+    if (!problem_size_reported_ && sol_out.count("X_optm") &&
+      mpc_->solver_size(*problem_size_))
+    {
+      problem_size_reported_ = true;
+      RCLCPP_INFO(
+        this->get_logger(),
+        "MPC problem: %lld variables, %lld constraints, %lld parameters, jacobian nnz %lld, "
+        "hessian nnz %lld, %lld MX nodes, %lld SX nodes, JIT %zu bytes.",
+        problem_size_->num_variables, problem_size_->num_constraints,
+        problem_size_->num_parameters, problem_size_->jacobian_nnz, problem_size_->hessian_nnz,
+        problem_size_->num_mx_nodes, problem_size_->num_sx_nodes, problem_size_->jit_size);
+    }
+    // the JIT solve is not representative
+    if (jitted) {
+      RacingMPC::function_times(stats, function_times_);
+      for (const auto & [name, time] : function_times_) {
+        auto & profiler = function_time_profilers_[name];
+        if (!profiler) {
+          profiler = std::make_unique<lmpc::utils::CycleProfiler<double>>(10);
+        }
+        profiler->add_cycle_stats(time);
+      }
+    }
+    last_solve_vel_ref_ = sol_in_.at("vel_ref");
+    last_solve_lateral_ref_ = sol_in_.at("lateral_ref");
+
+    // the JIT solve is not representative
+    if (heatmap_ && jitted) {
+      const auto s = sol_in_.at("x_ic").nonzeros()[XIndex::PX];
+      const bool failed = !sol_out.count("X_optm") ||
+        (stats.count("success") && !stats.at("success").as_bool());
+      // slack below 1 mm is numerical noise of the interior point method
+      const bool slack_active = sol_out.count("boundary_slack_optm") &&
+        static_cast<double>(sol_out.at("boundary_slack_optm")) > 1e-3;
+      heatmap_->add(
+        s, track_->region(s), solve_time.count(),
+        stats.count("iter_count") ? static_cast<double>(stats.at("iter_count")) : 0.0,
+        slack_active, failed);
+    }
+
+    if (sol_out.count("X_optm")) {
+      last_x_ = sol_out["X_optm"];
+      last_u_ = sol_out["U_optm"];
+      last_du_ = sol_out["dU_optm"];
+      telemetry_msg_.solved = true;
+    } else {
+      RCLCPP_ERROR_THROTTLE(
+        this->get_logger(), *this->get_clock(), 1000,
+        "MPC could not be solved.");
+      telemetry_msg_.solved = false;
+      if (approx_mpc_) {
+        auto approx_out = casadi::DMDict{};
+        auto approx_stats = casadi::Dict{};
+        approx_mpc_->solve(sol_in_, approx_out, approx_stats);
+        if (approx_stats.at("success").as_bool()) {
+          last_x_ = approx_out["X_optm"];
+          last_u_ = approx_out["U_optm"];
+          last_du_ = approx_out["dU_optm"];
+          RCLCPP_WARN_THROTTLE(
+            this->get_logger(), *this->get_clock(), 1000,
+            "Using the approximate MPC.");
+        }
+      }
+    }
   }
-  telemetry_msg.state = last_x_.get_elements();
-  telemetry_msg.control = last_u_.get_elements();
+  end_phase(SOLVE_PHASE);
+  telemetry_msg_.state.assign(last_x_.nonzeros().begin(), last_x_.nonzeros().end());
+  telemetry_msg_.control.assign(last_u_.nonzeros().begin(), last_u_.nonzeros().end());
 
+  if (standby_warm_up) {
+    standby_warmed_up_ = true;
+    if (jitted) {
+      RCLCPP_INFO(this->get_logger(), "The standby solver is built. Discarding the first solve...");
+      return;
+    }
+  }
   if (!jitted) {
     // on first solve, exit since JIT will take a long time
     jitted = true;
-    RCLCPP_INFO(this->get_logger(), "JIT is done. Discarding the first solve...");
+    RCLCPP_INFO(
+      this->get_logger(),
+      "JIT is done. Building and compiling the solver took %.1f s. Discarding the first solve...",
+      jit_time * 1e-3);
     return;
   }
 
-  auto last_x_global = last_x_;
-  last_x_global(Slice(XIndex::PX, XIndex::YAW + 1), Slice()) =
-    f2g_(last_x_(Slice(XIndex::PX, XIndex::YAW + 1), Slice()))[0];
-
-  auto x_ref_global = sol_in_.at("X_optm_ref");
-  x_ref_global(Slice(XIndex::PX, XIndex::YAW + 1), Slice()) =
-    f2g_(sol_in_.at("X_optm_ref")(Slice(XIndex::PX, XIndex::YAW + 1), Slice()))[0];
+  // convert the frenet poses {s, t, xi} of the solution and the reference to global poses
+  auto convert_poses = [this, N](const DM & x, utils::CasadiEvaluator & f2g)
+    -> const std::vector<double> & {
+      for (casadi_int i = 0; i < N; i++) {
+        std::copy_n(
+          x.ptr() + i * model_->nx() + XIndex::PX, 3, f2g.input(0).ptr() + 3 * i);
+      }
+      f2g.evaluate();
+      return f2g.output(0).nonzeros();
+    };
+  const auto & last_x_global = convert_poses(last_x_, *f2g_eval_);
+  const auto & x_ref_global = convert_poses(sol_in_.at("X_optm_ref"), *ref_f2g_eval_);
 
   const auto mpc_solve_duration = std::chrono::system_clock::now() - mpc_solve_start;
   const auto mpc_solve_duration_ms = mpc_solve_duration.count() * 1e-6;
   profiler_->add_cycle_stats(mpc_solve_duration_ms);
-  telemetry_msg.solve_time = mpc_solve_duration_ms;
+  telemetry_msg_.solve_time = mpc_solve_duration_ms;
   if (stats.count("iter_count")) {
     profiler_iter_count_->add_cycle_stats(static_cast<double>(stats.at("iter_count")));
   }
   profile_step_count++;
 
   traj_lock.unlock();
-  // sleep if the execution time is less than dt
-  if (config_->step_mode == RacingMPCStepMode::CONTINUOUS) {
-    if (mpc_solve_duration < std::chrono::duration<double>(dt_)) {
-      rclcpp::sleep_for(
-        std::chrono::duration_cast<std::chrono::nanoseconds>(
-          std::chrono::duration<double>(dt_) - mpc_solve_duration));
-    }
-  }
+  start_phase();
 
   // record the MPC publish time
   const auto now = this->now();
@@ -378,16 +741,107 @@ void RacingMPCNode::on_step_timer()
     diagnostics_msg.status.push_back(
       profiler_iter_count_->profile().to_diagnostic_status(
         "Racing MPC Iteration Count", "Number of Solver Iterations", 50));
+    if (perf_counters_enabled_) {
+      static const std::array<const char *, NUM_CYCLE_PHASES> phase_names {
+        "State", "Reference", "Solve", "Publish"};
+      for (size_t i = 0; i < NUM_CYCLE_PHASES; i++) {
+        diagnostics_msg.status.push_back(
+          phase_perf_profilers_[i]->to_diagnostic_status(
+            std::string("Racing MPC Perf Counters: ") + phase_names[i]));
+      }
+      diagnostics_msg.status.push_back(
+        ss_perf_profiler_->to_diagnostic_status("Racing MPC Perf Counters: Safe Set Query"));
+    }
+    const auto cache = mpc_->get_solution_cache();
+    if (cache) {
+      auto & status = diagnostics_msg.status.emplace_back();
+      status.name = "Racing MPC Warm Start Cache";
+      status.message = "Hit Rate and Mean Solver Iterations";
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+      auto add_value = [&status](const std::string & key, const double & value) {
+          auto & key_value = status.values.emplace_back();
+          key_value.key = key;
+          key_value.value = std::to_string(value);
+        };
+      add_value("hit_rate", cache->hit_rate());
+      add_value("mean_iter_hit", cache->mean_iterations(true));
+      add_value("mean_iter_miss", cache->mean_iterations(false));
+      add_value("iter_saving", cache->mean_iterations(false) - cache->mean_iterations(true));
+    }
+    if (problem_size_) {
+      auto & status = diagnostics_msg.status.emplace_back();
+      status.name = "Racing MPC Problem Size";
+      status.message = "Dimensions, Nonzeros, Graph Nodes and JIT Size (bytes)";
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+      auto add_value = [&status](const std::string & key, const int64_t & value) {
+          auto & key_value = status.values.emplace_back();
+          key_value.key = key;
+          key_value.value = std::to_string(value);
+        };
+      add_value("variables", problem_size_->num_variables);
+      add_value("constraints", problem_size_->num_constraints);
+      add_value("parameters", problem_size_->num_parameters);
+      add_value("jacobian_nnz", problem_size_->jacobian_nnz);
+      add_value("hessian_nnz", problem_size_->hessian_nnz);
+      add_value("mx_nodes", problem_size_->num_mx_nodes);
+      add_value("sx_nodes", problem_size_->num_sx_nodes);
+      add_value("jit_size", static_cast<int64_t>(problem_size_->jit_size));
+    }
+    if (!function_time_profilers_.empty()) {
+      auto & status = diagnostics_msg.status.emplace_back();
+      status.name = "Racing MPC Function Time";
+      status.message = "Mean Wall Time per Solve (ms)";
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+      for (const auto & [name, profiler] : function_time_profilers_) {
+        auto & key_value = status.values.emplace_back();
+        key_value.key = name;
+        key_value.value = std::to_string(profiler->profile().mean);
+      }
+    }
+    if (event_trigger_enabled_) {
+      diagnostics_msg.status.push_back(
+        skip_profiler_->profile().to_diagnostic_status(
+          "Racing MPC Skip Rate", "Fraction of Skipped Solves", 1.0));
+      diagnostics_msg.status.push_back(
+        tracking_error_profiler_->profile().to_diagnostic_status(
+          "Racing MPC Tracking Error", "Position Deviation from Plan (m)",
+          static_cast<double>(event_state_threshold_(XIndex::PY))));
+    }
+    if (planner_enabled_) {
+      diagnostics_msg.status.push_back(
+        planner_profiler_->profile().to_diagnostic_status(
+          "Racing MPC Planner Solve Time", "(ms)", 1e3 / planner_rate_));
+    }
+    if (step_scheduler_) {
+      const auto scheduler_stats = step_scheduler_->stats();
+      auto & status = diagnostics_msg.status.emplace_back();
+      status.name = "Racing MPC Scheduler";
+      status.message = "Deadline Latency, Period Jitter and State Age (ms)";
+      status.level = scheduler_stats.num_overruns > 0 ?
+        diagnostic_msgs::msg::DiagnosticStatus::WARN : diagnostic_msgs::msg::DiagnosticStatus::OK;
+      auto add_value = [&status](const std::string & key, const double & value) {
+          auto & key_value = status.values.emplace_back();
+          key_value.key = key;
+          key_value.value = std::to_string(value);
+        };
+      add_value("overruns", static_cast<double>(scheduler_stats.num_overruns));
+      add_value("skipped", static_cast<double>(scheduler_stats.num_skipped));
+      add_value("mean_latency", scheduler_stats.mean_latency);
+      add_value("max_latency", scheduler_stats.max_latency);
+      add_value("period_jitter_rms", scheduler_stats.period_jitter_rms);
+      add_value("max_period_jitter", scheduler_stats.max_period_jitter);
+      add_value("mean_state_age", scheduler_stats.mean_arrival_age);
+      step_scheduler_->reset_stats();
+    }
     diagnostics_msg.header.stamp = now;
     diagnostics_pub_->publish(diagnostics_msg);
     profile_step_count = 0;
   }
   // publish the actuation message
-  const auto last_u_base =
-    model_->to_base_control()(
-    casadi::DMDict{{"x", last_x_(Slice(), delay_step_)},
-      {"u", last_u_(Slice(), delay_step_)}}).at("u_out");
-  const auto u_vec = last_u_base.get_elements();
+  utils::copy_column(last_x_, delay_step_, to_base_control_eval_->input("x"));
+  utils::copy_column(last_u_, delay_step_, to_base_control_eval_->input("u"));
+  to_base_control_eval_->evaluate();
+  const auto & u_vec = to_base_control_eval_->output("u_out").nonzeros();
   // std::cout << "x: " << last_x_(Slice(), 0) << std::endl;
   // std::cout << "u: " << last_u_(Slice(), 0) << std::endl;
   // std::cout << "xip1: "
@@ -400,80 +854,72 @@ void RacingMPCNode::on_step_timer()
     vehicle_actuation_msg_->u_a = u_vec[UIndex::FB];
   }
   vehicle_actuation_msg_->u_steer = u_vec[UIndex::STEER];
+  auto & timing = vehicle_actuation_msg_->timing;
+  timing.source_time = state_source_time;
+  timing.step_start_time = step_start_time;
+  timing.publish_time = utils::trace_clock();
+  timing.step_execution_time = timing.publish_time - step_start_time;
   vehicle_actuation_pub_->publish(*vehicle_actuation_msg_);
 
   // publish the visualization message
-  auto mpc_vis_msg = nav_msgs::msg::Path();
-  mpc_vis_msg.header.stamp = now;
-  mpc_vis_msg.header.frame_id = "map";
-  mpc_vis_msg.poses.reserve(N);
+  mpc_vis_msg_.header.stamp = now;
   for (int i = 0; i < N; i++) {
-    auto & pose = mpc_vis_msg.poses.emplace_back();
+    auto & pose = mpc_vis_msg_.poses[i];
     pose.header.stamp = now;
-    pose.header.frame_id = "map";
-    pose.pose.position.x = x_ref_global(XIndex::PX, i).get_elements()[0];
-    pose.pose.position.y = x_ref_global(XIndex::PY, i).get_elements()[0];
+    pose.pose.position.x = x_ref_global[3 * i];
+    pose.pose.position.y = x_ref_global[3 * i + 1];
     pose.pose.position.z = 0.0;
     pose.pose.orientation = tf2::toMsg(
-      utils::TransformHelper::quaternion_from_heading(
-        x_ref_global(XIndex::YAW, i).get_elements()[0]));
+      utils::TransformHelper::quaternion_from_heading(x_ref_global[3 * i + 2]));
   }
-  mpc_vis_pub_->publish(mpc_vis_msg);
+  mpc_vis_pub_->publish(mpc_vis_msg_);
 
   // publish the ref visualization message
-  auto ref_vis_msg = nav_msgs::msg::Path();
-  ref_vis_msg.header.stamp = now;
-  ref_vis_msg.header.frame_id = "map";
-  ref_vis_msg.poses.reserve(N);
+  ref_vis_msg_.header.stamp = now;
   for (int i = 0; i < N; i++) {
-    auto & pose = ref_vis_msg.poses.emplace_back();
+    auto & pose = ref_vis_msg_.poses[i];
     pose.header.stamp = now;
-    pose.header.frame_id = "map";
-    pose.pose.position.x = last_x_global(XIndex::PX, i).get_elements()[0];
-    pose.pose.position.y = last_x_global(XIndex::PY, i).get_elements()[0];
+    pose.pose.position.x = last_x_global[3 * i];
+    pose.pose.position.y = last_x_global[3 * i + 1];
     pose.pose.position.z = 0.0;
     pose.pose.orientation = tf2::toMsg(
-      utils::TransformHelper::quaternion_from_heading(
-        last_x_global(XIndex::YAW, i).get_elements()[0]));
+      utils::TransformHelper::quaternion_from_heading(last_x_global[3 * i + 2]));
   }
-  ref_vis_pub_->publish(ref_vis_msg);
+  ref_vis_pub_->publish(ref_vis_msg_);
 
   // publish the safe set visualization message
   if (sol_out.count("ss_x")) {
     const auto & ss_X = sol_out["ss_x"];
-    const auto & ss_J = sol_out["ss_j"];
-    auto ss_vis_msg = visualization_msgs::msg::MarkerArray();
-    auto & marker = ss_vis_msg.markers.emplace_back();
+    auto & marker = ss_vis_msg_.markers.front();
     marker.header.stamp = now;
-    marker.header.frame_id = "map";
-    marker.ns = "safe_set";
-    marker.id = 0;
-    marker.type = visualization_msgs::msg::Marker::SPHERE_LIST;
-    const auto scale = model_->get_base_config().chassis_config->wheel_base / 10.0;
-    marker.scale.x = scale;
-    marker.scale.y = scale;
-    marker.scale.z = scale;
-    marker.action = visualization_msgs::msg::Marker::MODIFY;
-    marker.points.reserve(ss_X.size2());
+    marker.points.resize(ss_X.size2());
+    marker.colors.resize(ss_X.size2());
     for (casadi_int i = 0; i < ss_X.size2(); i++) {
-      const auto ss_x_frenet = ss_X(Slice(XIndex::PX, XIndex::YAW + 1), i);
-      const auto ss_x_global = track_->frenet_to_global_function()(ss_x_frenet)[0].get_elements();
-      auto & point = marker.points.emplace_back();
+      std::copy_n(
+        ss_X.ptr() + i * ss_X.size1() + XIndex::PX, 3, ss_f2g_eval_->input(0).ptr());
+      ss_f2g_eval_->evaluate();
+      const auto & ss_x_global = ss_f2g_eval_->output(0).nonzeros();
+      auto & point = marker.points[i];
       point.x = ss_x_global[0];
       point.y = ss_x_global[1];
       point.z = 0.0;
-      auto & color = marker.colors.emplace_back();
+      auto & color = marker.colors[i];
       color.r = 0.0;
       color.g = 1.0;
       color.b = 0.0;
       color.a = 1.0;
     }
-    ss_vis_pub_->publish(ss_vis_msg);
+    ss_vis_pub_->publish(ss_vis_msg_);
   }
 
   // publish the telemetry message
-  telemetry_msg.header.stamp = now;
-  mpc_telemetry_pub_->publish(telemetry_msg);
+  telemetry_msg_.header.stamp = now;
+  mpc_telemetry_pub_->publish(telemetry_msg_);
+  end_phase(PUBLISH_PHASE);
+
+  if (replication_role_ == RacingMPCReplicationRole::PRIMARY) {
+    write_mirrors();
+  }
 }
 
 rcl_interfaces::msg::SetParametersResult RacingMPCNode::on_set_parameters(
@@ -512,62 +958,115 @@ void RacingMPCNode::change_trajectory(const int & traj_idx)
     return;
   }
 
-  std::unique_lock<std::shared_mutex> traj_lock(traj_mutex_);
-  auto & old_traj = *track_;
   auto new_traj = tracks_->get_trajectory(traj_idx);
+  if (!new_traj) {
+    return;
+  }
+  // build the functions of the new trajectory before the control loop is stopped
+  std::unique_lock<std::mutex> construction_lock(utils::casadi_construction_mutex());
+  auto new_f2g = new_traj->frenet_to_global_function().map(mpc_->get_config().N);
+  auto new_discrete_dynamics = build_discrete_dynamics(*new_traj, dt_);
+  construction_lock.unlock();
 
-  if (new_traj) {
-    auto convert_frame = [&](const FrenetPose2D & old_frenet_pose) {
-        Pose2D global_pose;
-        old_traj.frenet_to_global(old_frenet_pose, global_pose);
-        FrenetPose2D new_frenet_pose;
-        new_traj->global_to_frenet(global_pose, new_frenet_pose);
-        return new_frenet_pose;
-      };
-    if (vehicle_state_msg_) {
-      std::unique_lock<std::shared_mutex> state_msg_lock(state_msg_mutex_);
-      auto & x = vehicle_state_msg_->x;
-      auto & e = vehicle_state_msg_->e;
-      // convert current pose to global then to new coordinate system
-      const Pose2D old_global_pose {{x.x, x.y}, e.psi};
+  std::unique_lock<std::shared_mutex> traj_lock(traj_mutex_);
+  auto & old_traj = *track_;
+  auto convert_frame = [&](const FrenetPose2D & old_frenet_pose) {
+      Pose2D global_pose;
+      old_traj.frenet_to_global(old_frenet_pose, global_pose);
       FrenetPose2D new_frenet_pose;
-      new_traj->global_to_frenet(old_global_pose, new_frenet_pose);
-      vehicle_state_msg_->p.s = new_frenet_pose.position.s;
-      vehicle_state_msg_->p.x_tran = new_frenet_pose.position.t;
-      vehicle_state_msg_->p.e_psi = new_frenet_pose.yaw;
-      state_msg_lock.unlock();
-
-      // convert previous solution to new coordinate system
-      if (mpc_->solved()) {
-        for (int i = 0; i < config_->N; i++) {
-          const auto xi = last_x_(casadi::Slice(), i).get_elements();
-          const FrenetPose2D old_frenet_pose {{xi[XIndex::PX], xi[XIndex::PY]}, xi[XIndex::YAW]};
-          const FrenetPose2D new_frenet_pose = convert_frame(old_frenet_pose);
-          last_x_(XIndex::PX, i) = new_frenet_pose.position.s;
-          last_x_(XIndex::PY, i) = new_frenet_pose.position.t;
-          last_x_(XIndex::YAW, i) = new_frenet_pose.yaw;
-        }
+      new_traj->global_to_frenet(global_pose, new_frenet_pose);
+      return new_frenet_pose;
+    };
+  if (vehicle_state_msg_) {
+    std::unique_lock<std::shared_mutex> state_msg_lock(state_msg_mutex_);
+    auto & x = vehicle_state_msg_->x;
+    auto & e = vehicle_state_msg_->e;
+    // convert current pose to global then to new coordinate system
+    const Pose2D old_global_pose {{x.x, x.y}, e.psi};
+    FrenetPose2D new_frenet_pose;
+    new_traj->global_to_frenet(old_global_pose, new_frenet_pose);
+    vehicle_state_msg_->p.s = new_frenet_pose.position.s;
+    vehicle_state_msg_->p.x_tran = new_frenet_pose.position.t;
+    vehicle_state_msg_->p.e_psi = new_frenet_pose.yaw;
+    state_msg_lock.unlock();
+
+    // convert previous solution to new coordinate system
+    if (mpc_->solved()) {
+      for (int i = 0; i < config_->N; i++) {
+        const auto xi = last_x_(casadi::Slice(), i).get_elements();
+        const FrenetPose2D old_frenet_pose {{xi[XIndex::PX], xi[XIndex::PY]}, xi[XIndex::YAW]};
+        const FrenetPose2D new_frenet_pose = convert_frame(old_frenet_pose);
+        last_x_(XIndex::PX, i) = new_frenet_pose.position.s;
+        last_x_(XIndex::PY, i) = new_frenet_pose.position.t;
+        last_x_(XIndex::YAW, i) = new_frenet_pose.yaw;
       }
     }
-    track_ = new_traj;
-    f2g_ = track_->frenet_to_global_function().map(mpc_->get_config().N);
-    traj_idx_ = traj_idx;
-    vis_->change_trajectory(*track_);
-    sol_in_["total_length"] = track_->total_length();
-
-    // build discrete dynamics
-    const auto x_sym = casadi::MX::sym("x", model_->nx());
-    const auto u_sym = casadi::MX::sym("u", model_->nu());
-    const auto k = track_->curvature_interpolation_function()(x_sym(XIndex::PX))[0];
-    const auto xip1 = model_->discrete_dynamics()(
-      casadi::MXDict{{"x", x_sym}, {"u", u_sym}, {"k", k}, {"dt", dt_}}
-    ).at("xip1");
-    discrete_dynamics_ = casadi::Function("discrete_dynamics", {x_sym, u_sym}, {xip1});
+  }
+  // the previous laps are reprojected in the background, not on the control thread
+  mpc_->change_trajectory(traj_idx_, track_, traj_idx, new_traj);
+  // the file of the previous trajectory may have been replaced or removed while it was in use
+  const auto indices = tracks_->indices();
+  const bool loaded = std::find(indices.begin(), indices.end(), traj_idx_) != indices.end();
+  update_partition_frame(traj_idx_, track_, loaded ? tracks_->get_trajectory(traj_idx_) : nullptr);
+  track_ = new_traj;
+  f2g_ = new_f2g;
+  traj_idx_ = traj_idx;
+  vis_->change_trajectory(*track_);
+  sol_in_["total_length"] = track_->total_length();
 
-    RCLCPP_INFO(
-      this->get_logger(),
-      "Changed trajectory to %d.", traj_idx_);
+  discrete_dynamics_ = new_discrete_dynamics;
+  construction_lock.lock();
+  build_track_evaluators();
+  construction_lock.unlock();
+
+  if (heatmap_enabled_) {
+    switch_heatmap(traj_idx_);
+  }
+
+  RCLCPP_INFO(
+    this->get_logger(),
+    "Changed trajectory to %d.", traj_idx_);
+}
+
+void RacingMPCNode::switch_heatmap(const int & traj_idx)
+{
+  // keep the statistics of each trajectory in case the race switches back
+  auto & heatmap = heatmaps_[traj_idx];
+  if (!heatmap) {
+    heatmap = std::make_shared<SolveHeatmap>(
+      heatmap_bin_size_, track_->total_length(), track_->num_regions());
   }
+  std::lock_guard<std::mutex> lock(heatmap_mutex_);
+  heatmap_ = heatmap;
+  heatmap_traj_idx_ = traj_idx;
+}
+
+void RacingMPCNode::on_heatmap_timer()
+{
+  std::unique_lock<std::mutex> lock(heatmap_mutex_);
+  const auto heatmap = heatmap_;
+  const auto traj_idx = heatmap_traj_idx_;
+  lock.unlock();
+
+  auto to_msg = [](const std::vector<SolveHeatmapBin> & bins) {
+      std::vector<lmpc_msgs::msg::SolveHeatmapBin> msgs(bins.size());
+      for (size_t i = 0; i < bins.size(); i++) {
+        msgs[i].count = bins[i].count;
+        msgs[i].mean_solve_time = bins[i].mean_solve_time;
+        msgs[i].max_solve_time = bins[i].max_solve_time;
+        msgs[i].mean_iter_count = bins[i].mean_iter_count;
+        msgs[i].slack_active_rate = bins[i].slack_active_rate;
+        msgs[i].failure_rate = bins[i].failure_rate;
+      }
+      return msgs;
+    };
+  auto heatmap_msg = lmpc_msgs::msg::SolveHeatmap();
+  heatmap_msg.header.stamp = this->now();
+  heatmap_msg.trajectory_index = traj_idx;
+  heatmap_msg.bin_size = heatmap->bin_size();
+  heatmap_msg.abscissa_bins = to_msg(heatmap->abscissa_bins());
+  heatmap_msg.region_bins = to_msg(heatmap->region_bins());
+  solve_heatmap_pub_->publish(heatmap_msg);
 }
 
 void RacingMPCNode::set_speed_limit(const double & speed_limit)
@@ -596,6 +1095,523 @@ void RacingMPCNode::set_speed_scale(const double & speed_scale)
   std::unique_lock<std::shared_mutex> speed_scale_lock(speed_scale_mutex_);
   this->speed_scale_ = scale;
 }
+
+void RacingMPCNode::update_partition_frame(
+  const int & traj_idx, RacingTrajectory::SharedPtr recorded_on,
+  RacingTrajectory::SharedPtr current)
+{
+  auto & ss_manager = mpc_->get_safe_set_manager();
+  if (!current) {
+    ss_manager.clear_partition(traj_idx);
+  } else if (recorded_on && recorded_on != current) {
+    ss_manager.reproject(traj_idx, recorded_on, traj_idx, current);
+  }
+}
+
+casadi::Function RacingMPCNode::build_discrete_dynamics(
+  RacingTrajectory & track,
+  const double & dt)
+{
+  const auto x_sym = casadi::MX::sym("x", model_->nx());
+  const auto u_sym = casadi::MX::sym("u", model_->nu());
+  const auto k = track.curvature_interpolation_function()(x_sym(XIndex::PX))[0];
+  const auto xip1 = model_->discrete_dynamics()(
+    casadi::MXDict{{"x", x_sym}, {"u", u_sym}, {"k", k}, {"dt", dt}}
+  ).at("xip1");
+  return casadi::Function("discrete_dynamics", {x_sym, u_sym}, {xip1});
+}
+
+void RacingMPCNode::build_track_evaluators()
+{
+  const auto N = static_cast<casadi_int>(mpc_->get_config().N);
+  dynamics_eval_ = std::make_unique<utils::CasadiEvaluator>(discrete_dynamics_);
+  // all references along the horizon in one call
+  const auto s = casadi::MX::sym("s");
+  const auto reference = casadi::Function(
+    "reference", {s},
+    {
+      track_->left_boundary_interpolation_function()(s)[0],
+      track_->right_boundary_interpolation_function()(s)[0],
+      track_->curvature_interpolation_function()(s)[0],
+      track_->velocity_interpolation_function()(s)[0]
+    },
+    {"s"}, {"bound_left", "bound_right", "curvatures", "vel_ref"});
+  reference_eval_ = std::make_unique<utils::CasadiEvaluator>(reference.map(N));
+  f2g_eval_ = std::make_unique<utils::CasadiEvaluator>(f2g_);
+  ref_f2g_eval_ = std::make_unique<utils::CasadiEvaluator>(f2g_);
+  ss_f2g_eval_ = std::make_unique<utils::CasadiEvaluator>(track_->frenet_to_global_function());
+}
+
+void RacingMPCNode::clip_velocity_reference(
+  casadi::DM & vel_ref, const casadi::DM & x,
+  const bool & apply_scale)
+{
+  // cap the velocity by the speed limit
+  std::shared_lock<std::shared_mutex> speed_limit_lock(speed_limit_mutex_);
+  std::shared_lock<std::shared_mutex> speed_scale_lock(speed_scale_mutex_);
+  const auto scale = apply_scale ? speed_scale_ : 1.0;
+  auto & vel_ref_elements = vel_ref.nonzeros();
+  for (size_t i = 0; i < vel_ref_elements.size(); i++) {
+    // clip the velocity reference within +- max_vel_ref_diff of current speed
+    const auto current_speed = x.nonzeros()[i * x.size1() + XIndex::VX];
+    const auto ref_speed = vel_ref_elements[i] * scale;
+    const auto speed_limit_clipped = std::clamp(
+      this->speed_limit_, current_speed - config_->max_vel_ref_diff,
+      current_speed + config_->max_vel_ref_diff);
+    // valid TTL has positive velocity profile.
+    // if the velocity profile is negative, set it to the speed limit
+    if (ref_speed > 0.0) {
+      const auto ref_speed_clipped = std::clamp(
+        ref_speed, current_speed - config_->max_vel_ref_diff,
+        current_speed + config_->max_vel_ref_diff);
+      vel_ref_elements[i] = std::min(ref_speed_clipped, speed_limit_clipped);
+    } else {
+      vel_ref_elements[i] = speed_limit_clipped;
+    }
+  }
+}
+
+bool RacingMPCNode::apply_plan(
+  const casadi::DM & abscissa, casadi::DM & vel_ref,
+  casadi::DM & lateral_ref)
+{
+  plan_buffer_.update();
+  if (!plan_buffer_.has_value()) {
+    return false;
+  }
+  const auto & plan = plan_buffer_.front();
+  // discard plans from another trajectory or older than two planner periods
+  const auto plan_age = static_cast<double>(sol_in_.at("t_ic")) - plan.t_ic;
+  if (plan.traj_idx != traj_idx_ || plan_age > 2.0 / planner_rate_) {
+    return false;
+  }
+
+  const auto & total_length = track_->total_length();
+  const auto & s_plan = plan.abscissa;
+  auto & vel = vel_ref.nonzeros();
+  auto & lateral = lateral_ref.nonzeros();
+  double s_last = s_plan.front();
+  for (size_t i = 0; i < abscissa.nonzeros().size(); i++) {
+    // unwrap the abscissa to be continuous with the plan
+    auto s = abscissa.nonzeros()[i];
+    s += std::round((s_last - s) / total_length) * total_length;
+    s_last = s;
+
+    const auto it = std::upper_bound(s_plan.begin(), s_plan.end(), s);
+    if (it == s_plan.begin()) {
+      vel[i] = plan.velocity.front();
+      lateral[i] = plan.lateral.front();
+    } else if (it == s_plan.end()) {
+      vel[i] = plan.velocity.back();
+      lateral[i] = plan.lateral.back();
+    } else {
+      const auto j = static_cast<size_t>(std::distance(s_plan.begin(), it));
+      const auto r = (s - s_plan[j - 1]) / (s_plan[j] - s_plan[j - 1]);
+      vel[i] = plan.velocity[j - 1] + r * (plan.velocity[j] - plan.velocity[j - 1]);
+      lateral[i] = plan.lateral[j - 1] + r * (plan.lateral[j] - plan.lateral[j - 1]);
+    }
+  }
+  return true;
+}
+
+bool RacingMPCNode::plan_still_valid(const casadi::DM & x_ic, double & tracking_error)
+{
+  // deviation of the current state from the state predicted by the shifted plan
+  const auto & x = x_ic.nonzeros();
+  const auto & x_plan = last_x_.nonzeros();  // the first column is the predicted state
+  const auto ds = std::remainder(x[XIndex::PX] - x_plan[XIndex::PX], track_->total_length());
+  tracking_error = std::hypot(ds, x[XIndex::PY] - x_plan[XIndex::PY]);
+
+  if (skip_count_ >= event_max_skip_ || traj_idx_ != last_solve_traj_idx_) {
+    return false;
+  }
+  const auto & threshold = event_state_threshold_.nonzeros();
+  for (size_t i = 0; i < x.size(); i++) {
+    const auto dx = i == static_cast<size_t>(XIndex::PX) ? ds : x[i] - x_plan[i];
+    if (std::abs(dx) > threshold[i]) {
+      return false;
+    }
+  }
+
+  // change of the references since the last solve, over the overlapping horizon
+  const auto steps_since_solve = static_cast<size_t>(skip_count_ + 1);
+  const auto & vel_ref = sol_in_.at("vel_ref").nonzeros();
+  const auto & lateral_ref = sol_in_.at("lateral_ref").nonzeros();
+  const auto & last_vel_ref = last_solve_vel_ref_.nonzeros();
+  const auto & last_lateral_ref = last_solve_lateral_ref_.nonzeros();
+  for (size_t i = 0; i + steps_since_solve < vel_ref.size(); i++) {
+    const auto d_vel = vel_ref[i] - last_vel_ref[i + steps_since_solve];
+    const auto d_lat = lateral_ref[i] - last_lateral_ref[i + steps_since_solve];
+    if (std::abs(d_vel) > event_ref_threshold_ || std::abs(d_lat) > event_ref_threshold_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void RacingMPCNode::start_phase()
+{
+  if (perf_counters_enabled_) {
+    phase_start_ = lmpc::utils::PerfCounters::this_thread().read();
+  }
+}
+
+void RacingMPCNode::end_phase(const RacingMPCCyclePhase & phase)
+{
+  if (perf_counters_enabled_) {
+    const auto now = lmpc::utils::PerfCounters::this_thread().read();
+    phase_perf_profilers_[phase]->add_sample(now - phase_start_);
+    phase_start_ = now;
+  }
+}
+
+void RacingMPCNode::write_mirrors()
+{
+  auto & data = mirror_buffer_;
+  data.clear();
+  std::shared_lock<std::shared_mutex> traj_lock(traj_mutex_);
+  data.push_back(static_cast<double>(traj_idx_));
+  for (const auto * warm_start : {&last_x_, &last_u_, &last_du_, &last_convex_combi_}) {
+    data.insert(data.end(), warm_start->nonzeros().begin(), warm_start->nonzeros().end());
+  }
+  traj_lock.unlock();
+  for (auto * profiler : {profiler_.get(), profiler_iter_count_.get()}) {
+    const auto samples = profiler->samples();
+    data.push_back(static_cast<double>(samples.size()));
+    data.insert(data.end(), samples.begin(), samples.end());
+  }
+  warm_start_mirror_->write(data);
+  warm_start_mirror_->beat(lmpc::utils::DeadlineScheduler::now());
+
+  // the laps only change when one is completed
+  auto & ss_manager = mpc_->get_safe_set_manager();
+  const auto revision = ss_manager.revision();
+  if (revision == ss_revision_) {
+    return;
+  }
+  ss_revision_ = revision;
+  auto append = [&data](const casadi::DM & dm) {
+      const auto dense = casadi::DM::densify(dm);
+      data.insert(data.end(), dense.nonzeros().begin(), dense.nonzeros().end());
+    };
+  const auto recorded_laps = ss_manager.recorded_laps();
+  data.clear();
+  data.push_back(static_cast<double>(recorded_laps.size()));
+  for (const auto & [partition, laps] : recorded_laps) {
+    data.push_back(static_cast<double>(partition));
+    data.push_back(static_cast<double>(laps.size()));
+    for (const auto & lap : laps) {
+      const auto & lap_data = lap->data();
+      data.push_back(static_cast<double>(lap_data.x.size2()));
+      append(lap_data.x);
+      append(lap_data.u);
+      append(lap_data.k);
+      append(lap_data.t);
+    }
+  }
+  if (data.size() > ss_mirror_->capacity()) {
+    RCLCPP_WARN(
+      this->get_logger(), "The safe set laps need %zu bytes, more than the %zu bytes of %s.",
+      data.size() * sizeof(double), ss_mirror_->capacity() * sizeof(double),
+      ss_segment_name_.c_str());
+    return;
+  }
+  ss_mirror_->write(data);
+}
+
+bool RacingMPCNode::follow_primary()
+{
+  // the standby may start before the primary
+  if (!ss_mirror_) {
+    try {
+      warm_start_mirror_ =
+        std::make_unique<lmpc::utils::SharedMemoryMirror>(warm_start_segment_name_);
+      ss_mirror_ = std::make_unique<lmpc::utils::SharedMemoryMirror>(ss_segment_name_);
+    } catch (const std::runtime_error & e) {
+      warm_start_mirror_.reset();
+      RCLCPP_INFO_THROTTLE(
+        this->get_logger(), *this->get_clock(), 1000,
+        "Waiting for the primary to mirror its state: %s", e.what());
+      return false;
+    }
+    RCLCPP_INFO(this->get_logger(), "Mirroring the state of the primary.");
+  }
+
+  read_warm_start_mirror();
+  if (!warm_start_mirrored_) {
+    return false;
+  }
+  // the first solve builds the solver and is not published, with or without JIT
+  if (!standby_warmed_up_) {
+    return true;
+  }
+  // read the laps after the first solve, which loads the laps of config_->load_path
+  read_ss_mirror();
+
+  // the primary beats from its first published actuation on
+  const auto heartbeat = warm_start_mirror_->heartbeat();
+  const auto heartbeat_age = lmpc::utils::DeadlineScheduler::now() - heartbeat;
+  if (heartbeat < 0 || heartbeat_age <= heartbeat_timeout_) {
+    return false;
+  }
+  standby_active_ = true;
+  // the lap in progress started under the primary and is incomplete here
+  mpc_->discard_lap();
+  RCLCPP_WARN(
+    this->get_logger(), "The primary missed its heartbeat for %.1f ms. Taking over.",
+    heartbeat_age * 1e-6);
+  return true;
+}
+
+bool RacingMPCNode::read_warm_start_mirror()
+{
+  const auto version = warm_start_mirror_->version();
+  if (version == warm_start_version_ || !warm_start_mirror_->read(mirror_buffer_)) {
+    return false;
+  }
+  const auto & data = mirror_buffer_;
+  const auto N = static_cast<casadi_int>(mpc_->get_config().N);
+  const auto nx = static_cast<casadi_int>(model_->nx());
+  const auto nu = static_cast<casadi_int>(model_->nu());
+  const auto num_convex_combi = config_->learning ? config_->num_ss_pts : 0;
+  const auto warm_start_size = static_cast<size_t>(
+    1 + nx * N + 2 * nu * (N - 1) + num_convex_combi);
+  if (data.size() < warm_start_size) {
+    RCLCPP_ERROR_THROTTLE(
+      this->get_logger(), *this->get_clock(), 1000,
+      "The warm start of the primary has %zu entries instead of %zu. "
+      "Do the MPC configurations match?", data.size(), warm_start_size);
+    return false;
+  }
+  const auto traj_idx = static_cast<int>(data[0]);
+  if (traj_idx != traj_idx_) {
+    RCLCPP_WARN_THROTTLE(
+      this->get_logger(), *this->get_clock(), 1000,
+      "The primary is on trajectory %d, not %d. Waiting for the trajectory command.",
+      traj_idx, traj_idx_);
+    return false;
+  }
+  warm_start_version_ = version;
+  auto it = data.begin() + 1;
+  auto take = [&it](const casadi_int & rows, const casadi_int & cols) {
+      const auto first = it;
+      it += rows * cols;
+      return casadi::DM(casadi::Sparsity::dense(rows, cols), std::vector<double>(first, it));
+    };
+  last_x_ = take(nx, N);
+  last_u_ = take(nu, N - 1);
+  last_du_ = take(nu, N - 1);
+  if (config_->learning) {
+    last_convex_combi_ = take(num_convex_combi, 1);
+  }
+  for (auto * profiler : {profiler_.get(), profiler_iter_count_.get()}) {
+    if (it == data.end()) {
+      break;
+    }
+    const auto num_samples = static_cast<size_t>(*it++);
+    if (static_cast<size_t>(data.end() - it) < num_samples) {
+      break;
+    }
+    profiler->restore(std::vector<double>(it, it + num_samples));
+    it += num_samples;
+  }
+  warm_start_mirrored_ = true;
+  return true;
+}
+
+void RacingMPCNode::read_ss_mirror()
+{
+  const auto version = ss_mirror_->version();
+  if (version == ss_version_ || !ss_mirror_->read(mirror_buffer_)) {
+    return;
+  }
+  ss_version_ = version;
+  const auto & data = mirror_buffer_;
+  const auto nx = static_cast<casadi_int>(model_->nx());
+  const auto nu = static_cast<casadi_int>(model_->nu());
+  // every read is checked against the remaining data first
+  size_t i = 0;
+  auto has = [&data, &i](const size_t & size) {
+      return data.size() - i >= size;
+    };
+  auto take = [&data, &i](const casadi_int & rows, const casadi_int & cols) {
+      const auto first = data.begin() + i;
+      i += static_cast<size_t>(rows * cols);
+      return casadi::DM(
+        casadi::Sparsity::dense(rows, cols), std::vector<double>(first, data.begin() + i));
+    };
+  auto malformed = [this]() {
+      RCLCPP_ERROR(this->get_logger(), "The safe set laps of the primary are malformed.");
+    };
+
+  if (!has(1)) {
+    return malformed();
+  }
+  const auto num_partitions = static_cast<size_t>(data[i++]);
+  for (size_t p = 0; p < num_partitions; p++) {
+    if (!has(2)) {
+      return malformed();
+    }
+    const auto partition = static_cast<int>(data[i++]);
+    const auto num_laps = static_cast<size_t>(data[i++]);
+    std::vector<SSTrajectory::SharedPtr> laps;
+    const auto track = tracks_->get_trajectory(partition);
+    for (size_t lap = 0; lap < num_laps; lap++) {
+      if (!has(1)) {
+        return malformed();
+      }
+      const auto n = static_cast<casadi_int>(data[i++]);
+      if (!has(static_cast<size_t>((nx + nu + 2) * n))) {
+        return malformed();
+      }
+      const auto x = take(nx, n);
+      const auto u = take(nu, n);
+      const auto k = take(1, n);
+      const auto t = take(1, n);
+      if (track) {
+        laps.push_back(std::make_shared<SSTrajectory>(x, u, k, t, track->total_length()));
+      }
+    }
+    if (track) {
+      mpc_->get_safe_set_manager().set_recorded_laps(partition, laps);
+    }
+  }
+  RCLCPP_INFO(this->get_logger(), "Mirrored the safe set laps of the primary.");
+}
+
+void RacingMPCNode::planner_loop()
+{
+  using casadi::DM;
+  using casadi::Slice;
+
+  const auto & planner_config = planner_mpc_->get_config();
+  const auto N = static_cast<casadi_int>(planner_config.N);
+  const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(1.0 / planner_rate_));
+
+  casadi::DMDict sol_in;
+  sol_in["T_ref"] = DM::zeros(1, N - 1) + planner_dt_;
+  sol_in["T_optm_ref"] = sol_in.at("T_ref");
+  DM last_x, last_u, last_du, last_convex_combi;
+  utils::CasadiEvaluator::UniquePtr dynamics_eval;
+  int last_traj_idx = -1;
+  double last_t_ic = 0.0;
+
+  auto next_wakeup = std::chrono::steady_clock::now();
+  while (planner_running_) {
+    next_wakeup += period;
+    {
+      std::unique_lock<std::mutex> lock(planner_mutex_);
+      planner_cv_.wait_until(lock, next_wakeup, [this] {return !planner_running_;});
+    }
+    if (!planner_running_) {
+      break;
+    }
+    planner_request_buffer_.update();
+    if (!planner_request_buffer_.has_value()) {
+      continue;
+    }
+    const auto & request = planner_request_buffer_.front();
+    auto & track = *request.track;
+    const auto solve_start = std::chrono::system_clock::now();
+
+    if (request.traj_idx != last_traj_idx) {
+      std::lock_guard<std::mutex> construction_lock(utils::casadi_construction_mutex());
+      dynamics_eval = std::make_unique<utils::CasadiEvaluator>(
+        build_discrete_dynamics(track, planner_dt_));
+      last_x = DM();
+    }
+
+    if (last_x.is_empty()) {
+      // (re)initialize with a constant input rollout from the current state
+      last_x = DM::zeros(model_->nx(), N);
+      last_u = DM::zeros(model_->nu(), N - 1) + 1e-9;
+      last_du = DM::zeros(model_->nu(), N - 1);
+      last_convex_combi = DM::zeros(planner_config.num_ss_pts);
+      utils::copy_to_column(request.x_ic, 0, last_x);
+      for (casadi_int i = 1; i < N; i++) {
+        utils::copy_column(last_x, i - 1, dynamics_eval->input(0));
+        utils::copy_column(last_u, i - 1, dynamics_eval->input(1));
+        dynamics_eval->evaluate();
+        utils::copy_to_column(dynamics_eval->output(0), i, last_x);
+      }
+    } else {
+      // shift the previous plan in place by the number of planner steps elapsed.
+      // the last control is repeated and the last state is propagated with it.
+      const auto shift = std::clamp<casadi_int>(
+        std::lround((request.t_ic - last_t_ic) / planner_dt_), 0, N - 2);
+      for (casadi_int k = 0; k < shift; k++) {
+        utils::shift_columns(last_x);
+        utils::shift_columns(last_u);
+        utils::shift_columns(last_du);
+        std::fill_n(last_du.ptr() + (N - 2) * model_->nu(), model_->nu(), 0.0);
+        utils::copy_column(last_x, N - 2, dynamics_eval->input(0));
+        utils::copy_column(last_u, N - 2, dynamics_eval->input(1));
+        dynamics_eval->evaluate();
+        utils::copy_to_column(dynamics_eval->output(0), N - 1, last_x);
+      }
+    }
+
+    const auto abscissa = last_x(XIndex::PX, Slice());
+    auto vel_ref = track.velocity_interpolation_function()(abscissa)[0];
+    clip_velocity_reference(vel_ref, last_x, true);
+    sol_in["x_ic"] = request.x_ic;
+    sol_in["u_ic"] = request.u_ic;
+    sol_in["t_ic"] = request.t_ic;
+    sol_in["total_length"] = track.total_length();
+    sol_in["X_ref"] = last_x;
+    sol_in["U_ref"] = last_u;
+    sol_in["X_optm_ref"] = last_x;
+    sol_in["U_optm_ref"] = last_u;
+    sol_in["dU_optm_ref"] = last_du;
+    if (planner_config.learning) {
+      sol_in["convex_combi_optm_ref"] = last_convex_combi;
+    }
+    sol_in["bound_left"] = track.left_boundary_interpolation_function()(abscissa)[0];
+    sol_in["bound_right"] = track.right_boundary_interpolation_function()(abscissa)[0];
+    sol_in["curvatures"] = track.curvature_interpolation_function()(abscissa)[0];
+    sol_in["vel_ref"] = vel_ref;
+
+    auto sol_out = casadi::DMDict{};
+    auto stats = casadi::Dict{};
+    planner_mpc_->solve(sol_in, sol_out, stats);
+    last_traj_idx = request.traj_idx;
+    last_t_ic = request.t_ic;
+    if (!sol_out.count("X_optm")) {
+      RCLCPP_WARN_THROTTLE(
+        this->get_logger(), *this->get_clock(), 1000,
+        "Planner could not be solved.");
+      last_x = DM();
+      continue;
+    }
+    last_x = sol_out.at("X_optm");
+    last_u = sol_out.at("U_optm");
+    last_du = sol_out.at("dU_optm");
+    if (planner_config.learning) {
+      last_convex_combi = sol_out.at("convex_combi_optm");
+    }
+
+    // hand the plan to the tracking MPC
+    auto & plan = plan_buffer_.back();
+    plan.traj_idx = request.traj_idx;
+    plan.t_ic = request.t_ic;
+    plan.abscissa.resize(N);
+    plan.lateral.resize(N);
+    plan.velocity.resize(N);
+    for (casadi_int i = 0; i < N; i++) {
+      const auto x_base = model_->to_base_state()(
+        casadi::DMDict{{"x", last_x(Slice(), i)},
+          {"u", last_u(Slice(), std::min(i, N - 2))}}).at("x_out");
+      plan.abscissa[i] = static_cast<double>(x_base(XIndex::PX));
+      plan.lateral[i] = static_cast<double>(x_base(XIndex::PY));
+      plan.velocity[i] = static_cast<double>(x_base(XIndex::VX));
+    }
+    plan_buffer_.publish();
+
+    const auto solve_duration = std::chrono::system_clock::now() - solve_start;
+    planner_profiler_->add_cycle_stats(solve_duration.count() * 1e-6);
+  }
+}
 }  // namespace racing_mpc
 }  // namespace mpc
 }  // namespace lmpc
@@ -58,6 +58,18 @@ RacingMPCConfig::SharedPtr load_parameters(rclcpp::Node * node)
     throw std::invalid_argument("Invalid step mode: " + step_mode_str);
   }
 
+  const auto transcription_str = declare_string("racing_mpc.transcription");
+  RacingMPCTranscription transcription;
+  if (transcription_str == "shooting") {
+    transcription = RacingMPCTranscription::SHOOTING;
+  } else if (transcription_str == "hermite_simpson") {
+    transcription = RacingMPCTranscription::HERMITE_SIMPSON;
+  } else if (transcription_str == "legendre") {
+    transcription = RacingMPCTranscription::LEGENDRE;
+  } else {
+    throw std::invalid_argument("Invalid transcription: " + transcription_str);
+  }
+
   const auto R = casadi::DM(declare_vec("racing_mpc.r"));
   const auto R_d = casadi::DM(declare_vec("racing_mpc.r_d"));
 
@@ -98,7 +110,16 @@ RacingMPCConfig::SharedPtr load_parameters(rclcpp::Node * node)
           declare_bool("racing_mpc.record"),
           declare_string("racing_mpc.path_prefix"),
           declare_bool("racing_mpc.load"),
-          declare_vec_str("racing_mpc.load_path")
+          declare_vec_str("racing_mpc.load_path"),
+
+          declare_bool("racing_mpc.warm_start_cache"),
+          declare_double("racing_mpc.cache_ds"),
+          declare_double("racing_mpc.cache_dv"),
+          static_cast<casadi_int>(declare_int("racing_mpc.cache_depth")),
+          static_cast<casadi_int>(declare_int("racing_mpc.cache_max_bins")),
+
+          transcription,
+          static_cast<casadi_int>(declare_int("racing_mpc.collocation_degree"))
         }
   );
 }
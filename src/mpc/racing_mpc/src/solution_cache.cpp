@@ -0,0 +1,160 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <base_vehicle_model/base_vehicle_model.hpp>
+
+#include "racing_mpc/solution_cache.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+using lmpc::vehicle_model::base_vehicle_model::XIndex;
+
+SolutionCache::SolutionCache(
+  const double & ds, const double & dv, const size_t & depth, const size_t & max_bins,
+  const casadi::DM & scale_x, const SolutionCacheEntry & entry_shape)
+: ds_(ds), dv_(dv), depth_(depth), max_bins_(max_bins), scale_x_(scale_x),
+  entry_shape_(entry_shape)
+{
+  if (ds <= 0.0 || dv <= 0.0 || depth == 0 || max_bins == 0) {
+    throw std::invalid_argument("SolutionCache: bin sizes, depth and bin cap must be positive.");
+  }
+}
+
+void SolutionCache::reset(const double & total_length, const double & v_max)
+{
+  if (!(total_length > 0.0) || !std::isfinite(total_length) || !std::isfinite(v_max)) {
+    throw std::invalid_argument("SolutionCache: track length and top speed must be finite.");
+  }
+  total_length_ = total_length;
+  // the speed axis spans the velocity profile, the abscissa bins are coarsened to stay
+  // within the cap
+  num_v_bins_ = std::min(
+    static_cast<size_t>(std::ceil(std::max(v_max, 0.0) / dv_)) + 1, max_bins_);
+  num_s_bins_ = std::max<size_t>(
+    std::min(
+      static_cast<size_t>(std::ceil(total_length / ds_)), max_bins_ / num_v_bins_), 1);
+  bin_ds_ = std::max(ds_, total_length / num_s_bins_);
+
+  const auto num_bins = num_s_bins_ * num_v_bins_;
+  entries_.assign(num_bins * depth_, entry_shape_);
+  bin_sizes_.assign(num_bins, 0);
+  bin_heads_.assign(num_bins, 0);
+  last_bin_ = num_bins;
+}
+
+void SolutionCache::insert(
+  const casadi::DM & x0, const casadi::DM & abscissa,
+  const casadi::DM & primal, const casadi::DM & dual)
+{
+  if (bin_sizes_.empty()) {
+    return;
+  }
+  const auto bin = bin_index(x0);
+  if (bin == last_bin_) {
+    return;
+  }
+  last_bin_ = bin;
+  // overwrite the oldest entry of the bin in place, the sizes match the preallocated ones
+  auto & head = bin_heads_[bin];
+  auto & entry = entries_[bin * depth_ + head];
+  entry.x0 = x0;
+  entry.abscissa = abscissa;
+  entry.primal = primal;
+  entry.dual = dual;
+  head = (head + 1) % depth_;
+  bin_sizes_[bin] = std::min(bin_sizes_[bin] + 1, depth_);
+}
+
+const SolutionCacheEntry * SolutionCache::query(const casadi::DM & x0, double & distance) const
+{
+  distance = std::numeric_limits<double>::infinity();
+  if (bin_sizes_.empty()) {
+    return nullptr;
+  }
+  const SolutionCacheEntry * best = nullptr;
+  const auto bin = bin_index(x0);
+  for (size_t i = 0; i < bin_sizes_[bin]; i++) {
+    const auto & entry = entries_[bin * depth_ + i];
+    const auto d = this->distance(entry.x0, x0);
+    if (d < distance) {
+      distance = d;
+      best = &entry;
+    }
+  }
+  return best;
+}
+
+double SolutionCache::distance(const casadi::DM & x1, const casadi::DM & x2) const
+{
+  auto dx = x1 - x2;
+  dx(XIndex::PX) = std::remainder(static_cast<double>(dx(XIndex::PX)), total_length_);
+  return static_cast<double>(casadi::DM::norm_2(dx / scale_x_));
+}
+
+void SolutionCache::record_result(const bool & hit, const double & iter_count)
+{
+  num_queries_++;
+  if (hit) {
+    num_hits_++;
+    iter_hits_ += iter_count;
+  } else {
+    iter_misses_ += iter_count;
+  }
+}
+
+double SolutionCache::hit_rate() const
+{
+  return num_queries_ ? static_cast<double>(num_hits_) / num_queries_ : 0.0;
+}
+
+double SolutionCache::mean_iterations(const bool & hit) const
+{
+  if (hit) {
+    return num_hits_ ? iter_hits_ / num_hits_ : 0.0;
+  }
+  const auto num_misses = num_queries_ - num_hits_;
+  return num_misses ? iter_misses_ / num_misses : 0.0;
+}
+
+const double & SolutionCache::total_length() const
+{
+  return total_length_;
+}
+
+size_t SolutionCache::bin_index(const casadi::DM & x0) const
+{
+  // read the dense state in place, indexing a DM would allocate
+  const auto & x = x0.nonzeros();
+  auto s = std::fmod(x[XIndex::PX], total_length_);
+  if (s < 0.0) {
+    s += total_length_;
+  }
+  const auto s_bin = std::min(static_cast<size_t>(s / bin_ds_), num_s_bins_ - 1);
+  const auto v = std::max(x[XIndex::VX], 0.0);
+  const auto v_bin = std::min(static_cast<size_t>(v / dv_), num_v_bins_ - 1);
+  return s_bin * num_v_bins_ + v_bin;
+}
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
@@ -0,0 +1,127 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "racing_mpc/solve_heatmap.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mpc
+{
+SolveHeatmap::SolveHeatmap(
+  const double & bin_size, const double & total_length,
+  const int & num_regions)
+: bin_size_(bin_size), total_length_(total_length)
+{
+  if (bin_size <= 0.0 || total_length <= 0.0) {
+    throw std::invalid_argument("SolveHeatmap: bin size and track length must be positive.");
+  }
+  num_abscissa_bins_ = static_cast<size_t>(std::ceil(total_length / bin_size));
+  abscissa_bins_ = std::make_unique<SolveHeatmapAccumulator[]>(num_abscissa_bins_);
+  num_regions_ = static_cast<size_t>(std::max(num_regions, 0));
+  region_bins_ = std::make_unique<SolveHeatmapAccumulator[]>(num_regions_);
+}
+
+void SolveHeatmap::add(
+  const double & abscissa, const int & region, const double & solve_time,
+  const double & iter_count, const bool & slack_active, const bool & failed)
+{
+  auto s = std::fmod(abscissa, total_length_);
+  if (s < 0.0) {
+    s += total_length_;
+  }
+  const auto s_bin = std::min(static_cast<size_t>(s / bin_size_), num_abscissa_bins_ - 1);
+  const auto solve_time_us = static_cast<uint64_t>(std::max(solve_time, 0.0) * 1e3);
+  const auto iter = static_cast<uint64_t>(std::max(iter_count, 0.0));
+  accumulate(abscissa_bins_[s_bin], solve_time_us, iter, slack_active, failed);
+  if (region >= 0 && static_cast<size_t>(region) < num_regions_) {
+    accumulate(region_bins_[region], solve_time_us, iter, slack_active, failed);
+  }
+}
+
+std::vector<SolveHeatmapBin> SolveHeatmap::abscissa_bins() const
+{
+  std::vector<SolveHeatmapBin> bins(num_abscissa_bins_);
+  for (size_t i = 0; i < num_abscissa_bins_; i++) {
+    bins[i] = read(abscissa_bins_[i]);
+  }
+  return bins;
+}
+
+std::vector<SolveHeatmapBin> SolveHeatmap::region_bins() const
+{
+  std::vector<SolveHeatmapBin> bins(num_regions_);
+  for (size_t i = 0; i < num_regions_; i++) {
+    bins[i] = read(region_bins_[i]);
+  }
+  return bins;
+}
+
+const double & SolveHeatmap::bin_size() const
+{
+  return bin_size_;
+}
+
+size_t SolveHeatmap::num_abscissa_bins() const
+{
+  return num_abscissa_bins_;
+}
+
+size_t SolveHeatmap::num_regions() const
+{
+  return num_regions_;
+}
+
+void SolveHeatmap::accumulate(
+  SolveHeatmapAccumulator & bin, const uint64_t & solve_time_us,
+  const uint64_t & iter_count, const bool & slack_active, const bool & failed)
+{
+  // there is a single writer, so a plain compare is enough to keep the maximum
+  if (solve_time_us > bin.max_solve_time_us.load(std::memory_order_relaxed)) {
+    bin.max_solve_time_us.store(solve_time_us, std::memory_order_relaxed);
+  }
+  bin.solve_time_us.fetch_add(solve_time_us, std::memory_order_relaxed);
+  bin.iter_count.fetch_add(iter_count, std::memory_order_relaxed);
+  bin.slack_active.fetch_add(slack_active ? 1 : 0, std::memory_order_relaxed);
+  bin.failures.fetch_add(failed ? 1 : 0, std::memory_order_relaxed);
+  // the count is released last so a reader never sees more solves than were accumulated
+  bin.count.fetch_add(1, std::memory_order_release);
+}
+
+SolveHeatmapBin SolveHeatmap::read(const SolveHeatmapAccumulator & bin)
+{
+  SolveHeatmapBin result;
+  result.count = bin.count.load(std::memory_order_acquire);
+  if (result.count == 0) {
+    return result;
+  }
+  const auto count = static_cast<double>(result.count);
+  // the totals may already include a solve that is not counted yet, which is negligible
+  result.mean_solve_time = bin.solve_time_us.load(std::memory_order_relaxed) * 1e-3 / count;
+  result.max_solve_time = bin.max_solve_time_us.load(std::memory_order_relaxed) * 1e-3;
+  result.mean_iter_count = bin.iter_count.load(std::memory_order_relaxed) / count;
+  result.slack_active_rate =
+    std::min(bin.slack_active.load(std::memory_order_relaxed) / count, 1.0);
+  result.failure_rate = std::min(bin.failures.load(std::memory_order_relaxed) / count, 1.0);
+  return result;
+}
+}  // namespace racing_mpc
+}  // namespace mpc
+}  // namespace lmpc
@@ -18,15 +18,25 @@
 #include <math.h>
 #include <iostream>
 #include <chrono>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 #include <rclcpp/rclcpp.hpp>
 #include <ament_index_cpp/get_package_share_directory.hpp>
 
 #include <base_vehicle_model/ros_param_loader.hpp>
 #include <single_track_planar_model/ros_param_loader.hpp>
 #include <lmpc_utils/primitives.hpp>
+#include <lmpc_utils/perf_counters.hpp>
 #include <racing_trajectory/racing_trajectory.hpp>
+#include <vehicle_model_factory/vehicle_model_factory.hpp>
 #include "racing_mpc/racing_mpc.hpp"
 #include "racing_mpc/ros_param_loader.hpp"
+#include "racing_mpc/solution_cache.hpp"
+#include "racing_mpc/solve_heatmap.hpp"
+#include "racing_mpc/mlp.hpp"
+#include "racing_mpc/mlp_trainer.hpp"
 
 using lmpc::mpc::racing_mpc::RacingMPC;
 using lmpc::vehicle_model::single_track_planar_model::SingleTrackPlanarModel;
@@ -128,10 +138,16 @@ void test_mpc(const lmpc::Pose2D & p0, const double & v0, const casadi_int & num
     auto sol_out = casadi::DMDict{};
     auto stats = casadi::Dict{};
     const auto start = std::chrono::high_resolution_clock::now();
+    const auto perf_start = lmpc::utils::PerfCounters::this_thread().read();
     mpc->solve(sol_in, sol_out, stats);
+    const auto perf = lmpc::utils::PerfCounters::this_thread().read() - perf_start;
     const auto stop = std::chrono::high_resolution_clock::now();
     const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
     std::cout << "MPC Execution Time: " << duration.count() << "ms" << std::endl;
+    std::cout << "MPC Perf Counters: cycles " << perf.counts[lmpc::utils::CYCLES] <<
+      ", instructions " << perf.counts[lmpc::utils::INSTRUCTIONS] <<
+      ", cache misses " << perf.counts[lmpc::utils::CACHE_MISSES] <<
+      ", context switches " << perf.counts[lmpc::utils::CONTEXT_SWITCHES] << std::endl;
     if (mpc->solved()) {
       sol_in.erase("X_optm_ref");
       sol_in.erase("U_optm_ref");
@@ -182,6 +198,309 @@ TEST(RacingMPCTest, MPCSolveTestStartDeviated)
   SUCCEED();
 }
 
+TEST(RacingMPCTest, SolutionCacheTest)
+{
+  using casadi::DM;
+  using lmpc::mpc::racing_mpc::SolutionCache;
+  const auto scale_x = DM{2000.0, 10.0, 0.1, 80.0, 2.0, 2.0};
+  const auto entry_shape = lmpc::mpc::racing_mpc::SolutionCacheEntry{
+    DM::zeros(6), DM::zeros(1, 2), DM::zeros(1), DM::zeros(1)};
+  auto cache = SolutionCache(1.0, 1.0, 2, 10000, scale_x, entry_shape);
+  double distance = 0.0;
+  EXPECT_EQ(cache.query(DM{0.5, 0.0, 0.0, 10.0, 0.0, 0.0}, distance), nullptr);
+
+  cache.reset(100.0, 20.0);
+  const auto x0 = DM{10.2, 0.1, 0.0, 10.2, 0.0, 0.0};
+  cache.insert(x0, DM{10.2, 11.2}, DM{1.0}, DM{2.0});
+  // a second solution in the same bin on the same pass is not stored
+  cache.insert(x0 + 0.1, DM{10.3, 11.3}, DM{3.0}, DM{4.0});
+
+  const auto entry = cache.query(DM{10.8, 0.0, 0.0, 10.5, 0.0, 0.0}, distance);
+  ASSERT_NE(entry, nullptr);
+  EXPECT_DOUBLE_EQ(static_cast<double>(entry->primal), 1.0);
+  EXPECT_LT(distance, 1.0);
+  // other abscissa or speed bins miss
+  EXPECT_EQ(cache.query(DM{11.5, 0.0, 0.0, 10.5, 0.0, 0.0}, distance), nullptr);
+  EXPECT_EQ(cache.query(DM{10.5, 0.0, 0.0, 12.5, 0.0, 0.0}, distance), nullptr);
+  // the abscissa wraps around the track
+  EXPECT_NE(cache.query(DM{110.5, 0.0, 0.0, 10.5, 0.0, 0.0}, distance), nullptr);
+  EXPECT_NEAR(cache.distance(DM{99.9, 0, 0, 0, 0, 0}, DM{0.1, 0, 0, 0, 0, 0}), 0.2 / 2000.0, 1e-9);
+  // the bins of a pass are kept up to the depth, the oldest is overwritten
+  cache.insert(x0 + 1.0, DM{11.2, 12.2}, DM{5.0}, DM{6.0});
+  cache.insert(x0, DM{10.2, 11.2}, DM{7.0}, DM{8.0});
+  cache.insert(x0 + 1.0, DM{11.2, 12.2}, DM{5.0}, DM{6.0});
+  cache.insert(x0 + 0.01, DM{10.2, 11.2}, DM{9.0}, DM{10.0});
+  ASSERT_NE(cache.query(x0, distance), nullptr);
+  EXPECT_DOUBLE_EQ(static_cast<double>(cache.query(x0, distance)->primal), 7.0);
+  EXPECT_DOUBLE_EQ(static_cast<double>(cache.query(x0 + 0.01, distance)->primal), 9.0);
+
+  // the abscissa bins are coarsened to stay within the cap, faster states use the last bin
+  auto capped_cache = SolutionCache(1.0, 1.0, 1, 21 * 10, scale_x, entry_shape);
+  capped_cache.reset(100.0, 20.0);
+  capped_cache.insert(x0, DM{10.2, 11.2}, DM{1.0}, DM{2.0});
+  EXPECT_NE(capped_cache.query(DM{19.5, 0.0, 0.0, 10.5, 0.0, 0.0}, distance), nullptr);
+  EXPECT_EQ(capped_cache.query(DM{20.5, 0.0, 0.0, 10.5, 0.0, 0.0}, distance), nullptr);
+  capped_cache.insert(DM{50.0, 0.0, 0.0, 40.0, 0.0, 0.0}, DM{50.0, 51.0}, DM{3.0}, DM{4.0});
+  EXPECT_NE(capped_cache.query(DM{50.0, 0.0, 0.0, 20.5, 0.0, 0.0}, distance), nullptr);
+
+  cache.record_result(true, 5.0);
+  cache.record_result(false, 15.0);
+  EXPECT_DOUBLE_EQ(cache.hit_rate(), 0.5);
+  EXPECT_DOUBLE_EQ(cache.mean_iterations(true), 5.0);
+  EXPECT_DOUBLE_EQ(cache.mean_iterations(false), 15.0);
+}
+
+TEST(RacingMPCTest, SolveHeatmapTest)
+{
+  using lmpc::mpc::racing_mpc::SolveHeatmap;
+  auto heatmap = SolveHeatmap(10.0, 95.0, 2);
+  EXPECT_EQ(heatmap.num_abscissa_bins(), 10u);
+  EXPECT_EQ(heatmap.num_regions(), 2u);
+
+  heatmap.add(12.0, 1, 20.0, 10.0, false, false);
+  heatmap.add(18.0, 1, 40.0, 30.0, true, true);
+  // the abscissa wraps around the track, the last bin is shorter
+  heatmap.add(-1.0, 0, 5.0, 4.0, false, false);
+  // out of range regions are only binned by abscissa
+  heatmap.add(50.0, 5, 5.0, 4.0, false, false);
+
+  const auto abscissa_bins = heatmap.abscissa_bins();
+  EXPECT_EQ(abscissa_bins[0].count, 0u);
+  EXPECT_EQ(abscissa_bins[1].count, 2u);
+  EXPECT_NEAR(abscissa_bins[1].mean_solve_time, 30.0, 1e-3);
+  EXPECT_NEAR(abscissa_bins[1].max_solve_time, 40.0, 1e-3);
+  EXPECT_DOUBLE_EQ(abscissa_bins[1].mean_iter_count, 20.0);
+  EXPECT_DOUBLE_EQ(abscissa_bins[1].slack_active_rate, 0.5);
+  EXPECT_DOUBLE_EQ(abscissa_bins[1].failure_rate, 0.5);
+  EXPECT_EQ(abscissa_bins[5].count, 1u);
+  EXPECT_EQ(abscissa_bins[9].count, 1u);
+
+  const auto region_bins = heatmap.region_bins();
+  EXPECT_EQ(region_bins[0].count, 1u);
+  EXPECT_EQ(region_bins[1].count, 2u);
+  EXPECT_DOUBLE_EQ(region_bins[1].failure_rate, 0.5);
+}
+
+TEST(RacingMPCTest, MLPTest)
+{
+  using lmpc::mpc::racing_mpc::MLP;
+  using lmpc::mpc::racing_mpc::MLPTrainer;
+  using lmpc::mpc::racing_mpc::MLPTrainerConfig;
+  // fit a smooth function of two inputs, with offsets and scales the normalization must handle
+  const Eigen::Index num_samples = 2000;
+  Eigen::MatrixXd inputs = Eigen::MatrixXd::Random(2, num_samples);
+  inputs.row(0) = inputs.row(0) * 3.0 + Eigen::RowVectorXd::Constant(num_samples, 10.0);
+  Eigen::MatrixXd outputs(2, num_samples);
+  for (Eigen::Index i = 0; i < num_samples; i++) {
+    outputs(0, i) = 100.0 * std::sin(inputs(0, i) - 10.0) + 50.0 * inputs(1, i);
+    outputs(1, i) = inputs(1, i) * inputs(1, i);
+  }
+  auto mlp = MLP({2, 32, 32, 2}, 0);
+  auto trainer = MLPTrainer(mlp, MLPTrainerConfig{200, 64, 1e-2, 0.2, 0});
+  const auto validation_loss = trainer.train(inputs, outputs);
+  EXPECT_LT(validation_loss, 1e-2);
+  EXPECT_NEAR(mlp.forward(Eigen::Vector2d{10.5, 0.5})(0), 100.0 * std::sin(0.5) + 25.0, 5.0);
+
+  // save and load
+  mlp.save("test_mlp.txt");
+  auto loaded = MLP("test_mlp.txt");
+  const Eigen::Vector2d x{11.0, -0.3};
+  const Eigen::VectorXd y = mlp.forward(x);
+  EXPECT_TRUE(loaded.forward(x).isApprox(y));
+  EXPECT_THROW(MLP("nonexistent_mlp.txt"), std::runtime_error);
+}
+
+TEST(RacingMPCTest, MLPInferenceBenchmark)
+{
+  using lmpc::mpc::racing_mpc::MLP;
+  auto mlp = MLP({57, 64, 64, 18}, 0);
+  const Eigen::VectorXd x = Eigen::VectorXd::Random(57);
+  const int num_eval = 100000;
+  double sum = 0.0;
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_eval; i++) {
+    sum += mlp.forward(x)(0);
+  }
+  const auto stop = std::chrono::high_resolution_clock::now();
+  const auto duration = std::chrono::duration<double, std::micro>(stop - start).count();
+  std::cout << "MLP Inference Time: " << duration / num_eval << "us" << std::endl;
+  EXPECT_TRUE(std::isfinite(sum));
+}
+
+TEST(RacingMPCTest, TranscriptionBenchmark)
+{
+  using casadi::DM;
+  using casadi::Slice;
+  using lmpc::mpc::racing_mpc::RacingMPCConfig;
+  using lmpc::mpc::racing_mpc::RacingMPCTranscription;
+
+  // the putnam configuration of racing_mpc_putnam.launch.py
+  rclcpp::init(0, nullptr);
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle.param.yaml",
+    "--params-file", model_share_dir + "/param/sample_vehicle.param.yaml",
+    "--params-file", share_dir + "/param/sample_mpc.param.yaml"
+  });
+  auto test_node = rclcpp::Node("test_racing_mpc_node", options);
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(&test_node);
+  auto model_config = lmpc::vehicle_model::single_track_planar_model::load_parameters(&test_node);
+  auto model = std::make_shared<SingleTrackPlanarModel>(base_config, model_config);
+  auto config = lmpc::mpc::racing_mpc::load_parameters(&test_node);
+  rclcpp::shutdown();
+  // track the racing line without the recorded safe sets, and let every solve converge
+  config->learning = false;
+  config->load = false;
+  config->record = false;
+  config->warm_start_cache = false;
+  config->max_cpu_time = 10.0;
+
+  auto traj = lmpc::vehicle_model::racing_trajectory::RacingTrajectory(
+    trajectory_share_dir + "/test_data/putnam_optm.txt");
+  const auto N = static_cast<casadi_int>(config->N);
+  const auto nu = static_cast<casadi_int>(model->nu());
+  const double dt = 0.1, v0 = 20.0, s0 = 10.0;
+  auto X_ref = DM::zeros(model->nx(), N);
+  for (casadi_int i = 0; i < N; i++) {
+    X_ref(XIndex::PX, i) = s0 + v0 * dt * i;
+    X_ref(XIndex::VX, i) = v0;
+  }
+  const auto abscissa = X_ref(XIndex::PX, Slice());
+  const auto sol_in = casadi::DMDict{
+    {"X_optm_ref", X_ref},
+    {"U_optm_ref", DM::zeros(nu, N - 1)},
+    {"dU_optm_ref", DM::zeros(nu, N - 1)},
+    {"T_optm_ref", DM::zeros(1, N - 1) + dt},
+    {"X_ref", X_ref},
+    {"U_ref", DM::zeros(nu, N - 1)},
+    {"T_ref", DM::zeros(1, N - 1) + dt},
+    {"x_ic", X_ref(Slice(), 0)},
+    {"u_ic", DM::zeros(nu, 1)},
+    {"t_ic", 0.0},
+    {"total_length", traj.total_length()},
+    {"bound_left", traj.left_boundary_interpolation_function()(abscissa)[0]},
+    {"bound_right", traj.right_boundary_interpolation_function()(abscissa)[0]},
+    {"curvatures", traj.curvature_interpolation_function()(abscissa)[0]},
+    {"vel_ref", traj.velocity_interpolation_function()(abscissa)[0]}
+  };
+
+  const std::vector<std::pair<std::string, RacingMPCTranscription>> transcriptions{
+    {"shooting", RacingMPCTranscription::SHOOTING},
+    {"hermite_simpson", RacingMPCTranscription::HERMITE_SIMPSON},
+    {"legendre", RacingMPCTranscription::LEGENDRE}
+  };
+  casadi_int shooting_nx = 0;
+  for (const auto & [name, transcription] : transcriptions) {
+    auto mpc_config = std::make_shared<RacingMPCConfig>(*config);
+    mpc_config->transcription = transcription;
+    auto mpc = RacingMPC(mpc_config, model, true);
+
+    const int num_solve = 5;
+    double iter_count = 0.0;
+    std::map<std::string, double> times, total_times;
+    for (int i = 0; i < num_solve; i++) {
+      auto sol_out = casadi::DMDict{};
+      auto stats = casadi::Dict{};
+      mpc.solve(sol_in, sol_out, stats);
+      ASSERT_TRUE(mpc.solved());
+      iter_count += static_cast<double>(stats.at("iter_count"));
+      RacingMPC::function_times(stats, times);
+      for (const auto & [function, time] : times) {
+        total_times[function] += time;
+      }
+    }
+    // the solver time is what remains of the total after the functions
+    ASSERT_TRUE(total_times.count("total") && total_times.count("solver"));
+    EXPECT_GT(total_times.at("nlp_hess_l"), 0.0);
+    EXPECT_LE(total_times.at("solver"), total_times.at("total"));
+
+    const auto size = mpc.problem_size();
+    EXPECT_GT(size.jacobian_nnz, 0);
+    EXPECT_GT(size.hessian_nnz, 0);
+    EXPECT_GT(size.num_sx_nodes, 0);
+    std::cout << "Transcription " << name << ": " << size.num_variables << " variables, " <<
+      size.num_constraints << " constraints, " << size.num_parameters << " parameters, " <<
+      "jacobian nnz " << size.jacobian_nnz << ", hessian nnz " << size.hessian_nnz << ", " <<
+      size.num_mx_nodes << " MX nodes, " << size.num_sx_nodes << " SX nodes" << std::endl;
+    std::cout << "Transcription " << name << ": " << iter_count / num_solve <<
+      " iterations, " << total_times.at("total") / num_solve << "ms per solve, " <<
+      total_times.at("total") / iter_count << "ms per iteration (";
+    for (const auto & [function, time] : total_times) {
+      if (function != "total") {
+        std::cout << function << " " << time / iter_count << "ms ";
+      }
+    }
+    std::cout << ")" << std::endl;
+
+    if (transcription == RacingMPCTranscription::SHOOTING) {
+      shooting_nx = size.num_variables;
+    } else {
+      // the collocation states are decision variables
+      EXPECT_GT(size.num_variables, shooting_nx);
+    }
+  }
+}
+
+TEST(RacingMPCTest, ModelCollocationTest)
+{
+  using lmpc::mpc::racing_mpc::RacingMPCConfig;
+  using lmpc::mpc::racing_mpc::RacingMPCTranscription;
+
+  // the double track model enforces the full dynamics itself
+  rclcpp::init(0, nullptr);
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle.param.yaml",
+    "--params-file", ament_index_cpp::get_package_share_directory("double_track_planar_model") +
+    "/param/sample_vehicle.param.yaml",
+    "--params-file", share_dir + "/param/sample_mpc.param.yaml"
+  });
+  auto test_node = rclcpp::Node("test_racing_mpc_node", options);
+  auto model = lmpc::vehicle_model::vehicle_model_factory::load_vehicle_model(
+    "double_track_planar_model", &test_node);
+  auto config = lmpc::mpc::racing_mpc::load_parameters(&test_node);
+  rclcpp::shutdown();
+  ASSERT_TRUE(model);
+  ASSERT_TRUE(model->enforces_dynamics());
+  config->learning = false;
+  config->load = false;
+  config->record = false;
+  config->collocation_degree = 3;
+
+  const auto nx = static_cast<casadi_int>(model->nx());
+  const auto num_steps = static_cast<casadi_int>(config->N) - 1;
+  const std::vector<std::pair<RacingMPCTranscription, casadi_int>> transcriptions{
+    {RacingMPCTranscription::SHOOTING, 0},
+    {RacingMPCTranscription::HERMITE_SIMPSON, 1},
+    {RacingMPCTranscription::LEGENDRE, 3}
+  };
+  lmpc::mpc::racing_mpc::RacingMPCProblemSize shooting_size;
+  for (const auto & [transcription, nc] : transcriptions) {
+    auto mpc_config = std::make_shared<RacingMPCConfig>(*config);
+    mpc_config->transcription = transcription;
+    auto mpc = RacingMPC(mpc_config, model, true);
+    const auto size = mpc.problem_size();
+    if (transcription == RacingMPCTranscription::SHOOTING) {
+      shooting_size = size;
+      continue;
+    }
+    // each step trades the model's RK4 step for its collocation defect, and the dynamics
+    // are not enforced a second time by the MPC
+    EXPECT_EQ(size.num_variables - shooting_size.num_variables, nx * nc * num_steps);
+    EXPECT_EQ(size.num_constraints - shooting_size.num_constraints, nx * nc * num_steps);
+  }
+
+  // a single Legendre point would be read as the Hermite-Simpson midpoint
+  auto legendre_config = std::make_shared<RacingMPCConfig>(*config);
+  legendre_config->transcription = RacingMPCTranscription::LEGENDRE;
+  legendre_config->collocation_degree = 1;
+  EXPECT_THROW(RacingMPC(legendre_config, model, true), std::invalid_argument);
+}
+
 // TEST(RacingMPCTest, MPCSolveTestAtJoint)
 // {
 //   const lmpc::Pose2D x0_pose2d{
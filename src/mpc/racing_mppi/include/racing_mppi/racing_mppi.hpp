@@ -0,0 +1,132 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RACING_MPPI__RACING_MPPI_HPP_
+#define RACING_MPPI__RACING_MPPI_HPP_
+
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <casadi/casadi.hpp>
+#include <lmpc_utils/casadi_evaluator.hpp>
+#include <lmpc_utils/parallel_jit.hpp>
+
+#include "racing_mppi/racing_mppi_config.hpp"
+#include "vehicle_model_factory/vehicle_model_factory.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mppi
+{
+using lmpc::vehicle_model::base_vehicle_model::BaseVehicleModel;
+using lmpc::vehicle_model::base_vehicle_model::XIndex;
+using lmpc::vehicle_model::base_vehicle_model::UIndex;
+using lmpc::utils::CasadiEvaluator;
+using lmpc::utils::ParallelJitStats;
+
+/**
+ * @brief Model predictive path integral controller.
+ *
+ * Every solve perturbs the nominal control sequence with gaussian noise, rolls out
+ * num_samples sequences through the discrete dynamics of the model in the Frenet frame,
+ * and moves the nominal sequence towards the exponentially weighted average of the samples.
+ * The rollouts are split into one batch per thread; each batch is a single mapped
+ * casadi::Function, evaluated on preallocated buffers.
+ */
+class RacingMPPI
+{
+public:
+  typedef std::shared_ptr<RacingMPPI> SharedPtr;
+  typedef std::unique_ptr<RacingMPPI> UniquePtr;
+
+  explicit RacingMPPI(
+    RacingMPPIConfig::SharedPtr mppi_config,
+    BaseVehicleModel::SharedPtr model);
+  ~RacingMPPI();
+  RacingMPPI(const RacingMPPI &) = delete;
+  RacingMPPI & operator=(const RacingMPPI &) = delete;
+
+  const RacingMPPIConfig & get_config() const;
+
+  /**
+   * @brief Run one MPPI iteration.
+   *
+   * @param in x_ic, u_ic, curvatures, bound_left, bound_right and vel_ref, same as RacingMPC.
+   * lateral_ref is optional (default 0). U_ref (nu x N-1), if given, replaces the nominal
+   * control sequence, otherwise the previous solution shifted by one step is used.
+   * @param out X_optm, U_optm and dU_optm of the nominal rollout after the update.
+   * @param stats success, min_cost and effective_sample_size.
+   * @throws std::invalid_argument if an input has the wrong size.
+   */
+  void solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::Dict & stats);
+
+  BaseVehicleModel & get_model();
+
+  const bool & solved() const;
+
+  // number of rollouts per solve, i.e. num_samples rounded up to a multiple of num_threads
+  size_t num_rollouts() const;
+
+  // timing of the rollout compilation, empty if jit is disabled
+  const ParallelJitStats & jit_stats() const;
+
+protected:
+  RacingMPPIConfig::SharedPtr config_ {};
+  BaseVehicleModel::SharedPtr model_ {};
+  bool solved_ = false;
+  size_t samples_per_thread_;
+
+  casadi::Function rollout_;  // single sequence, outputs X and cost
+  casadi::Function cost_;  // single sequence, outputs cost
+
+  ParallelJitStats jit_stats_ {};
+
+  CasadiEvaluator::UniquePtr rollout_eval_;
+  // one batch of samples_per_thread_ rollouts per thread
+  std::vector<CasadiEvaluator::UniquePtr> batch_evals_;
+  std::vector<std::mt19937> generators_;
+  std::vector<std::exception_ptr> batch_errors_;  // of the last evaluation of each batch
+
+  casadi::DM u_nom_;  // nominal control sequence (nu x N-1)
+  casadi::DM eps_;  // control perturbations of all rollouts (nu x (N-1) * num_rollouts)
+  std::vector<double> costs_;
+  std::vector<double> weights_;
+
+  // the calling thread evaluates batch 0, the workers evaluate the other batches
+  std::vector<std::thread> workers_;
+  std::mutex pool_mutex_;
+  std::condition_variable pool_cv_;
+  std::condition_variable done_cv_;
+  size_t generation_ = 0;
+  size_t pending_ = 0;
+  bool stopping_ = false;
+
+  void build_rollout();
+  void worker_loop(const size_t & batch);
+  void sample_batch(const size_t & batch);
+  void run_batches();
+};
+}  // namespace racing_mppi
+}  // namespace mpc
+}  // namespace lmpc
+#endif  // RACING_MPPI__RACING_MPPI_HPP_
@@ -0,0 +1,55 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RACING_MPPI__RACING_MPPI_CONFIG_HPP_
+#define RACING_MPPI__RACING_MPPI_CONFIG_HPP_
+
+#include <memory>
+
+#include <casadi/casadi.hpp>
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mppi
+{
+struct RacingMPPIConfig
+{
+  typedef std::shared_ptr<RacingMPPIConfig> SharedPtr;
+
+  size_t N;  // steps
+  double dt;  // delta t between steps
+  size_t num_samples;  // perturbed control sequences per solve, rounded up to the threads
+  size_t num_threads;  // rollout threads, including the calling thread
+  bool jit;  // compile the rollouts
+  double temperature;  // lambda of the path integral weights
+  casadi::DM noise_std;  // standard deviation of the control perturbations
+  double margin;  // safety margin to the track boundary
+  casadi::DM q_progress;  // reward of the abscissa gained over the horizon
+  casadi::DM q_boundary;  // cost of the track boundary violation
+  casadi::DM q_vel;  // velocity reference tracking cost
+  casadi::DM q_contour;  // lateral reference tracking cost
+  casadi::DM R;  // control cost
+  casadi::DM R_d;  // control rate cost
+  casadi::DM u_max;  // control upper bound
+  casadi::DM u_min;  // control lower bound
+  size_t seed;  // seed of the perturbations
+};
+}  // namespace racing_mppi
+}  // namespace mpc
+}  // namespace lmpc
+#endif  // RACING_MPPI__RACING_MPPI_CONFIG_HPP_
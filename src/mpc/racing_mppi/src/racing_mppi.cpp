@@ -0,0 +1,367 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "racing_mppi/racing_mppi.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mppi
+{
+RacingMPPI::RacingMPPI(
+  RacingMPPIConfig::SharedPtr mppi_config,
+  BaseVehicleModel::SharedPtr model)
+: config_(mppi_config), model_(model)
+{
+  using casadi::DM;
+
+  if (config_->N < 2 || config_->num_samples == 0 || config_->num_threads == 0) {
+    throw std::invalid_argument("RacingMPPI: N must be at least 2, samples and threads positive.");
+  }
+  if (config_->temperature <= 0.0) {
+    throw std::invalid_argument("RacingMPPI: temperature must be positive.");
+  }
+  const auto nu = static_cast<casadi_int>(model_->nu());
+  if (config_->noise_std.numel() != nu || config_->u_max.numel() != nu ||
+    config_->u_min.numel() != nu)
+  {
+    throw std::invalid_argument("RacingMPPI: noise_std, u_max and u_min must have nu elements.");
+  }
+
+  build_rollout();
+
+  const auto num_threads = config_->num_threads;
+  samples_per_thread_ = (config_->num_samples + num_threads - 1) / num_threads;
+  // the track data is shared by the rollouts of a batch, only the control sequences are stacked
+  std::vector<std::string> shared_inputs;
+  for (const auto & name : cost_.name_in()) {
+    if (name != "U") {
+      shared_inputs.push_back(name);
+    }
+  }
+  auto batch = cost_.map(
+    "mppi_batch", "serial", static_cast<casadi_int>(samples_per_thread_), shared_inputs, {});
+  if (config_->jit) {
+    // the mapped rollouts are plain loops over doubles, left to the compiler to vectorize
+    auto jit_options = lmpc::utils::ParallelJitOptions();
+    jit_options.flags = "-Ofast -march=native";
+    jit_options.name = "mppi_jit";
+    const auto compiled = lmpc::utils::parallel_jit({rollout_, batch}, jit_options, &jit_stats_);
+    rollout_ = compiled[0];
+    batch = compiled[1];
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    batch_evals_.push_back(std::make_unique<CasadiEvaluator>(batch));
+    generators_.emplace_back(static_cast<std::mt19937::result_type>(config_->seed + i));
+  }
+  batch_errors_.resize(num_threads);
+  rollout_eval_ = std::make_unique<CasadiEvaluator>(rollout_);
+
+  const auto seq_length = static_cast<casadi_int>(config_->N - 1);
+  u_nom_ = DM::zeros(nu, seq_length);
+  eps_ = DM::zeros(nu, seq_length * static_cast<casadi_int>(num_rollouts()));
+  costs_.resize(num_rollouts());
+  weights_.resize(num_rollouts());
+
+  for (size_t i = 1; i < num_threads; i++) {
+    workers_.emplace_back(&RacingMPPI::worker_loop, this, i);
+  }
+}
+
+RacingMPPI::~RacingMPPI()
+{
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    stopping_ = true;
+  }
+  pool_cv_.notify_all();
+  for (auto & worker : workers_) {
+    worker.join();
+  }
+}
+
+const RacingMPPIConfig & RacingMPPI::get_config() const
+{
+  return *config_.get();
+}
+
+void RacingMPPI::solve(const casadi::DMDict & in, casadi::DMDict & out, casadi::Dict & stats)
+{
+  using casadi::DM;
+
+  const auto nu = model_->nu();
+  const auto seq_length = nu * (config_->N - 1);
+  const auto dt = config_->dt;
+
+  // nominal control sequence
+  if (in.count("U_ref") && in.at("U_ref").size() == u_nom_.size()) {
+    u_nom_ = in.at("U_ref");
+  } else if (solved_) {
+    lmpc::utils::shift_columns(u_nom_);
+  }
+  const auto u_ic = in.count("u_ic") ? in.at("u_ic") : DM(u_nom_(casadi::Slice(), 0));
+
+  // the same track data for all the rollouts
+  auto set_inputs = [&](CasadiEvaluator & eval) {
+      const auto & f = eval.function();
+      for (casadi_int i = 0; i < f.n_in(); i++) {
+        const auto & name = f.name_in(i);
+        if (name == "U") {
+          continue;
+        } else if (name == "u_ic") {
+          eval.input(i) = u_ic;
+        } else if (name == "lateral_ref" && !in.count("lateral_ref")) {
+          std::fill(eval.input(i).nonzeros().begin(), eval.input(i).nonzeros().end(), 0.0);
+        } else {
+          eval.input(i) = in.at(name);
+        }
+        if (eval.input(i).nnz() != f.nnz_in(i)) {
+          throw std::invalid_argument("RacingMPPI: input " + name + " has the wrong size.");
+        }
+      }
+    };
+  for (auto & eval : batch_evals_) {
+    set_inputs(*eval);
+  }
+  set_inputs(*rollout_eval_);
+
+  run_batches();
+
+  // path integral weights, relative to the best rollout for numerical stability;
+  // diverged rollouts (non-finite cost) get no weight
+  auto min_cost = std::numeric_limits<double>::infinity();
+  for (const auto & cost : costs_) {
+    if (std::isfinite(cost)) {
+      min_cost = std::min(min_cost, cost);
+    }
+  }
+  if (!std::isfinite(min_cost)) {
+    stats["success"] = false;
+    return;
+  }
+  double weight_sum = 0.0;
+  double weight_sq_sum = 0.0;
+  for (size_t k = 0; k < costs_.size(); k++) {
+    weights_[k] = std::isfinite(costs_[k]) ?
+      std::exp(-(costs_[k] - min_cost) / config_->temperature) : 0.0;
+    weight_sum += weights_[k];
+    weight_sq_sum += weights_[k] * weights_[k];
+  }
+
+  auto & u_nom = u_nom_.nonzeros();
+  const auto & eps = eps_.nonzeros();
+  for (size_t k = 0; k < costs_.size(); k++) {
+    if (weights_[k] == 0.0) {
+      continue;
+    }
+    const auto w = weights_[k] / weight_sum;
+    const auto offset = k * seq_length;
+    for (size_t l = 0; l < seq_length; l++) {
+      u_nom[l] += w * eps[offset + l];
+    }
+  }
+
+  // nominal rollout
+  rollout_eval_->input("U") = u_nom_;
+  rollout_eval_->evaluate();
+  solved_ = true;
+
+  auto dU = DM::zeros(u_nom_.size1(), u_nom_.size2());
+  auto & du = dU.nonzeros();
+  const auto & u_ic_nz = u_ic.nonzeros();
+  for (size_t l = 0; l < seq_length; l++) {
+    const auto u_prev = l < nu ? u_ic_nz[l] : u_nom[l - nu];
+    du[l] = (u_nom[l] - u_prev) / dt;
+  }
+  out["X_optm"] = rollout_eval_->output("X");
+  out["U_optm"] = u_nom_;
+  out["dU_optm"] = dU;
+
+  stats["success"] = true;
+  stats["min_cost"] = min_cost;
+  stats["cost"] = static_cast<double>(rollout_eval_->output("cost"));
+  stats["effective_sample_size"] = weight_sum * weight_sum / weight_sq_sum;
+}
+
+BaseVehicleModel & RacingMPPI::get_model()
+{
+  return *model_;
+}
+
+const bool & RacingMPPI::solved() const
+{
+  return solved_;
+}
+
+size_t RacingMPPI::num_rollouts() const
+{
+  return samples_per_thread_ * config_->num_threads;
+}
+
+const ParallelJitStats & RacingMPPI::jit_stats() const
+{
+  return jit_stats_;
+}
+
+void RacingMPPI::build_rollout()
+{
+  using casadi::SX;
+  using casadi::Slice;
+
+  const auto N = static_cast<casadi_int>(config_->N);
+  const auto nx = static_cast<casadi_int>(model_->nx());
+  const auto nu = static_cast<casadi_int>(model_->nu());
+
+  const auto x_ic = SX::sym("x_ic", nx);
+  const auto u_ic = SX::sym("u_ic", nu);
+  const auto U = SX::sym("U", nu, N - 1);
+  const auto curvatures = SX::sym("curvatures", 1, N);
+  const auto bound_left = SX::sym("bound_left", 1, N);
+  const auto bound_right = SX::sym("bound_right", 1, N);
+  const auto vel_ref = SX::sym("vel_ref", 1, N);
+  const auto lateral_ref = SX::sym("lateral_ref", 1, N);
+
+  const auto dt = SX(config_->dt);
+  const auto R = SX(config_->R);
+  const auto R_d = SX(config_->R_d);
+  const auto q_boundary = SX(config_->q_boundary);
+  const auto q_vel = SX(config_->q_vel);
+  const auto q_contour = SX(config_->q_contour);
+  const auto margin = config_->margin + model_->get_base_config().chassis_config->b / 2.0;
+
+  auto X = SX::zeros(nx, N);
+  X(Slice(), 0) = x_ic;
+  SX cost = 0.0;
+  for (casadi_int i = 0; i < N - 1; i++) {
+    const SX xi = X(Slice(), i);
+    const SX ui = U(Slice(), i);
+    const SX uim1 = i == 0 ? u_ic : SX(U(Slice(), i - 1));
+    const SX dui = (ui - uim1) / dt;
+    X(Slice(), i + 1) = model_->fast_discrete_dynamics()(
+      casadi::SXDict{{"x", xi}, {"u", ui}, {"k", curvatures(i)}, {"dt", dt}}).at("xip1");
+    cost += SX::mtimes({ui.T(), R, ui});
+    cost += SX::mtimes({dui.T(), R_d, dui});
+
+    // track boundary as a soft constraint, since infeasible samples still need a finite cost
+    const SX py = X(XIndex::PY, i + 1);
+    const SX left_violation = SX::fmax(py - (bound_left(i + 1) - margin), SX(0.0));
+    const SX right_violation = SX::fmax(bound_right(i + 1) + margin - py, SX(0.0));
+    cost += q_boundary * (left_violation * left_violation + right_violation * right_violation);
+    cost += q_vel * SX::sq(X(XIndex::VX, i + 1) - vel_ref(i + 1));
+    cost += q_contour * SX::sq(py - lateral_ref(i + 1));
+  }
+  cost -= SX(config_->q_progress) * (SX(X(XIndex::PX, N - 1)) - x_ic(XIndex::PX));
+
+  const auto in = casadi::SXVector{
+    x_ic, u_ic, U, curvatures, bound_left, bound_right, vel_ref, lateral_ref};
+  const auto in_names = std::vector<std::string>{
+    "x_ic", "u_ic", "U", "curvatures", "bound_left", "bound_right", "vel_ref", "lateral_ref"};
+  rollout_ = casadi::Function("mppi_rollout", in, {X, cost}, in_names, {"X", "cost"});
+  cost_ = casadi::Function("mppi_cost", in, {cost}, in_names, {"cost"});
+}
+
+void RacingMPPI::worker_loop(const size_t & batch)
+{
+  size_t generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(pool_mutex_);
+      pool_cv_.wait(lock, [&] {return stopping_ || generation_ != generation;});
+      if (stopping_) {
+        return;
+      }
+      generation = generation_;
+    }
+    sample_batch(batch);
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex_);
+      pending_--;
+    }
+    done_cv_.notify_one();
+  }
+}
+
+void RacingMPPI::sample_batch(const size_t & batch)
+{
+  auto & eval = *batch_evals_[batch];
+  auto & gen = generators_[batch];
+  std::normal_distribution<double> normal(0.0, 1.0);
+
+  const auto nu = model_->nu();
+  const auto seq_length = nu * (config_->N - 1);
+  const auto & u_nom = u_nom_.nonzeros();
+  const auto & noise_std = config_->noise_std.nonzeros();
+  const auto & u_max = config_->u_max.nonzeros();
+  const auto & u_min = config_->u_min.nonzeros();
+  auto & U = eval.input("U").nonzeros();
+  auto & eps = eps_.nonzeros();
+
+  for (size_t j = 0; j < samples_per_thread_; j++) {
+    const auto k = batch * samples_per_thread_ + j;
+    for (size_t l = 0; l < seq_length; l++) {
+      const auto row = l % nu;
+      auto u = u_nom[l];
+      // the first rollout keeps the nominal sequence, so the update never gets worse than it
+      if (k != 0) {
+        u += noise_std[row] * normal(gen);
+      }
+      u = std::clamp(u, u_min[row], u_max[row]);
+      U[j * seq_length + l] = u;
+      eps[k * seq_length + l] = u - u_nom[l];
+    }
+  }
+
+  // an exception cannot leave a worker, so it is rethrown by run_batches()
+  try {
+    eval.evaluate();
+    const auto & cost = eval.output(0).nonzeros();
+    std::copy(cost.begin(), cost.end(), costs_.begin() + batch * samples_per_thread_);
+  } catch (...) {
+    batch_errors_[batch] = std::current_exception();
+  }
+}
+
+void RacingMPPI::run_batches()
+{
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    pending_ = workers_.size();
+    generation_++;
+  }
+  pool_cv_.notify_all();
+  sample_batch(0);
+  std::unique_lock<std::mutex> lock(pool_mutex_);
+  done_cv_.wait(lock, [&] {return pending_ == 0;});
+  lock.unlock();
+  for (auto & error : batch_errors_) {
+    if (error) {
+      const auto rethrown = error;
+      std::fill(batch_errors_.begin(), batch_errors_.end(), nullptr);
+      std::rethrow_exception(rethrown);
+    }
+  }
+}
+}  // namespace racing_mppi
+}  // namespace mpc
+}  // namespace lmpc
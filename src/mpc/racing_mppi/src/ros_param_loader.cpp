@@ -0,0 +1,77 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <string>
+#include <memory>
+#include <vector>
+
+#include <lmpc_utils/ros_param_helper.hpp>
+
+#include "racing_mppi/ros_param_loader.hpp"
+
+namespace lmpc
+{
+namespace mpc
+{
+namespace racing_mppi
+{
+RacingMPPIConfig::SharedPtr load_parameters(rclcpp::Node * node)
+{
+  auto declare_double = [&](const char * name) {
+      return lmpc::utils::declare_parameter<double>(node, name);
+    };
+  auto declare_vec = [&](const char * name) {
+      return lmpc::utils::declare_parameter<std::vector<double>>(node, name);
+    };
+  auto declare_int = [&](const char * name) {
+      return lmpc::utils::declare_parameter<int64_t>(node, name);
+    };
+  auto declare_bool = [&](const char * name) {
+      return lmpc::utils::declare_parameter<bool>(node, name);
+    };
+
+  const auto R = casadi::DM(declare_vec("racing_mppi.r"));
+  const auto R_d = casadi::DM(declare_vec("racing_mppi.r_d"));
+
+  return std::make_shared<RacingMPPIConfig>(
+    RacingMPPIConfig{
+          static_cast<size_t>(declare_int("racing_mppi.n")),
+          declare_double("racing_mppi.dt"),
+          static_cast<size_t>(declare_int("racing_mppi.num_samples")),
+          static_cast<size_t>(declare_int("racing_mppi.num_threads")),
+          declare_bool("racing_mppi.jit"),
+          declare_double("racing_mppi.temperature"),
+          casadi::DM(declare_vec("racing_mppi.noise_std")),
+          declare_double("racing_mppi.margin"),
+          casadi::DM(declare_double("racing_mppi.q_progress")),
+          casadi::DM(declare_double("racing_mppi.q_boundary")),
+          casadi::DM(declare_double("racing_mppi.q_vel")),
+          casadi::DM(declare_double("racing_mppi.q_contour")),
+          casadi::DM::reshape(
+            R, static_cast<casadi_int>(sqrt(R.size1())),
+            static_cast<casadi_int>(sqrt(R.size1()))),
+          casadi::DM::reshape(
+            R_d, static_cast<casadi_int>(sqrt(R_d.size1())),
+            static_cast<casadi_int>(sqrt(R_d.size1()))),
+          casadi::DM(declare_vec("racing_mppi.u_max")),
+          casadi::DM(declare_vec("racing_mppi.u_min")),
+          static_cast<size_t>(declare_int("racing_mppi.seed"))
+        }
+  );
+}
+}  // namespace racing_mppi
+}  // namespace mpc
+}  // namespace lmpc
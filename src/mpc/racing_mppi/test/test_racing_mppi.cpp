@@ -0,0 +1,148 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <gtest/gtest.h>
+
+#include <math.h>
+#include <iostream>
+#include <chrono>
+#include <rclcpp/rclcpp.hpp>
+#include <ament_index_cpp/get_package_share_directory.hpp>
+
+#include <base_vehicle_model/ros_param_loader.hpp>
+#include <single_track_planar_model/ros_param_loader.hpp>
+#include <lmpc_utils/primitives.hpp>
+#include <racing_trajectory/racing_trajectory.hpp>
+#include "racing_mppi/racing_mppi.hpp"
+#include "racing_mppi/ros_param_loader.hpp"
+
+using lmpc::mpc::racing_mppi::RacingMPPI;
+using lmpc::vehicle_model::single_track_planar_model::SingleTrackPlanarModel;
+using lmpc::vehicle_model::single_track_planar_model::XIndex;
+
+const auto share_dir = ament_index_cpp::get_package_share_directory("racing_mppi");
+const auto base_share_dir = ament_index_cpp::get_package_share_directory("base_vehicle_model");
+const auto model_share_dir = ament_index_cpp::get_package_share_directory(
+  "single_track_planar_model");
+const auto trajectory_share_dir = ament_index_cpp::get_package_share_directory(
+  "racing_trajectory");
+
+RacingMPPI::SharedPtr get_mppi()
+{
+  rclcpp::init(0, nullptr);
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle_2.param.yaml",
+    "--params-file", model_share_dir + "/param/sample_vehicle_2.param.yaml",
+    "--params-file", share_dir + "/param/sample_mppi.param.yaml"
+  });
+  auto test_node = rclcpp::Node("test_racing_mppi_node", options);
+
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(&test_node);
+  auto model_config = lmpc::vehicle_model::single_track_planar_model::load_parameters(&test_node);
+  auto model = std::make_shared<SingleTrackPlanarModel>(base_config, model_config);
+
+  auto config = lmpc::mpc::racing_mppi::load_parameters(&test_node);
+  auto mppi = std::make_shared<RacingMPPI>(config, model);
+
+  rclcpp::shutdown();
+  return mppi;
+}
+
+// track data along a constant speed guess of the horizon, as the MPC node computes it
+casadi::DMDict get_sol_in(
+  const RacingMPPI & mppi, lmpc::vehicle_model::racing_trajectory::RacingTrajectory & traj,
+  const double & v0)
+{
+  using casadi::DM;
+  using casadi::Slice;
+  const auto N = static_cast<casadi_int>(mppi.get_config().N);
+  const auto dt = mppi.get_config().dt;
+
+  lmpc::FrenetPose2D x0_frenet;
+  traj.global_to_frenet(lmpc::Pose2D{{0.0, 0.0}, 0.0}, x0_frenet);
+  auto abscissa = DM::zeros(1, N);
+  for (casadi_int i = 0; i < N; i++) {
+    abscissa(i) = x0_frenet.position.s + v0 * dt * i;
+  }
+  return casadi::DMDict{
+    {"x_ic", DM{x0_frenet.position.s, x0_frenet.position.t, x0_frenet.yaw, v0, 0.0, 0.0}},
+    {"u_ic", DM::zeros(2, 1)},
+    {"bound_left", traj.left_boundary_interpolation_function()(abscissa)[0]},
+    {"bound_right", traj.right_boundary_interpolation_function()(abscissa)[0]},
+    {"curvatures", traj.curvature_interpolation_function()(abscissa)[0]},
+    {"vel_ref", traj.velocity_interpolation_function()(abscissa)[0]}
+  };
+}
+
+TEST(RacingMPPITest, RacingMPPISolveTest) {
+  auto mppi = get_mppi();
+  auto traj = lmpc::vehicle_model::racing_trajectory::RacingTrajectory(
+    trajectory_share_dir + "/test_data/mgkt_optm.txt");
+  const auto sol_in = get_sol_in(*mppi, traj, 5.0);
+  const auto N = static_cast<casadi_int>(mppi->get_config().N);
+
+  auto sol_out = casadi::DMDict{};
+  auto stats = casadi::Dict{};
+  for (int i = 0; i < 5; i++) {
+    mppi->solve(sol_in, sol_out, stats);
+    ASSERT_TRUE(stats.at("success").as_bool());
+  }
+  const auto & X_optm = sol_out.at("X_optm");
+  EXPECT_EQ(X_optm.size1(), static_cast<casadi_int>(mppi->get_model().nx()));
+  EXPECT_EQ(X_optm.size2(), N);
+  EXPECT_EQ(sol_out.at("U_optm").size2(), N - 1);
+  EXPECT_GT(static_cast<double>(X_optm(XIndex::PX, N - 1) - X_optm(XIndex::PX, 0)), 0.0);
+  EXPECT_GE(static_cast<double>(stats.at("effective_sample_size")), 1.0);
+  std::cout << "MPPI Effective Sample Size: " << stats.at("effective_sample_size") << std::endl;
+}
+
+TEST(RacingMPPITest, RacingMPPIInputSizeTest) {
+  auto mppi = get_mppi();
+  auto traj = lmpc::vehicle_model::racing_trajectory::RacingTrajectory(
+    trajectory_share_dir + "/test_data/mgkt_optm.txt");
+  auto sol_in = get_sol_in(*mppi, traj, 5.0);
+  sol_in["vel_ref"] = casadi::DM::zeros(1, 1);
+
+  auto sol_out = casadi::DMDict{};
+  auto stats = casadi::Dict{};
+  EXPECT_THROW(mppi->solve(sol_in, sol_out, stats), std::invalid_argument);
+}
+
+TEST(RacingMPPITest, RacingMPPIBenchmark) {
+  auto mppi = get_mppi();
+  auto traj = lmpc::vehicle_model::racing_trajectory::RacingTrajectory(
+    trajectory_share_dir + "/test_data/mgkt_optm.txt");
+  const auto sol_in = get_sol_in(*mppi, traj, 5.0);
+
+  auto sol_out = casadi::DMDict{};
+  auto stats = casadi::Dict{};
+  mppi->solve(sol_in, sol_out, stats);
+  const int num_solve = 20;
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_solve; i++) {
+    mppi->solve(sol_in, sol_out, stats);
+  }
+  const auto stop = std::chrono::high_resolution_clock::now();
+  const auto duration = std::chrono::duration<double>(stop - start).count();
+  const auto rollouts = static_cast<double>(mppi->num_rollouts() * num_solve);
+  std::cout << "MPPI Execution Time: " << duration / num_solve * 1e3 << "ms" << std::endl;
+  std::cout << "MPPI Rollouts per Second per Core: " <<
+    rollouts / duration / mppi->get_config().num_threads << std::endl;
+  SUCCEED();
+}
@@ -0,0 +1,116 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RACING_SIMULATOR__CAR_COLLISION_HPP_
+#define RACING_SIMULATOR__CAR_COLLISION_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <lmpc_utils/primitives.hpp>
+
+namespace lmpc
+{
+namespace simulation
+{
+namespace racing_simulator
+{
+struct CarContact
+{
+  size_t first;  // car index
+  size_t second;  // car index, greater than first
+  double depth;  // penetration depth along the separating axis of least overlap (m)
+};
+
+/**
+ * @brief Car-to-car contact detection on a closed race track.
+ *
+ * The broad phase sorts the cars by abscissa and only pairs cars whose abscissa gap
+ * (wrapped around the track) is within the reach of two car footprints. The narrow phase
+ * tests the candidate pairs as oriented boxes with the separating axis theorem.
+ */
+class CarCollisionDetector
+{
+public:
+  typedef std::shared_ptr<CarCollisionDetector> SharedPtr;
+  typedef std::unique_ptr<CarCollisionDetector> UniquePtr;
+
+  /**
+   * @brief Construct a new car collision detector
+   *
+   * @param front distance from the cg to the front of the car (m)
+   * @param rear distance from the cg to the rear of the car (m)
+   * @param half_width half width of the car (m)
+   * @param track_length total length of the race track (m)
+   * @param margin added to the broad phase reach, since the abscissa gap overestimates
+   * the distance between cars on the inside of a corner (m)
+   */
+  CarCollisionDetector(
+    const double & front, const double & rear, const double & half_width,
+    const double & track_length, const double & margin);
+
+  /**
+   * @brief detect the contacts between all cars
+   *
+   * @param abscissa abscissa of each car
+   * @param poses global pose of the cg of each car
+   * @return const std::vector<CarContact>& contacts, ordered by the first car
+   */
+  const std::vector<CarContact> & detect(
+    const std::vector<double> & abscissa,
+    const std::vector<Pose2D> & poses);
+
+  /**
+   * @brief contacts found in the last detection
+   */
+  const std::vector<CarContact> & contacts() const;
+
+  /**
+   * @brief number of pairs passed to the narrow phase in the last detection
+   */
+  size_t num_candidate_pairs() const;
+
+  /**
+   * @brief maximum abscissa gap of a candidate pair (m)
+   */
+  double reach() const;
+
+  /**
+   * @brief test two car footprints for contact
+   *
+   * @param p0 global pose of the cg of the first car
+   * @param p1 global pose of the cg of the second car
+   * @param depth output penetration depth, if in contact (m)
+   * @return true if the footprints overlap
+   */
+  bool overlap(const Pose2D & p0, const Pose2D & p1, double & depth) const;
+
+protected:
+  double center_offset_;  // cg to the center of the footprint (m)
+  double half_length_;
+  double half_width_;
+  double track_length_;
+  double reach_;
+
+  std::vector<double> abscissa_ {};  // wrapped into [0, track length)
+  std::vector<size_t> order_ {};  // car indices sorted by abscissa
+  std::vector<CarContact> contacts_ {};
+  size_t num_candidate_pairs_ {0};
+};
+}  // namespace racing_simulator
+}  // namespace simulation
+}  // namespace lmpc
+#endif  // RACING_SIMULATOR__CAR_COLLISION_HPP_
@@ -0,0 +1,148 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RACING_SIMULATOR__MULTI_CAR_SIMULATOR_HPP_
+#define RACING_SIMULATOR__MULTI_CAR_SIMULATOR_HPP_
+
+#include <memory>
+#include <vector>
+
+#include <casadi/casadi.hpp>
+
+#include "racing_simulator/car_collision.hpp"
+#include "racing_simulator/racing_simulator.hpp"
+
+namespace lmpc
+{
+namespace simulation
+{
+namespace racing_simulator
+{
+/**
+ * @brief Simulates many cars of the same model on one race track.
+ *
+ * All cars are stepped in one mapped evaluation of the model, which also returns the global
+ * pose of each car for the contact detection. States and controls are stored column-wise,
+ * one column per car.
+ */
+class MultiCarSimulator
+{
+public:
+  typedef std::shared_ptr<MultiCarSimulator> SharedPtr;
+  typedef std::unique_ptr<MultiCarSimulator> UniquePtr;
+
+  /**
+   * @brief Construct a new multi car simulator
+   *
+   * @param dt time step (s)
+   * @param x0 initial states (nx x number of cars)
+   * @param track race track
+   * @param model vehicle model shared by all cars
+   * @param contact_margin added to the reach of the contact broad phase (m)
+   */
+  MultiCarSimulator(
+    const double & dt,
+    const casadi::DM & x0,
+    RacingTrajectory::SharedPtr track,
+    SingleTrackPlanarModel::SharedPtr model,
+    const double & contact_margin);
+
+  /**
+   * @brief Get the vehicle model
+   *
+   * @return SingleTrackPlanarModel& model
+   */
+  SingleTrackPlanarModel & get_model();
+
+  /**
+   * @brief Get the race track
+   *
+   * @return RacingTrajectory& race track
+   */
+  RacingTrajectory & get_track();
+
+  size_t num_cars() const;
+
+  /**
+   * @brief return the current states of all cars
+   *
+   * @return const casadi::DM& states (nx x number of cars)
+   */
+  const casadi::DM & x() const;
+
+  /**
+   * @brief return the current base control inputs of all cars
+   *
+   * @return const casadi::DM& control inputs (base nu x number of cars)
+   */
+  const casadi::DM & u() const;
+
+  /**
+   * @brief return the global pose of the cg of each car after the last step
+   */
+  const std::vector<Pose2D> & global_poses() const;
+
+  /**
+   * @brief return the abscissa of each car after the last step
+   */
+  const std::vector<double> & abscissa() const;
+
+  /**
+   * @brief return the car-to-car contacts after the last step
+   */
+  const std::vector<CarContact> & contacts() const;
+
+  /**
+   * @brief return the contact detector
+   */
+  const CarCollisionDetector & collision_detector() const;
+
+  /**
+   * @brief reset the state of one car, and detect the contacts again
+   *
+   * @param car car index
+   * @param x new state
+   */
+  void set_state(const size_t & car, const casadi::DM & x);
+
+  /**
+   * @brief step all cars forward by one time step, and detect the contacts
+   *
+   * @param u base control inputs (base nu x number of cars)
+   */
+  void step(const casadi::DM & u);
+
+protected:
+  size_t num_cars_;
+  casadi::DM x_;
+  casadi::DM u_;
+  std::vector<Pose2D> global_poses_ {};
+  std::vector<double> abscissa_ {};
+
+  RacingTrajectory::SharedPtr track_ {};
+  SingleTrackPlanarModel::SharedPtr model_ {};
+  CarCollisionDetector collision_detector_;
+
+  // {x, u_base} -> {xip1, global pose} of one car, mapped over all cars
+  casadi::Function batch_step_ {};
+  // {x} -> {global pose} of one car, mapped over all cars
+  casadi::Function batch_pose_ {};
+
+  void update_contacts(const casadi::DM & poses);
+};
+}  // namespace racing_simulator
+}  // namespace simulation
+}  // namespace lmpc
+#endif  // RACING_SIMULATOR__MULTI_CAR_SIMULATOR_HPP_
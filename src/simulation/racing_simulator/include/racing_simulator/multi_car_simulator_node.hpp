@@ -0,0 +1,86 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RACING_SIMULATOR__MULTI_CAR_SIMULATOR_NODE_HPP_
+#define RACING_SIMULATOR__MULTI_CAR_SIMULATOR_NODE_HPP_
+
+#include <memory>
+#include <vector>
+
+#include <casadi/casadi.hpp>
+
+#include <rclcpp/rclcpp.hpp>
+
+#include <mpclab_msgs/msg/vehicle_state_msg.hpp>
+#include <mpclab_msgs/msg/vehicle_actuation_msg.hpp>
+#include <lmpc_msgs/msg/vehicle_state_array.hpp>
+
+#include "racing_simulator/racing_simulator_config.hpp"
+#include "racing_simulator/multi_car_simulator.hpp"
+
+namespace lmpc
+{
+namespace simulation
+{
+namespace racing_simulator
+{
+/**
+ * @brief Continuous-mode simulator of many cars on one race track.
+ *
+ * Car i subscribes to <prefix><i>/vehicle_actuation and <prefix><i>/reset_state, and
+ * publishes <prefix><i>/vehicle_state. A car without actuation coasts with zero input.
+ */
+class MultiCarSimulatorNode : public rclcpp::Node
+{
+public:
+  explicit MultiCarSimulatorNode(const rclcpp::NodeOptions & options);
+
+protected:
+  MultiCarSimulatorConfig::SharedPtr config_ {};
+  RacingTrajectory::SharedPtr track_ {};
+  SingleTrackPlanarModel::SharedPtr model_ {};
+  MultiCarSimulator::SharedPtr simulator_ {};
+  uint64_t sim_step_ {0};
+  std::vector<uint64_t> lap_count_ {};
+  size_t num_contacts_ {0};
+
+  // latest message of each car
+  std::vector<mpclab_msgs::msg::VehicleActuationMsg::SharedPtr> vehicle_actuation_msgs_ {};
+  lmpc_msgs::msg::VehicleStateArray vehicle_state_array_msg_ {};
+
+  // publishers (to controllers)
+  std::vector<rclcpp::Publisher<mpclab_msgs::msg::VehicleStateMsg>::SharedPtr> vehicle_state_pubs_;
+  rclcpp::Publisher<lmpc_msgs::msg::VehicleStateArray>::SharedPtr vehicle_state_array_pub_;
+
+  // subscribers (from controllers, reset state)
+  std::vector<rclcpp::Subscription<mpclab_msgs::msg::VehicleActuationMsg>::SharedPtr>
+  vehicle_actuation_subs_;
+  std::vector<rclcpp::Subscription<mpclab_msgs::msg::VehicleStateMsg>::SharedPtr>
+  reset_state_subs_;
+
+  rclcpp::TimerBase::SharedPtr sim_step_timer_;
+
+  // callbacks
+  void on_reset_state(const size_t & car, const mpclab_msgs::msg::VehicleStateMsg::SharedPtr msg);
+  void on_state_update();
+
+  // helper functions
+  // fill the state messages of all cars from the simulator
+  void update_vehicle_state_msgs();
+};
+}  // namespace racing_simulator
+}  // namespace simulation
+}  // namespace lmpc
+#endif  // RACING_SIMULATOR__MULTI_CAR_SIMULATOR_NODE_HPP_
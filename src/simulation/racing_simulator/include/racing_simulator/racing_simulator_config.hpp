@@ -45,6 +45,18 @@ struct RacingSimulatorConfig
   std::string race_track_file_path = "";
   RacingSimulatorStepMode step_mode = RacingSimulatorStepMode::STEP;
   casadi::DM x0;
+  double latency_report_period = 0.0;  // s, 0 to disable the latency trace diagnostics
+};
+
+struct MultiCarSimulatorConfig
+{
+  typedef std::shared_ptr<MultiCarSimulatorConfig> SharedPtr;
+  double dt = 0.0;
+  std::string race_track_file_path = "";
+  std::string car_namespace_prefix = "car_";  // car i is controlled under <prefix><i>/
+  casadi::DM x0;  // nx x number of cars
+  double contact_margin = 0.0;  // m, added to the reach of the contact broad phase
+  bool publish_batched_state = false;  // also publish all cars in one message
 };
 }  // namespace racing_simulator
 }  // namespace simulation
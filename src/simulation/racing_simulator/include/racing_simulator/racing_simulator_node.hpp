@@ -25,10 +25,12 @@
 #include <geometry_msgs/msg/polygon_stamped.hpp>
 #include <geometry_msgs/msg/transform_stamped.hpp>
 #include <nav_msgs/msg/odometry.hpp>
+#include <diagnostic_msgs/msg/diagnostic_array.hpp>
 
 #include <mpclab_msgs/msg/vehicle_state_msg.hpp>
 #include <mpclab_msgs/msg/vehicle_actuation_msg.hpp>
 #include <lmpc_transform_helper/lmpc_transform_helper.hpp>
+#include <lmpc_utils/latency_histogram.hpp>
 
 #include "racing_simulator/racing_simulator_config.hpp"
 #include "racing_simulator/racing_simulator.hpp"
@@ -64,6 +66,13 @@ protected:
   mpclab_msgs::msg::VehicleActuationMsg::SharedPtr vehicle_actuation_msg_ {};
   TransformStamped::SharedPtr map_to_baselink_msg_ {};
 
+  // end-to-end latency trace, measured when an actuation is first applied (ms)
+  mpclab_msgs::msg::VehicleActuationMsg::SharedPtr last_traced_actuation_msg_ {};
+  lmpc::utils::LatencyHistogram state_age_histogram_ {};  // state sampled to command applied
+  lmpc::utils::LatencyHistogram command_age_histogram_ {};  // command published to applied
+  lmpc::utils::LatencyHistogram controller_wait_histogram_ {};  // state sampled to step start
+  lmpc::utils::LatencyHistogram controller_step_histogram_ {};  // step start to command published
+
   // publishers (to controller)
   rclcpp::Publisher<mpclab_msgs::msg::VehicleStateMsg>::SharedPtr vehicle_state_pub_;
 
@@ -71,6 +80,9 @@ protected:
   rclcpp::Publisher<PolygonStamped>::SharedPtr vehicle_polygon_pub_;
   rclcpp::Publisher<nav_msgs::msg::Odometry>::SharedPtr vehicle_odom_pub_;
 
+  // publishers (to diagnostics)
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_pub_;
+
   // subscribers (from controller)
   rclcpp::Subscription<mpclab_msgs::msg::VehicleActuationMsg>::SharedPtr vehicle_actuation_sub_;
 
@@ -82,18 +94,22 @@ protected:
   rclcpp::TimerBase::SharedPtr state_repub_timer_;
   // continuous mode: stream vehicle state
   rclcpp::TimerBase::SharedPtr sim_step_timer_;
+  rclcpp::TimerBase::SharedPtr latency_report_timer_;
 
   // callbacks
   void on_actuation(const mpclab_msgs::msg::VehicleActuationMsg::SharedPtr msg);
   void on_reset_state(const mpclab_msgs::msg::VehicleStateMsg::SharedPtr msg);
   void on_state_repub_timer();
   void on_state_update();
+  void on_latency_report_timer();
 
   // helper functions
   Polygon build_polygon(const casadi::DM & pts);
   void update_vehicle_state_msg(
     const std::vector<double> & x, const FrenetPose2D & frenet_pose,
     const Pose2D & global_pose);
+  // record the latencies of the actuation if it is applied for the first time
+  void trace_actuation(const double & apply_time);
 };
 }  // namespace racing_simulator
 }  // namespace simulation
@@ -30,6 +30,7 @@ namespace simulation
 namespace racing_simulator
 {
 RacingSimulatorConfig::SharedPtr load_parameters(rclcpp::Node * node);
+MultiCarSimulatorConfig::SharedPtr load_multi_car_parameters(rclcpp::Node * node);
 }  // namespace racing_simulator
 }  // namespace simulation
 }  // namespace lmpc
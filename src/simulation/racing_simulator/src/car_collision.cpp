@@ -0,0 +1,157 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "racing_simulator/car_collision.hpp"
+
+namespace lmpc
+{
+namespace simulation
+{
+namespace racing_simulator
+{
+CarCollisionDetector::CarCollisionDetector(
+  const double & front, const double & rear, const double & half_width,
+  const double & track_length, const double & margin)
+: center_offset_(0.5 * (front - rear)),
+  half_length_(0.5 * (front + rear)),
+  half_width_(half_width),
+  track_length_(track_length),
+  reach_(2.0 * std::hypot(std::max(front, rear), half_width) + margin)
+{
+  if (half_length_ <= 0.0 || half_width_ <= 0.0) {
+    throw std::invalid_argument("CarCollisionDetector: the car footprint must not be empty");
+  }
+  if (track_length_ <= 0.0) {
+    throw std::invalid_argument("CarCollisionDetector: track length must be positive");
+  }
+}
+
+const std::vector<CarContact> & CarCollisionDetector::detect(
+  const std::vector<double> & abscissa,
+  const std::vector<Pose2D> & poses)
+{
+  const auto n = abscissa.size();
+  if (poses.size() != n) {
+    throw std::invalid_argument("CarCollisionDetector: one pose per abscissa is expected");
+  }
+  contacts_.clear();
+  num_candidate_pairs_ = 0;
+
+  // broad phase: the cars barely move between detections, so the previous order is
+  // nearly sorted and insertion sort is linear. cars at the same abscissa are ordered by index
+  abscissa_.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    abscissa_[i] = std::fmod(abscissa[i], track_length_);
+    if (abscissa_[i] < 0.0) {
+      abscissa_[i] += track_length_;
+    }
+  }
+  if (order_.size() != n) {
+    order_.resize(n);
+    std::iota(order_.begin(), order_.end(), 0);
+  }
+  for (size_t a = 1; a < n; a++) {
+    const auto i = order_[a];
+    auto b = a;
+    for (; b > 0 && (abscissa_[order_[b - 1]] > abscissa_[i] ||
+      (abscissa_[order_[b - 1]] == abscissa_[i] && order_[b - 1] > i)); b--)
+    {
+      order_[b] = order_[b - 1];
+    }
+    order_[b] = i;
+  }
+
+  // sweep ahead of each car, wrapping around the finish line
+  for (size_t a = 0; a < n; a++) {
+    const auto i = order_[a];
+    for (size_t step = 1; step < n; step++) {
+      const auto j = order_[(a + step) % n];
+      auto gap = abscissa_[j] - abscissa_[i];
+      if (gap < 0.0) {
+        gap += track_length_;
+      }
+      if (gap > reach_) {
+        break;
+      }
+      // on a track shorter than twice the reach, the pair is also found ahead of j.
+      // so is a pair at the same abscissa, found ahead of the car with the lower index
+      if ((track_length_ - gap <= reach_ || gap == 0.0) && j < i) {
+        continue;
+      }
+      num_candidate_pairs_++;
+
+      // narrow phase
+      double depth = 0.0;
+      if (overlap(poses[i], poses[j], depth)) {
+        contacts_.push_back(CarContact{std::min(i, j), std::max(i, j), depth});
+      }
+    }
+  }
+  std::sort(
+    contacts_.begin(), contacts_.end(), [](const CarContact & c0, const CarContact & c1) {
+      return c0.first < c1.first || (c0.first == c1.first && c0.second < c1.second);
+    });
+  return contacts_;
+}
+
+const std::vector<CarContact> & CarCollisionDetector::contacts() const
+{
+  return contacts_;
+}
+
+size_t CarCollisionDetector::num_candidate_pairs() const
+{
+  return num_candidate_pairs_;
+}
+
+double CarCollisionDetector::reach() const
+{
+  return reach_;
+}
+
+bool CarCollisionDetector::overlap(const Pose2D & p0, const Pose2D & p1, double & depth) const
+{
+  const double c0 = std::cos(p0.yaw), s0 = std::sin(p0.yaw);
+  const double c1 = std::cos(p1.yaw), s1 = std::sin(p1.yaw);
+  const double dx = p1.position.x + center_offset_ * c1 - p0.position.x - center_offset_ * c0;
+  const double dy = p1.position.y + center_offset_ * s1 - p0.position.y - center_offset_ * s0;
+
+  // the separating axes are the length and width directions of both boxes
+  const double axes[4][2] = {{c0, s0}, {-s0, c0}, {c1, s1}, {-s1, c1}};
+  depth = std::numeric_limits<double>::infinity();
+  for (const auto & axis : axes) {
+    const auto project = [&](const double & c, const double & s) {
+        return half_length_ * std::abs(c * axis[0] + s * axis[1]) +
+               half_width_ * std::abs(-s * axis[0] + c * axis[1]);
+      };
+    const auto overlap_on_axis = project(c0, s0) + project(c1, s1) -
+      std::abs(dx * axis[0] + dy * axis[1]);
+    if (overlap_on_axis <= 0.0) {
+      return false;
+    }
+    depth = std::min(depth, overlap_on_axis);
+  }
+  return true;
+}
+}  // namespace racing_simulator
+}  // namespace simulation
+}  // namespace lmpc
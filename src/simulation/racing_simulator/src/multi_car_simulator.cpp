@@ -0,0 +1,196 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <math.h>
+#include <stdexcept>
+#include <vector>
+
+#include "racing_simulator/multi_car_simulator.hpp"
+#include "lmpc_utils/utils.hpp"
+
+namespace lmpc
+{
+namespace simulation
+{
+namespace racing_simulator
+{
+namespace
+{
+CarCollisionDetector build_collision_detector(
+  const SingleTrackPlanarModel & model, const RacingTrajectory & track,
+  const double & contact_margin)
+{
+  const auto & chassis_config = *(model.get_base_config().chassis_config);
+  const auto lr = chassis_config.wheel_base * chassis_config.cg_ratio;
+  const auto lf = chassis_config.wheel_base - lr;
+  return CarCollisionDetector(lf, lr, chassis_config.b / 2.0, track.total_length(), contact_margin);
+}
+}  // namespace
+
+MultiCarSimulator::MultiCarSimulator(
+  const double & dt,
+  const casadi::DM & x0,
+  RacingTrajectory::SharedPtr track,
+  SingleTrackPlanarModel::SharedPtr model,
+  const double & contact_margin)
+: num_cars_(static_cast<size_t>(x0.size2())),
+  x_(casadi::DM::densify(x0)),
+  u_(casadi::DM::zeros(model->BaseVehicleModel::nu(), x0.size2())),
+  track_(track),
+  model_(model),
+  collision_detector_(build_collision_detector(*model, *track, contact_margin))
+{
+  if (dt <= 0) {
+    throw std::invalid_argument("dt must be positive");
+  }
+  if (num_cars_ == 0 || x0.size1() != static_cast<casadi_int>(model_->nx())) {
+    throw std::invalid_argument("MultiCarSimulator: x0 must be nx x number of cars");
+  }
+
+  // build the step of one car
+  const auto use_frenet = model_->get_base_config().modeling_config->use_frenet;
+  const auto x_sym = casadi::MX::sym("x", model_->nx());
+  const auto u_sym = casadi::MX::sym("u", model_->BaseVehicleModel::nu());
+  casadi::MX k = 0.0;
+  if (use_frenet) {
+    k = track_->curvature_interpolation_function()(x_sym(XIndex::PX))[0];
+  }
+  const auto u_derived = model_->from_base_control()(
+    casadi::MXDict{{"x", x_sym}, {"u", u_sym}}).at("u_out");
+  auto xip1 = model_->fast_discrete_dynamics()(
+    casadi::MXDict{{"x", x_sym}, {"u", u_derived}, {"k", k}, {"dt", dt}}
+  ).at("xip1");
+  if (use_frenet) {
+    xip1(XIndex::PX) = utils::align_abscissa<casadi::MX>(
+      xip1(XIndex::PX),
+      track_->total_length() / 2.0, track_->total_length());
+  } else {
+    xip1(XIndex::YAW) = utils::align_yaw<casadi::MX>(
+      xip1(XIndex::YAW), 0.0);
+  }
+
+  // the global pose of the cg, for the contact detection
+  const auto pose_sym = casadi::MX::vertcat(
+    {x_sym(XIndex::PX), x_sym(XIndex::PY), x_sym(XIndex::YAW)});
+  const auto car_pose = casadi::Function(
+    "car_pose", {x_sym},
+    {use_frenet ? track_->frenet_to_global_function()(pose_sym)[0] : pose_sym});
+  const auto car_step = casadi::Function(
+    "car_step", {x_sym, u_sym}, {xip1, car_pose(casadi::MXVector{xip1})[0]});
+
+  // one evaluation steps all cars
+  batch_step_ = car_step.map(static_cast<casadi_int>(num_cars_), "serial");
+  batch_pose_ = car_pose.map(static_cast<casadi_int>(num_cars_), "serial");
+  update_contacts(batch_pose_(casadi::DMVector{x_})[0]);
+}
+
+SingleTrackPlanarModel & MultiCarSimulator::get_model()
+{
+  return *model_;
+}
+
+RacingTrajectory & MultiCarSimulator::get_track()
+{
+  return *track_;
+}
+
+size_t MultiCarSimulator::num_cars() const
+{
+  return num_cars_;
+}
+
+const casadi::DM & MultiCarSimulator::x() const
+{
+  return x_;
+}
+
+const casadi::DM & MultiCarSimulator::u() const
+{
+  return u_;
+}
+
+const std::vector<Pose2D> & MultiCarSimulator::global_poses() const
+{
+  return global_poses_;
+}
+
+const std::vector<double> & MultiCarSimulator::abscissa() const
+{
+  return abscissa_;
+}
+
+const std::vector<CarContact> & MultiCarSimulator::contacts() const
+{
+  return collision_detector_.contacts();
+}
+
+const CarCollisionDetector & MultiCarSimulator::collision_detector() const
+{
+  return collision_detector_;
+}
+
+void MultiCarSimulator::set_state(const size_t & car, const casadi::DM & x)
+{
+  if (car >= num_cars_) {
+    throw std::out_of_range("MultiCarSimulator: car index out of range");
+  }
+  x_(casadi::Slice(), static_cast<casadi_int>(car)) = x;
+  update_contacts(batch_pose_(casadi::DMVector{x_})[0]);
+}
+
+void MultiCarSimulator::step(const casadi::DM & u)
+{
+  if (u.size1() != u_.size1() || u.size2() != u_.size2()) {
+    throw std::invalid_argument("MultiCarSimulator: u must be base nu x number of cars");
+  }
+
+  // velocity cannot be exactly zero for single track planar model
+  const auto nx = model_->nx();
+  auto & x_nz = x_.nonzeros();
+  for (size_t i = 0; i < num_cars_; i++) {
+    auto & v = x_nz[i * nx + XIndex::VX];
+    if (abs(v) < 1e-6) {
+      v = std::copysign(1e-6, v);
+    }
+  }
+
+  u_ = u;
+  const auto out = batch_step_(casadi::DMVector{x_, u_});
+  x_ = out.at(0);
+  update_contacts(out.at(1));
+}
+
+void MultiCarSimulator::update_contacts(const casadi::DM & poses)
+{
+  const auto & poses_nz = poses.nonzeros();
+  const auto & x_nz = x_.nonzeros();
+  const auto nx = model_->nx();
+  const auto use_frenet = model_->get_base_config().modeling_config->use_frenet;
+  global_poses_.resize(num_cars_);
+  abscissa_.resize(num_cars_);
+  for (size_t i = 0; i < num_cars_; i++) {
+    auto & pose = global_poses_[i];
+    pose.position.x = poses_nz[3 * i];
+    pose.position.y = poses_nz[3 * i + 1];
+    pose.yaw = poses_nz[3 * i + 2];
+    // the closest waypoint is accurate enough for the broad phase
+    abscissa_[i] = use_frenet ? x_nz[i * nx + XIndex::PX] :
+      track_->initial_frenet_guess(pose).position.s;
+  }
+  collision_detector_.detect(abscissa_, global_poses_);
+}
+}  // namespace racing_simulator
+}  // namespace simulation
+}  // namespace lmpc
@@ -0,0 +1,252 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <base_vehicle_model/ros_param_loader.hpp>
+#include <single_track_planar_model/ros_param_loader.hpp>
+#include <lmpc_utils/latency_histogram.hpp>
+
+#include "racing_simulator/multi_car_simulator_node.hpp"
+#include "racing_simulator/ros_param_loader.hpp"
+
+namespace lmpc
+{
+namespace simulation
+{
+namespace racing_simulator
+{
+MultiCarSimulatorNode::MultiCarSimulatorNode(const rclcpp::NodeOptions & options)
+: rclcpp::Node("multi_car_simulator_node", options),
+  config_(lmpc::simulation::racing_simulator::load_multi_car_parameters(this)),
+  track_(std::make_shared<RacingTrajectory>(config_->race_track_file_path)),
+  sim_step_(0)
+{
+  // initialize simulator
+  auto base_model_config =
+    lmpc::vehicle_model::base_vehicle_model::load_parameters(this);
+  auto single_track_model_config =
+    lmpc::vehicle_model::single_track_planar_model::load_parameters(this);
+  model_ = std::make_shared<SingleTrackPlanarModel>(base_model_config, single_track_model_config);
+  simulator_ = std::make_shared<MultiCarSimulator>(
+    config_->dt, config_->x0, track_, model_, config_->contact_margin);
+  const auto num_cars = simulator_->num_cars();
+
+  // initialize vehicle state messages
+  lap_count_.assign(num_cars, 0);
+  vehicle_actuation_msgs_.resize(num_cars);
+  vehicle_state_array_msg_.states.resize(num_cars);
+  update_vehicle_state_msgs();
+
+  // initialize the publishers and subscribers of each car
+  for (size_t i = 0; i < num_cars; i++) {
+    const auto ns = config_->car_namespace_prefix + std::to_string(i) + "/";
+    vehicle_state_pubs_.push_back(
+      this->create_publisher<mpclab_msgs::msg::VehicleStateMsg>(ns + "vehicle_state", 1));
+    vehicle_actuation_subs_.push_back(
+      this->create_subscription<mpclab_msgs::msg::VehicleActuationMsg>(
+        ns + "vehicle_actuation", 1,
+        [this, i](const mpclab_msgs::msg::VehicleActuationMsg::SharedPtr msg) {
+          vehicle_actuation_msgs_[i] = msg;
+        }));
+    reset_state_subs_.push_back(
+      this->create_subscription<mpclab_msgs::msg::VehicleStateMsg>(
+        ns + "reset_state", 1,
+        [this, i](const mpclab_msgs::msg::VehicleStateMsg::SharedPtr msg) {
+          on_reset_state(i, msg);
+        }));
+  }
+  if (config_->publish_batched_state) {
+    vehicle_state_array_pub_ = this->create_publisher<lmpc_msgs::msg::VehicleStateArray>(
+      "vehicle_states", 1);
+  }
+
+  // initialize timer
+  sim_step_timer_ = this->create_wall_timer(
+    std::chrono::milliseconds(static_cast<int>(config_->dt * 1000.0)),
+    std::bind(&MultiCarSimulatorNode::on_state_update, this));
+}
+
+void MultiCarSimulatorNode::on_reset_state(
+  const size_t & car,
+  const mpclab_msgs::msg::VehicleStateMsg::SharedPtr msg)
+{
+  // reset the car
+  casadi::DM x;
+  if (model_->get_base_config().modeling_config->use_frenet) {
+    x = casadi::DM{
+      msg->p.s,
+      msg->p.x_tran,
+      msg->p.e_psi,
+      msg->v.v_long,
+      msg->v.v_tran,
+      msg->w.w_psi
+    };
+  } else {
+    x = casadi::DM{
+      msg->x.x,
+      msg->x.y,
+      msg->e.psi,
+      msg->v.v_long,
+      msg->v.v_tran,
+      msg->w.w_psi
+    };
+  }
+  simulator_->set_state(car, x);
+}
+
+void MultiCarSimulatorNode::on_state_update()
+{
+  // cars without actuation coast
+  const auto num_cars = simulator_->num_cars();
+  const auto nu = static_cast<size_t>(simulator_->u().size1());
+  auto u = casadi::DM::zeros(simulator_->u().size1(), simulator_->u().size2());
+  auto & u_nz = u.nonzeros();
+  for (size_t i = 0; i < num_cars; i++) {
+    const auto & msg = vehicle_actuation_msgs_[i];
+    if (!msg) {
+      continue;
+    }
+    u_nz[i * nu + UIndex::FD] = msg->u_a > 0.0 ? msg->u_a : 0.0;
+    u_nz[i * nu + UIndex::FB] = msg->u_a < 0.0 ? msg->u_a : 0.0;
+    u_nz[i * nu + UIndex::STEER] = msg->u_steer;
+  }
+  simulator_->step(u);
+
+  // increment simulation step
+  sim_step_++;
+
+  // report new contacts
+  const auto & contacts = simulator_->contacts();
+  if (contacts.size() > num_contacts_) {
+    for (const auto & contact : contacts) {
+      RCLCPP_WARN(
+        this->get_logger(), "Contact between car %zu and car %zu (%.3fm).", contact.first,
+        contact.second, contact.depth);
+    }
+  }
+  num_contacts_ = contacts.size();
+
+  // update the vehicle state messages
+  const auto now = this->now();
+  const auto source_time = utils::trace_clock();
+  update_vehicle_state_msgs();
+
+  // publish the updated states, stamped for the latency trace
+  for (size_t i = 0; i < num_cars; i++) {
+    auto & msg = vehicle_state_array_msg_.states[i];
+    msg.header.stamp = now;
+    msg.timing.source_time = source_time;
+    msg.timing.publish_time = utils::trace_clock();
+    vehicle_state_pubs_[i]->publish(msg);
+  }
+  if (config_->publish_batched_state) {
+    vehicle_state_array_msg_.header.stamp = now;
+    vehicle_state_array_msg_.contact_first.clear();
+    vehicle_state_array_msg_.contact_second.clear();
+    vehicle_state_array_msg_.contact_depth.clear();
+    for (const auto & contact : contacts) {
+      vehicle_state_array_msg_.contact_first.push_back(static_cast<uint32_t>(contact.first));
+      vehicle_state_array_msg_.contact_second.push_back(static_cast<uint32_t>(contact.second));
+      vehicle_state_array_msg_.contact_depth.push_back(contact.depth);
+    }
+    vehicle_state_array_pub_->publish(vehicle_state_array_msg_);
+  }
+}
+
+void MultiCarSimulatorNode::update_vehicle_state_msgs()
+{
+  const auto num_cars = simulator_->num_cars();
+  const auto nx = model_->nx();
+  const auto & x = simulator_->x().nonzeros();
+  const auto & global_poses = simulator_->global_poses();
+
+  // find the frenet pose of all cars in one evaluation
+  std::vector<double> frenet_poses;
+  if (model_->get_base_config().modeling_config->use_frenet) {
+    frenet_poses.reserve(3 * num_cars);
+    for (size_t i = 0; i < num_cars; i++) {
+      frenet_poses.push_back(x[i * nx + XIndex::PX]);
+      frenet_poses.push_back(x[i * nx + XIndex::PY]);
+      frenet_poses.push_back(x[i * nx + XIndex::YAW]);
+    }
+  } else {
+    auto poses = casadi::DM::zeros(3, static_cast<casadi_int>(num_cars));
+    auto & poses_nz = poses.nonzeros();
+    for (size_t i = 0; i < num_cars; i++) {
+      poses_nz[3 * i] = global_poses[i].position.x;
+      poses_nz[3 * i + 1] = global_poses[i].position.y;
+      poses_nz[3 * i + 2] = global_poses[i].yaw;
+    }
+    frenet_poses = track_->global_to_frenet(poses, 1).get_elements();
+  }
+  auto abscissa = casadi::DM::zeros(1, static_cast<casadi_int>(num_cars));
+  for (size_t i = 0; i < num_cars; i++) {
+    abscissa.nonzeros()[i] = frenet_poses[3 * i];
+  }
+  const auto curvatures =
+    track_->curvature_interpolation_function()(abscissa)[0].get_elements();
+
+  for (size_t i = 0; i < num_cars; i++) {
+    const auto xi = x.begin() + i * nx;
+    const FrenetPose2D frenet_pose{{frenet_poses[3 * i], frenet_poses[3 * i + 1]},
+      frenet_poses[3 * i + 2]};
+    const auto & global_pose = global_poses[i];
+    auto & msg = vehicle_state_array_msg_.states[i];
+
+    // increment lap count if necessary
+    if (msg.p.s - frenet_pose.position.s > 0.5 * track_->total_length()) {
+      lap_count_[i]++;
+    }
+
+    // calculate the frenet frame velocity
+    const auto & k = curvatures[i];
+    const auto vb = BodyVelocity2D{xi[XIndex::VX], xi[XIndex::VY], xi[XIndex::VYAW]};
+    auto vs = transform_velocity(vb, frenet_pose.yaw);
+    vs.x /= (1.0 - k * frenet_pose.position.t);
+
+    // build the updated state message
+    msg.t = sim_step_ * config_->dt;
+    msg.x.x = global_pose.position.x;
+    msg.x.y = global_pose.position.y;
+    msg.e.psi = global_pose.yaw;
+    msg.v.v_long = xi[XIndex::VX];
+    msg.v.v_tran = xi[XIndex::VY];
+    msg.p.s = frenet_pose.position.s;
+    msg.p.x_tran = frenet_pose.position.t;
+    msg.p.e_psi = frenet_pose.yaw;
+    msg.pt.ds = vs.x;
+    msg.pt.dx_tran = vs.y;
+    msg.w.w_psi = xi[XIndex::VYAW];
+    msg.pt.de_psi = xi[XIndex::VYAW] - vs.x * k;
+
+    if (vehicle_actuation_msgs_[i]) {
+      msg.u = *vehicle_actuation_msgs_[i];
+    } else {
+      msg.u.u_a = 0.0;
+      msg.u.u_steer = 0.0;
+    }
+    msg.lap_num = lap_count_[i] + frenet_pose.position.s / track_->total_length();
+  }
+}
+}  // namespace racing_simulator
+}  // namespace simulation
+}  // namespace lmpc
+
+#include "rclcpp_components/register_node_macro.hpp"
+RCLCPP_COMPONENTS_REGISTER_NODE(lmpc::simulation::racing_simulator::MultiCarSimulatorNode)
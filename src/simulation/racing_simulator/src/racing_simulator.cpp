@@ -51,10 +51,10 @@ RacingSimulator::RacingSimulator(
     k = track_->curvature_interpolation_function()(x_sym(XIndex::PX))[0];
   }
 
-  auto xip1 = model_->discrete_dynamics()(
+  auto xip1 = model_->fast_discrete_dynamics()(
     casadi::MXDict{{"x", x_sym}, {"u", u_sym}, {"k", k}, {"dt", dt_}}
   ).at("xip1");
-  const auto x_dot = model_->dynamics()(
+  const auto x_dot = model_->fast_dynamics()(
     casadi::MXDict{{"x", x_sym}, {"u", u_sym}, {"k", k}}
   ).at("x_dot");
 
@@ -107,6 +107,15 @@ RacingSimulatorNode::RacingSimulatorNode(const rclcpp::NodeOptions & options)
   vehicle_odom_pub_ = this->create_publisher<nav_msgs::msg::Odometry>(
     "vehicle_odom", 1);
 
+  // publish the end-to-end latency trace
+  if (config_->latency_report_period > 0.0) {
+    diagnostics_pub_ = this->create_publisher<diagnostic_msgs::msg::DiagnosticArray>(
+      "diagnostics", 1);
+    latency_report_timer_ = this->create_wall_timer(
+      std::chrono::duration<double>(config_->latency_report_period),
+      std::bind(&RacingSimulatorNode::on_latency_report_timer, this));
+  }
+
   // initialize subscribers
   vehicle_actuation_sub_ = this->create_subscription<mpclab_msgs::msg::VehicleActuationMsg>(
     "vehicle_actuation", 1,
@@ -188,6 +197,46 @@ void RacingSimulatorNode::on_state_repub_timer()
   }
 }
 
+void RacingSimulatorNode::on_latency_report_timer()
+{
+  auto diagnostics_msg = diagnostic_msgs::msg::DiagnosticArray();
+  const auto period_ms = config_->dt * 1e3;
+  diagnostics_msg.status.push_back(
+    state_age_histogram_.to_diagnostic_status(
+      "Racing Simulator State Age", "State Sampled to Command Applied (ms)", 2.0 * period_ms));
+  diagnostics_msg.status.push_back(
+    command_age_histogram_.to_diagnostic_status(
+      "Racing Simulator Command Age", "Command Published to Applied (ms)", period_ms));
+  diagnostics_msg.status.push_back(
+    controller_wait_histogram_.to_diagnostic_status(
+      "Racing Simulator Controller Wait", "State Sampled to Controller Step (ms)", period_ms));
+  diagnostics_msg.status.push_back(
+    controller_step_histogram_.to_diagnostic_status(
+      "Racing Simulator Controller Step", "Controller Step to Command Published (ms)",
+      period_ms));
+  diagnostics_msg.header.stamp = this->now();
+  diagnostics_pub_->publish(diagnostics_msg);
+}
+
+void RacingSimulatorNode::trace_actuation(const double & apply_time)
+{
+  if (vehicle_actuation_msg_ == last_traced_actuation_msg_) {
+    return;
+  }
+  last_traced_actuation_msg_ = vehicle_actuation_msg_;
+  // skip commands from controllers that do not propagate the trace
+  const auto & timing = vehicle_actuation_msg_->timing;
+  if (timing.source_time <= 0.0 || timing.publish_time <= 0.0) {
+    return;
+  }
+  state_age_histogram_.record((apply_time - timing.source_time) * 1e3);
+  command_age_histogram_.record((apply_time - timing.publish_time) * 1e3);
+  if (timing.step_start_time > 0.0) {
+    controller_wait_histogram_.record((timing.step_start_time - timing.source_time) * 1e3);
+    controller_step_histogram_.record((timing.publish_time - timing.step_start_time) * 1e3);
+  }
+}
+
 Polygon RacingSimulatorNode::build_polygon(const casadi::DM & pts)
 {
   Polygon polygon;
@@ -245,6 +294,7 @@ void RacingSimulatorNode::on_state_update()
       "Waiting for vehicle actuation message.");
     return;
   }
+  trace_actuation(utils::trace_clock());
   const auto last_x = simulator_->x().get_elements();
   const auto u = casadi::DM(
         {
@@ -286,6 +336,7 @@ void RacingSimulatorNode::on_state_update()
   // update the vehicle state message
   const auto now = this->now();
   vehicle_state_msg_->header.stamp = now;
+  vehicle_state_msg_->timing.source_time = utils::trace_clock();
   update_vehicle_state_msg(x, frenet_pose, global_pose);
 
   // publish tf
@@ -321,7 +372,8 @@ void RacingSimulatorNode::on_state_update()
     state_repub_timer_->reset();
   }
 
-  // publish the updated state
+  // publish the updated state, stamped for the latency trace
+  vehicle_state_msg_->timing.publish_time = utils::trace_clock();
   vehicle_state_pub_->publish(*vehicle_state_msg_);
 
   // publish the vehicle visualization
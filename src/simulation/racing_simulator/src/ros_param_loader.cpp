@@ -15,6 +15,7 @@
 
 #include <string>
 #include <memory>
+#include <stdexcept>
 #include <vector>
 
 #include <lmpc_utils/ros_param_helper.hpp>
@@ -65,7 +66,47 @@ RacingSimulatorConfig::SharedPtr load_parameters(rclcpp::Node * node)
           declare_bool("racing_simulator.visualize_vehicle"),
           declare_string("racing_simulator.race_track_file_path"),
           step_mode,
-          casadi::DM(declare_vec("racing_simulator.x0"))
+          casadi::DM(declare_vec("racing_simulator.x0")),
+          declare_double("racing_simulator.latency_report_period")
+        }
+  );
+}
+
+MultiCarSimulatorConfig::SharedPtr load_multi_car_parameters(rclcpp::Node * node)
+{
+  auto declare_double = [&](const char * name) {
+      return lmpc::utils::declare_parameter<double>(node, name);
+    };
+  auto declare_string = [&](const char * name) {
+      return lmpc::utils::declare_parameter<std::string>(node, name);
+    };
+  auto declare_vec = [&](const char * name) {
+      return lmpc::utils::declare_parameter<std::vector<double>>(node, name);
+    };
+  auto declare_int = [&](const char * name) {
+      return lmpc::utils::declare_parameter<int64_t>(node, name);
+    };
+  auto declare_bool = [&](const char * name) {
+      return lmpc::utils::declare_parameter<bool>(node, name);
+    };
+
+  // the initial states of all cars are concatenated
+  const auto num_cars = declare_int("multi_car_simulator.num_cars");
+  const auto x0 = declare_vec("multi_car_simulator.x0");
+  if (num_cars <= 0 || x0.size() % static_cast<size_t>(num_cars) != 0) {
+    throw std::invalid_argument("x0 must hold the initial state of each car");
+  }
+
+  return std::make_shared<MultiCarSimulatorConfig>(
+    MultiCarSimulatorConfig{
+          declare_double("multi_car_simulator.dt"),
+          declare_string("multi_car_simulator.race_track_file_path"),
+          declare_string("multi_car_simulator.car_namespace_prefix"),
+          casadi::DM::reshape(
+            casadi::DM(x0), static_cast<casadi_int>(x0.size() / static_cast<size_t>(num_cars)),
+            static_cast<casadi_int>(num_cars)),
+          declare_double("multi_car_simulator.contact_margin"),
+          declare_bool("multi_car_simulator.publish_batched_state")
         }
   );
 }
@@ -15,7 +15,175 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+#include <ament_index_cpp/get_package_share_directory.hpp>
+
+#include <base_vehicle_model/ros_param_loader.hpp>
+#include <single_track_planar_model/ros_param_loader.hpp>
+#include "racing_simulator/car_collision.hpp"
+#include "racing_simulator/multi_car_simulator.hpp"
+
+using lmpc::Pose2D;
+using lmpc::simulation::racing_simulator::CarCollisionDetector;
+using lmpc::simulation::racing_simulator::MultiCarSimulator;
+
 TEST(RacingSimulatorTest, RacingSimulatorTest1)
 {
   SUCCEED();
 }
+
+TEST(RacingSimulatorTest, CarCollisionTest)
+{
+  // 3m x 2m cars with the cg in the middle, on a 100m track
+  auto detector = CarCollisionDetector(1.5, 1.5, 1.0, 100.0, 0.0);
+  const auto pose = [](const double & x, const double & y, const double & yaw) {
+      return Pose2D{{x, y}, yaw};
+    };
+
+  // car 0 and 1 overlap by 0.5m, car 2 is alone
+  auto contacts = detector.detect(
+    {10.0, 12.5, 50.0}, {pose(10.0, 0.0, 0.0), pose(12.5, 0.0, 0.0), pose(50.0, 0.0, 0.0)});
+  ASSERT_EQ(contacts.size(), 1u);
+  EXPECT_EQ(contacts[0].first, 0u);
+  EXPECT_EQ(contacts[0].second, 1u);
+  EXPECT_NEAR(contacts[0].depth, 0.5, 1e-12);
+  EXPECT_EQ(detector.num_candidate_pairs(), 1u);
+
+  // the pair across the finish line is found
+  contacts = detector.detect(
+    {99.0, 1.0, 50.0}, {pose(-1.0, 0.0, 0.0), pose(1.0, 0.0, 0.0), pose(50.0, 0.0, 0.0)});
+  ASSERT_EQ(contacts.size(), 1u);
+  EXPECT_EQ(contacts[0].first, 0u);
+  EXPECT_EQ(contacts[0].second, 1u);
+
+  // cars side by side at the same abscissa are reported once, whatever their previous order
+  contacts = detector.detect({30.0, 30.0}, {pose(30.0, 0.0, 0.0), pose(30.0, 1.5, 0.0)});
+  ASSERT_EQ(contacts.size(), 1u);
+  EXPECT_EQ(contacts[0].first, 0u);
+  EXPECT_EQ(contacts[0].second, 1u);
+  EXPECT_EQ(detector.num_candidate_pairs(), 1u);
+  contacts = detector.detect(
+    {20.0, 10.0, 50.0}, {pose(20.0, 0.0, 0.0), pose(10.0, 0.0, 0.0), pose(50.0, 0.0, 0.0)});
+  EXPECT_TRUE(contacts.empty());
+  contacts = detector.detect(
+    {10.0, 10.0, 50.0}, {pose(10.0, 0.0, 0.0), pose(10.0, 1.5, 0.0), pose(50.0, 0.0, 0.0)});
+  ASSERT_EQ(contacts.size(), 1u);
+  EXPECT_EQ(contacts[0].first, 0u);
+  EXPECT_EQ(contacts[0].second, 1u);
+  EXPECT_NEAR(contacts[0].depth, 0.5, 1e-12);
+  EXPECT_EQ(detector.num_candidate_pairs(), 1u);
+
+  // the corners of rotated cars miss each other, although their bounding circles overlap
+  double depth = 0.0;
+  EXPECT_FALSE(detector.overlap(pose(0.0, 0.0, M_PI_4), pose(3.0, -0.5, M_PI_4), depth));
+  EXPECT_TRUE(detector.overlap(pose(0.0, 0.0, M_PI_4), pose(2.0, 1.5, M_PI_4), depth));
+
+  EXPECT_THROW(detector.detect({0.0}, {}), std::invalid_argument);
+  EXPECT_THROW(CarCollisionDetector(1.5, 1.5, 0.0, 100.0, 0.0), std::invalid_argument);
+}
+
+TEST(RacingSimulatorTest, CarCollisionBroadPhaseTest)
+{
+  // cars scattered on a circular track, compared to testing all pairs
+  const double track_length = 300.0;
+  const double radius = track_length / (2.0 * M_PI);
+  auto detector = CarCollisionDetector(1.8, 1.2, 1.0, track_length, 1.0);
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> s_dist(0.0, track_length);
+  std::uniform_real_distribution<double> t_dist(-3.0, 3.0);
+  std::uniform_real_distribution<double> yaw_dist(-0.3, 0.3);
+
+  size_t num_contacts = 0;
+  for (int trial = 0; trial < 100; trial++) {
+    std::vector<double> abscissa;
+    std::vector<Pose2D> poses;
+    for (int i = 0; i < 40; i++) {
+      const auto s = s_dist(gen);
+      const auto theta = s / radius;
+      const auto r = radius - t_dist(gen);
+      abscissa.push_back(s);
+      poses.push_back(
+        Pose2D{{r * std::cos(theta), r * std::sin(theta)}, theta + M_PI_2 + yaw_dist(gen)});
+    }
+    const auto contacts = detector.detect(abscissa, poses);
+    size_t k = 0;
+    for (size_t i = 0; i < poses.size(); i++) {
+      for (size_t j = i + 1; j < poses.size(); j++) {
+        double depth = 0.0;
+        if (detector.overlap(poses[i], poses[j], depth)) {
+          ASSERT_LT(k, contacts.size());
+          EXPECT_EQ(contacts[k].first, i);
+          EXPECT_EQ(contacts[k].second, j);
+          k++;
+        }
+      }
+    }
+    EXPECT_EQ(k, contacts.size());
+    num_contacts += k;
+    EXPECT_LT(detector.num_candidate_pairs(), poses.size() * (poses.size() - 1) / 2);
+  }
+  EXPECT_GT(num_contacts, 0u);
+}
+
+TEST(RacingSimulatorTest, MultiCarSimulatorBenchmark)
+{
+  rclcpp::init(0, nullptr);
+  const auto base_share_dir = ament_index_cpp::get_package_share_directory("base_vehicle_model");
+  const auto model_share_dir = ament_index_cpp::get_package_share_directory(
+    "single_track_planar_model");
+  const auto trajectory_share_dir = ament_index_cpp::get_package_share_directory(
+    "racing_trajectory");
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle_2.param.yaml",
+    "--params-file", model_share_dir + "/param/sample_vehicle_2.param.yaml"
+  });
+  auto test_node = rclcpp::Node("test_racing_simulator_node", options);
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(&test_node);
+  auto model_config = lmpc::vehicle_model::single_track_planar_model::load_parameters(&test_node);
+  rclcpp::shutdown();
+  auto model = std::make_shared<lmpc::vehicle_model::single_track_planar_model::
+      SingleTrackPlanarModel>(base_config, model_config);
+  auto track = std::make_shared<lmpc::vehicle_model::racing_trajectory::RacingTrajectory>(
+    trajectory_share_dir + "/test_data/mgkt_optm.txt");
+
+  // a grid of cars 10m apart, where car 1 is placed on top of car 0
+  const casadi_int num_cars = 24;
+  auto x0 = casadi::DM::zeros(6, num_cars);
+  for (casadi_int i = 0; i < num_cars; i++) {
+    x0(0, i) = 10.0 * i;
+    x0(3, i) = 5.0;
+  }
+  x0(0, 1) = 1.0;
+  const double dt = 0.01;
+  auto simulator = MultiCarSimulator(dt, x0, track, model, 1.0);
+  ASSERT_EQ(simulator.contacts().size(), 1u);
+  EXPECT_EQ(simulator.contacts()[0].first, 0u);
+  EXPECT_EQ(simulator.contacts()[0].second, 1u);
+
+  // all cars accelerate on the center line
+  auto u = casadi::DM::zeros(3, num_cars);
+  u(0, casadi::Slice()) = 500.0;
+  const int num_steps = 500;
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_steps; i++) {
+    simulator.step(u);
+  }
+  const auto duration = std::chrono::duration<double>(
+    std::chrono::high_resolution_clock::now() - start).count();
+  for (casadi_int i = 0; i < num_cars; i++) {
+    EXPECT_GT(static_cast<double>(simulator.x()(3, i)), 5.0);
+  }
+  std::cout << "Multi Car Simulator (" << num_cars << " cars): " <<
+    duration / num_steps * 1e3 << "ms per step, real time factor " <<
+    dt * num_steps / duration << ", candidate pairs " <<
+    simulator.collision_detector().num_candidate_pairs() << std::endl;
+}
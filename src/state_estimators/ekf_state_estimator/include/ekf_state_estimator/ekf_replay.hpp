@@ -0,0 +1,125 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef EKF_STATE_ESTIMATOR__EKF_REPLAY_HPP_
+#define EKF_STATE_ESTIMATOR__EKF_REPLAY_HPP_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <casadi/casadi.hpp>
+
+#include "ekf_state_estimator/ekf_state_estimator.hpp"
+
+namespace lmpc
+{
+namespace state_estimator
+{
+namespace ekf_state_estimator
+{
+struct EKFLogRecord
+{
+  int64_t timestamp;  // ns
+  std::string source;  // "u" for a control, "x" for a reference state, otherwise an observation
+  casadi::DM value;  // column vector
+};
+
+typedef std::vector<EKFLogRecord> EKFLog;
+
+/**
+ * @brief Load a sensor log with one record per line: timestamp (ns), source and values,
+ * separated by spaces. Lines starting with # are skipped. The records must be in time order.
+ *
+ * @throws std::runtime_error if the file cannot be read or a line is malformed.
+ */
+EKFLog load_ekf_log(const std::string & file);
+
+/**
+ * @brief Save a sensor log in the format of load_ekf_log().
+ */
+void save_ekf_log(const EKFLog & log, const std::string & file);
+
+// one filter configuration to replay
+struct EKFTuning
+{
+  casadi::DM P0;  // initial estimate covariance
+  casadi::DM Q;  // process noise covariance
+  std::map<std::string, casadi::DM> R;  // observation covariance of each observation
+};
+
+struct EKFReplayResult
+{
+  casadi::DM rmse;  // nx x 1 root mean square error against the reference states
+  double score = 0.0;  // weighted mean square error, lower is better
+  size_t num_references = 0;  // number of reference states compared
+  size_t num_updates = 0;  // number of observation updates
+  bool diverged = false;  // the estimate became NaN or Inf
+  double replay_time = 0.0;  // ms
+};
+
+/**
+ * @brief Replay sensor logs through EKFStateEstimator, without ROS and as fast as possible.
+ *
+ * The observations select states, i.e. h(x) = x[state indices]. Controls are applied with
+ * update_control() and each reference state is compared to the latest estimate, so the
+ * references should be logged right after the observations at the same time.
+ */
+class EKFReplay
+{
+public:
+  typedef std::shared_ptr<EKFReplay> SharedPtr;
+  typedef std::unique_ptr<EKFReplay> UniquePtr;
+
+  /**
+   * @brief Construct a new EKF replay.
+   *
+   * @param config filter config, of which x0, x_max and x_min are used
+   * @param model vehicle model of the filter
+   * @param observations state indices observed by each observation
+   * @param weights nx x 1 weights of the squared errors in the score
+   */
+  EKFReplay(
+    EKFStateEstimatorConfig::SharedPtr config,
+    SingleTrackPlanarModel::SharedPtr model,
+    const std::map<std::string, std::vector<casadi_int>> & observations,
+    const casadi::DM & weights);
+
+  EKFReplayResult replay(const EKFLog & log, const EKFTuning & tuning) const;
+
+  /**
+   * @brief Replay a log with many filter configurations in parallel.
+   * The filters are built on the calling thread, since building CasADi expressions is not
+   * thread-safe, and replayed on num_threads threads.
+   */
+  std::vector<EKFReplayResult> replay(
+    const EKFLog & log, const std::vector<EKFTuning> & tunings,
+    const size_t & num_threads) const;
+
+protected:
+  EKFStateEstimatorConfig::SharedPtr config_ {};
+  SingleTrackPlanarModel::SharedPtr model_ {};
+  std::map<std::string, casadi::Function> hs_;
+  casadi::DM weights_;
+
+  EKFStateEstimator::UniquePtr build_filter(const EKFTuning & tuning) const;
+  EKFReplayResult run(EKFStateEstimator & ekf, const EKFLog & log, const EKFTuning & tuning) const;
+};
+}  // namespace ekf_state_estimator
+}  // namespace state_estimator
+}  // namespace lmpc
+#endif  // EKF_STATE_ESTIMATOR__EKF_REPLAY_HPP_
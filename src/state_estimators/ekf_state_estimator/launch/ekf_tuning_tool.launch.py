@@ -0,0 +1,75 @@
+# Copyright 2023 Haoru Xue
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+import os
+from ament_index_python import get_package_share_directory
+from launch import LaunchDescription
+from launch_ros.actions import Node
+from launch.substitutions import LaunchConfiguration
+from launch.actions import DeclareLaunchArgument
+
+
+def get_share_file(package_name, *args):
+    return os.path.join(get_package_share_directory(package_name), *args)
+
+
+def generate_launch_description():
+    log_file = LaunchConfiguration("log_file")
+    result_file = LaunchConfiguration("result_file")
+    declare_log_file_cmd = DeclareLaunchArgument(
+        "log_file", description="sensor log to replay"
+    )
+    declare_result_file_cmd = DeclareLaunchArgument(
+        "result_file", default_value="ekf_tuning_results.txt"
+    )
+
+    ekf_config = get_share_file(
+        "ekf_state_estimator", "param", "sample_ekf.param.yaml")
+    tool_config = get_share_file(
+        "ekf_state_estimator", "param", "ekf_tuning_tool.param.yaml")
+    dt_model_config = (
+        get_share_file("single_track_planar_model"),
+        "/param/",
+        "sample_vehicle_2.param.yaml",
+    )
+    base_model_config = (
+        get_share_file("base_vehicle_model"),
+        "/param/",
+        "sample_vehicle_2.param.yaml",
+    )
+
+    return LaunchDescription(
+        [
+            declare_log_file_cmd,
+            declare_result_file_cmd,
+            Node(
+                package="ekf_state_estimator",
+                executable="ekf_tuning_tool",
+                name="ekf_tuning_tool",
+                output="screen",
+                parameters=[
+                    ekf_config,
+                    tool_config,
+                    dt_model_config,
+                    base_model_config,
+                    {
+                        "ekf_tuning_tool.log_file": log_file,
+                        "ekf_tuning_tool.result_file": result_file,
+                    },
+                ],
+                emulate_tty=True,
+            ),
+        ]
+    )
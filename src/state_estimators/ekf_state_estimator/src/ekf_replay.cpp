@@ -0,0 +1,256 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "ekf_state_estimator/ekf_replay.hpp"
+
+namespace lmpc
+{
+namespace state_estimator
+{
+namespace ekf_state_estimator
+{
+EKFLog load_ekf_log(const std::string & file)
+{
+  std::ifstream in(file);
+  if (!in) {
+    throw std::runtime_error("load_ekf_log: cannot read " + file + ".");
+  }
+  EKFLog log;
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream line_stream(line);
+    EKFLogRecord record;
+    if (!(line_stream >> record.timestamp >> record.source)) {
+      throw std::runtime_error(
+              "load_ekf_log: malformed line " + std::to_string(line_number) + " in " + file + ".");
+    }
+    std::vector<double> values;
+    double value;
+    while (line_stream >> value) {
+      values.push_back(value);
+    }
+    if (!log.empty() && record.timestamp < log.back().timestamp) {
+      throw std::runtime_error(
+              "load_ekf_log: line " + std::to_string(line_number) + " in " + file +
+              " goes back in time.");
+    }
+    record.value = casadi::DM(values);
+    log.push_back(std::move(record));
+  }
+  return log;
+}
+
+void save_ekf_log(const EKFLog & log, const std::string & file)
+{
+  std::ofstream out(file);
+  if (!out) {
+    throw std::runtime_error("save_ekf_log: cannot write " + file + ".");
+  }
+  out << std::setprecision(17);
+  for (const auto & record : log) {
+    out << record.timestamp << " " << record.source;
+    for (const auto & value : record.value.nonzeros()) {
+      out << " " << value;
+    }
+    out << "\n";
+  }
+}
+
+EKFReplay::EKFReplay(
+  EKFStateEstimatorConfig::SharedPtr config,
+  SingleTrackPlanarModel::SharedPtr model,
+  const std::map<std::string, std::vector<casadi_int>> & observations,
+  const casadi::DM & weights)
+: config_(config), model_(model), weights_(weights)
+{
+  const auto nx = static_cast<casadi_int>(model_->nx());
+  if (weights_.numel() != nx) {
+    throw std::invalid_argument("EKFReplay: the score weights must have nx elements.");
+  }
+  if (observations.empty()) {
+    throw std::invalid_argument("EKFReplay: at least one observation is required.");
+  }
+  const auto x = casadi::SX::sym("x", nx, 1);
+  for (const auto & [name, idxs] : observations) {
+    if (name == "u" || name == "x") {
+      throw std::invalid_argument("EKFReplay: \"u\" and \"x\" are reserved log sources.");
+    }
+    for (const auto & idx : idxs) {
+      if (idx < 0 || idx >= nx) {
+        throw std::invalid_argument("EKFReplay: observation " + name + " has a bad index.");
+      }
+    }
+    casadi::SXVector selected;
+    for (const auto & idx : idxs) {
+      selected.push_back(x(idx));
+    }
+    const auto z = casadi::SX::sym("z", static_cast<casadi_int>(idxs.size()), 1);
+    hs_[name] = casadi::Function("h_" + name, {x, z}, {casadi::SX::vertcat(selected)});
+  }
+}
+
+EKFReplayResult EKFReplay::replay(const EKFLog & log, const EKFTuning & tuning) const
+{
+  auto ekf = build_filter(tuning);
+  return run(*ekf, log, tuning);
+}
+
+std::vector<EKFReplayResult> EKFReplay::replay(
+  const EKFLog & log, const std::vector<EKFTuning> & tunings,
+  const size_t & num_threads) const
+{
+  std::vector<EKFStateEstimator::UniquePtr> filters;
+  filters.reserve(tunings.size());
+  for (const auto & tuning : tunings) {
+    filters.push_back(build_filter(tuning));
+  }
+
+  std::vector<EKFReplayResult> results(tunings.size());
+  std::vector<std::exception_ptr> errors(tunings.size());
+  std::atomic<size_t> next {0};
+  auto work = [&]() {
+      for (size_t i = next++; i < tunings.size(); i = next++) {
+        try {
+          results[i] = run(*filters[i], log, tunings[i]);
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      }
+    };
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < std::max<size_t>(std::min(num_threads, tunings.size()), 1); i++) {
+    workers.emplace_back(work);
+  }
+  for (auto & worker : workers) {
+    worker.join();
+  }
+  for (const auto & error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  return results;
+}
+
+EKFStateEstimator::UniquePtr EKFReplay::build_filter(const EKFTuning & tuning) const
+{
+  const auto nx = static_cast<casadi_int>(model_->nx());
+  if (tuning.P0.size1() != nx || tuning.P0.size2() != nx ||
+    tuning.Q.size1() != nx || tuning.Q.size2() != nx)
+  {
+    throw std::invalid_argument("EKFReplay: P0 and Q must be nx x nx.");
+  }
+  auto config = std::make_shared<EKFStateEstimatorConfig>(*config_);
+  config->P0 = tuning.P0;
+  config->Q = tuning.Q;
+  auto ekf = std::make_unique<EKFStateEstimator>(config, model_);
+  for (const auto & [name, h] : hs_) {
+    const auto R = tuning.R.find(name);
+    if (R == tuning.R.end() || R->second.size1() != h.nnz_in(1) ||
+      R->second.size2() != h.nnz_in(1))
+    {
+      throw std::invalid_argument("EKFReplay: observation " + name + " has no valid R.");
+    }
+    auto h_copy = h;
+    ekf->register_observation(name, h.nnz_in(1), h_copy);
+  }
+  return ekf;
+}
+
+EKFReplayResult EKFReplay::run(
+  EKFStateEstimator & ekf, const EKFLog & log,
+  const EKFTuning & tuning) const
+{
+  const auto start = std::chrono::steady_clock::now();
+  const auto nx = model_->nx();
+  EKFReplayResult result;
+  std::vector<double> squared_errors(nx, 0.0);
+  casadi::DMDict in{{"z", casadi::DM()}, {"R", casadi::DM()}, {"timestamp", casadi::DM(0.0)}};
+  casadi::DMDict out;
+
+  for (const auto & record : log) {
+    if (!ekf.is_initialized()) {
+      ekf.initialize(record.timestamp);
+    }
+    if (record.source == "u") {
+      ekf.update_control(record.value);
+    } else if (record.source == "x") {
+      const auto & x = ekf.get_latest_estimate().nonzeros();
+      const auto & x_ref = record.value.nonzeros();
+      if (x_ref.size() != nx) {
+        throw std::invalid_argument("EKFReplay: a reference state does not have nx elements.");
+      }
+      for (size_t i = 0; i < nx; i++) {
+        auto error = x[i] - x_ref[i];
+        if (static_cast<casadi_int>(i) == XIndex::YAW) {
+          error = std::remainder(error, 2.0 * M_PI);
+        }
+        squared_errors[i] += error * error;
+      }
+      result.num_references++;
+    } else {
+      const auto R = tuning.R.find(record.source);
+      if (R == tuning.R.end()) {
+        throw std::invalid_argument("EKFReplay: unknown log source " + record.source + ".");
+      }
+      in["z"] = record.value;
+      in["R"] = R->second;
+      *in["timestamp"].ptr() = static_cast<double>(record.timestamp);
+      ekf.update_observation(record.source, in, out);
+      result.num_updates++;
+      if (!ekf.get_latest_estimate().is_regular()) {
+        result.diverged = true;
+        break;
+      }
+    }
+  }
+
+  result.rmse = casadi::DM::zeros(nx, 1);
+  auto & rmse = result.rmse.nonzeros();
+  if (result.diverged || result.num_references == 0) {
+    result.score = std::numeric_limits<double>::infinity();
+  } else {
+    const auto & weights = weights_.nonzeros();
+    for (size_t i = 0; i < nx; i++) {
+      const auto mse = squared_errors[i] / result.num_references;
+      rmse[i] = std::sqrt(mse);
+      result.score += weights[i] * mse;
+    }
+  }
+  result.replay_time = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+  return result;
+}
+}  // namespace ekf_state_estimator
+}  // namespace state_estimator
+}  // namespace lmpc
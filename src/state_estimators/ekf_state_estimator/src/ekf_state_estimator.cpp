@@ -36,7 +36,7 @@ EKFStateEstimator::EKFStateEstimator(
   EKFStateEstimatorConfig::SharedPtr ekf_config,
   SingleTrackPlanarModel::SharedPtr model)
 : config_(ekf_config), model_(model),
-  rk4_(utils::rk4_function(model_->nx(), model_->nu(), model_->dynamics())),
+  rk4_(utils::rk4_function(model_->nx(), model_->nu(), model_->fast_dynamics())),
   initialized_(false), hs_(), h_jacs_(), x_(config_->x0), u_(casadi::DM::zeros(model_->nu(), 1)),
   P_(config_->P0), K_(model_->nx(), 0)
 {
@@ -116,6 +116,8 @@ void EKFStateEstimator::update_observation(
   using casadi::DM;
   using casadi::Slice;
 
+  // the debug dump prints every matrix, so it is only composed if someone listens
+  const bool debug = logger_.enabled(utils::LogLevel::DEBUG);
   std::stringstream debug_ss;
 
   if (!is_initialized()) {
@@ -135,21 +137,23 @@ void EKFStateEstimator::update_observation(
   }
 
   // EKF prediction
-  debug_ss << "*********** EKF Cycle Begins ***********" << std::endl;
-  if (name.has_value()) {
-    debug_ss << "source name: " << name.value() << std::endl;
-  }
   const auto in_dict = casadi::DMDict{{"x", x_}, {"u", u_}, {"k", 0.0}, {"dt", dt_ns * 1e-9}};
-  debug_ss << "dt " << dt_ns * 1e-6 << "ms" << std::endl;
   const auto x_p = rk4_(in_dict).at("xip1");
   const auto F = F_(in_dict).at("F");
   const auto P_p = DM::mtimes({F, P_, F.T()}) + config_->Q;
 
-  debug_ss << "*********** EKF Prediction ***********" << std::endl;
-  debug_ss << "[state prediction x_p]\n" << x_p << std::endl;
-  debug_ss << "[linearized state dynamics F]" << F << std::endl;
-  debug_ss << "[covariance prediction P_p]" << P_p << std::endl;
-  debug_ss << "*********** EKF Correction ***********" << std::endl;
+  if (debug) {
+    debug_ss << "*********** EKF Cycle Begins ***********" << std::endl;
+    if (name.has_value()) {
+      debug_ss << "source name: " << name.value() << std::endl;
+    }
+    debug_ss << "dt " << dt_ns * 1e-6 << "ms" << std::endl;
+    debug_ss << "*********** EKF Prediction ***********" << std::endl;
+    debug_ss << "[state prediction x_p]\n" << x_p << std::endl;
+    debug_ss << "[linearized state dynamics F]" << F << std::endl;
+    debug_ss << "[covariance prediction P_p]" << P_p << std::endl;
+    debug_ss << "*********** EKF Correction ***********" << std::endl;
+  }
 
   // EKF update
   if (name.has_value()) {
@@ -171,24 +175,27 @@ void EKFStateEstimator::update_observation(
       auto & h = hs_.at(name.value());
       auto H = h_jacs_.at(name.value())(casadi::DMVector{x_p, z})[0];
       // innovation
-      const auto y = z - h(casadi::DMVector{x_p, z})[0];
-      debug_ss << "[Observation z]\n" << z << std::endl;
-      debug_ss << "[Observation prediction h]\n" << h(casadi::DMVector{x_p, z})[0] << std::endl;
-      debug_ss << "[Innovation y]\n" << y << std::endl;
+      const auto z_p = h(casadi::DMVector{x_p, z})[0];
+      const auto y = z - z_p;
       // innovation covariance
       const auto S = DM::mtimes({H, P_p, H.T()}) + R;
-      debug_ss << "[Observation jacobian H]" << H << std::endl;
-      debug_ss << "[Observation covariance R]" << R << std::endl;
-      debug_ss << "[Innovation covairance S]" << S << std::endl;
       // Kalman gain
       K_(Slice(), slice_z) = DM::mtimes({P_p, H.T(), DM::inv(S)});
-      debug_ss << "[Kalman gain K]\n" << K_(Slice(), slice_z) << std::endl;
       // update estimates
       x_ = x_p + DM::mtimes(K_(Slice(), slice_z), y);
-      debug_ss << "[Final estimate x_]\n" << x_ << std::endl;
       // update covariance
       P_ = DM::mtimes(DM::eye(model_->nx()) - DM::mtimes(K_(Slice(), slice_z), H), P_p);
-      debug_ss << "[Final estimate covariance P_]" << P_ << std::endl;
+      if (debug) {
+        debug_ss << "[Observation z]\n" << z << std::endl;
+        debug_ss << "[Observation prediction h]\n" << z_p << std::endl;
+        debug_ss << "[Innovation y]\n" << y << std::endl;
+        debug_ss << "[Observation jacobian H]" << H << std::endl;
+        debug_ss << "[Observation covariance R]" << R << std::endl;
+        debug_ss << "[Innovation covairance S]" << S << std::endl;
+        debug_ss << "[Kalman gain K]\n" << K_(Slice(), slice_z) << std::endl;
+        debug_ss << "[Final estimate x_]\n" << x_ << std::endl;
+        debug_ss << "[Final estimate covariance P_]" << P_ << std::endl;
+      }
     }
   } else {
     // pure prediction update
@@ -206,8 +213,10 @@ void EKFStateEstimator::update_observation(
   out["P"] = P_;
   out["K"] = K_;
   out["Kz"] = K_(Slice(), slice_z);
-  debug_ss << "*********** EKF Cycle Ends ***********" << std::endl;
-  logger_.send_log(utils::LogLevel::DEBUG, debug_ss.str());
+  if (debug) {
+    debug_ss << "*********** EKF Cycle Ends ***********" << std::endl;
+    logger_.send_log(utils::LogLevel::DEBUG, debug_ss.str());
+  }
 
   // advance time
   nanosec_ = time_ns;
@@ -0,0 +1,165 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// Tune the EKF offline by replaying a recorded sensor log with a grid of Q, P0 and R scales.
+// The log format is described in ekf_state_estimator/ekf_replay.hpp.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <rclcpp/rclcpp.hpp>
+#include <lmpc_utils/ros_param_helper.hpp>
+#include <base_vehicle_model/ros_param_loader.hpp>
+#include <single_track_planar_model/ros_param_loader.hpp>
+
+#include "ekf_state_estimator/ekf_replay.hpp"
+#include "ekf_state_estimator/ros_param_loader.hpp"
+
+using casadi::DM;
+using lmpc::state_estimator::ekf_state_estimator::EKFReplay;
+using lmpc::state_estimator::ekf_state_estimator::EKFReplayResult;
+using lmpc::state_estimator::ekf_state_estimator::EKFTuning;
+using lmpc::utils::declare_parameter;
+using lmpc::vehicle_model::single_track_planar_model::SingleTrackPlanarModel;
+
+namespace
+{
+// scales of one grid point
+struct TuningScales
+{
+  double p0_scale;
+  double q_scale;
+  std::map<std::string, double> r_scales;
+};
+}  // namespace
+
+int main(int argc, char * argv[])
+{
+  rclcpp::init(argc, argv);
+  auto node = std::make_shared<rclcpp::Node>("ekf_tuning_tool");
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(node.get());
+  auto model_config = lmpc::vehicle_model::single_track_planar_model::load_parameters(node.get());
+  auto model = std::make_shared<SingleTrackPlanarModel>(base_config, model_config);
+  auto config = lmpc::state_estimator::ekf_state_estimator::load_parameters(node.get());
+
+  const auto log_file = declare_parameter<std::string>(node.get(), "ekf_tuning_tool.log_file");
+  const auto result_file = declare_parameter<std::string>(
+    node.get(), "ekf_tuning_tool.result_file");
+  const auto num_threads = static_cast<size_t>(
+    std::max(declare_parameter<int>(node.get(), "ekf_tuning_tool.num_threads"), 1));
+  const auto weights = declare_parameter<std::vector<double>>(
+    node.get(), "ekf_tuning_tool.score_weights");
+  const auto p0_scales = declare_parameter<std::vector<double>>(
+    node.get(), "ekf_tuning_tool.p0_scales");
+  const auto q_scales = declare_parameter<std::vector<double>>(
+    node.get(), "ekf_tuning_tool.q_scales");
+  const auto names = declare_parameter<std::vector<std::string>>(
+    node.get(), "ekf_tuning_tool.observation_names");
+
+  // each observation selects states and has a diagonal R with its own scales
+  std::map<std::string, std::vector<casadi_int>> observations;
+  std::map<std::string, DM> base_R;
+  std::map<std::string, std::vector<double>> r_scales;
+  for (const auto & name : names) {
+    const auto prefix = "ekf_tuning_tool." + name + ".";
+    const auto idxs = declare_parameter<std::vector<int64_t>>(
+      node.get(), (prefix + "state_idxs").c_str());
+    observations[name] = std::vector<casadi_int>(idxs.begin(), idxs.end());
+    base_R[name] = DM::diag(DM(declare_parameter<std::vector<double>>(
+        node.get(), (prefix + "r").c_str())));
+    r_scales[name] = declare_parameter<std::vector<double>>(
+      node.get(), (prefix + "r_scales").c_str());
+  }
+
+  // full grid of the scales
+  std::vector<TuningScales> grid;
+  for (const auto & p0_scale : p0_scales) {
+    for (const auto & q_scale : q_scales) {
+      grid.push_back(TuningScales{p0_scale, q_scale, {}});
+    }
+  }
+  for (const auto & name : names) {
+    std::vector<TuningScales> expanded;
+    for (const auto & point : grid) {
+      for (const auto & r_scale : r_scales.at(name)) {
+        expanded.push_back(point);
+        expanded.back().r_scales[name] = r_scale;
+      }
+    }
+    grid = std::move(expanded);
+  }
+  std::vector<EKFTuning> tunings;
+  tunings.reserve(grid.size());
+  for (const auto & point : grid) {
+    EKFTuning tuning{config->P0 * point.p0_scale, config->Q * point.q_scale, {}};
+    for (const auto & name : names) {
+      tuning.R[name] = base_R.at(name) * point.r_scales.at(name);
+    }
+    tunings.push_back(tuning);
+  }
+
+  const auto log = lmpc::state_estimator::ekf_state_estimator::load_ekf_log(log_file);
+  RCLCPP_INFO(
+    node->get_logger(), "Replaying %lu records with %lu configurations on %lu threads.",
+    log.size(), tunings.size(), num_threads);
+  const auto replay = EKFReplay(config, model, observations, DM(weights));
+  const auto start = std::chrono::steady_clock::now();
+  const auto results = replay.replay(log, tunings, num_threads);
+  const std::chrono::duration<double> sweep_time = std::chrono::steady_clock::now() - start;
+  RCLCPP_INFO(node->get_logger(), "Sweep done in %.2f s.", sweep_time.count());
+
+  std::vector<size_t> ranking(results.size());
+  for (size_t i = 0; i < ranking.size(); i++) {
+    ranking[i] = i;
+  }
+  std::sort(
+    ranking.begin(), ranking.end(),
+    [&results](const size_t & a, const size_t & b) {return results[a].score < results[b].score;});
+
+  // one line per configuration, best first: score, p0 scale, q scale, r scales, rmse
+  std::ofstream out(result_file);
+  out << std::setprecision(6);
+  for (const auto & i : ranking) {
+    out << results[i].score << " " << grid[i].p0_scale << " " << grid[i].q_scale;
+    for (const auto & name : names) {
+      out << " " << grid[i].r_scales.at(name);
+    }
+    for (const auto & rmse : results[i].rmse.nonzeros()) {
+      out << " " << rmse;
+    }
+    out << "\n";
+  }
+  if (!ranking.empty()) {
+    const auto & best = grid[ranking.front()];
+    std::ostringstream r_ss;
+    for (const auto & name : names) {
+      r_ss << " " << name << "=" << best.r_scales.at(name);
+    }
+    RCLCPP_INFO(
+      node->get_logger(), "Best score %.6g with p0 scale %g, q scale %g, r scales%s.",
+      results[ranking.front()].score, best.p0_scale, best.q_scale, r_ss.str().c_str());
+  }
+  RCLCPP_INFO(node->get_logger(), "Results saved to %s.", result_file.c_str());
+  rclcpp::shutdown();
+  return 0;
+}
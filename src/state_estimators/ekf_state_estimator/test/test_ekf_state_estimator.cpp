@@ -18,11 +18,14 @@
 #include <math.h>
 #include <iostream>
 #include <chrono>
+#include <cstdio>
+#include <random>
 #include <rclcpp/rclcpp.hpp>
 #include <ament_index_cpp/get_package_share_directory.hpp>
 
 #include "base_vehicle_model/ros_param_loader.hpp"
 #include "single_track_planar_model/ros_param_loader.hpp"
+#include "ekf_state_estimator/ekf_replay.hpp"
 #include "ekf_state_estimator/ekf_state_estimator.hpp"
 #include "ekf_state_estimator/ros_param_loader.hpp"
 
@@ -113,3 +116,92 @@ TEST(EKFStateEstimatorTest, EKFStateEstimatorSolveTest) {
 
   SUCCEED();
 }
+
+TEST(EKFStateEstimatorTest, EKFReplayTest) {
+  using casadi::DM;
+  using lmpc::state_estimator::ekf_state_estimator::EKFLog;
+  using lmpc::state_estimator::ekf_state_estimator::EKFReplay;
+  using lmpc::state_estimator::ekf_state_estimator::EKFTuning;
+  rclcpp::init(0, nullptr);
+  const auto base_share_dir = ament_index_cpp::get_package_share_directory("base_vehicle_model");
+  const auto model_share_dir = ament_index_cpp::get_package_share_directory(
+    "single_track_planar_model");
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle_2.param.yaml",
+    "--params-file", model_share_dir + "/param/sample_vehicle_2.param.yaml",
+    "--params-file", share_dir + "/param/sample_ekf.param.yaml"
+  });
+  auto test_node = rclcpp::Node("test_ekf_state_estimator_node", options);
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(&test_node);
+  auto model_config = lmpc::vehicle_model::single_track_planar_model::load_parameters(&test_node);
+  auto model = std::make_shared<SingleTrackPlanarModel>(base_config, model_config);
+  auto config = lmpc::state_estimator::ekf_state_estimator::load_parameters(&test_node);
+  rclcpp::shutdown();
+
+  // simulate a constant steering turn and log noisy position and speed observations
+  const auto nx = static_cast<casadi_int>(model->nx());
+  const double dt = 0.01;
+  const int64_t dt_ns = 10000000;
+  auto x = DM::zeros(nx, 1);
+  x(XIndex::VX) = 5.0;
+  config->x0 = x;
+  const auto nu = static_cast<casadi_int>(model->nu());
+  auto u = DM::zeros(nu, 1);
+  u(nu - 1) = 0.05;  // steering
+  const double pos_std = 0.1, speed_std = 0.05;
+  std::mt19937 gen(0);
+  std::normal_distribution<double> pos_noise(0.0, pos_std), speed_noise(0.0, speed_std);
+  EKFLog log;
+  for (int64_t i = 1; i <= 500; i++) {
+    log.push_back({i * dt_ns, "u", u});
+    x = model->discrete_dynamics()(
+      casadi::DMDict{{"x", x}, {"u", u}, {"k", 0.0}, {"dt", dt}}).at("xip1");
+    log.push_back(
+    {
+      i * dt_ns, "gps",
+      DM{static_cast<double>(x(XIndex::PX)) + pos_noise(gen),
+        static_cast<double>(x(XIndex::PY)) + pos_noise(gen)}});
+    log.push_back(
+      {i * dt_ns, "speed", DM{static_cast<double>(x(XIndex::VX)) + speed_noise(gen)}});
+    log.push_back({i * dt_ns, "x", x});
+  }
+
+  // the log survives a round trip through a file
+  const auto log_file = std::string("test_ekf_replay_log.txt");
+  lmpc::state_estimator::ekf_state_estimator::save_ekf_log(log, log_file);
+  const auto loaded = lmpc::state_estimator::ekf_state_estimator::load_ekf_log(log_file);
+  std::remove(log_file.c_str());
+  ASSERT_EQ(loaded.size(), log.size());
+  EXPECT_EQ(loaded.back().timestamp, log.back().timestamp);
+  EXPECT_EQ(loaded.back().source, log.back().source);
+  EXPECT_NEAR(
+    static_cast<double>(DM::norm_inf(loaded.back().value - log.back().value)), 0.0, 1e-12);
+
+  const auto replay = EKFReplay(
+    config, model, {{"gps", {XIndex::PX, XIndex::PY}}, {"speed", {XIndex::VX}}},
+    DM::ones(nx, 1));
+  auto sensible = EKFTuning{config->P0, config->Q * 0.01, {}};
+  sensible.R["gps"] = DM::eye(2) * pos_std * pos_std;
+  sensible.R["speed"] = DM::eye(1) * speed_std * speed_std;
+  // trusting the observations too much follows the noise
+  auto absurd = sensible;
+  absurd.R["gps"] = DM::eye(2) * 1e-6;
+  absurd.R["speed"] = DM::eye(1) * 1e-6;
+  const auto results = replay.replay(loaded, {sensible, absurd}, 2);
+  ASSERT_EQ(results.size(), 2u);
+  for (const auto & result : results) {
+    EXPECT_EQ(result.num_references, 500u);
+    EXPECT_EQ(result.num_updates, 1000u);
+    EXPECT_FALSE(result.diverged);
+    std::cout << "EKF Replay Score: " << result.score << ", Time: " << result.replay_time <<
+      "ms" << std::endl;
+  }
+  EXPECT_LT(results[0].score, results[1].score);
+  // the parallel replay matches the serial one
+  EXPECT_DOUBLE_EQ(replay.replay(loaded, sensible).score, results[0].score);
+  EXPECT_THROW(
+    EKFReplay(config, model, {{"x", {XIndex::PX}}}, DM::ones(nx, 1)), std::invalid_argument);
+}
@@ -0,0 +1,86 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef LMPC_UTILS__CASADI_EVALUATOR_HPP_
+#define LMPC_UTILS__CASADI_EVALUATOR_HPP_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <casadi/casadi.hpp>
+
+namespace lmpc
+{
+namespace utils
+{
+/**
+ * @brief Evaluate a casadi::Function on preallocated inputs, outputs and work vectors.
+ *
+ * Unlike casadi::Function::operator() on DMs, evaluate() does not allocate,
+ * as long as the inputs are written in place or assigned from DMs of the same size.
+ */
+class CasadiEvaluator
+{
+public:
+  typedef std::shared_ptr<CasadiEvaluator> SharedPtr;
+  typedef std::unique_ptr<CasadiEvaluator> UniquePtr;
+
+  explicit CasadiEvaluator(const casadi::Function & function);
+  ~CasadiEvaluator();
+  CasadiEvaluator(const CasadiEvaluator &) = delete;
+  CasadiEvaluator & operator=(const CasadiEvaluator &) = delete;
+
+  casadi::DM & input(const casadi_int & index);
+  casadi::DM & input(const std::string & name);
+  const casadi::DM & output(const casadi_int & index) const;
+  const casadi::DM & output(const std::string & name) const;
+
+  /**
+   * @brief Evaluate the function. Throws if an input changed its number of nonzeros.
+   */
+  void evaluate();
+
+  const casadi::Function & function() const;
+
+protected:
+  casadi::Function function_;
+  std::vector<casadi::DM> inputs_;
+  std::vector<casadi::DM> outputs_;
+  std::vector<const double *> arg_;
+  std::vector<double *> res_;
+  std::vector<casadi_int> iw_;
+  std::vector<double> w_;
+  int mem_;
+};
+
+/**
+ * @brief Shift the columns of a dense matrix left by one in place.
+ * The last column is left unchanged, i.e. it duplicates the second last column.
+ */
+void shift_columns(casadi::DM & m);
+
+/**
+ * @brief Copy a column of a dense matrix into a dense vector of the same height in place.
+ */
+void copy_column(const casadi::DM & m, const casadi_int & col, casadi::DM & out);
+
+/**
+ * @brief Copy a dense vector into a column of a dense matrix of the same height in place.
+ */
+void copy_to_column(const casadi::DM & v, const casadi_int & col, casadi::DM & m);
+}  // namespace utils
+}  // namespace lmpc
+#endif  // LMPC_UTILS__CASADI_EVALUATOR_HPP_
@@ -20,6 +20,7 @@
 #include <mutex>
 #include <memory>
 #include <string>
+#include <vector>
 #include <algorithm>
 
 #include <boost/circular_buffer.hpp>
@@ -101,6 +102,23 @@ public:
     return durations_.capacity();
   }
 
+  // the durations in the window, oldest first
+  std::vector<Duration> samples()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::vector<Duration>(durations_.begin(), durations_.end());
+  }
+
+  // replace the durations in the window, e.g. by those of another profiler
+  void restore(const std::vector<Duration> & samples)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    durations_.clear();
+    for (const auto & duration : samples) {
+      durations_.push_back(duration);
+    }
+  }
+
   Profile<Duration> profile()
   {
     std::lock_guard<std::mutex> lock(mutex_);
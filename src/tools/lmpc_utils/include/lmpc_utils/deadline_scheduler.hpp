@@ -0,0 +1,126 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef LMPC_UTILS__DEADLINE_SCHEDULER_HPP_
+#define LMPC_UTILS__DEADLINE_SCHEDULER_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace lmpc
+{
+namespace utils
+{
+enum class OverrunPolicy
+{
+  SKIP,  // drop the missed deadlines and continue on the original rhythm
+  CATCH_UP  // run the missed cycles back-to-back
+};
+
+struct DeadlineSchedulerConfig
+{
+  double period = 0.05;  // s
+  OverrunPolicy overrun_policy = OverrunPolicy::SKIP;
+  double phase_offset = 0.0;  // s, target delay of a deadline after an arrival
+  double phase_gain = 0.0;  // fraction of the phase error corrected per cycle, 0 to disable
+};
+
+struct DeadlineSchedulerStats
+{
+  uint64_t num_cycles = 0;
+  uint64_t num_overruns = 0;  // cycles that ended after the next deadline
+  uint64_t num_skipped = 0;  // deadlines dropped by OverrunPolicy::SKIP
+  double mean_latency = 0.0;  // ms, wake-up after the deadline
+  double max_latency = 0.0;  // ms
+  double period_jitter_rms = 0.0;  // ms, deviation of the wake-up period from the period
+  double max_period_jitter = 0.0;  // ms
+  double mean_arrival_age = 0.0;  // ms, time from the last arrival to the wake-up
+};
+
+/**
+ * @brief Periodic control loop on a dedicated thread, woken at absolute deadlines on the
+ * monotonic clock (clock_nanosleep with TIMER_ABSTIME), so the period does not drift with
+ * the callback duration and no executor thread is blocked.
+ *
+ * The deadlines can be phase-locked to the arrivals of an input, e.g. state messages, by
+ * calling notify_arrival(). Each cycle moves the deadline by phase_gain of its phase error
+ * to the last arrival plus phase_offset, which keeps the input fresh when it is produced at
+ * the same rate by another clock.
+ */
+class DeadlineScheduler
+{
+public:
+  typedef std::shared_ptr<DeadlineScheduler> SharedPtr;
+  typedef std::unique_ptr<DeadlineScheduler> UniquePtr;
+
+  explicit DeadlineScheduler(const DeadlineSchedulerConfig & config);
+  ~DeadlineScheduler();
+  DeadlineScheduler(const DeadlineScheduler &) = delete;
+  DeadlineScheduler & operator=(const DeadlineScheduler &) = delete;
+
+  /**
+   * @brief Start calling the callback every period, the first time one period from now.
+   *
+   * @throws std::runtime_error if already running.
+   */
+  void start(std::function<void()> callback);
+
+  // stop and join the loop. the callback in progress finishes first.
+  void stop();
+  bool is_running() const;
+
+  // record an arrival at the current or the given monotonic time (ns)
+  void notify_arrival();
+  void notify_arrival(const int64_t & time);
+
+  DeadlineSchedulerStats stats() const;
+  void reset_stats();
+
+  const DeadlineSchedulerConfig & get_config() const;
+
+  // monotonic clock in ns
+  static int64_t now();
+
+protected:
+  DeadlineSchedulerConfig config_;
+  int64_t period_;  // ns
+  int64_t phase_offset_;  // ns
+  std::function<void()> callback_ {};
+  std::thread thread_;
+  std::atomic<bool> running_ {false};
+  std::atomic<int64_t> last_arrival_ {-1};
+
+  mutable std::mutex stats_mutex_;
+  DeadlineSchedulerStats stats_ {};
+  int64_t last_wake_ = -1;
+  uint64_t num_periods_ = 0;
+  uint64_t num_arrival_ages_ = 0;
+  double sum_latency_ = 0.0;
+  double sum_squared_jitter_ = 0.0;
+  double sum_arrival_age_ = 0.0;
+
+  void loop();
+  // the next deadline after the phase correction
+  int64_t phase_lock(const int64_t & deadline) const;
+  void record(const int64_t & deadline, const int64_t & wake);
+};
+}  // namespace utils
+}  // namespace lmpc
+#endif  // LMPC_UTILS__DEADLINE_SCHEDULER_HPP_
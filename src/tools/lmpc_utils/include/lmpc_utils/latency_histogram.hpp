@@ -0,0 +1,92 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef LMPC_UTILS__LATENCY_HISTOGRAM_HPP_
+#define LMPC_UTILS__LATENCY_HISTOGRAM_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <diagnostic_msgs/msg/diagnostic_status.hpp>
+
+namespace lmpc
+{
+namespace utils
+{
+/**
+ * @brief Time of a trace point in seconds on the monotonic clock. It is shared by all
+ * processes on a host, so trace points can be compared across nodes. A state source outside
+ * this repository should stamp mpclab_msgs/TimingMsg.source_time with the same clock.
+ */
+double trace_clock();
+
+/**
+ * @brief Histogram of latencies in ms with log-spaced bins.
+ *
+ * Recording is lock-free and wait-free, so one histogram can be shared by the threads that
+ * record and report it. Percentiles are resolved to the upper edge of their bin, i.e. to
+ * within 10^(1 / bins_per_decade).
+ */
+class LatencyHistogram
+{
+public:
+  typedef std::shared_ptr<LatencyHistogram> SharedPtr;
+  typedef std::unique_ptr<LatencyHistogram> UniquePtr;
+
+  /**
+   * @param min upper edge of the first bin (ms), smaller values are counted in it
+   * @param max lower edge of the last bin (ms), larger values are counted in it
+   * @param bins_per_decade resolution
+   */
+  explicit LatencyHistogram(
+    const double & min = 1e-3, const double & max = 1e4,
+    const size_t & bins_per_decade = 20);
+
+  void record(const double & latency);
+  void reset();
+
+  uint64_t count() const;
+  double mean() const;  // ms
+  double max() const;  // ms
+  // latency below which a fraction p in [0, 1] of the records are (ms)
+  double percentile(const double & p) const;
+
+  /**
+   * @brief Summarize the count, mean, p50, p90, p99 and max.
+   *
+   * @param warn_threshold the level is WARN if the p99 is above it (ms)
+   */
+  diagnostic_msgs::msg::DiagnosticStatus to_diagnostic_status(
+    const std::string & name, const std::string & message,
+    const double & warn_threshold) const;
+
+protected:
+  double log_min_;
+  double bins_per_decade_;
+  size_t num_bins_;
+  std::unique_ptr<std::atomic<uint64_t>[]> bins_;
+  std::atomic<uint64_t> count_ {0};
+  std::atomic<uint64_t> sum_ {0};  // ns
+  std::atomic<uint64_t> max_ {0};  // ns
+
+  size_t bin(const double & latency) const;
+  double upper_edge(const size_t & bin) const;
+};
+}  // namespace utils
+}  // namespace lmpc
+#endif  // LMPC_UTILS__LATENCY_HISTOGRAM_HPP_
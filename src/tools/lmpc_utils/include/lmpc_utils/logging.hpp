@@ -86,6 +86,14 @@ public:
    */
   void send_log(const LogLevel & level, const std::string & what);
 
+  /**
+   * @brief Check if a log of this level would reach any callback.
+   * Use it to skip composing expensive messages.
+   *
+   * @param level log level.
+   */
+  bool enabled(const LogLevel & level) const;
+
   /**
    * @brief use this helper function to get a logger callback that dumps to RCLCPP.
    *
@@ -0,0 +1,70 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef LMPC_UTILS__PARALLEL_JIT_HPP_
+#define LMPC_UTILS__PARALLEL_JIT_HPP_
+
+#include <string>
+#include <vector>
+
+#include <casadi/casadi.hpp>
+
+namespace lmpc
+{
+namespace utils
+{
+struct ParallelJitOptions
+{
+  std::string compiler = "gcc";
+  std::string flags = "-O3";
+  std::string directory = "";  // a temporary directory if empty
+  std::string name = "lmpc_jit";  // name of the shared object
+  size_t num_threads = 0;  // hardware concurrency if 0
+  // remove the sources and objects once linked, and the temporary directory once loaded
+  bool cleanup = true;
+};
+
+struct ParallelJitStats
+{
+  size_t num_units = 0;
+  size_t num_threads = 0;
+  double codegen_time = 0.0;  // ms
+  double compile_time = 0.0;  // ms, wall time of all units
+  double link_time = 0.0;  // ms
+  double total_time = 0.0;  // ms
+  std::vector<double> unit_compile_times;  // ms
+};
+
+/**
+ * @brief Compile functions just in time, one translation unit per function.
+ *
+ * Unlike the "jit" option of a casadi::Function, which compiles one function into one
+ * source file on a single core, the units are compiled concurrently and linked into one
+ * shared object. Pass the stage or derivative functions separately to split the work.
+ * Throws std::runtime_error if a compiler or linker invocation fails.
+ *
+ * @param functions functions to compile, with unique names
+ * @param options compiler options
+ * @param stats if not null, filled with the JIT timing
+ * @return the compiled functions, in the same order
+ */
+std::vector<casadi::Function> parallel_jit(
+  const std::vector<casadi::Function> & functions,
+  const ParallelJitOptions & options = ParallelJitOptions(),
+  ParallelJitStats * stats = nullptr);
+}  // namespace utils
+}  // namespace lmpc
+#endif  // LMPC_UTILS__PARALLEL_JIT_HPP_
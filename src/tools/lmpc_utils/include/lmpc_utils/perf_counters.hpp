@@ -0,0 +1,126 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef LMPC_UTILS__PERF_COUNTERS_HPP_
+#define LMPC_UTILS__PERF_COUNTERS_HPP_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/circular_buffer.hpp>
+
+#include <diagnostic_msgs/msg/diagnostic_status.hpp>
+
+namespace lmpc
+{
+namespace utils
+{
+enum PerfCounterIndex : size_t
+{
+  CYCLES = 0,
+  INSTRUCTIONS = 1,
+  CACHE_MISSES = 2,  // last level cache misses
+  CONTEXT_SWITCHES = 3,
+  NUM_PERF_COUNTERS = 4
+};
+
+struct PerfSample
+{
+  std::array<double, NUM_PERF_COUNTERS> counts {};
+
+  PerfSample operator-(const PerfSample & other) const;
+  PerfSample & operator+=(const PerfSample & other);
+};
+
+/**
+ * @brief Hardware and software performance counters of the calling thread (Linux perf_event).
+ *
+ * Counters that cannot be opened (no PMU, perf_event_paranoid, non-Linux) read as zero.
+ */
+class PerfCounters
+{
+public:
+  typedef std::shared_ptr<PerfCounters> SharedPtr;
+  typedef std::unique_ptr<PerfCounters> UniquePtr;
+
+  PerfCounters();
+  ~PerfCounters();
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters & operator=(const PerfCounters &) = delete;
+
+  /**
+   * @brief Counters of the calling thread, opened on first use.
+   */
+  static PerfCounters & this_thread();
+
+  /**
+   * @brief Cumulative counts since the counters were opened.
+   */
+  PerfSample read() const;
+
+  bool available(const PerfCounterIndex & index) const;
+  bool available() const;
+
+protected:
+  int group_fd_ = -1;
+  std::array<int, NUM_PERF_COUNTERS> fds_;
+  std::array<uint64_t, NUM_PERF_COUNTERS> ids_ {};
+};
+
+/**
+ * @brief Performance counter samples of one named phase, aggregated over a window.
+ */
+class PerfProfiler
+{
+public:
+  typedef std::shared_ptr<PerfProfiler> SharedPtr;
+  typedef std::unique_ptr<PerfProfiler> UniquePtr;
+
+  explicit PerfProfiler(const size_t & window);
+
+  void add_sample(const PerfSample & sample);
+
+  /**
+   * @brief Mean of the samples in the window.
+   */
+  PerfSample mean();
+
+  diagnostic_msgs::msg::DiagnosticStatus to_diagnostic_status(const std::string & name);
+
+protected:
+  boost::circular_buffer<PerfSample> samples_;
+  std::mutex mutex_;
+};
+
+/**
+ * @brief Add the counts of the calling thread within the scope to a profiler.
+ * Does nothing if the profiler is null.
+ */
+class ScopedPerfSample
+{
+public:
+  explicit ScopedPerfSample(PerfProfiler * profiler);
+  ~ScopedPerfSample();
+
+protected:
+  PerfProfiler * profiler_;
+  PerfSample start_;
+};
+}  // namespace utils
+}  // namespace lmpc
+#endif  // LMPC_UTILS__PERF_COUNTERS_HPP_
@@ -0,0 +1,124 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef LMPC_UTILS__SHARED_MEMORY_MIRROR_HPP_
+#define LMPC_UTILS__SHARED_MEMORY_MIRROR_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lmpc
+{
+namespace utils
+{
+/**
+ * @brief Lock-free mirror of a vector of doubles from one process to others, in a POSIX
+ * shared memory segment.
+ *
+ * The segment is a seqlock: the writer makes the sequence odd, copies the data and makes it
+ * even again, so it never waits for a reader. A reader copies the data and retries if the
+ * sequence changed in between. The segment also holds a heartbeat, the monotonic time of the
+ * last beat of the writer, so that the readers can tell when the writer stalls.
+ *
+ * The writer creates the segment, replacing a stale one of the same name, and removes it when
+ * destroyed. Readers that mapped it keep the last data after the writer is gone.
+ */
+class SharedMemoryMirror
+{
+public:
+  typedef std::shared_ptr<SharedMemoryMirror> SharedPtr;
+  typedef std::unique_ptr<SharedMemoryMirror> UniquePtr;
+
+  /**
+   * @brief Create the segment as its writer.
+   *
+   * @param name segment name, starting with "/"
+   * @param capacity max number of doubles
+   * @throws std::runtime_error if the segment cannot be created.
+   */
+  SharedMemoryMirror(const std::string & name, const size_t & capacity);
+
+  /**
+   * @brief Open the segment of a writer as a reader.
+   *
+   * @param name segment name, starting with "/"
+   * @throws std::runtime_error if the segment does not exist or is not initialized yet.
+   */
+  explicit SharedMemoryMirror(const std::string & name);
+
+  ~SharedMemoryMirror();
+  SharedMemoryMirror(const SharedMemoryMirror &) = delete;
+  SharedMemoryMirror & operator=(const SharedMemoryMirror &) = delete;
+
+  /**
+   * @brief Replace the mirrored data. Writer only.
+   *
+   * @throws std::length_error if the data exceeds the capacity.
+   */
+  void write(const std::vector<double> & data);
+
+  /**
+   * @brief Copy the latest consistent data.
+   *
+   * @param data resized to the mirrored data
+   * @param max_retries max number of copies torn by a concurrent write
+   * @return true if the data was copied, false if nothing is written yet or all copies were
+   * torn.
+   */
+  bool read(std::vector<double> & data, const size_t & max_retries = 16) const;
+
+  // number of completed writes. a reader copies the data only when it changes
+  uint64_t version() const;
+
+  // record the monotonic time (ns) of the writer. writer only
+  void beat(const int64_t & time);
+  // monotonic time (ns) of the last beat, -1 if the writer never beat
+  int64_t heartbeat() const;
+
+  const std::string & name() const;
+  size_t capacity() const;
+  bool is_writer() const;
+
+protected:
+  struct Header
+  {
+    std::atomic<uint64_t> magic;  // set last when the segment is initialized
+    std::atomic<uint64_t> sequence;  // odd while a write is in progress
+    std::atomic<uint64_t> size;  // number of doubles of the data
+    std::atomic<int64_t> heartbeat;
+    uint64_t capacity;
+  };
+
+  static_assert(
+    std::atomic<uint64_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free,
+    "SharedMemoryMirror needs lock-free 64-bit atomics to be shared between processes.");
+
+  std::string name_;
+  bool writer_;
+  int fd_ = -1;
+  size_t mapped_size_ = 0;
+  void * mapping_ = nullptr;
+  Header * header_ = nullptr;
+  double * data_ = nullptr;
+  size_t capacity_ = 0;
+
+  void map(const int & protection);
+};
+}  // namespace utils
+}  // namespace lmpc
+#endif  // LMPC_UTILS__SHARED_MEMORY_MIRROR_HPP_
@@ -0,0 +1,102 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef LMPC_UTILS__TRIPLE_BUFFER_HPP_
+#define LMPC_UTILS__TRIPLE_BUFFER_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace lmpc
+{
+namespace utils
+{
+/**
+ * @brief Lock-free single-producer single-consumer hand-off of the latest value.
+ *
+ * The producer fills back() and calls publish(). The consumer calls update() and reads front().
+ * A third slot sits between them so that neither side ever waits for the other, and a value
+ * being read is never overwritten. Only the most recent published value is kept.
+ */
+template<typename T>
+class TripleBuffer
+{
+public:
+  typedef std::shared_ptr<TripleBuffer> SharedPtr;
+  typedef std::unique_ptr<TripleBuffer> UniquePtr;
+
+  TripleBuffer()
+  {
+  }
+
+  /**
+   * @brief Slot owned by the producer. Fill it before calling publish().
+   */
+  T & back()
+  {
+    return buffers_[back_];
+  }
+
+  /**
+   * @brief Make back() visible to the consumer and hand the producer a free slot.
+   */
+  void publish()
+  {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  /**
+   * @brief Move the latest published value into front().
+   *
+   * @return true if a new value was published since the last update.
+   */
+  bool update()
+  {
+    if (!(middle_.load(std::memory_order_acquire) & kFresh)) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+    has_value_ = true;
+    return true;
+  }
+
+  /**
+   * @brief Slot owned by the consumer. Valid after the first successful update().
+   */
+  const T & front() const
+  {
+    return buffers_[front_];
+  }
+
+  bool has_value() const
+  {
+    return has_value_;
+  }
+
+protected:
+  static constexpr uint8_t kIndexMask = 0x3;
+  static constexpr uint8_t kFresh = 0x4;
+
+  std::array<T, 3> buffers_ {};
+  std::atomic<uint8_t> middle_ {1};
+  uint8_t back_ = 0;  // producer only
+  uint8_t front_ = 2;  // consumer only
+  bool has_value_ = false;  // consumer only
+};
+}  // namespace utils
+}  // namespace lmpc
+#endif  // LMPC_UTILS__TRIPLE_BUFFER_HPP_
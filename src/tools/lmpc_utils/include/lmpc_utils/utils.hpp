@@ -16,6 +16,8 @@
 #ifndef LMPC_UTILS__UTILS_HPP_
 #define LMPC_UTILS__UTILS_HPP_
 
+#include <mutex>
+
 #include "casadi/casadi.hpp"
 
 namespace lmpc
@@ -120,6 +122,76 @@ casadi::Function euler_function(
   const casadi_int & nx, const casadi_int & nu,
   casadi::Function & dynamics);
 
+/**
+ * @brief Create the jacobian of a RK4 step, propagating the sensitivities through its stages.
+ * Each stage reuses the continuous jacobians, so the expression stays much smaller than the
+ * symbolic jacobian of the unrolled step.
+ *
+ * @param nx size of state
+ * @param nu size of control
+ * @param dynamics continuous dynamics function
+ * @param dynamics_jacobian continuous dynamics jacobian with outputs `A` and `B`
+ * @return casadi::Function with inputs `x`, `u`, `k` and `dt` and outputs the jacobians `A`
+ * and `B` of the next state and the offset `g` = xip1 - A * x - B * u.
+ */
+casadi::Function rk4_jacobian_function(
+  const casadi_int & nx, const casadi_int & nu,
+  const casadi::Function & dynamics, const casadi::Function & dynamics_jacobian);
+
+/**
+ * @brief Create the jacobian of a Euler step from the continuous jacobians.
+ *
+ * @param nx size of state
+ * @param nu size of control
+ * @param dynamics continuous dynamics function
+ * @param dynamics_jacobian continuous dynamics jacobian with outputs `A` and `B`
+ * @return casadi::Function with inputs `x`, `u`, `k` and `dt` and outputs `A`, `B` and `g`,
+ * same as rk4_jacobian_function().
+ */
+casadi::Function euler_jacobian_function(
+  const casadi_int & nx, const casadi_int & nu,
+  const casadi::Function & dynamics, const casadi::Function & dynamics_jacobian);
+
+/**
+ * @brief Create the defect of a Hermite-Simpson collocation step (separated form).
+ * The control is held over the step and the midpoint state is a decision variable,
+ * so that each dynamics evaluation depends on a single state.
+ *
+ * @param nx size of state
+ * @param nu size of control
+ * @param dynamics continuous dynamics function
+ * @return casadi::Function with inputs `x`, `xc` (midpoint state), `xip1`, `u`, `k` and `dt`
+ * and output `defect` of size 2 * nx, which is zero when the step follows the dynamics.
+ */
+casadi::Function hermite_simpson_function(
+  const casadi_int & nx, const casadi_int & nu,
+  const casadi::Function & dynamics);
+
+/**
+ * @brief Create the defect of a Legendre collocation step.
+ * The control is held over the step and the states at the collocation points are
+ * decision variables.
+ *
+ * @param nx size of state
+ * @param nu size of control
+ * @param degree number of collocation points
+ * @param dynamics continuous dynamics function
+ * @return casadi::Function with inputs `x`, `xc` (nx by degree collocation states), `xip1`, `u`,
+ * `k` and `dt` and output `defect` of size nx * (degree + 1), which is zero when the step
+ * follows the dynamics.
+ */
+casadi::Function legendre_collocation_function(
+  const casadi_int & nx, const casadi_int & nu, const casadi_int & degree,
+  const casadi::Function & dynamics);
+
+/**
+ * @brief Building CasADi functions is not thread safe. Threads that build functions while
+ * others may do so, such as the background loaders and planners, hold this lock while
+ * building. Evaluating a function needs no lock. Do not take it while holding a lock that
+ * another thread may wait for while holding it.
+ */
+std::mutex & casadi_construction_mutex();
+
 enum TyreIndex : size_t
 {
   FL = 0,
@@ -0,0 +1,111 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "lmpc_utils/casadi_evaluator.hpp"
+
+namespace lmpc
+{
+namespace utils
+{
+CasadiEvaluator::CasadiEvaluator(const casadi::Function & function)
+: function_(function),
+  arg_(function.sz_arg(), nullptr),
+  res_(function.sz_res(), nullptr),
+  iw_(function.sz_iw()),
+  w_(function.sz_w()),
+  mem_(function.checkout())
+{
+  inputs_.reserve(function_.n_in());
+  for (casadi_int i = 0; i < function_.n_in(); i++) {
+    inputs_.push_back(casadi::DM::zeros(function_.sparsity_in(i)));
+  }
+  outputs_.reserve(function_.n_out());
+  for (casadi_int i = 0; i < function_.n_out(); i++) {
+    outputs_.push_back(casadi::DM::zeros(function_.sparsity_out(i)));
+  }
+}
+
+CasadiEvaluator::~CasadiEvaluator()
+{
+  function_.release(mem_);
+}
+
+casadi::DM & CasadiEvaluator::input(const casadi_int & index)
+{
+  return inputs_.at(index);
+}
+
+casadi::DM & CasadiEvaluator::input(const std::string & name)
+{
+  return inputs_.at(function_.index_in(name));
+}
+
+const casadi::DM & CasadiEvaluator::output(const casadi_int & index) const
+{
+  return outputs_.at(index);
+}
+
+const casadi::DM & CasadiEvaluator::output(const std::string & name) const
+{
+  return outputs_.at(function_.index_out(name));
+}
+
+void CasadiEvaluator::evaluate()
+{
+  // the pointers are refreshed since an input may have been move-assigned
+  for (size_t i = 0; i < inputs_.size(); i++) {
+    if (inputs_[i].nnz() != function_.nnz_in(i)) {
+      throw std::invalid_argument(
+              "CasadiEvaluator: input " + function_.name_in(i) + " of " + function_.name() +
+              " has the wrong size.");
+    }
+    arg_[i] = inputs_[i].ptr();
+  }
+  for (size_t i = 0; i < outputs_.size(); i++) {
+    res_[i] = outputs_[i].ptr();
+  }
+  if (function_(arg_.data(), res_.data(), iw_.data(), w_.data(), mem_)) {
+    throw std::runtime_error("CasadiEvaluator: evaluation of " + function_.name() + " failed.");
+  }
+}
+
+const casadi::Function & CasadiEvaluator::function() const
+{
+  return function_;
+}
+
+void shift_columns(casadi::DM & m)
+{
+  auto & nz = m.nonzeros();
+  std::copy(nz.begin() + m.size1(), nz.end(), nz.begin());
+}
+
+void copy_column(const casadi::DM & m, const casadi_int & col, casadi::DM & out)
+{
+  const auto & nz = m.nonzeros();
+  const auto begin = nz.begin() + col * m.size1();
+  std::copy(begin, begin + m.size1(), out.nonzeros().begin());
+}
+
+void copy_to_column(const casadi::DM & v, const casadi_int & col, casadi::DM & m)
+{
+  const auto & nz = v.nonzeros();
+  std::copy(nz.begin(), nz.end(), m.nonzeros().begin() + col * m.size1());
+}
+}  // namespace utils
+}  // namespace lmpc
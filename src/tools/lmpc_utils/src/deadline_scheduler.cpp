@@ -0,0 +1,190 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+#include "lmpc_utils/deadline_scheduler.hpp"
+
+namespace lmpc
+{
+namespace utils
+{
+DeadlineScheduler::DeadlineScheduler(const DeadlineSchedulerConfig & config)
+: config_(config),
+  period_(static_cast<int64_t>(std::llround(config.period * 1e9))),
+  phase_offset_(static_cast<int64_t>(std::llround(config.phase_offset * 1e9)))
+{
+  if (period_ <= 0) {
+    throw std::invalid_argument("DeadlineScheduler: the period must be positive.");
+  }
+  if (config_.phase_gain < 0.0 || config_.phase_gain > 1.0) {
+    throw std::invalid_argument("DeadlineScheduler: the phase gain must be in [0, 1].");
+  }
+}
+
+DeadlineScheduler::~DeadlineScheduler()
+{
+  stop();
+}
+
+void DeadlineScheduler::start(std::function<void()> callback)
+{
+  if (running_.exchange(true)) {
+    throw std::runtime_error("DeadlineScheduler: already running.");
+  }
+  callback_ = std::move(callback);
+  thread_ = std::thread(&DeadlineScheduler::loop, this);
+}
+
+void DeadlineScheduler::stop()
+{
+  running_ = false;
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool DeadlineScheduler::is_running() const
+{
+  return running_;
+}
+
+void DeadlineScheduler::notify_arrival()
+{
+  notify_arrival(now());
+}
+
+void DeadlineScheduler::notify_arrival(const int64_t & time)
+{
+  last_arrival_ = time;
+}
+
+DeadlineSchedulerStats DeadlineScheduler::stats() const
+{
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  auto stats = stats_;
+  if (stats.num_cycles > 0) {
+    stats.mean_latency = sum_latency_ / stats.num_cycles;
+  }
+  if (num_periods_ > 0) {
+    stats.period_jitter_rms = std::sqrt(sum_squared_jitter_ / num_periods_);
+  }
+  if (num_arrival_ages_ > 0) {
+    stats.mean_arrival_age = sum_arrival_age_ / num_arrival_ages_;
+  }
+  return stats;
+}
+
+void DeadlineScheduler::reset_stats()
+{
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  stats_ = DeadlineSchedulerStats();
+  last_wake_ = -1;
+  num_periods_ = 0;
+  num_arrival_ages_ = 0;
+  sum_latency_ = 0.0;
+  sum_squared_jitter_ = 0.0;
+  sum_arrival_age_ = 0.0;
+}
+
+const DeadlineSchedulerConfig & DeadlineScheduler::get_config() const
+{
+  return config_;
+}
+
+int64_t DeadlineScheduler::now()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void DeadlineScheduler::loop()
+{
+  auto deadline = now() + period_;
+  while (running_) {
+    timespec ts;
+    ts.tv_sec = static_cast<time_t>(deadline / 1000000000);
+    ts.tv_nsec = static_cast<long>(deadline % 1000000000);  // NOLINT
+    // restart the sleep if a signal interrupts it. the deadline is absolute.
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+    if (!running_) {
+      break;
+    }
+    record(deadline, now());
+    callback_();
+
+    deadline = phase_lock(deadline + period_);
+    const auto end = now();
+    if (end > deadline) {
+      const auto missed = static_cast<uint64_t>((end - deadline) / period_ + 1);
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      stats_.num_overruns++;
+      if (config_.overrun_policy == OverrunPolicy::SKIP) {
+        deadline += static_cast<int64_t>(missed) * period_;
+        stats_.num_skipped += missed;
+      }
+    }
+  }
+}
+
+int64_t DeadlineScheduler::phase_lock(const int64_t & deadline) const
+{
+  const auto arrival = last_arrival_.load();
+  // arrivals older than a few periods say little about the current rhythm
+  if (config_.phase_gain <= 0.0 || arrival < 0 || deadline - arrival > 4 * period_) {
+    return deadline;
+  }
+  // phase error in [-period / 2, period / 2)
+  auto error = (deadline - arrival - phase_offset_) % period_;
+  if (error < 0) {
+    error += period_;
+  }
+  if (error >= period_ / 2) {
+    error -= period_;
+  }
+  return deadline - static_cast<int64_t>(std::llround(config_.phase_gain * error));
+}
+
+void DeadlineScheduler::record(const int64_t & deadline, const int64_t & wake)
+{
+  const auto arrival = last_arrival_.load();
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  const auto latency = (wake - deadline) * 1e-6;
+  stats_.num_cycles++;
+  sum_latency_ += latency;
+  stats_.max_latency = std::max(stats_.max_latency, latency);
+  if (last_wake_ >= 0) {
+    const auto jitter = std::abs((wake - last_wake_ - period_) * 1e-6);
+    num_periods_++;
+    sum_squared_jitter_ += jitter * jitter;
+    stats_.max_period_jitter = std::max(stats_.max_period_jitter, jitter);
+  }
+  last_wake_ = wake;
+  if (arrival >= 0 && arrival <= wake) {
+    num_arrival_ages_++;
+    sum_arrival_age_ += (wake - arrival) * 1e-6;
+  }
+}
+}  // namespace utils
+}  // namespace lmpc
@@ -0,0 +1,152 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <time.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "lmpc_utils/latency_histogram.hpp"
+
+namespace lmpc
+{
+namespace utils
+{
+double trace_clock()
+{
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<double>(ts.tv_sec) + ts.tv_nsec * 1e-9;
+}
+
+LatencyHistogram::LatencyHistogram(
+  const double & min, const double & max,
+  const size_t & bins_per_decade)
+: log_min_(std::log10(min)),
+  bins_per_decade_(static_cast<double>(bins_per_decade))
+{
+  if (min <= 0.0 || max <= min || bins_per_decade == 0) {
+    throw std::invalid_argument("LatencyHistogram: invalid range or resolution.");
+  }
+  // one underflow bin below min, then the log-spaced bins up to max and beyond
+  num_bins_ = static_cast<size_t>(std::ceil((std::log10(max) - log_min_) * bins_per_decade_)) + 2;
+  bins_ = std::make_unique<std::atomic<uint64_t>[]>(num_bins_);
+  reset();
+}
+
+void LatencyHistogram::record(const double & latency)
+{
+  bins_[bin(latency)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  const auto ns = static_cast<uint64_t>(std::max(latency, 0.0) * 1e6);
+  sum_.fetch_add(ns, std::memory_order_relaxed);
+  auto max = max_.load(std::memory_order_relaxed);
+  while (ns > max && !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+  }
+}
+
+void LatencyHistogram::reset()
+{
+  for (size_t i = 0; i < num_bins_; i++) {
+    bins_[i].store(0, std::memory_order_relaxed);
+  }
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+  return count_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const
+{
+  const auto n = count();
+  return n > 0 ? sum_.load(std::memory_order_relaxed) * 1e-6 / n : 0.0;
+}
+
+double LatencyHistogram::max() const
+{
+  return max_.load(std::memory_order_relaxed) * 1e-6;
+}
+
+double LatencyHistogram::percentile(const double & p) const
+{
+  // the bins are read one by one, so the total may include later records
+  uint64_t total = 0;
+  for (size_t i = 0; i < num_bins_; i++) {
+    total += bins_[i].load(std::memory_order_relaxed);
+  }
+  if (total == 0) {
+    return 0.0;
+  }
+  const auto target = std::max<uint64_t>(
+    static_cast<uint64_t>(std::ceil(std::clamp(p, 0.0, 1.0) * total)), 1);
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < num_bins_; i++) {
+    cumulative += bins_[i].load(std::memory_order_relaxed);
+    if (cumulative >= target) {
+      // the last bin is open, so its records are bounded by the max instead
+      return i + 1 == num_bins_ ? max() : std::min(upper_edge(i), max());
+    }
+  }
+  return max();
+}
+
+diagnostic_msgs::msg::DiagnosticStatus LatencyHistogram::to_diagnostic_status(
+  const std::string & name, const std::string & message,
+  const double & warn_threshold) const
+{
+  using diagnostic_msgs::msg::DiagnosticStatus;
+  using diagnostic_msgs::msg::KeyValue;
+
+  auto status = DiagnosticStatus();
+  auto add_value = [&status](const std::string & key, const double & value) {
+      KeyValue & key_value = status.values.emplace_back();
+      key_value.key = key;
+      key_value.value = std::to_string(value);
+    };
+  const auto p99 = percentile(0.99);
+  add_value("count", static_cast<double>(count()));
+  add_value("mean", mean());
+  add_value("p50", percentile(0.5));
+  add_value("p90", percentile(0.9));
+  add_value("p99", p99);
+  add_value("max", max());
+
+  status.level = p99 > warn_threshold ? DiagnosticStatus::WARN : DiagnosticStatus::OK;
+  status.name = name;
+  status.message = message;
+  return status;
+}
+
+size_t LatencyHistogram::bin(const double & latency) const
+{
+  if (!(latency > 0.0)) {
+    return 0;
+  }
+  const auto position = std::ceil((std::log10(latency) - log_min_) * bins_per_decade_);
+  return static_cast<size_t>(std::clamp(position, 0.0, static_cast<double>(num_bins_ - 1)));
+}
+
+double LatencyHistogram::upper_edge(const size_t & bin) const
+{
+  return std::pow(10.0, log_min_ + bin / bins_per_decade_);
+}
+}  // namespace utils
+}  // namespace lmpc
@@ -45,6 +45,16 @@ void Logger::send_log(const LogLevel & level, const std::string & what)
   }
 }
 
+bool Logger::enabled(const LogLevel & level) const
+{
+  for (const auto & callback : callbacks_) {
+    if (level > callback.second.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Logger::LoggerCallback Logger::log_to_rclcpp(rclcpp::Node * node)
 {
   return [node](const LogLevel & level, const std::string & what)
@@ -0,0 +1,158 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include "lmpc_utils/parallel_jit.hpp"
+
+namespace lmpc
+{
+namespace utils
+{
+namespace
+{
+// removes a directory and its content when leaving the scope, unless it is released
+struct ScopedDirectory
+{
+  std::string path;
+  ~ScopedDirectory()
+  {
+    if (!path.empty()) {
+      std::error_code error;
+      std::filesystem::remove_all(path, error);
+    }
+  }
+};
+}  // namespace
+
+std::vector<casadi::Function> parallel_jit(
+  const std::vector<casadi::Function> & functions,
+  const ParallelJitOptions & options,
+  ParallelJitStats * stats)
+{
+  namespace fs = std::filesystem;
+  using std::chrono::steady_clock;
+  typedef std::chrono::duration<double, std::milli> Milliseconds;
+  const auto start = steady_clock::now();
+
+  std::string directory = options.directory;
+  ScopedDirectory temporary_directory;
+  if (directory.empty()) {
+    auto dir_template = (fs::temp_directory_path() / (options.name + "_XXXXXX")).string();
+    if (!mkdtemp(dir_template.data())) {
+      throw std::runtime_error("parallel_jit: could not create a temporary directory.");
+    }
+    directory = dir_template;
+    // also removed if the compilation fails
+    if (options.cleanup) {
+      temporary_directory.path = directory;
+    }
+  } else {
+    fs::create_directories(directory);
+  }
+
+  // code generation is not thread-safe, so only the compilation is parallel
+  const auto num_units = functions.size();
+  std::vector<std::string> sources(num_units);
+  std::vector<std::string> objects(num_units);
+  for (size_t i = 0; i < num_units; i++) {
+    auto gen = casadi::CodeGenerator(
+      options.name + "_" + std::to_string(i) + ".c", casadi::Dict{{"with_header", false}});
+    gen.add(functions[i]);
+    sources[i] = gen.generate(directory + "/");
+    objects[i] = (fs::path(directory) / (options.name + "_" + std::to_string(i) + ".o")).string();
+  }
+  const auto codegen_end = steady_clock::now();
+
+  const auto num_threads = std::max<size_t>(
+    std::min<size_t>(
+      options.num_threads ? options.num_threads : std::thread::hardware_concurrency(),
+      num_units), 1);
+  std::vector<double> unit_compile_times(num_units, 0.0);
+  std::vector<std::string> errors;
+  std::mutex errors_mutex;
+  std::atomic<size_t> next_unit {0};
+  auto compile_units = [&]() {
+      for (size_t i = next_unit++; i < num_units; i = next_unit++) {
+        const auto unit_start = steady_clock::now();
+        const auto command = options.compiler + " -fPIC -c " + options.flags + " \"" +
+          sources[i] + "\" -o \"" + objects[i] + "\"";
+        if (std::system(command.c_str()) != 0) {
+          std::lock_guard<std::mutex> lock(errors_mutex);
+          errors.push_back(command);
+        }
+        unit_compile_times[i] = Milliseconds(steady_clock::now() - unit_start).count();
+      }
+    };
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < num_threads; i++) {
+    workers.emplace_back(compile_units);
+  }
+  for (auto & worker : workers) {
+    worker.join();
+  }
+  if (!errors.empty()) {
+    throw std::runtime_error("parallel_jit: compilation failed: " + errors.front());
+  }
+  const auto compile_end = steady_clock::now();
+
+  const auto library = (fs::path(directory) / (options.name + ".so")).string();
+  auto command = options.compiler + " -shared " + options.flags;
+  for (const auto & object : objects) {
+    command += " \"" + object + "\"";
+  }
+  command += " -o \"" + library + "\"";
+  if (std::system(command.c_str()) != 0) {
+    throw std::runtime_error("parallel_jit: linking failed: " + command);
+  }
+  if (options.cleanup) {
+    for (size_t i = 0; i < num_units; i++) {
+      fs::remove(sources[i]);
+      fs::remove(objects[i]);
+    }
+  }
+
+  const auto importer = casadi::Importer(library, "dll");
+  std::vector<casadi::Function> compiled;
+  compiled.reserve(num_units);
+  for (const auto & function : functions) {
+    compiled.push_back(casadi::external(function.name(), importer));
+  }
+  // the shared object stays mapped once loaded, so the temporary directory is removed on return
+  const auto end = steady_clock::now();
+
+  if (stats) {
+    stats->num_units = num_units;
+    stats->num_threads = num_threads;
+    stats->codegen_time = Milliseconds(codegen_end - start).count();
+    stats->compile_time = Milliseconds(compile_end - codegen_end).count();
+    stats->link_time = Milliseconds(end - compile_end).count();
+    stats->total_time = Milliseconds(end - start).count();
+    stats->unit_compile_times = unit_compile_times;
+  }
+  return compiled;
+}
+}  // namespace utils
+}  // namespace lmpc
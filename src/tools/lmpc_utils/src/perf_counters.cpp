@@ -0,0 +1,214 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "lmpc_utils/perf_counters.hpp"
+
+namespace lmpc
+{
+namespace utils
+{
+PerfSample PerfSample::operator-(const PerfSample & other) const
+{
+  PerfSample result;
+  for (size_t i = 0; i < NUM_PERF_COUNTERS; i++) {
+    result.counts[i] = counts[i] - other.counts[i];
+  }
+  return result;
+}
+
+PerfSample & PerfSample::operator+=(const PerfSample & other)
+{
+  for (size_t i = 0; i < NUM_PERF_COUNTERS; i++) {
+    counts[i] += other.counts[i];
+  }
+  return *this;
+}
+
+PerfCounters::PerfCounters()
+{
+  fds_.fill(-1);
+#ifdef __linux__
+  const std::array<std::pair<uint32_t, uint64_t>, NUM_PERF_COUNTERS> events {{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}
+  }};
+  for (size_t i = 0; i < NUM_PERF_COUNTERS; i++) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].first;
+    attr.config = events[i].second;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // user space only, except for context switches which only happen in the kernel
+    attr.exclude_kernel = attr.type == PERF_TYPE_HARDWARE;
+    attr.exclude_hv = 1;
+    // the first counter that opens leads the group so that all are read with one syscall
+    const auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd_, 0));
+    if (fd < 0) {
+      continue;
+    }
+    if (group_fd_ < 0) {
+      group_fd_ = fd;
+    }
+    fds_[i] = fd;
+    ioctl(fd, PERF_EVENT_IOC_ID, &ids_[i]);
+  }
+  if (group_fd_ >= 0) {
+    ioctl(group_fd_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(group_fd_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+  for (const auto & fd : fds_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+PerfCounters & PerfCounters::this_thread()
+{
+  static thread_local PerfCounters counters;
+  return counters;
+}
+
+PerfSample PerfCounters::read() const
+{
+  PerfSample sample;
+#ifdef __linux__
+  if (group_fd_ < 0) {
+    return sample;
+  }
+  // layout of PERF_FORMAT_GROUP: nr, time_enabled, time_running, {value, id} * nr
+  std::array<uint64_t, 3 + 2 * NUM_PERF_COUNTERS> buffer {};
+  if (::read(group_fd_, buffer.data(), sizeof(buffer)) <= 0) {
+    return sample;
+  }
+  const auto nr = std::min<uint64_t>(buffer[0], NUM_PERF_COUNTERS);
+  const auto time_enabled = static_cast<double>(buffer[1]);
+  const auto time_running = static_cast<double>(buffer[2]);
+  // scale up if the counters were multiplexed with other users of the PMU
+  const auto scale = time_running > 0.0 ? time_enabled / time_running : 1.0;
+  for (uint64_t j = 0; j < nr; j++) {
+    const auto value = buffer[3 + 2 * j];
+    const auto id = buffer[4 + 2 * j];
+    for (size_t i = 0; i < NUM_PERF_COUNTERS; i++) {
+      if (fds_[i] >= 0 && ids_[i] == id) {
+        sample.counts[i] = static_cast<double>(value) * scale;
+      }
+    }
+  }
+#endif
+  return sample;
+}
+
+bool PerfCounters::available(const PerfCounterIndex & index) const
+{
+  return fds_[index] >= 0;
+}
+
+bool PerfCounters::available() const
+{
+  return group_fd_ >= 0;
+}
+
+PerfProfiler::PerfProfiler(const size_t & window)
+: samples_(window)
+{
+}
+
+void PerfProfiler::add_sample(const PerfSample & sample)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  samples_.push_back(sample);
+}
+
+PerfSample PerfProfiler::mean()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  PerfSample result;
+  if (samples_.empty()) {
+    return result;
+  }
+  for (const auto & sample : samples_) {
+    result += sample;
+  }
+  for (auto & count : result.counts) {
+    count /= samples_.size();
+  }
+  return result;
+}
+
+diagnostic_msgs::msg::DiagnosticStatus PerfProfiler::to_diagnostic_status(const std::string & name)
+{
+  using diagnostic_msgs::msg::DiagnosticStatus;
+  using diagnostic_msgs::msg::KeyValue;
+
+  const auto sample = mean();
+  auto status = DiagnosticStatus();
+  auto add_value = [&status](const std::string & key, const double & value) {
+      KeyValue & key_value = status.values.emplace_back();
+      key_value.key = key;
+      key_value.value = std::to_string(value);
+    };
+  add_value("cycles", sample.counts[CYCLES]);
+  add_value("instructions", sample.counts[INSTRUCTIONS]);
+  add_value(
+    "ipc", sample.counts[CYCLES] > 0.0 ?
+    sample.counts[INSTRUCTIONS] / sample.counts[CYCLES] : 0.0);
+  add_value("cache_misses", sample.counts[CACHE_MISSES]);
+  add_value("context_switches", sample.counts[CONTEXT_SWITCHES]);
+
+  status.level = DiagnosticStatus::OK;
+  status.name = name;
+  status.message = "Mean Performance Counters";
+  return status;
+}
+
+ScopedPerfSample::ScopedPerfSample(PerfProfiler * profiler)
+: profiler_(profiler)
+{
+  if (profiler_) {
+    start_ = PerfCounters::this_thread().read();
+  }
+}
+
+ScopedPerfSample::~ScopedPerfSample()
+{
+  if (profiler_) {
+    profiler_->add_sample(PerfCounters::this_thread().read() - start_);
+  }
+}
+}  // namespace utils
+}  // namespace lmpc
@@ -0,0 +1,197 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include "lmpc_utils/shared_memory_mirror.hpp"
+
+namespace lmpc
+{
+namespace utils
+{
+namespace
+{
+constexpr uint64_t kMagic = 0x4c4d50434d495252;  // "LMPCMIRR"
+// the data starts on its own cache line, away from the header written by every beat
+constexpr size_t kDataOffset = 64;
+
+std::string error_message(const std::string & what, const std::string & name)
+{
+  return "SharedMemoryMirror: " + what + " " + name + ": " + std::strerror(errno);
+}
+}  // namespace
+
+SharedMemoryMirror::SharedMemoryMirror(const std::string & name, const size_t & capacity)
+: name_(name), writer_(true), capacity_(capacity)
+{
+  static_assert(sizeof(Header) <= kDataOffset, "SharedMemoryMirror: header too large.");
+  // a segment left by a writer that crashed is replaced
+  shm_unlink(name_.c_str());
+  fd_ = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd_ < 0) {
+    throw std::runtime_error(error_message("failed to create", name_));
+  }
+  mapped_size_ = kDataOffset + capacity_ * sizeof(double);
+  if (ftruncate(fd_, static_cast<off_t>(mapped_size_)) != 0) {
+    const auto message = error_message("failed to size", name_);
+    close(fd_);
+    shm_unlink(name_.c_str());
+    throw std::runtime_error(message);
+  }
+  map(PROT_READ | PROT_WRITE);
+  header_ = new (mapping_) Header;
+  header_->sequence.store(0, std::memory_order_relaxed);
+  header_->size.store(0, std::memory_order_relaxed);
+  header_->heartbeat.store(-1, std::memory_order_relaxed);
+  header_->capacity = capacity_;
+  header_->magic.store(kMagic, std::memory_order_release);
+}
+
+SharedMemoryMirror::SharedMemoryMirror(const std::string & name)
+: name_(name), writer_(false)
+{
+  fd_ = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd_ < 0) {
+    throw std::runtime_error(error_message("failed to open", name_));
+  }
+  struct stat segment_stat;
+  if (fstat(fd_, &segment_stat) != 0 ||
+    static_cast<size_t>(segment_stat.st_size) < kDataOffset)
+  {
+    close(fd_);
+    throw std::runtime_error("SharedMemoryMirror: " + name_ + " is not initialized.");
+  }
+  mapped_size_ = static_cast<size_t>(segment_stat.st_size);
+  map(PROT_READ);
+  header_ = static_cast<Header *>(mapping_);
+  if (header_->magic.load(std::memory_order_acquire) != kMagic ||
+    kDataOffset + header_->capacity * sizeof(double) > mapped_size_)
+  {
+    munmap(mapping_, mapped_size_);
+    close(fd_);
+    throw std::runtime_error("SharedMemoryMirror: " + name_ + " is not initialized.");
+  }
+  capacity_ = header_->capacity;
+}
+
+SharedMemoryMirror::~SharedMemoryMirror()
+{
+  munmap(mapping_, mapped_size_);
+  close(fd_);
+  if (writer_) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+void SharedMemoryMirror::write(const std::vector<double> & data)
+{
+  if (!writer_) {
+    throw std::runtime_error("SharedMemoryMirror: " + name_ + " is opened as a reader.");
+  }
+  if (data.size() > capacity_) {
+    throw std::length_error(
+            "SharedMemoryMirror: " + std::to_string(data.size()) + " doubles exceed the capacity " +
+            std::to_string(capacity_) + " of " + name_ + ".");
+  }
+  const auto sequence = header_->sequence.load(std::memory_order_relaxed);
+  header_->sequence.store(sequence + 1, std::memory_order_relaxed);
+  // the odd sequence is visible before any of the data changes
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->size.store(data.size(), std::memory_order_relaxed);
+  std::memcpy(data_, data.data(), data.size() * sizeof(double));
+  header_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool SharedMemoryMirror::read(std::vector<double> & data, const size_t & max_retries) const
+{
+  for (size_t i = 0; i <= max_retries; i++) {
+    const auto sequence = header_->sequence.load(std::memory_order_acquire);
+    if (sequence == 0) {
+      return false;
+    }
+    if (sequence & 1) {
+      continue;
+    }
+    const auto size = header_->size.load(std::memory_order_relaxed);
+    if (size > capacity_) {
+      continue;
+    }
+    data.resize(size);
+    std::memcpy(data.data(), data_, size * sizeof(double));
+    // the copy completes before the sequence is checked again
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header_->sequence.load(std::memory_order_relaxed) == sequence) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint64_t SharedMemoryMirror::version() const
+{
+  return header_->sequence.load(std::memory_order_acquire) / 2;
+}
+
+void SharedMemoryMirror::beat(const int64_t & time)
+{
+  if (!writer_) {
+    throw std::runtime_error("SharedMemoryMirror: " + name_ + " is opened as a reader.");
+  }
+  header_->heartbeat.store(time, std::memory_order_release);
+}
+
+int64_t SharedMemoryMirror::heartbeat() const
+{
+  return header_->heartbeat.load(std::memory_order_acquire);
+}
+
+const std::string & SharedMemoryMirror::name() const
+{
+  return name_;
+}
+
+size_t SharedMemoryMirror::capacity() const
+{
+  return capacity_;
+}
+
+bool SharedMemoryMirror::is_writer() const
+{
+  return writer_;
+}
+
+void SharedMemoryMirror::map(const int & protection)
+{
+  mapping_ = mmap(nullptr, mapped_size_, protection, MAP_SHARED, fd_, 0);
+  if (mapping_ == MAP_FAILED) {
+    const auto message = error_message("failed to map", name_);
+    close(fd_);
+    if (writer_) {
+      shm_unlink(name_.c_str());
+    }
+    throw std::runtime_error(message);
+  }
+  data_ = reinterpret_cast<double *>(static_cast<char *>(mapping_) + kDataOffset);
+}
+}  // namespace utils
+}  // namespace lmpc
@@ -13,6 +13,9 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <stdexcept>
+#include <vector>
+
 #include "lmpc_utils/utils.hpp"
 
 namespace lmpc
@@ -121,5 +124,135 @@ casadi::Function euler_function(
   const auto out = x + dt * x_dot;
   return casadi::Function("rk4", {x, u, k, dt}, {out}, {"x", "u", "k", "dt"}, {"xip1"});
 }
+
+casadi::Function rk4_jacobian_function(
+  const casadi_int & nx, const casadi_int & nu,
+  const casadi::Function & dynamics, const casadi::Function & dynamics_jacobian)
+{
+  using casadi::SX;
+  const auto x = SX::sym("x", nx, 1);
+  const auto u = SX::sym("u", nu, 1);
+  const auto k = SX::sym("k", 1, 1);
+  const auto dt = SX::sym("dt", 1, 1);
+  const auto I = SX::eye(nx);
+
+  // each stage derivative k_j = f(x + c_j * dt * k_{j-1}) has the sensitivities
+  // dk_j/dx = A_j * (I + c_j * dt * dk_{j-1}/dx) and dk_j/du = A_j * c_j * dt * dk_{j-1}/du + B_j
+  SX x_dot_sum = SX::zeros(nx, 1);
+  SX A_sum = SX::zeros(nx, nx);
+  SX B_sum = SX::zeros(nx, nu);
+  SX x_dot_prev = SX::zeros(nx, 1);
+  SX A_prev = SX::zeros(nx, nx);
+  SX B_prev = SX::zeros(nx, nu);
+  const double c[] = {0.0, 0.5, 0.5, 1.0};
+  const double w[] = {1.0, 2.0, 2.0, 1.0};
+  for (int j = 0; j < 4; j++) {
+    const auto in = casadi::SXDict{{"x", x + c[j] * dt * x_dot_prev}, {"u", u}, {"k", k}};
+    const auto x_dot = dynamics(in).at("x_dot");
+    const auto jac = dynamics_jacobian(in);
+    const auto A_j = SX::mtimes(jac.at("A"), I + c[j] * dt * A_prev);
+    const auto B_j = SX::mtimes(jac.at("A"), c[j] * dt * B_prev) + jac.at("B");
+    x_dot_sum += w[j] * x_dot;
+    A_sum += w[j] * A_j;
+    B_sum += w[j] * B_j;
+    x_dot_prev = x_dot;
+    A_prev = A_j;
+    B_prev = B_j;
+  }
+  const auto xip1 = x + dt / 6.0 * x_dot_sum;
+  const auto A = I + dt / 6.0 * A_sum;
+  const auto B = dt / 6.0 * B_sum;
+  const auto g = xip1 - (SX::mtimes(A, x) + SX::mtimes(B, u));
+  return casadi::Function(
+    "rk4_jacobian", {x, u, k, dt}, {A, B, g}, {"x", "u", "k", "dt"}, {"A", "B", "g"});
+}
+
+casadi::Function euler_jacobian_function(
+  const casadi_int & nx, const casadi_int & nu,
+  const casadi::Function & dynamics, const casadi::Function & dynamics_jacobian)
+{
+  using casadi::SX;
+  const auto x = SX::sym("x", nx, 1);
+  const auto u = SX::sym("u", nu, 1);
+  const auto k = SX::sym("k", 1, 1);
+  const auto dt = SX::sym("dt", 1, 1);
+
+  const auto in = casadi::SXDict{{"x", x}, {"u", u}, {"k", k}};
+  const auto jac = dynamics_jacobian(in);
+  const auto xip1 = x + dt * dynamics(in).at("x_dot");
+  const auto A = SX::eye(nx) + dt * jac.at("A");
+  const auto B = dt * jac.at("B");
+  const auto g = xip1 - (SX::mtimes(A, x) + SX::mtimes(B, u));
+  return casadi::Function(
+    "euler_jacobian", {x, u, k, dt}, {A, B, g}, {"x", "u", "k", "dt"}, {"A", "B", "g"});
+}
+
+casadi::Function hermite_simpson_function(
+  const casadi_int & nx, const casadi_int & nu,
+  const casadi::Function & dynamics)
+{
+  using casadi::SX;
+  const auto x = SX::sym("x", nx, 1);
+  const auto xc = SX::sym("xc", nx, 1);
+  const auto xip1 = SX::sym("xip1", nx, 1);
+  const auto u = SX::sym("u", nu, 1);
+  const auto k = SX::sym("k", 1, 1);
+  const auto dt = SX::sym("dt", 1, 1);
+
+  const auto f = [&](const SX & xj) {
+      return dynamics(casadi::SXDict{{"x", xj}, {"u", u}, {"k", k}}).at("x_dot");
+    };
+  const auto f0 = f(x);
+  const auto fc = f(xc);
+  const auto f1 = f(xip1);
+  const auto defect = SX::vertcat(
+  {
+    xc - 0.5 * (x + xip1) - dt / 8.0 * (f0 - f1),
+    xip1 - x - dt / 6.0 * (f0 + 4.0 * fc + f1)
+  });
+  return casadi::Function(
+    "hermite_simpson", {x, xc, xip1, u, k, dt}, {defect},
+    {"x", "xc", "xip1", "u", "k", "dt"}, {"defect"});
+}
+
+casadi::Function legendre_collocation_function(
+  const casadi_int & nx, const casadi_int & nu, const casadi_int & degree,
+  const casadi::Function & dynamics)
+{
+  using casadi::SX;
+  using casadi::Slice;
+  if (degree < 1) {
+    throw std::invalid_argument("legendre_collocation_function: degree must be positive.");
+  }
+  const auto x = SX::sym("x", nx, 1);
+  const auto xc = SX::sym("xc", nx, degree);
+  const auto xip1 = SX::sym("xip1", nx, 1);
+  const auto u = SX::sym("u", nu, 1);
+  const auto k = SX::sym("k", 1, 1);
+  const auto dt = SX::sym("dt", 1, 1);
+
+  // C maps the step states to the state derivatives at the collocation points,
+  // D maps them to the state at the end of the step
+  casadi::DM C, D, B;
+  casadi::collocation_coeff(casadi::collocation_points(degree, "legendre"), C, D, B);
+  const auto Z = SX::horzcat({x, xc});
+  const auto Z_dot = SX::mtimes(Z, SX(C));
+  std::vector<SX> defects;
+  for (casadi_int j = 0; j < degree; j++) {
+    const auto x_dot = dynamics(
+      casadi::SXDict{{"x", xc(Slice(), j)}, {"u", u}, {"k", k}}).at("x_dot");
+    defects.push_back(Z_dot(Slice(), j) - dt * x_dot);
+  }
+  defects.push_back(xip1 - SX::mtimes(Z, SX(D)));
+  return casadi::Function(
+    "legendre_collocation", {x, xc, xip1, u, k, dt}, {SX::vertcat(defects)},
+    {"x", "xc", "xip1", "u", "k", "dt"}, {"defect"});
+}
+
+std::mutex & casadi_construction_mutex()
+{
+  static std::mutex mutex;
+  return mutex;
+}
 }  // namespace utils
 }  // namespace lmpc
@@ -16,8 +16,25 @@
 #include <gtest/gtest.h>
 #include <rclcpp/rclcpp.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "lmpc_utils/casadi_evaluator.hpp"
+#include "lmpc_utils/deadline_scheduler.hpp"
+#include "lmpc_utils/latency_histogram.hpp"
 #include "lmpc_utils/lookup.hpp"
+#include "lmpc_utils/parallel_jit.hpp"
+#include "lmpc_utils/perf_counters.hpp"
 #include "lmpc_utils/ros_param_helper.hpp"
+#include "lmpc_utils/shared_memory_mirror.hpp"
+#include "lmpc_utils/triple_buffer.hpp"
+#include "lmpc_utils/utils.hpp"
 
 TEST(LmpcUtilsTest, RosParamHelperTest) {
   rclcpp::init(0, nullptr);
@@ -46,3 +63,310 @@ TEST(LmpcUtilsTest, RosParamHelperTest) {
   rclcpp::shutdown();
   SUCCEED();
 }
+
+TEST(LmpcUtilsTest, TripleBufferTest) {
+  lmpc::utils::TripleBuffer<std::vector<int>> buffer;
+  EXPECT_FALSE(buffer.update());
+  EXPECT_FALSE(buffer.has_value());
+
+  buffer.back().assign(4, 1);
+  buffer.publish();
+  EXPECT_TRUE(buffer.update());
+  EXPECT_EQ(buffer.front(), std::vector<int>(4, 1));
+  EXPECT_FALSE(buffer.update());
+
+  // the consumer must only ever see complete, non-decreasing values
+  const int num_values = 10000;
+  std::thread producer([&buffer, num_values]() {
+      for (int i = 2; i <= num_values; i++) {
+        buffer.back().assign(16, i);
+        buffer.publish();
+      }
+    });
+  int last = 1;
+  while (last < num_values) {
+    if (buffer.update()) {
+      const auto & value = buffer.front();
+      ASSERT_EQ(value.size(), 16u);
+      for (const auto & v : value) {
+        ASSERT_EQ(v, value.front());
+      }
+      ASSERT_GE(value.front(), last);
+      last = value.front();
+    }
+  }
+  producer.join();
+  EXPECT_EQ(last, num_values);
+}
+
+TEST(LmpcUtilsTest, PerfCountersTest) {
+  using lmpc::utils::PerfProfiler;
+  using lmpc::utils::PerfSample;
+  PerfProfiler profiler(2);
+  EXPECT_DOUBLE_EQ(profiler.mean().counts[lmpc::utils::CYCLES], 0.0);
+
+  // counters may be unavailable (e.g. in containers), but reading must not fail
+  {
+    lmpc::utils::ScopedPerfSample sample(&profiler);
+    std::this_thread::yield();
+  }
+  for (const auto & count : profiler.mean().counts) {
+    EXPECT_GE(count, 0.0);
+  }
+
+  PerfSample a;
+  a.counts.fill(4.0);
+  PerfSample b;
+  b.counts.fill(2.0);
+  profiler.add_sample(a);
+  profiler.add_sample(b);
+  EXPECT_DOUBLE_EQ(profiler.mean().counts[lmpc::utils::INSTRUCTIONS], 3.0);
+  EXPECT_DOUBLE_EQ((a - b).counts[lmpc::utils::CACHE_MISSES], 2.0);
+
+  const auto status = profiler.to_diagnostic_status("test");
+  EXPECT_EQ(status.name, "test");
+  EXPECT_EQ(status.values.size(), 5u);
+}
+
+TEST(LmpcUtilsTest, CasadiEvaluatorTest) {
+  using casadi::DM;
+  using casadi::MX;
+  const auto x = MX::sym("x", 2);
+  const auto u = MX::sym("u", 1);
+  const auto f = casadi::Function("f", {x, u}, {x * u, MX::sum1(x)}, {"x", "u"}, {"y", "z"});
+  lmpc::utils::CasadiEvaluator evaluator(f);
+  evaluator.input("x") = DM{1.0, 2.0};
+  evaluator.input(1).nonzeros()[0] = 3.0;
+  evaluator.evaluate();
+  EXPECT_DOUBLE_EQ(evaluator.output("y").nonzeros()[1], 6.0);
+  EXPECT_DOUBLE_EQ(static_cast<double>(evaluator.output(1)), 3.0);
+  evaluator.input("x") = DM{1.0, 2.0, 3.0};
+  EXPECT_THROW(evaluator.evaluate(), std::invalid_argument);
+
+  auto m = DM::reshape(DM{1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, 2, 3);
+  lmpc::utils::shift_columns(m);
+  EXPECT_EQ(m.nonzeros(), (std::vector<double>{3.0, 4.0, 5.0, 6.0, 5.0, 6.0}));
+  auto column = DM::zeros(2);
+  lmpc::utils::copy_column(m, 1, column);
+  EXPECT_EQ(column.nonzeros(), (std::vector<double>{5.0, 6.0}));
+  lmpc::utils::copy_to_column(DM{7.0, 8.0}, 2, m);
+  EXPECT_EQ(m.nonzeros(), (std::vector<double>{3.0, 4.0, 5.0, 6.0, 7.0, 8.0}));
+}
+
+TEST(LmpcUtilsTest, ParallelJitTest) {
+  using casadi::DM;
+  using casadi::SX;
+  const auto x = SX::sym("x", 3);
+  const auto f = casadi::Function("jit_test_f", {x}, {SX::sin(x) * x}, {"x"}, {"y"});
+  const auto g = casadi::Function("jit_test_g", {x}, {SX::sumsqr(x)}, {"x"}, {"z"});
+  lmpc::utils::ParallelJitStats stats;
+  auto options = lmpc::utils::ParallelJitOptions();
+  options.name = "parallel_jit_test";
+  const auto compiled = lmpc::utils::parallel_jit({f, g}, options, &stats);
+  ASSERT_EQ(compiled.size(), 2u);
+  EXPECT_EQ(stats.num_units, 2u);
+  EXPECT_EQ(stats.unit_compile_times.size(), 2u);
+  // the temporary directory is removed once the library is loaded
+  for (const auto & entry :
+    std::filesystem::directory_iterator(std::filesystem::temp_directory_path()))
+  {
+    EXPECT_NE(entry.path().filename().string().rfind(options.name, 0), 0u);
+  }
+  const auto x_val = DM{0.1, 0.2, 0.3};
+  EXPECT_NEAR(
+    static_cast<double>(DM::norm_inf(compiled[0](x_val)[0] - f(x_val)[0])), 0.0, 1e-12);
+  EXPECT_NEAR(static_cast<double>(compiled[1](x_val)[0]), 0.14, 1e-12);
+  EXPECT_EQ(compiled[1].name_out(0), "z");
+
+  auto bad_options = lmpc::utils::ParallelJitOptions();
+  bad_options.compiler = "false";
+  EXPECT_THROW(lmpc::utils::parallel_jit({f}, bad_options), std::runtime_error);
+}
+
+TEST(LmpcUtilsTest, DeadlineSchedulerTest) {
+  using lmpc::utils::DeadlineScheduler;
+  using lmpc::utils::DeadlineSchedulerConfig;
+  DeadlineSchedulerConfig config;
+  config.period = 0.01;
+
+  // the callback duration does not stretch the period
+  {
+    DeadlineScheduler scheduler(config);
+    scheduler.start([]() {std::this_thread::sleep_for(std::chrono::milliseconds(3));});
+    EXPECT_THROW(scheduler.start([]() {}), std::runtime_error);
+    std::this_thread::sleep_for(std::chrono::milliseconds(505));
+    scheduler.stop();
+    const auto stats = scheduler.stats();
+    EXPECT_GE(stats.num_cycles, 45u);
+    EXPECT_LE(stats.num_cycles, 50u);
+    std::cout << "Deadline Scheduler Latency: " << stats.mean_latency << "ms, Period Jitter: " <<
+      stats.period_jitter_rms << "ms (rms), " << stats.max_period_jitter << "ms (max)" <<
+      std::endl;
+  }
+
+  // an overrun skips the missed deadlines
+  {
+    DeadlineScheduler scheduler(config);
+    int count = 0;
+    scheduler.start(
+      [&count]() {
+        if (++count == 5) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(25));
+        }
+      });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    scheduler.stop();
+    const auto stats = scheduler.stats();
+    EXPECT_GE(stats.num_overruns, 1u);
+    EXPECT_GE(stats.num_skipped, 2u);
+  }
+
+  // the deadlines lock onto arrivals at the same rate
+  {
+    config.phase_gain = 0.2;
+    config.phase_offset = 0.001;
+    DeadlineScheduler scheduler(config);
+    std::atomic<bool> producing {true};
+    auto producer = std::thread(
+      [&scheduler, &producing]() {
+        const auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(5);
+        for (int i = 0; producing; i++) {
+          std::this_thread::sleep_until(start + std::chrono::milliseconds(10 * i));
+          scheduler.notify_arrival();
+        }
+      });
+    scheduler.start([]() {});
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    scheduler.reset_stats();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    scheduler.stop();
+    producing = false;
+    producer.join();
+    EXPECT_LT(scheduler.stats().mean_arrival_age, 4.0);
+    std::cout << "Deadline Scheduler Arrival Age: " << scheduler.stats().mean_arrival_age <<
+      "ms" << std::endl;
+  }
+  EXPECT_THROW(DeadlineScheduler(DeadlineSchedulerConfig{0.0}), std::invalid_argument);
+}
+
+TEST(LmpcUtilsTest, LatencyHistogramTest) {
+  using lmpc::utils::LatencyHistogram;
+  LatencyHistogram histogram;
+  // uniform latencies from 1 to 100 ms recorded by four threads
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back(
+      [&histogram, t]() {
+        for (int i = t; i < 10000; i += 4) {
+          histogram.record(1.0 + 99.0 * i / 9999.0);
+        }
+      });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(histogram.count(), 10000u);
+  EXPECT_NEAR(histogram.mean(), 50.5, 1e-3);
+  EXPECT_NEAR(histogram.max(), 100.0, 1e-3);
+  // percentiles are resolved to 10^(1/20), about 12%
+  EXPECT_NEAR(histogram.percentile(0.5), 50.5, 50.5 * 0.13);
+  EXPECT_NEAR(histogram.percentile(0.99), 99.0, 99.0 * 0.13);
+  EXPECT_LE(histogram.percentile(1.0), histogram.max());
+  const auto status = histogram.to_diagnostic_status("Latency", "(ms)", 50.0);
+  EXPECT_EQ(status.level, diagnostic_msgs::msg::DiagnosticStatus::WARN);
+  // out of range latencies are clamped to the end bins
+  histogram.reset();
+  histogram.record(0.0);
+  histogram.record(1e6);
+  EXPECT_EQ(histogram.count(), 2u);
+  EXPECT_NEAR(histogram.percentile(0.5), 1e-3, 1e-9);
+  EXPECT_NEAR(histogram.percentile(1.0), 1e6, 1e-3);
+  EXPECT_GT(lmpc::utils::trace_clock(), 0.0);
+}
+
+TEST(LmpcUtilsTest, SharedMemoryMirrorTest) {
+  using lmpc::utils::SharedMemoryMirror;
+  const std::string name = "/test_lmpc_utils_mirror";
+  SharedMemoryMirror writer(name, 64);
+  SharedMemoryMirror reader(name);
+  EXPECT_EQ(reader.capacity(), 64u);
+  EXPECT_FALSE(reader.is_writer());
+  std::vector<double> data;
+  EXPECT_FALSE(reader.read(data));
+  EXPECT_EQ(reader.heartbeat(), -1);
+
+  writer.write({1.0, 2.0, 3.0});
+  writer.beat(42);
+  EXPECT_EQ(reader.version(), 1u);
+  ASSERT_TRUE(reader.read(data));
+  EXPECT_EQ(data, std::vector<double>({1.0, 2.0, 3.0}));
+  EXPECT_EQ(reader.heartbeat(), 42);
+  EXPECT_THROW(writer.write(std::vector<double>(65)), std::length_error);
+  EXPECT_THROW(reader.beat(0), std::runtime_error);
+
+  // the reader must only ever see complete, non-decreasing values
+  writer.write(std::vector<double>(17, 1.0));
+  const int num_values = 10000;
+  std::thread producer([&writer, num_values]() {
+      for (int i = 2; i <= num_values; i++) {
+        writer.write(std::vector<double>(static_cast<size_t>(16 + i % 48), i));
+      }
+    });
+  double last = 1.0;
+  while (last < num_values) {
+    if (reader.read(data)) {
+      ASSERT_EQ(data.size(), static_cast<size_t>(16 + static_cast<int>(data.front()) % 48));
+      for (const auto & v : data) {
+        ASSERT_EQ(v, data.front());
+      }
+      ASSERT_GE(data.front(), last);
+      last = data.front();
+    }
+  }
+  producer.join();
+  EXPECT_EQ(reader.version(), static_cast<uint64_t>(num_values + 1));
+  EXPECT_THROW(SharedMemoryMirror("/test_lmpc_utils_missing"), std::runtime_error);
+}
+
+TEST(LmpcUtilsTest, CollocationTest) {
+  using casadi::DM;
+  using casadi::SX;
+  // x_dot = a * x + u, whose exact solution satisfies the collocation equations
+  // up to the interpolation error
+  const double a = -2.0, u = 0.5, x0 = 1.0, dt = 0.05;
+  const auto x = SX::sym("x", 1);
+  const auto u_sym = SX::sym("u", 1);
+  const auto k = SX::sym("k", 1);
+  const auto dynamics = casadi::Function(
+    "dynamics", {x, u_sym, k}, {a * x + u_sym}, {"x", "u", "k"}, {"x_dot"});
+  const auto exact = [&](const double & t) {
+      return (x0 + u / a) * std::exp(a * t) - u / a;
+    };
+
+  const auto hermite_simpson = lmpc::utils::hermite_simpson_function(1, 1, dynamics);
+  auto defect = hermite_simpson(
+    casadi::DMDict{{"x", x0}, {"xc", exact(dt / 2.0)}, {"xip1", exact(dt)}, {"u", u},
+      {"k", 0.0}, {"dt", dt}}).at("defect");
+  EXPECT_EQ(defect.size1(), 2);
+  EXPECT_LT(static_cast<double>(DM::norm_inf(defect)), 1e-5);
+
+  const casadi_int degree = 3;
+  const auto tau = casadi::collocation_points(degree, "legendre");
+  auto xc = DM::zeros(1, degree);
+  for (casadi_int j = 0; j < degree; j++) {
+    xc(j) = exact(tau[j] * dt);
+  }
+  const auto legendre = lmpc::utils::legendre_collocation_function(1, 1, degree, dynamics);
+  defect = legendre(
+    casadi::DMDict{{"x", x0}, {"xc", xc}, {"xip1", exact(dt)}, {"u", u}, {"k", 0.0},
+      {"dt", dt}}).at("defect");
+  EXPECT_EQ(defect.size1(), degree + 1);
+  EXPECT_LT(static_cast<double>(DM::norm_inf(defect)), 1e-5);
+  // a wrong end state is a continuity defect
+  defect = legendre(
+    casadi::DMDict{{"x", x0}, {"xc", xc}, {"xip1", exact(dt) + 0.1}, {"u", u}, {"k", 0.0},
+      {"dt", dt}}).at("defect");
+  EXPECT_NEAR(static_cast<double>(defect(degree)), 0.1, 1e-5);
+  EXPECT_THROW(
+    lmpc::utils::legendre_collocation_function(1, 1, 0, dynamics), std::invalid_argument);
+}
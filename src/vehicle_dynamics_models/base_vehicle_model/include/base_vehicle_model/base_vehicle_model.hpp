@@ -105,6 +105,18 @@ public:
    */
   virtual const casadi::Function & discrete_dynamics_jacobian() const;
 
+  /**
+   * @brief Returns the continuous dynamics for simulation and rollouts, with the same
+   * inputs and outputs as dynamics(). If the model supports it and the tyre approximation is
+   * enabled, the magic formula is replaced by its approximation. Otherwise it is dynamics().
+   */
+  virtual const casadi::Function & fast_dynamics() const;
+
+  /**
+   * @brief Returns the discretized fast_dynamics(), with the same inputs as discrete_dynamics().
+   */
+  virtual const casadi::Function & fast_discrete_dynamics() const;
+
   /**
    * @brief If the subclassed VD model uses a different state representation,
    *        this function should take "x" and "u",
@@ -133,6 +145,12 @@ public:
    */
   virtual void add_nlp_constraints(casadi::Opti & opti, const casadi::MXDict & in);
 
+  /**
+   * @brief Whether add_nlp_constraints() constrains "xip1" to the full dynamics from "x",
+   * collocated on "xc" if given. Otherwise the caller enforces the dynamics.
+   */
+  virtual bool enforces_dynamics() const;
+
   /**
    * @brief calculate longitudinal control based on control variable.
    *
@@ -195,6 +213,12 @@ public:
   virtual double calc_brake_force(const double & brake_kpa);
 
 protected:
+  /**
+   * @brief Set fast_dynamics() and discretize it with the configured integrator.
+   * The outputs of the discrete function are "xip1" and the other outputs of the dynamics.
+   */
+  void set_fast_dynamics(const casadi::Function & fast_dynamics);
+
   BaseVehicleModelConfig::SharedPtr base_config_ {};
   BaseVehicleModelState base_state_;
 
@@ -202,6 +226,8 @@ protected:
   casadi::Function dynamics_jacobian_ {};
   casadi::Function discrete_dynamics_ {};
   casadi::Function discrete_dynamics_jacobian_ {};
+  casadi::Function fast_dynamics_ {};
+  casadi::Function fast_discrete_dynamics_ {};
   casadi::Function to_base_state_ {};
   casadi::Function to_base_control_ {};
   casadi::Function from_base_state_ {};
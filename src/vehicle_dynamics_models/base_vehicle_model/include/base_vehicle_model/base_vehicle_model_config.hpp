@@ -136,6 +136,13 @@ struct ModelingConfig
 
   // Sample throttle point for torque lookup (0-100)
   double sample_throttle;
+
+  // Max error of the normalized lateral tyre force approximation of the fast dynamics.
+  // 0 disables the approximation
+  double tyre_approximation_tol;
+
+  // Slip angle range of the tyre approximation (rad)
+  double tyre_approximation_max_slip;
 };
 
 struct BaseVehicleModelConfig
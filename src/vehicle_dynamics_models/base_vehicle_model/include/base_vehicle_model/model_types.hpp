@@ -0,0 +1,180 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef BASE_VEHICLE_MODEL__MODEL_TYPES_HPP_
+#define BASE_VEHICLE_MODEL__MODEL_TYPES_HPP_
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <casadi/casadi.hpp>
+#include <lmpc_utils/casadi_evaluator.hpp>
+
+namespace lmpc
+{
+namespace vehicle_model
+{
+namespace base_vehicle_model
+{
+/**
+ * @brief Compile-time sized state and control types of a vehicle model.
+ * The controls are sized at runtime up to MAX_NU, since some models select the control
+ * representation in the config. All types are stack-allocated.
+ *
+ * @tparam NX_ state size
+ * @tparam MAX_NU_ max control size
+ */
+template<int NX_, int MAX_NU_>
+struct ModelTypes
+{
+  static constexpr int NX = NX_;
+  static constexpr int MAX_NU = MAX_NU_;
+  typedef Eigen::Matrix<double, NX, 1> State;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MAX_NU, 1> Control;
+  typedef Eigen::Matrix<double, NX, NX> StateMatrix;
+  typedef Eigen::Matrix<double, NX, Eigen::Dynamic, 0, NX, MAX_NU> InputMatrix;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, MAX_NU, MAX_NU> ControlMatrix;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, NX, 0, MAX_NU, NX> GainMatrix;
+};
+
+typedef ModelTypes<6, 3> BaseModelTypes;
+
+// view of a dense DM as an Eigen matrix of the same shape, without copying
+inline Eigen::Map<Eigen::MatrixXd> dm_map(casadi::DM & m)
+{
+  if (!m.is_dense()) {
+    throw std::invalid_argument("dm_map: the matrix must be dense.");
+  }
+  return Eigen::Map<Eigen::MatrixXd>(m.ptr(), m.size1(), m.size2());
+}
+
+inline Eigen::Map<const Eigen::MatrixXd> dm_map(const casadi::DM & m)
+{
+  if (!m.is_dense()) {
+    throw std::invalid_argument("dm_map: the matrix must be dense.");
+  }
+  return Eigen::Map<const Eigen::MatrixXd>(m.ptr(), m.size1(), m.size2());
+}
+
+/**
+ * @brief Copy a dense DM into an Eigen matrix. Throws std::invalid_argument if the shape
+ * does not fit the compile-time or max size of the output.
+ */
+template<typename Derived>
+void from_dm(const casadi::DM & m, Eigen::PlainObjectBase<Derived> & out)
+{
+  const auto rows = static_cast<Eigen::Index>(m.size1());
+  const auto cols = static_cast<Eigen::Index>(m.size2());
+  constexpr auto rows_at_compile_time = Eigen::PlainObjectBase<Derived>::RowsAtCompileTime;
+  constexpr auto cols_at_compile_time = Eigen::PlainObjectBase<Derived>::ColsAtCompileTime;
+  constexpr auto max_rows = Eigen::PlainObjectBase<Derived>::MaxRowsAtCompileTime;
+  constexpr auto max_cols = Eigen::PlainObjectBase<Derived>::MaxColsAtCompileTime;
+  if ((rows_at_compile_time != Eigen::Dynamic && rows != rows_at_compile_time) ||
+    (cols_at_compile_time != Eigen::Dynamic && cols != cols_at_compile_time) ||
+    (max_rows != Eigen::Dynamic && rows > max_rows) ||
+    (max_cols != Eigen::Dynamic && cols > max_cols))
+  {
+    throw std::invalid_argument(
+            "from_dm: a " + std::to_string(rows) + "x" + std::to_string(cols) +
+            " matrix does not fit the output type.");
+  }
+  out = dm_map(m);
+}
+
+/**
+ * @brief Copy an Eigen matrix into a dense DM of the same shape in place.
+ * Throws std::invalid_argument if the shapes differ.
+ */
+template<typename Derived>
+void to_dm(const Eigen::MatrixBase<Derived> & m, casadi::DM & out)
+{
+  if (static_cast<Eigen::Index>(out.size1()) != m.rows() ||
+    static_cast<Eigen::Index>(out.size2()) != m.cols())
+  {
+    throw std::invalid_argument("to_dm: the output has a different shape.");
+  }
+  dm_map(out) = m;
+}
+
+template<typename Derived>
+casadi::DM to_dm(const Eigen::MatrixBase<Derived> & m)
+{
+  auto out = casadi::DM::zeros(m.rows(), m.cols());
+  dm_map(out) = m;
+  return out;
+}
+
+/**
+ * @brief Evaluate a discrete dynamics function with inputs "x", "u", "k", "dt"
+ * and output "xip1" on typed states and controls, without allocating.
+ *
+ * @tparam Types ModelTypes of the model
+ */
+template<typename Types>
+class TypedDiscreteDynamics
+{
+public:
+  typedef typename Types::State State;
+  typedef typename Types::Control Control;
+
+  explicit TypedDiscreteDynamics(const casadi::Function & discrete_dynamics)
+  : eval_(discrete_dynamics),
+    x_idx_(eval_.function().index_in("x")),
+    u_idx_(eval_.function().index_in("u")),
+    k_idx_(eval_.function().index_in("k")),
+    dt_idx_(eval_.function().index_in("dt")),
+    xip1_idx_(eval_.function().index_out("xip1"))
+  {
+    if (eval_.function().nnz_in(x_idx_) != Types::NX ||
+      eval_.function().nnz_in(u_idx_) > Types::MAX_NU)
+    {
+      throw std::invalid_argument(
+              "TypedDiscreteDynamics: " + eval_.function().name() +
+              " does not match the state or control size.");
+    }
+  }
+
+  const State & operator()(
+    const State & x, const Control & u, const double & k, const double & dt)
+  {
+    if (u.size() != eval_.function().nnz_in(u_idx_)) {
+      throw std::invalid_argument("TypedDiscreteDynamics: the control has the wrong size.");
+    }
+    std::copy_n(x.data(), Types::NX, eval_.input(x_idx_).ptr());
+    std::copy_n(u.data(), u.size(), eval_.input(u_idx_).ptr());
+    *eval_.input(k_idx_).ptr() = k;
+    *eval_.input(dt_idx_).ptr() = dt;
+    eval_.evaluate();
+    std::copy_n(eval_.output(xip1_idx_).ptr(), Types::NX, xip1_.data());
+    return xip1_;
+  }
+
+protected:
+  lmpc::utils::CasadiEvaluator eval_;
+  casadi_int x_idx_;
+  casadi_int u_idx_;
+  casadi_int k_idx_;
+  casadi_int dt_idx_;
+  casadi_int xip1_idx_;
+  State xip1_;
+};
+}  // namespace base_vehicle_model
+}  // namespace vehicle_model
+}  // namespace lmpc
+#endif  // BASE_VEHICLE_MODEL__MODEL_TYPES_HPP_
@@ -0,0 +1,93 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef BASE_VEHICLE_MODEL__TYRE_APPROXIMATION_HPP_
+#define BASE_VEHICLE_MODEL__TYRE_APPROXIMATION_HPP_
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace lmpc
+{
+namespace vehicle_model
+{
+namespace base_vehicle_model
+{
+/**
+ * @brief Rational approximation of the normalized magic formula lateral force
+ *   sin(C * atan(B * a - E * (B * a - atan(B * a))))
+ * in the form a * P(s) / Q(s), s = (a / max_slip)^2, which is branch-free and only uses
+ * multiplications, additions and one division. The degree is the lowest one whose maximum
+ * error on [-max_slip, max_slip] is within the tolerance. The slip angle is clamped to this range.
+ */
+class TyreApproximation
+{
+public:
+  typedef std::shared_ptr<TyreApproximation> SharedPtr;
+  typedef std::unique_ptr<TyreApproximation> UniquePtr;
+
+  /**
+   * @brief Fit the approximation. Throws std::invalid_argument if no degree up to
+   * max_degree is within the tolerance.
+   *
+   * @param B magic formula B
+   * @param C magic formula C
+   * @param E magic formula E
+   * @param max_slip largest slip angle of the fit (rad)
+   * @param tol max absolute error of the normalized lateral force
+   * @param max_degree max degree of P and Q
+   */
+  TyreApproximation(
+    const double & B, const double & C, const double & E, const double & max_slip,
+    const double & tol, const size_t & max_degree = 8);
+
+  // the exact normalized lateral force
+  static double magic_formula(
+    const double & B, const double & C, const double & E, const double & slip);
+
+  template<typename T>
+  T evaluate(const T & slip) const
+  {
+    using std::fmax;
+    using std::fmin;
+    const T a = fmin(fmax(slip, T(-max_slip_)), T(max_slip_));
+    const T s = (a * inv_max_slip_) * (a * inv_max_slip_);
+    T p = T(p_.back());
+    for (size_t i = p_.size() - 1; i-- > 0; ) {
+      p = p * s + p_[i];
+    }
+    T q = T(q_.back());
+    for (size_t i = q_.size() - 1; i-- > 0; ) {
+      q = q * s + q_[i];
+    }
+    return a * p / q;
+  }
+
+  size_t degree() const;
+  const double & max_error() const;  // max error on the fitted range
+
+protected:
+  double max_slip_;
+  double inv_max_slip_;
+  double max_error_;
+  std::vector<double> p_;  // coefficients of P, lowest order first
+  std::vector<double> q_;  // coefficients of Q, lowest order first, q_[0] = 1
+};
+}  // namespace base_vehicle_model
+}  // namespace vehicle_model
+}  // namespace lmpc
+#endif  // BASE_VEHICLE_MODEL__TYRE_APPROXIMATION_HPP_
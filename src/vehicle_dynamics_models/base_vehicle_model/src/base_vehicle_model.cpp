@@ -14,6 +14,11 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <lmpc_utils/utils.hpp>
 
 #include "base_vehicle_model/base_vehicle_model.hpp"
 
@@ -87,6 +92,52 @@ const casadi::Function & BaseVehicleModel::discrete_dynamics_jacobian() const
   return discrete_dynamics_jacobian_;
 }
 
+const casadi::Function & BaseVehicleModel::fast_dynamics() const
+{
+  return fast_dynamics_.is_null() ? dynamics_ : fast_dynamics_;
+}
+
+const casadi::Function & BaseVehicleModel::fast_discrete_dynamics() const
+{
+  return fast_discrete_dynamics_.is_null() ? discrete_dynamics_ : fast_discrete_dynamics_;
+}
+
+void BaseVehicleModel::set_fast_dynamics(const casadi::Function & fast_dynamics)
+{
+  using casadi::SX;
+  const auto x = SX::sym("x", nx());
+  const auto u = SX::sym("u", nu());
+  const auto k = SX::sym("k", 1);
+  const auto dt = SX::sym("dt", 1);
+  const auto in = casadi::SXDict{{"x", x}, {"u", u}, {"k", k}, {"dt", dt}};
+
+  auto dynamics = fast_dynamics;
+  SX xip1;
+  const auto & integrator_type = get_base_config().modeling_config->integrator_type;
+  if (integrator_type == IntegratorType::RK4) {
+    xip1 = utils::rk4_function(nx(), nu(), dynamics)(in).at("xip1");
+  } else if (integrator_type == IntegratorType::EULER) {
+    xip1 = utils::euler_function(nx(), nu(), dynamics)(in).at("xip1");
+  } else {
+    throw std::runtime_error("unsupported integrator type");
+  }
+
+  // the other outputs are evaluated at the initial state, as in discrete_dynamics()
+  const auto out = dynamics(casadi::SXDict{{"x", x}, {"u", u}, {"k", k}});
+  std::vector<SX> outputs{xip1};
+  std::vector<std::string> output_names{"xip1"};
+  for (const auto & name : dynamics.name_out()) {
+    if (name != "x_dot") {
+      outputs.push_back(out.at(name));
+      output_names.push_back(name);
+    }
+  }
+  fast_dynamics_ = fast_dynamics;
+  fast_discrete_dynamics_ = casadi::Function(
+    fast_dynamics.name() + "_discrete", {x, u, k, dt}, outputs, {"x", "u", "k", "dt"},
+    output_names);
+}
+
 const casadi::Function & BaseVehicleModel::to_base_state() const
 {
   return to_base_state_;
@@ -113,6 +164,11 @@ void BaseVehicleModel::add_nlp_constraints(casadi::Opti & opti, const casadi::MX
   (void) in;
 }
 
+bool BaseVehicleModel::enforces_dynamics() const
+{
+  return false;
+}
+
 void BaseVehicleModel::calc_lon_control(
   const casadi::DMDict & in, double & throttle,
   double & brake_kpa) const
@@ -155,6 +155,8 @@ BaseVehicleModelConfig::SharedPtr load_parameters(rclcpp::Node * node)
           declare_bool("modeling.use_frenet"),
           integrator_type,
           declare_double("modeling.sample_throttle"),
+          declare_double("modeling.tyre_approximation_tol"),
+          declare_double("modeling.tyre_approximation_max_slip"),
         }
   );
 
@@ -0,0 +1,144 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "base_vehicle_model/tyre_approximation.hpp"
+
+namespace lmpc
+{
+namespace vehicle_model
+{
+namespace base_vehicle_model
+{
+TyreApproximation::TyreApproximation(
+  const double & B, const double & C, const double & E, const double & max_slip,
+  const double & tol, const size_t & max_degree)
+: max_slip_(max_slip), inv_max_slip_(1.0 / max_slip),
+  max_error_(std::numeric_limits<double>::infinity())
+{
+  if (max_slip <= 0.0 || tol <= 0.0) {
+    throw std::invalid_argument("TyreApproximation: max slip and tolerance must be positive.");
+  }
+  // the error is checked on a dense grid. the fit uses chebyshev nodes, which are
+  // dense near the ends of the range where the magic formula bends the most
+  const size_t num_check = 2000;
+  auto eval_pq = [](const Eigen::VectorXd & c, const double & s) {
+      double y = 0.0;
+      for (Eigen::Index i = c.size() - 1; i >= 0; i--) {
+        y = y * s + c(i);
+      }
+      return y;
+    };
+
+  for (size_t m = 1; m <= max_degree; m++) {
+    const auto n = static_cast<Eigen::Index>(20 * (m + 1) + 50);
+    Eigen::VectorXd a(n), s(n), g(n), w = Eigen::VectorXd::Ones(n), q_prev = w;
+    for (Eigen::Index i = 0; i < n; i++) {
+      a(i) = max_slip * 0.5 * (1.0 + std::cos(M_PI * (i + 0.5) / n));
+      s(i) = std::pow(a(i) * inv_max_slip_, 2);
+      g(i) = magic_formula(B, C, E, a(i)) / a(i);
+    }
+
+    // P(s) - g (Q(s) - 1) = g, linearized by the previous Q (Sanathanan-Koerner)
+    // and reweighted by the previous error to approach the minimax fit (Lawson)
+    const auto np = static_cast<Eigen::Index>(m + 1);
+    const auto nq = static_cast<Eigen::Index>(m);
+    Eigen::MatrixXd A(n, np + nq);
+    Eigen::VectorXd b(n);
+    for (size_t iter = 0; iter < 40; iter++) {
+      for (Eigen::Index i = 0; i < n; i++) {
+        const auto scale = a(i) * w(i) / q_prev(i);
+        double s_pow = 1.0;
+        for (Eigen::Index j = 0; j < np; j++) {
+          A(i, j) = scale * s_pow;
+          if (j < nq) {
+            A(i, np + j) = -scale * g(i) * s_pow * s(i);
+          }
+          s_pow *= s(i);
+        }
+        b(i) = scale * g(i);
+      }
+      const Eigen::VectorXd x = A.colPivHouseholderQr().solve(b);
+      Eigen::VectorXd p = x.head(np);
+      Eigen::VectorXd q(nq + 1);
+      q << 1.0, x.tail(nq);
+
+      Eigen::VectorXd err(n);
+      for (Eigen::Index i = 0; i < n; i++) {
+        q_prev(i) = eval_pq(q, s(i));
+        err(i) = std::abs(a(i) * (g(i) - eval_pq(p, s(i)) / q_prev(i)));
+      }
+      if (iter >= 10) {
+        w = w.cwiseProduct(err.cwiseSqrt());
+        w /= w.maxCoeff();
+        w = w.cwiseMax(1e-12);
+      }
+      if ((q_prev.array() <= 0.0).any()) {
+        break;
+      }
+
+      // a pole or a sign change of Q in the range is not accepted
+      double max_error = 0.0;
+      double min_q = std::numeric_limits<double>::infinity();
+      for (size_t i = 0; i <= num_check; i++) {
+        const auto ai = max_slip * static_cast<double>(i) / num_check;
+        const auto si = std::pow(ai * inv_max_slip_, 2);
+        const auto qi = eval_pq(q, si);
+        min_q = std::min(min_q, qi);
+        max_error = std::max(
+          max_error, std::abs(magic_formula(B, C, E, ai) - ai * eval_pq(p, si) / qi));
+      }
+      if (min_q > 0.0 && max_error < max_error_) {
+        max_error_ = max_error;
+        p_.assign(p.data(), p.data() + p.size());
+        q_.assign(q.data(), q.data() + q.size());
+      }
+    }
+    if (max_error_ <= tol) {
+      return;
+    }
+  }
+  std::ostringstream msg;
+  msg << "TyreApproximation: the best approximation error " << max_error_ <<
+    " is above the tolerance " << tol << ".";
+  throw std::invalid_argument(msg.str());
+}
+
+double TyreApproximation::magic_formula(
+  const double & B, const double & C, const double & E, const double & slip)
+{
+  return std::sin(C * std::atan(B * slip - E * (B * slip - std::atan(B * slip))));
+}
+
+size_t TyreApproximation::degree() const
+{
+  return p_.size() - 1;
+}
+
+const double & TyreApproximation::max_error() const
+{
+  return max_error_;
+}
+}  // namespace base_vehicle_model
+}  // namespace vehicle_model
+}  // namespace lmpc
@@ -14,11 +14,16 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <gtest/gtest.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
 #include <rclcpp/rclcpp.hpp>
 #include <ament_index_cpp/get_package_share_directory.hpp>
 
 #include "base_vehicle_model/base_vehicle_model.hpp"
+#include "base_vehicle_model/model_types.hpp"
 #include "base_vehicle_model/ros_param_loader.hpp"
+#include "base_vehicle_model/tyre_approximation.hpp"
 
 TEST(BaseVehicleModelTest, BaseVehicleModelTest) {
   rclcpp::init(0, nullptr);
@@ -34,3 +39,96 @@ TEST(BaseVehicleModelTest, BaseVehicleModelTest) {
   rclcpp::shutdown();
   SUCCEED();
 }
+
+TEST(BaseVehicleModelTest, TyreApproximationTest) {
+  using lmpc::vehicle_model::base_vehicle_model::TyreApproximation;
+  const double B = 11.0, C = 1.7, max_slip = 0.3, tol = 1e-3;
+  for (const double E : {0.0, 1.0}) {
+    const auto approx = TyreApproximation(B, C, E, max_slip, tol);
+    EXPECT_LE(approx.max_error(), tol);
+    double max_error = 0.0;
+    for (int i = -1000; i <= 1000; i++) {
+      const auto a = max_slip * i / 1000.0;
+      max_error = std::max(
+        max_error, std::abs(approx.evaluate(a) - TyreApproximation::magic_formula(B, C, E, a)));
+    }
+    EXPECT_LE(max_error, tol);
+    // the slip angle is clamped to the fitted range
+    EXPECT_DOUBLE_EQ(approx.evaluate(1.0), approx.evaluate(max_slip));
+
+    // the symbolic evaluation is the same function
+    const auto a = casadi::SX::sym("a");
+    const auto f = casadi::Function("f", {a}, {approx.evaluate(a)});
+    EXPECT_NEAR(static_cast<double>(f(casadi::DM(0.05))[0]), approx.evaluate(0.05), 1e-12);
+    std::cout << "Tyre Approximation (E = " << E << "): degree " << approx.degree() <<
+      ", max error " << approx.max_error() << std::endl;
+  }
+  EXPECT_THROW(TyreApproximation(B, C, 1.0, max_slip, 1e-15), std::invalid_argument);
+}
+
+TEST(BaseVehicleModelTest, TyreApproximationBenchmark) {
+  using lmpc::vehicle_model::base_vehicle_model::TyreApproximation;
+  const double B = 11.0, C = 1.7, E = 1.0, max_slip = 0.3;
+  const auto approx = TyreApproximation(B, C, E, max_slip, 1e-3);
+  const int num_eval = 1000000;
+  double sum = 0.0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_eval; i++) {
+    sum += TyreApproximation::magic_formula(B, C, E, max_slip * ((i % 2001) - 1000) / 1000.0);
+  }
+  const auto exact_time = std::chrono::duration<double, std::nano>(
+    std::chrono::high_resolution_clock::now() - start).count() / num_eval;
+  start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_eval; i++) {
+    sum -= approx.evaluate(max_slip * ((i % 2001) - 1000) / 1000.0);
+  }
+  const auto approx_time = std::chrono::duration<double, std::nano>(
+    std::chrono::high_resolution_clock::now() - start).count() / num_eval;
+  std::cout << "Magic Formula: " << exact_time << "ns, Approximation: " << approx_time << "ns" <<
+    std::endl;
+  EXPECT_LT(std::abs(sum) / num_eval, 1e-3);
+}
+
+TEST(BaseVehicleModelTest, ModelTypesTest) {
+  using lmpc::vehicle_model::base_vehicle_model::ModelTypes;
+  using lmpc::vehicle_model::base_vehicle_model::TypedDiscreteDynamics;
+  using lmpc::vehicle_model::base_vehicle_model::from_dm;
+  using lmpc::vehicle_model::base_vehicle_model::to_dm;
+  typedef ModelTypes<4, 3> Types;
+
+  // DM round trip
+  const auto x_dm = casadi::DM{1.0, 2.0, 3.0, 4.0};
+  Types::State x;
+  from_dm(x_dm, x);
+  EXPECT_DOUBLE_EQ(x(3), 4.0);
+  auto x_out = casadi::DM::zeros(4, 1);
+  to_dm(x, x_out);
+  EXPECT_DOUBLE_EQ(static_cast<double>(casadi::DM::norm_inf(x_out - x_dm)), 0.0);
+  Types::Control u;
+  from_dm(casadi::DM{0.5, -0.5}, u);
+  EXPECT_EQ(u.size(), 2);
+  EXPECT_THROW(from_dm(casadi::DM{1.0, 2.0}, x), std::invalid_argument);
+  EXPECT_THROW(from_dm(casadi::DM::zeros(4, 1), u), std::invalid_argument);
+  EXPECT_THROW(to_dm(u, x_out), std::invalid_argument);
+
+  // xip1 = x + dt * (k * x + [u; u])
+  const auto x_sym = casadi::SX::sym("x", 4);
+  const auto u_sym = casadi::SX::sym("u", 2);
+  const auto k_sym = casadi::SX::sym("k");
+  const auto dt_sym = casadi::SX::sym("dt");
+  const auto xip1 = x_sym + dt_sym * (k_sym * x_sym + casadi::SX::vertcat({u_sym, u_sym}));
+  const auto f = casadi::Function(
+    "discrete_dynamics", {x_sym, u_sym, k_sym, dt_sym}, {xip1},
+    {"x", "u", "k", "dt"}, {"xip1"});
+  auto typed = TypedDiscreteDynamics<Types>(f);
+  const auto & x_next = typed(x, u, 2.0, 0.1);
+  const auto expected = f(
+    casadi::DMDict{{"x", x_dm}, {"u", casadi::DM{0.5, -0.5}}, {"k", 2.0}, {"dt", 0.1}}).at("xip1");
+  for (int i = 0; i < Types::NX; i++) {
+    EXPECT_NEAR(x_next(i), expected.nonzeros()[i], 1e-12);
+  }
+  Types::Control u_wrong(3);
+  u_wrong.setZero();
+  EXPECT_THROW(typed(x, u_wrong, 2.0, 0.1), std::invalid_argument);
+  EXPECT_THROW(TypedDiscreteDynamics<ModelTypes<6, 3>>(f), std::invalid_argument);
+}
@@ -28,6 +28,12 @@ namespace vehicle_model
 {
 namespace double_track_planar_model
 {
+enum LoadTransferMethod
+{
+  NEWTON,
+  FIXED_POINT
+};
+
 struct DoubleTrackPlanarModelConfig
 {
   typedef std::shared_ptr<DoubleTrackPlanarModelConfig> SharedPtr;
@@ -40,6 +46,8 @@ struct DoubleTrackPlanarModelConfig
   double P_max;
   double kroll_f;
   double mu;
+  LoadTransferMethod load_transfer_method;  // iteration resolving the load transfer
+  int64_t load_transfer_iterations;  // iterations resolving the load transfer in the dynamics
 };
 
 enum XIndex : size_t
@@ -74,7 +82,18 @@ public:
   size_t nx() const override;
   size_t nu() const override;
 
+  /**
+   * @brief Add constraints to the optimal control problem.
+   * The dynamics are integrated with RK4, or collocated if "xc" (collocation states) is given:
+   * Hermite-Simpson with one collocation state per step and Legendre with more.
+   * If "gamma_y" is given, the lateral load transfer is a decision variable held over the step
+   * and constrained to the tyre forces. Otherwise it is resolved in the dynamics.
+   *
+   * @param opti Casadi NLP optimizer
+   * @param in "x", "u", "xip1", "t", "k", "track_length", optional "gamma_y", "uip1" and "xc".
+   */
   void add_nlp_constraints(casadi::Opti & opti, const casadi::MXDict & in) override;
+  bool enforces_dynamics() const override;
   void calc_lon_control(
     const casadi::DMDict & in, double & throttle,
     double & brake_kpa) const override;
@@ -85,6 +104,8 @@ private:
 
   DoubleTrackPlanarModelConfig::SharedPtr config_ {};
   casadi::Function dynamics_gamma_y_;
+  casadi::Function augmented_dynamics_;  // gamma_y appended to the control
+  casadi::Function collocation_;
 };
 }  // namespace double_track_planar_model
 }  // namespace vehicle_model
@@ -13,7 +13,10 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <vector>
+
 #include "double_track_planar_model/double_track_planar_model.hpp"
+#include "base_vehicle_model/tyre_approximation.hpp"
 #include "lmpc_utils/utils.hpp"
 #define GRAVITY 9.8
 
@@ -52,7 +55,6 @@ void DoubleTrackPlanarModel::add_nlp_constraints(casadi::Opti & opti, const casa
   using TI = lmpc::utils::TyreIndex;
   const auto & x = in.at("x");
   const auto & u = in.at("u");
-  const auto & gamma_y = in.at("gamma_y");
   const auto & xip1 = in.at("xip1");
   const auto & t = in.at("t");
   const auto k =
@@ -86,21 +88,40 @@ void DoubleTrackPlanarModel::add_nlp_constraints(casadi::Opti & opti, const casa
       xip1_temp(XIndex::PX), x(XIndex::PX),
       in.at("track_length"));
   }
-  // TODO(haoru): choose different integrator based on config
-  const auto out1 = dynamics_gamma_y_({{"x", x}, {"u", u}, {"gamma_y", gamma_y}, {"k", k}});
-  const auto k1 = out1.at("x_dot");
-  const auto out2 = dynamics_gamma_y_(
-    {{"x", x + t / 2.0 * k1}, {"u", u}, {"gamma_y", gamma_y},
-      {"k", k}});
-  const auto k2 = out2.at("x_dot");
-  const auto out3 = dynamics_gamma_y_(
-    {{"x", x + t / 2.0 * k2}, {"u", u}, {"gamma_y", gamma_y},
-      {"k", k}});
-  const auto k3 = out3.at("x_dot");
-  const auto out4 =
-    dynamics_gamma_y_({{"x", x + t * k3}, {"u", u}, {"gamma_y", gamma_y}, {"k", k}});
-  const auto k4 = out4.at("x_dot");
-  opti.subject_to(x + t / 6 * (k1 + 2 * k2 + 2 * k3 + k4) - xip1_temp == 0);
+  // without a load transfer decision variable, the dynamics resolve it and are an ODE.
+  // otherwise the load transfer is held over the step like the control.
+  const bool load_transfer_variable = in.count("gamma_y") > 0;
+  const auto & step_dynamics = load_transfer_variable ? augmented_dynamics_ : dynamics_;
+  const auto u_step = load_transfer_variable ? casadi::MX::vertcat({u, in.at("gamma_y")}) : u;
+  const auto out1 = step_dynamics(casadi::MXDict{{"x", x}, {"u", u_step}, {"k", k}});
+  if (in.count("xc")) {
+    // the collocation states are decision variables, so each dynamics evaluation
+    // only depends on one of them
+    const auto & xc = in.at("xc");
+    const auto degree = xc.size2();
+    if (collocation_.is_null() || collocation_.size2_in(1) != degree ||
+      collocation_.size1_in(3) != u_step.size1())
+    {
+      const auto nx_c = static_cast<casadi_int>(nx());
+      const auto nu_c = u_step.size1();
+      collocation_ = degree == 1 ?
+        utils::hermite_simpson_function(nx_c, nu_c, step_dynamics) :
+        utils::legendre_collocation_function(nx_c, nu_c, degree, step_dynamics);
+    }
+    const auto defect = collocation_(
+      casadi::MXDict{{"x", x}, {"xc", xc}, {"xip1", xip1_temp}, {"u", u_step}, {"k", k},
+        {"dt", t}}).at("defect");
+    opti.subject_to(defect == 0);
+  } else {
+    const auto k1 = out1.at("x_dot");
+    const auto k2 = step_dynamics(
+      casadi::MXDict{{"x", x + t / 2.0 * k1}, {"u", u_step}, {"k", k}}).at("x_dot");
+    const auto k3 = step_dynamics(
+      casadi::MXDict{{"x", x + t / 2.0 * k2}, {"u", u_step}, {"k", k}}).at("x_dot");
+    const auto k4 = step_dynamics(
+      casadi::MXDict{{"x", x + t * k3}, {"u", u_step}, {"k", k}}).at("x_dot");
+    opti.subject_to(x + t / 6 * (k1 + 2 * k2 + 2 * k3 + k4) - xip1_temp == 0);
+  }
 
   // tyre constraints
   const auto Fx_ij = out1.at("Fx_ij");
@@ -111,11 +132,13 @@ void DoubleTrackPlanarModel::add_nlp_constraints(casadi::Opti & opti, const casa
   }
 
   // load transfer constraint
-  opti.subject_to(
-    gamma_y ==
-    hcog / (0.5 * (twf + twr)) *
-    (Fy_ij(TI::RL) + Fy_ij(TI::RR) + (Fx_ij(TI::FL) + Fx_ij(TI::FR)) * sin(delta) +
-    (Fy_ij(TI::FL) + Fy_ij(TI::FR)) * cos(delta)));
+  if (load_transfer_variable) {
+    opti.subject_to(
+      in.at("gamma_y") ==
+      hcog / (0.5 * (twf + twr)) *
+      (Fy_ij(TI::RL) + Fy_ij(TI::RR) + (Fx_ij(TI::FL) + Fx_ij(TI::FR)) * sin(delta) +
+      (Fy_ij(TI::FL) + Fy_ij(TI::FR)) * cos(delta)));
+  }
 
   // static actuator cconstraint
   opti.subject_to(v * fd <= P_max);
@@ -136,6 +159,11 @@ void DoubleTrackPlanarModel::add_nlp_constraints(casadi::Opti & opti, const casa
   }
 }
 
+bool DoubleTrackPlanarModel::enforces_dynamics() const
+{
+  return true;
+}
+
 void DoubleTrackPlanarModel::calc_lon_control(
   const casadi::DMDict & in, double & throttle,
   double & brake_kpa) const
@@ -245,14 +273,19 @@ void DoubleTrackPlanarModel::compile_dynamics()
   const auto a_rr = atan((lr * omega - v * sin(beta)) / (v * cos(beta) + 0.5 * twr * omega));
 
   // lateral tyre force Fy (eq. 5)
-  const auto Fy_fl = mu * Fz_fl * (1.0 + eps_f * Fz_fl / Fz0_f) *
-    sin(Cf * atan(Bf * a_fl - Ef * (Bf * a_fl - atan(Bf * a_fl))));
-  const auto Fy_fr = mu * Fz_fr * (1.0 + eps_f * Fz_fr / Fz0_f) *
-    sin(Cf * atan(Bf * a_fr - Ef * (Bf * a_fr - atan(Bf * a_fr))));
-  const auto Fy_rl = mu * Fz_rl * (1.0 + eps_r * Fz_rl / Fz0_r) *
-    sin(Cr * atan(Br * a_rl - Er * (Br * a_rl - atan(Br * a_rl))));
-  const auto Fy_rr = mu * Fz_rr * (1.0 + eps_r * Fz_rr / Fz0_r) *
-    sin(Cr * atan(Br * a_rr - Er * (Br * a_rr - atan(Br * a_rr))));
+  // the normalized lateral forces are symbols here, substituted by the magic formula
+  // for the dynamics and by its approximation for the fast dynamics
+  const auto Fy_norm = SX::sym("Fy_norm", 4);
+  const auto Fy_fl = mu * Fz_fl * (1.0 + eps_f * Fz_fl / Fz0_f) * Fy_norm(0);
+  const auto Fy_fr = mu * Fz_fr * (1.0 + eps_f * Fz_fr / Fz0_f) * Fy_norm(1);
+  const auto Fy_rl = mu * Fz_rl * (1.0 + eps_r * Fz_rl / Fz0_r) * Fy_norm(2);
+  const auto Fy_rr = mu * Fz_rr * (1.0 + eps_r * Fz_rr / Fz0_r) * Fy_norm(3);
+  const auto Fy_norm_exact = vertcat(
+    std::vector<SX>{
+    sin(Cf * atan(Bf * a_fl - Ef * (Bf * a_fl - atan(Bf * a_fl)))),
+    sin(Cf * atan(Bf * a_fr - Ef * (Bf * a_fr - atan(Bf * a_fr)))),
+    sin(Cr * atan(Br * a_rl - Er * (Br * a_rl - atan(Br * a_rl)))),
+    sin(Cr * atan(Br * a_rr - Er * (Br * a_rr - atan(Br * a_rr))))});
 
   // dynamics (eq. 3a, 3b, 3c)
   const auto v_dot = 1.0 / m *
@@ -276,10 +309,12 @@ void DoubleTrackPlanarModel::compile_dynamics()
     phi_dot -= k * vx;
   }
 
-  const auto x_dot = vertcat(vx, vy, phi_dot, omega_dot, beta_dot, v_dot);
+  const auto x_dot_sym = vertcat(vx, vy, phi_dot, omega_dot, beta_dot, v_dot);
   const auto Fx_ij = vertcat(Fx_fl, Fx_fr, Fx_rl, Fx_rr);
-  const auto Fy_ij = vertcat(Fy_fl, Fy_fr, Fy_rl, Fy_rr);
+  const auto Fy_ij_sym = vertcat(Fy_fl, Fy_fr, Fy_rl, Fy_rr);
   const auto Fz_ij = vertcat(Fz_fl, Fz_fr, Fz_rl, Fz_rr);
+  const auto x_dot = SX::substitute(x_dot_sym, Fy_norm, Fy_norm_exact);
+  const auto Fy_ij = SX::substitute(Fy_ij_sym, Fy_norm, Fy_norm_exact);
 
   dynamics_gamma_y_ = casadi::Function(
     "double_track_planar_model",
@@ -288,6 +323,14 @@ void DoubleTrackPlanarModel::compile_dynamics()
     {"x", "u", "gamma_y", "k"},
     {"x_dot", "Fx_ij", "Fy_ij", "Fz_ij"});
 
+  // the lateral load transfer appended to the control, for steps where it is held
+  augmented_dynamics_ = casadi::Function(
+    "double_track_planar_model_augmented_dynamics",
+    {x, SX::vertcat({u, gamma_y}), k},
+    {x_dot, Fx_ij, Fy_ij, Fz_ij},
+    {"x", "u", "k"},
+    {"x_dot", "Fx_ij", "Fy_ij", "Fz_ij"});
+
   const auto Ac = SX::jacobian(x_dot, x);
   const auto Bc = SX::jacobian(x_dot, u);
   const auto B2c = SX::jacobian(x_dot, gamma_y);
@@ -300,48 +343,82 @@ void DoubleTrackPlanarModel::compile_dynamics()
     {"A", "B", "B2"}
   );
 
-  using TI = utils::TyreIndex;
-  const casadi::SXDict dyn_in =
-  {
-    {"x", x},
-    {"u", u},
-    {"k", k},
-    {"gamma_y", gamma_y}
-  };
-  auto dyn_out = dynamics_gamma_y_(dyn_in);
-
-  const auto & Fx_ij_fwd = dyn_out.at("Fx_ij");
-  const auto & Fy_ij_fwd = dyn_out.at("Fy_ij");
-
-  const auto res = gamma_y - hcog / (0.5 * (twf + twr)) *
-    (Fy_ij_fwd(TI::RL) + Fy_ij_fwd(TI::RR) + (Fx_ij_fwd(TI::FL) + Fx_ij_fwd(TI::FR)) * sin(delta) +
-    (Fy_ij_fwd(TI::FL) + Fy_ij_fwd(TI::FR)) * cos(delta));
-  auto g = casadi::Function("g", {gamma_y}, {res});
-  auto lateral_load_transfer_ = casadi::rootfinder("G", "newton", g, {{"error_on_fail", false}});
-
-  const auto gamma_y_solve = casadi::DM(lateral_load_transfer_(casadi::DM{0.0}));
-  for (auto & var : dyn_out) {
-    dyn_out[var.first] = casadi::DM(casadi::SX::substitute(var.second, gamma_y, gamma_y_solve));
-  }
+  // the load transfer is implicit (eq. 8), since the lateral forces depend on it through the
+  // vertical forces. resolve it from gamma_y = 0 with a fixed number of iterations, so that
+  // the forward dynamics are an ODE. a single newton iteration is the first-order approximation.
+  const auto load_transfer_residual = gamma_y - hcog / (0.5 * (twf + twr)) *
+    (Fy_rl + Fy_rr + (Fx_fl + Fx_fr) * sin(delta) + (Fy_fl + Fy_fr) * cos(delta));
+  const auto resolve_load_transfer = [&](const SX & Fy_norm_value) {
+      const auto res = SX::substitute(load_transfer_residual, Fy_norm, Fy_norm_value);
+      const auto update = get_config().load_transfer_method == LoadTransferMethod::NEWTON ?
+        gamma_y - res / SX::jacobian(res, gamma_y) : gamma_y - res;
+      SX gamma_y_value = SX::zeros(1, 1);
+      for (int64_t i = 0; i < get_config().load_transfer_iterations; i++) {
+        gamma_y_value = SX::substitute(update, gamma_y, gamma_y_value);
+      }
+      return gamma_y_value;
+    };
+
+  const auto gamma_y_solve = resolve_load_transfer(Fy_norm_exact);
   dynamics_ = casadi::Function(
     "double_track_planar_model_forward_dynamics",
     {x, u, k},
-    {dyn_out.at("x_dot"), dyn_out.at("Fx_ij"), dyn_out.at("Fy_ij"), dyn_out.at(
-        "Fz_ij"), gamma_y_solve},
+    SX::substitute(
+      std::vector<SX>{x_dot, Fx_ij, Fy_ij, Fz_ij, gamma_y}, std::vector<SX>{gamma_y},
+      std::vector<SX>{gamma_y_solve}),
     {"x", "u", "k"},
     {"x_dot", "Fx_ij", "Fy_ij", "Fz_ij", "gamma_y"});
 
+  // replace the magic formula with its approximation in the fast dynamics
+  const auto & modeling_config = *get_base_config().modeling_config;
+  if (modeling_config.tyre_approximation_tol > 0.0) {
+    const auto front = base_vehicle_model::TyreApproximation(
+      Bf, Cf, Ef, modeling_config.tyre_approximation_max_slip,
+      modeling_config.tyre_approximation_tol);
+    const auto rear = base_vehicle_model::TyreApproximation(
+      Br, Cr, Er, modeling_config.tyre_approximation_max_slip,
+      modeling_config.tyre_approximation_tol);
+    const auto Fy_norm_fast = vertcat(
+      std::vector<SX>{
+      front.evaluate(a_fl), front.evaluate(a_fr), rear.evaluate(a_rl), rear.evaluate(a_rr)});
+    auto fast_out = SX::substitute(
+      std::vector<SX>{x_dot_sym, Fx_ij, Fy_ij_sym, Fz_ij}, std::vector<SX>{Fy_norm},
+      std::vector<SX>{Fy_norm_fast});
+    const auto gamma_y_fast = resolve_load_transfer(Fy_norm_fast);
+    fast_out = SX::substitute(
+      fast_out, std::vector<SX>{gamma_y}, std::vector<SX>{gamma_y_fast});
+    fast_out.push_back(gamma_y_fast);
+    set_fast_dynamics(
+      casadi::Function(
+        "double_track_planar_model_fast_dynamics",
+        {x, u, k},
+        fast_out,
+        {"x", "u", "k"},
+        {"x_dot", "Fx_ij", "Fy_ij", "Fz_ij", "gamma_y"}));
+  }
+
   // discretize dynamics
+  // the discrete jacobians are propagated through the integrator stages
+  const auto x_dot_fwd = dynamics_(casadi::SXDict{{"x", x}, {"u", u}, {"k", k}}).at("x_dot");
+  const auto forward_jacobian = casadi::Function(
+    "double_track_planar_model_forward_dynamics_jacobian",
+    {x, u, k},
+    {SX::jacobian(x_dot_fwd, x), SX::jacobian(x_dot_fwd, u)},
+    {"x", "u", "k"},
+    {"A", "B"});
   SX xip1;
+  casadi::Function discrete_jacobian;
   const auto & integrator_type = get_base_config().modeling_config->integrator_type;
   if (integrator_type == base_vehicle_model::IntegratorType::RK4) {
     xip1 = utils::rk4_function(nx(), nu(), dynamics_)(
       casadi::SXDict{{"x", x}, {"u", u}, {"k", k}, {"dt", dt}}
     ).at("xip1");
+    discrete_jacobian = utils::rk4_jacobian_function(nx(), nu(), dynamics_, forward_jacobian);
   } else if (integrator_type == base_vehicle_model::IntegratorType::EULER) {
     xip1 = utils::euler_function(nx(), nu(), dynamics_)(
       casadi::SXDict{{"x", x}, {"u", u}, {"k", k}, {"dt", dt}}
     ).at("xip1");
+    discrete_jacobian = utils::euler_jacobian_function(nx(), nu(), dynamics_, forward_jacobian);
   } else {
     throw std::runtime_error("unsupported integrator type");
   }
@@ -353,15 +430,12 @@ void DoubleTrackPlanarModel::compile_dynamics()
     {"x", "u", "k", "dt"},
     {"xip1", "Fx_ij", "Fy_ij", "Fz_ij"});
 
-  const auto Ad = SX::jacobian(xip1, x);
-  const auto Bd = SX::jacobian(xip1, u);
-
   discrete_dynamics_jacobian_ = casadi::Function(
     "double_track_planar_model_discrete_dynamics_jacobian",
     {x, u, k, dt},
-    {Ad, Bd},
+    discrete_jacobian(std::vector<SX>{x, u, k, dt}),
     {"x", "u", "k", "dt"},
-    {"A", "B"}
+    {"A", "B", "g"}
   );
 }
 }  // namespace double_track_planar_model
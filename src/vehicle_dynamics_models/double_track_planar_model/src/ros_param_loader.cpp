@@ -15,6 +15,7 @@
 
 #include <string>
 #include <memory>
+#include <stdexcept>
 #include <vector>
 
 #include <lmpc_utils/ros_param_helper.hpp>
@@ -32,6 +33,23 @@ DoubleTrackPlanarModelConfig::SharedPtr load_parameters(rclcpp::Node * node)
   auto declare_double = [&](const char * name) {
       return lmpc::utils::declare_parameter<double>(node, name);
     };
+  auto declare_int = [&](const char * name) {
+      return lmpc::utils::declare_parameter<int64_t>(node, name);
+    };
+  auto declare_string = [&](const char * name) {
+      return lmpc::utils::declare_parameter<std::string>(node, name);
+    };
+
+  const auto load_transfer_method_str =
+    declare_string("double_track_planar.load_transfer_method");
+  LoadTransferMethod load_transfer_method;
+  if (load_transfer_method_str == "newton") {
+    load_transfer_method = LoadTransferMethod::NEWTON;
+  } else if (load_transfer_method_str == "fixed_point") {
+    load_transfer_method = LoadTransferMethod::FIXED_POINT;
+  } else {
+    throw std::invalid_argument("Invalid load transfer method: " + load_transfer_method_str);
+  }
 
   return std::make_shared<DoubleTrackPlanarModelConfig>(
     DoubleTrackPlanarModelConfig{
@@ -42,7 +60,9 @@ DoubleTrackPlanarModelConfig::SharedPtr load_parameters(rclcpp::Node * node)
           declare_double("double_track_planar.v_max"),
           declare_double("double_track_planar.p_max"),
           declare_double("double_track_planar.kroll_f"),
-          declare_double("double_track_planar.mu")
+          declare_double("double_track_planar.mu"),
+          load_transfer_method,
+          declare_int("double_track_planar.load_transfer_iterations")
         }
   );
 }
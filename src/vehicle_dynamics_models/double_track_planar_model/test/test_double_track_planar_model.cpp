@@ -15,6 +15,7 @@
 
 #include <gtest/gtest.h>
 
+#include <cmath>
 #include <iostream>
 #include <rclcpp/rclcpp.hpp>
 #include <ament_index_cpp/get_package_share_directory.hpp>
@@ -79,3 +80,56 @@ TEST(DoubleTrackPlanarModelTest, TestDoubleTrackDynamics) {
   rclcpp::shutdown();
   SUCCEED();
 }
+
+TEST(DoubleTrackPlanarModelTest, TestLoadTransferResolution) {
+  using lmpc::vehicle_model::double_track_planar_model::DoubleTrackPlanarModel;
+  using lmpc::vehicle_model::double_track_planar_model::LoadTransferMethod;
+  rclcpp::init(0, nullptr);
+  const auto base_share_dir = ament_index_cpp::get_package_share_directory("base_vehicle_model");
+  const auto share_dir = ament_index_cpp::get_package_share_directory("double_track_planar_model");
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle.param.yaml",
+    "--params-file", share_dir + "/param/sample_vehicle.param.yaml",
+  });
+  auto test_node = rclcpp::Node("test_double_track_planar_model_node", options);
+
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(&test_node);
+  auto config = lmpc::vehicle_model::double_track_planar_model::load_parameters(&test_node);
+  const auto & chassis = *base_config->chassis_config;
+
+  // a cornering state, where the load transfer is significant
+  const auto x = casadi::DM{0.0, 0.0, 0.0, 0.5, 0.02, 40.0};
+  const auto u = casadi::DM{500.0, 0.0, 0.05};
+  const auto delta = static_cast<double>(u(2));
+  const auto residual = [&](const casadi::DMDict & out) {
+      const auto Fx = out.at("Fx_ij").get_elements();
+      const auto Fy = out.at("Fy_ij").get_elements();
+      return static_cast<double>(out.at("gamma_y")) - chassis.cg_height /
+             (0.5 * (chassis.tw_f + chassis.tw_r)) *
+             (Fy[2] + Fy[3] + (Fx[0] + Fx[1]) * sin(delta) + (Fy[0] + Fy[1]) * cos(delta));
+    };
+
+  for (const auto method : {LoadTransferMethod::NEWTON, LoadTransferMethod::FIXED_POINT}) {
+    config->load_transfer_method = method;
+    config->load_transfer_iterations = 6;
+    auto model = DoubleTrackPlanarModel(base_config, config);
+    const auto out = model.dynamics()(casadi::DMDict{{"x", x}, {"u", u}, {"k", 0.0}});
+    const auto gamma_y = static_cast<double>(out.at("gamma_y"));
+    EXPECT_GT(std::abs(gamma_y), 0.0);
+    EXPECT_LT(std::abs(residual(out)), 1e-3 * std::abs(gamma_y));
+    std::cout << "Load Transfer (" << (method == LoadTransferMethod::NEWTON ? "newton" :
+      "fixed point") << "): " << gamma_y << "N, residual " << residual(out) << "N" << std::endl;
+
+    // the discrete dynamics need no load transfer input
+    const auto xip1 = model.discrete_dynamics()(
+      casadi::DMDict{{"x", x}, {"u", u}, {"k", 0.0}, {"dt", 0.05}}).at("xip1");
+    for (const auto & xi : xip1.get_elements()) {
+      EXPECT_TRUE(std::isfinite(xi));
+    }
+  }
+
+  rclcpp::shutdown();
+}
@@ -0,0 +1,35 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef KINEMATIC_BICYCLE_MODEL__KINEMATIC_BICYCLE_MODEL_TYPES_HPP_
+#define KINEMATIC_BICYCLE_MODEL__KINEMATIC_BICYCLE_MODEL_TYPES_HPP_
+
+#include <base_vehicle_model/model_types.hpp>
+
+namespace lmpc
+{
+namespace vehicle_model
+{
+namespace kinematic_bicycle_model
+{
+// states are indexed by XIndex, controls by UIndex
+typedef base_vehicle_model::ModelTypes<4, 3> KinematicBicycleTypes;
+typedef KinematicBicycleTypes::State KinematicBicycleState;
+typedef KinematicBicycleTypes::Control KinematicBicycleControl;
+}  // namespace kinematic_bicycle_model
+}  // namespace vehicle_model
+}  // namespace lmpc
+#endif  // KINEMATIC_BICYCLE_MODEL__KINEMATIC_BICYCLE_MODEL_TYPES_HPP_
@@ -13,6 +13,8 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <vector>
+
 #include "kinematic_bicycle_model/kinematic_bicycle_model.hpp"
 #include "lmpc_utils/utils.hpp"
 #define GRAVITY 9.8
@@ -250,16 +252,20 @@ void KinematicBicycleModel::compile_dynamics()
   );
 
   // discretize dynamics
+  // the discrete jacobians are propagated through the integrator stages
   SX xip1;
+  casadi::Function discrete_jacobian;
   const auto & integrator_type = get_base_config().modeling_config->integrator_type;
   if (integrator_type == base_vehicle_model::IntegratorType::RK4) {
     xip1 = utils::rk4_function(nx(), nu(), dynamics_)(
       casadi::SXDict{{"x", x}, {"u", u}, {"k", k}, {"dt", dt}}
     ).at("xip1");
+    discrete_jacobian = utils::rk4_jacobian_function(nx(), nu(), dynamics_, dynamics_jacobian_);
   } else if (integrator_type == base_vehicle_model::IntegratorType::EULER) {
     xip1 = utils::euler_function(nx(), nu(), dynamics_)(
       casadi::SXDict{{"x", x}, {"u", u}, {"k", k}, {"dt", dt}}
     ).at("xip1");
+    discrete_jacobian = utils::euler_jacobian_function(nx(), nu(), dynamics_, dynamics_jacobian_);
   } else {
     throw std::runtime_error("unsupported integrator type");
   }
@@ -271,15 +277,12 @@ void KinematicBicycleModel::compile_dynamics()
     {"x", "u", "k", "dt"},
     {"xip1", "Fx_ij", "Fz_ij"});
 
-  const auto Ad = SX::jacobian(xip1, x);
-  const auto Bd = SX::jacobian(xip1, u);
-
   discrete_dynamics_jacobian_ = casadi::Function(
     "single_track_planar_model_discrete_dynamics_jacobian",
     {x, u, k, dt},
-    {Ad, Bd},
+    discrete_jacobian(std::vector<SX>{x, u, k, dt}),
     {"x", "u", "k", "dt"},
-    {"A", "B"}
+    {"A", "B", "g"}
   );
 
   // state conversions
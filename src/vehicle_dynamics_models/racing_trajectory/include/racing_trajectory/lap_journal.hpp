@@ -0,0 +1,194 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RACING_TRAJECTORY__LAP_JOURNAL_HPP_
+#define RACING_TRAJECTORY__LAP_JOURNAL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <casadi/casadi.hpp>
+
+namespace lmpc
+{
+namespace vehicle_model
+{
+namespace racing_trajectory
+{
+enum class JournalRecordType : uint32_t
+{
+  STEP = 1,  // one recorded step of a lap
+  LAP_START = 2,  // the lap begins at the start/finish line
+  LAP_END = 3,  // the lap is complete
+  DISCARD = 4  // the steps of the lap so far are discarded
+};
+
+// a lap read back from a journal
+struct JournalLap
+{
+  uint32_t lap = 0;
+  int32_t partition = 0;  // safe set partition the lap was recorded in
+  bool started = false;  // began at the start/finish line
+  bool completed = false;
+  casadi::DM x;  // nx x steps
+  casadi::DM u;  // nu x steps
+  casadi::DM k;  // 1 x steps
+  casadi::DM t;  // 1 x steps
+};
+
+/**
+ * @brief Sync a written file, move it over another and sync their directory, so that after a
+ * crash the target is either the old or the whole new file.
+ *
+ * @param from written file, removed on failure
+ * @param to target file
+ * @throws std::runtime_error if a step fails.
+ */
+void durable_rename(const std::string & from, const std::string & to);
+
+/**
+ * @brief Append-only journal of the recorded laps, so that a crash loses no more than the last
+ * commit period.
+ *
+ * The records have a fixed size and are copied into a preallocated ring buffer by the
+ * recording thread, which never waits. A background writer appends all buffered records at
+ * once and syncs them to disk with a single fsync every commit period (group commit). A record
+ * is dropped if the buffer is full.
+ *
+ * Each record has a checksum, so that the records torn by a crash are recognized and ignored
+ * when the journal is recovered.
+ */
+class LapJournal
+{
+public:
+  typedef std::shared_ptr<LapJournal> SharedPtr;
+  typedef std::unique_ptr<LapJournal> UniquePtr;
+
+  /**
+   * @brief Open a journal for appending, creating it if needed.
+   *
+   * @param path journal file
+   * @param nx state dimension
+   * @param nu control dimension
+   * @param capacity number of records of the ring buffer
+   * @param commit_period max time between two commits (s)
+   * @throws std::runtime_error if the file cannot be opened or has other dimensions.
+   */
+  LapJournal(
+    const std::string & path, const size_t & nx, const size_t & nu,
+    const size_t & capacity = 4096, const double & commit_period = 0.1);
+  ~LapJournal();
+  LapJournal(const LapJournal &) = delete;
+  LapJournal & operator=(const LapJournal &) = delete;
+
+  /**
+   * @brief Buffer a step of a lap. Never blocks.
+   *
+   * @param x state, nx doubles
+   * @param u control, nu doubles
+   * @return false if the buffer is full and the step is dropped.
+   */
+  bool append_step(
+    const uint32_t & lap, const int32_t & partition, const double * x, const double * u,
+    const double & k, const double & t);
+
+  // buffer a LAP_START, LAP_END or DISCARD record. never blocks
+  bool append_marker(
+    const JournalRecordType & type, const uint32_t & lap, const int32_t & partition);
+
+  // wait until all buffered records are on disk
+  void flush();
+
+  size_t nx() const;
+  size_t nu() const;
+  uint64_t num_committed() const;
+  uint64_t num_dropped() const;
+
+  /**
+   * @brief Read the laps of a journal, in the order they were started. The records after the
+   * first torn one are ignored.
+   *
+   * @param path journal file
+   * @return std::vector<JournalLap> the completed laps and the lap in progress, if any.
+   * Empty if the journal does not exist.
+   * @throws std::runtime_error if the file is not a journal.
+   */
+  static std::vector<JournalLap> recover(const std::string & path);
+
+  /**
+   * @brief Atomically replace a journal by one that holds only the given laps.
+   *
+   * @throws std::runtime_error if the journal cannot be written.
+   */
+  static void compact(
+    const std::string & path, const size_t & nx, const size_t & nu,
+    const std::vector<JournalLap> & laps);
+
+protected:
+  struct RecordHeader
+  {
+    uint32_t type;
+    uint32_t lap;
+    int32_t partition;
+    uint32_t reserved;
+    uint64_t checksum;  // of the record after this field
+  };
+
+  struct FileHeader
+  {
+    uint64_t magic;
+    uint32_t nx;
+    uint32_t nu;
+  };
+
+  std::string path_;
+  size_t nx_;
+  size_t nu_;
+  size_t record_size_;
+  size_t capacity_;
+  double commit_period_;
+  int fd_ = -1;
+  uint64_t file_size_ = 0;  // of the committed records
+
+  // single producer, single consumer ring of records
+  std::vector<char> buffer_;
+  std::atomic<uint64_t> head_ {0};  // records buffered
+  std::atomic<uint64_t> tail_ {0};  // records committed
+  std::atomic<uint64_t> num_dropped_ {0};
+
+  std::mutex mutex_;
+  std::condition_variable writer_cv_;
+  std::condition_variable flush_cv_;
+  uint64_t flush_target_ = 0;
+  bool stop_ = false;
+  std::thread writer_;
+
+  // claim the next slot, nullptr if the buffer is full
+  char * claim(
+    const JournalRecordType & type, const uint32_t & lap, const int32_t & partition);
+  // write and sync the buffered records
+  void commit();
+  void write_records();
+};
+}  // namespace racing_trajectory
+}  // namespace vehicle_model
+}  // namespace lmpc
+#endif  // RACING_TRAJECTORY__LAP_JOURNAL_HPP_
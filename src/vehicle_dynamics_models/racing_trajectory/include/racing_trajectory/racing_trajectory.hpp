@@ -16,7 +16,9 @@
 #ifndef RACING_TRAJECTORY__RACING_TRAJECTORY_HPP_
 #define RACING_TRAJECTORY__RACING_TRAJECTORY_HPP_
 
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include <casadi/casadi.hpp>
@@ -90,6 +92,33 @@ public:
     const bool & initialize_with_previous = false
   );
 
+  /**
+   * @brief Convert a batch of global poses to frenet poses in mapped evaluations.
+   * Each pose is initialized with the closest point on the trajectory.
+   *
+   * @param global_poses input global poses {x, y, theta} (3 x n).
+   * @param num_threads number of threads of the mapped conversion.
+   * @return casadi::DM the frenet poses {s, t, xi} (3 x n).
+   */
+  casadi::DM global_to_frenet(const casadi::DM & global_poses, const casadi_int & num_threads);
+
+  /**
+   * @brief Convert a batch of frenet poses to global poses in mapped evaluations.
+   *
+   * @param frenet_poses input frenet poses {s, t, xi} (3 x n).
+   * @return casadi::DM the global poses {x, y, theta} (3 x n).
+   */
+  casadi::DM frenet_to_global(const casadi::DM & frenet_poses);
+
+  /**
+   * @brief Build the mapped functions of the batch conversions, which are cached.
+   * CasADi functions must not be built concurrently, so call it on the thread that builds
+   * them before converting batches on another thread.
+   *
+   * @param num_threads number of threads of the batch global to frenet conversion.
+   */
+  void build_batch_conversions(const casadi_int & num_threads);
+
   /**
    * @brief Exposes the frenet-global conversion function.
    * Could be used for efficient evaluation and possible gradient evaluation.
@@ -167,7 +196,27 @@ public:
 
   const double & total_length() const;
 
+  // highest speed of the velocity profile
+  double max_speed() const;
+
+  /**
+   * @brief Look up the region of the waypoint at or before an abscissa.
+   * The abscissa is wrapped around the track.
+   *
+   * @param abscissa abscissa of the query.
+   * @return int the region index from the trajectory table.
+   */
+  int region(const double & abscissa) const;
+
+  /**
+   * @brief Number of regions, i.e. the largest region index plus one.
+   */
+  int num_regions() const;
+
 protected:
+  // initial guess of the global to frenet conversion from the closest waypoint
+  FrenetPose2D initial_frenet_guess(const Pose2D & global_pose) const;
+
   casadi::DM traj_;  // stores the trajectory table
   casadi::DM abscissa_;  // stores the abscissa copied from the trajectory table
   casadi::Function norm_2_;  // helper function to compute the norm of all waypoints
@@ -181,6 +230,10 @@ protected:
   casadi::Function frenet_to_global_;  // frenet to global conversion function
   casadi::Function global_to_frenet_;  // global to frenet conversion function
   casadi::Function global_to_frenet_sol_;  // g_to_f qp solver
+  // batch conversions, mapped over a fixed number of poses
+  casadi::Function frenet_to_global_batch_;
+  std::map<casadi_int, casadi::Function> global_to_frenet_batches_;  // by number of threads
+  std::mutex batch_mutex_;
 
   double total_length_;  // total length of the trajectory
 
@@ -16,9 +16,16 @@
 #ifndef RACING_TRAJECTORY__RACING_TRAJECTORY_MAP_HPP_
 #define RACING_TRAJECTORY__RACING_TRAJECTORY_MAP_HPP_
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <map>
+#include <thread>
+#include <vector>
 
 #include <casadi/casadi.hpp>
 
@@ -31,21 +38,70 @@ namespace vehicle_model
 namespace racing_trajectory
 {
 /**
- * @brief A set of racing trajectories.
+ * @brief A set of racing trajectories, loaded from the files [number_name.txt] of a folder.
  *
+ * When watched, the folder is followed with inotify. A file that is written or moved into the
+ * folder is built into a trajectory on a background thread, and then replaces the trajectory
+ * of its number at once. A removed file removes its trajectory. A trajectory that was handed
+ * out stays valid when it is replaced. The trajectories are built under
+ * lmpc::utils::casadi_construction_mutex().
  */
 class RacingTrajectoryMap
 {
 public:
   typedef std::shared_ptr<RacingTrajectoryMap> SharedPtr;
   typedef std::unique_ptr<RacingTrajectoryMap> UniquePtr;
+  // called on the watcher thread with the number, the previous trajectory, nullptr if new, and
+  // the new trajectory, nullptr if removed
+  typedef std::function<void(const int &, RacingTrajectory::SharedPtr,
+      RacingTrajectory::SharedPtr)> UpdateCallback;
 
-  explicit RacingTrajectoryMap(const std::string & directory_path);
+  /**
+   * @brief Load all trajectories of a folder.
+   *
+   * @param directory_path folder of the trajectory files
+   * @param watch if true, follow the changes of the folder on a background thread
+   * @throws std::runtime_error if a file is not named [number_name.txt], a number is
+   * duplicated, or the folder cannot be watched.
+   */
+  explicit RacingTrajectoryMap(const std::string & directory_path, const bool & watch = false);
+  ~RacingTrajectoryMap();
+  RacingTrajectoryMap(const RacingTrajectoryMap &) = delete;
+  RacingTrajectoryMap & operator=(const RacingTrajectoryMap &) = delete;
 
   RacingTrajectory::SharedPtr get_trajectory(const int & index);
 
-private:
+  // numbers of the loaded trajectories
+  std::vector<int> indices() const;
+
+  // number of trajectories loaded, replaced or removed by the watcher
+  uint64_t revision() const;
+
+  bool is_watching() const;
+
+  // blocks until a running callback returns, so that clearing it is safe before the owner
+  // of the callback is destroyed. Do not call from the callback.
+  void set_update_callback(const UpdateCallback & callback);
+
+protected:
+  std::string directory_path_;
+  mutable std::shared_mutex mutex_;
   std::map<int, RacingTrajectory::SharedPtr> trajectories_;
+  std::map<int, std::string> file_names_;  // file of each trajectory number
+  std::mutex callback_mutex_;  // held while the callback is replaced or running
+  UpdateCallback update_callback_ {};
+  std::atomic<uint64_t> revision_ {0};
+
+  int inotify_fd_ = -1;
+  int stop_fd_ = -1;  // wakes the watcher up to stop
+  std::thread watcher_;
+
+  // number of a file named [number_name.txt], false if it does not conform
+  static bool parse_file_name(const std::string & file_name, int & number);
+  void on_file_written(const std::string & file_name);
+  void on_file_removed(const std::string & file_name);
+  void publish(const int & number, RacingTrajectory::SharedPtr trajectory);
+  void watch_folder();
 };
 }  // namespace racing_trajectory
 }  // namespace vehicle_model
@@ -16,14 +16,22 @@
 #ifndef RACING_TRAJECTORY__SAFE_SET_HPP_
 #define RACING_TRAJECTORY__SAFE_SET_HPP_
 
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <shared_mutex>
 
 #include <boost/circular_buffer.hpp>
 #include <casadi/casadi.hpp>
+#include <lmpc_utils/perf_counters.hpp>
 
+#include "racing_trajectory/lap_journal.hpp"
+#include "racing_trajectory/racing_trajectory.hpp"
 #include "racing_trajectory/trajectory_kd_tree.hpp"
 
 namespace lmpc
@@ -52,6 +60,7 @@ struct SSTrajectoryData
   casadi::DM x;
   casadi::DM u;
   casadi::DM k;
+  casadi::DM t;
   casadi::DM dt;
 
   casadi::DM x_repeat;
@@ -100,6 +109,22 @@ public:
   SSResult query(const SSQuery & query) const;
   std::vector<RegResult> query(const RegQuery & query) const;
 
+  const SSTrajectoryData & data() const;
+
+  /**
+   * @brief Reproject the lap into the frenet frame of another trajectory.
+   * The poses {s, t, xi} are the first three states. They are converted to global poses
+   * and projected onto the new trajectory in one mapped evaluation, then the curvatures
+   * are interpolated at the new abscissa.
+   *
+   * @param from trajectory the lap was recorded on
+   * @param to trajectory to reproject onto
+   * @param num_threads number of threads of the mapped projection
+   */
+  SSTrajectory::SharedPtr reproject(
+    RacingTrajectory & from, RacingTrajectory & to,
+    const casadi_int & num_threads) const;
+
 private:
   SSTrajectoryData lap_;
   lmpc::vehicle_model::racing_trajectory::TrajectoryKDTree tree_;
@@ -115,18 +140,112 @@ class SafeSetManager
 public:
   typedef std::shared_ptr<SafeSetManager> SharedPtr;
   typedef std::unique_ptr<SafeSetManager> UniquePtr;
+  // source partition, target partition and error of a lap that failed to reproject
+  typedef std::function<void (const int &, const int &, const std::string &)> ErrorCallback;
 
   explicit SafeSetManager(const size_t & max_lap_stored);
+  ~SafeSetManager();
+  SafeSetManager(const SafeSetManager &) = delete;
+  SafeSetManager & operator=(const SafeSetManager &) = delete;
 
+  // laps are added to and queried from the active partition
   void add_lap(
     const casadi::DM & x, const casadi::DM & u, const casadi::DM & k,
     const casadi::DM & t, const double & total_length);
   SSResult query(const SSQuery & query);
   RegResult query(const RegQuery & query);
 
+  /**
+   * @brief Select the partition, i.e. the trajectory index whose frenet frame is in use.
+   * Unknown partitions start empty.
+   */
+  void set_active_partition(const int & partition);
+  int active_partition();
+
+  // number of laps of a partition, including the reprojected laps
+  size_t num_laps(const int & partition);
+
+  /**
+   * @brief Laps recorded in each partition, oldest first, without the reprojected laps.
+   * The laps are shared, so they stay valid while new laps are recorded.
+   */
+  std::map<int, std::vector<SSTrajectory::SharedPtr>> recorded_laps();
+
+  /**
+   * @brief Replace the laps recorded in a partition, e.g. by those of another process.
+   * Only the last max_lap_stored laps are kept.
+   */
+  void set_recorded_laps(const int & partition, const std::vector<SSTrajectory::SharedPtr> & laps);
+
+  // incremented whenever the recorded laps change
+  uint64_t revision();
+
+  /**
+   * @brief Reproject the laps recorded in one partition into the frame of another in a
+   * background thread. Once done, they replace the earlier reprojections between the two
+   * partitions. Only recorded laps are reprojected, so errors do not compound.
+   * The mapped conversions are built on the calling thread, and only evaluated in the
+   * background.
+   *
+   * If both partitions are the same, its trajectory is replaced, e.g. by a new file. The laps
+   * recorded in it are then reprojected into the new frame, and the laps reprojected into its
+   * old frame are dropped, as are the reprojections into it still running.
+   *
+   * @param from_partition source partition
+   * @param from trajectory of the source partition
+   * @param to_partition target partition
+   * @param to trajectory of the target partition
+   * @return std::shared_future<void> ready when the reprojected laps are in use
+   */
+  std::shared_future<void> reproject(
+    const int & from_partition, RacingTrajectory::SharedPtr from,
+    const int & to_partition, RacingTrajectory::SharedPtr to);
+
+  /**
+   * @brief Drop the laps of a partition whose trajectory is gone, both recorded in it and
+   * reprojected into it. The reprojections into it still running are dropped too.
+   */
+  void clear_partition(const int & partition);
+
+  /**
+   * @brief Report the laps that fail to reproject. Called from the background thread.
+   *
+   * @param callback nullptr to ignore the failures.
+   */
+  void set_error_callback(ErrorCallback callback);
+
+  /**
+   * @brief Sample the performance counters of the calling thread around each query.
+   *
+   * @param profiler profiler to add the samples to. nullptr to disable.
+   */
+  void set_perf_profiler(lmpc::utils::PerfProfiler::SharedPtr profiler);
+
 private:
-  boost::circular_buffer<SSTrajectory::UniquePtr> laps_;
+  struct Partition
+  {
+    boost::circular_buffer<SSTrajectory::SharedPtr> laps;  // recorded in this frame
+    std::map<int, std::vector<SSTrajectory::SharedPtr>> reprojected_laps;  // by source
+    uint64_t frame = 0;  // incremented when the trajectory of the partition is replaced
+  };
+
+  size_t max_lap_stored_;
+  std::map<int, Partition> partitions_;
+  int active_partition_ = 0;
+  uint64_t revision_ = 0;
+  // laps of the active partition, reprojected laps first, so the recorded laps are queried first
+  std::vector<SSTrajectory::SharedPtr> laps_;
   std::shared_mutex mutex_;
+  ErrorCallback error_callback_ {};
+  std::vector<std::shared_future<void>> reprojections_;
+  std::mutex reprojections_mutex_;
+
+  // all are called with the unique lock held
+  Partition & get_partition(const int & partition);
+  void update_active_laps();
+  // drop the laps in the frame of a partition, and return its recorded laps
+  std::vector<SSTrajectory::SharedPtr> replace_frame(const int & partition);
+  lmpc::utils::PerfProfiler::SharedPtr perf_profiler_ {};
 };
 
 class SafeSetRecorder
@@ -145,6 +264,29 @@ public:
 
   void load(const std::vector<std::string> & from_files, const double & total_length);
 
+  // discard the lap in progress, e.g. when its frenet frame changes
+  void discard_lap();
+
+  /**
+   * @brief Journal the laps as they are recorded, so that they survive a crash.
+   * The laps of an existing journal are recovered first. The completed laps are saved to files
+   * if recording to files, and added to the safe set at the first step. The lap in progress
+   * resumes if the first step continues it, and the journal is compacted to that lap.
+   *
+   * @param path journal file
+   * @param nx state dimension
+   * @param nu control dimension
+   * @param commit_period max time between two commits of the journal (s)
+   * @param resume_timeout max time from the last journaled step to the first step for the lap in
+   * progress to resume (s)
+   */
+  void open_journal(
+    const std::string & path, const size_t & nx, const size_t & nu,
+    const double & commit_period, const double & resume_timeout);
+
+  // the journal, nullptr if not journaling
+  const LapJournal * journal() const;
+
 private:
   SafeSetManager & manager_;
   casadi::DM last_x_;
@@ -156,6 +298,20 @@ private:
   bool to_file_;
   std::string file_prefix_;
   size_t lap_count_;
+
+  LapJournal::UniquePtr journal_ {};
+  std::vector<JournalLap> recovered_laps_;  // added at the first step
+  double resume_timeout_ = 0.0;
+  // the lap files are written in the background
+  std::vector<std::future<void>> lap_writes_;
+
+  // add the recovered laps and resume the lap in progress
+  void restore_journal(const casadi::DM & x, const casadi::DM & t, const double & total_length);
+  static void save_lap(
+    const std::string & filename, const casadi::DM & x, const casadi::DM & u,
+    const casadi::DM & k, const casadi::DM & t);
+  // whether all files of a lap are saved
+  static bool lap_saved(const std::string & filename);
 };
 
 }  // namespace racing_trajectory
@@ -0,0 +1,89 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#ifndef RACING_TRAJECTORY__SYNTHETIC_TRACK_HPP_
+#define RACING_TRAJECTORY__SYNTHETIC_TRACK_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <casadi/casadi.hpp>
+
+namespace lmpc
+{
+namespace vehicle_model
+{
+namespace racing_trajectory
+{
+struct SyntheticTrackConfig
+{
+  double length = 1000.0;  // approximate track length (m)
+  size_t num_points = 1000;  // number of waypoints
+  size_t num_harmonics = 6;  // number of shape harmonics, more gives more corners
+  double shape_amplitude = 0.3;  // sum of the harmonic amplitudes relative to the radius, < 1
+  double track_width = 10.0;  // m
+  double max_speed = 50.0;  // m/s
+  double max_lat_acc = 15.0;  // m/s^2
+  double max_lon_acc = 8.0;  // m/s^2
+  int num_regions = 1;  // the track is split into regions of equal length
+  uint32_t seed = 0;
+};
+
+/**
+ * @brief Generate a closed counter-clockwise track in the TrajectoryIndex format (17 x n).
+ * The center line is a star-shaped curve r(theta) = r0 (1 + sum a_i cos(i theta + phi_i)) with
+ * random amplitudes and phases, resampled at equal arc length. Curvature and yaw are exact,
+ * and the speed profile respects the lateral and longitudinal acceleration limits around the
+ * loop. Save it with traj.T().to_file(file, "txt") to load it as a RacingTrajectory file.
+ *
+ * @throws std::invalid_argument if the config is invalid, or the inner boundary folds over
+ * because a corner is tighter than half the track width.
+ */
+casadi::DM generate_synthetic_track(const SyntheticTrackConfig & config);
+
+struct SyntheticLapConfig
+{
+  size_t num_points = 500;  // number of states in the lap
+  double lateral_amplitude = 1.0;  // max lateral offset from the center line (m)
+  double speed_scale = 0.9;  // speed relative to the speed profile of the track
+  double speed_noise = 0.05;  // uniform speed noise relative to the speed
+  size_t nu = 2;  // number of controls, the first is the longitudinal acceleration
+  uint32_t seed = 0;
+};
+
+// a lap in the format of SafeSetManager::add_lap()
+struct SyntheticLap
+{
+  casadi::DM x;  // {s, t, xi, vx, vy, omega} (6 x n)
+  casadi::DM u;  // nu x n
+  casadi::DM k;  // curvature (1 x n)
+  casadi::DM t;  // time (1 x n)
+  double total_length;
+};
+
+/**
+ * @brief Generate a lap weaving around the center line of a track, e.g. from
+ * generate_synthetic_track(). The lateral offset is a random sinusoid kept within 80% of the
+ * boundaries.
+ *
+ * @param traj track in the TrajectoryIndex format (17 x n).
+ * @param config lap config.
+ */
+SyntheticLap generate_synthetic_lap(const casadi::DM & traj, const SyntheticLapConfig & config);
+}  // namespace racing_trajectory
+}  // namespace vehicle_model
+}  // namespace lmpc
+#endif  // RACING_TRAJECTORY__SYNTHETIC_TRACK_HPP_
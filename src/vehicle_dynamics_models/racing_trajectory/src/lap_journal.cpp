@@ -0,0 +1,461 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "racing_trajectory/lap_journal.hpp"
+
+namespace lmpc
+{
+namespace vehicle_model
+{
+namespace racing_trajectory
+{
+namespace
+{
+constexpr uint64_t kMagic = 0x4c4d50434a524e4c;  // "LMPCJRNL"
+// the checksum skips the type, lap, partition and reserved fields before it
+constexpr size_t kChecksumOffset = 16;
+constexpr size_t kPayloadOffset = 24;
+
+size_t record_size(const size_t & nx, const size_t & nu)
+{
+  // t, k, x and u follow the record header
+  return kPayloadOffset + (2 + nx + nu) * sizeof(double);
+}
+
+// FNV-1a of the record, without the checksum itself
+uint64_t checksum(const char * record, const size_t & size)
+{
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < size; i++) {
+    if (i == kChecksumOffset) {
+      i = kPayloadOffset - 1;
+      continue;
+    }
+    hash ^= static_cast<uint8_t>(record[i]);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+void seal(char * record, const size_t & size)
+{
+  const auto hash = checksum(record, size);
+  std::memcpy(record + kChecksumOffset, &hash, sizeof(hash));
+}
+
+bool write_all(const int & fd, const char * data, size_t size)
+{
+  while (size > 0) {
+    const auto written = ::write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+  return true;
+}
+}  // namespace
+
+LapJournal::LapJournal(
+  const std::string & path, const size_t & nx, const size_t & nu,
+  const size_t & capacity, const double & commit_period)
+: path_(path),
+  nx_(nx),
+  nu_(nu),
+  record_size_(record_size(nx, nu)),
+  capacity_(capacity),
+  commit_period_(commit_period),
+  buffer_(capacity * record_size_)
+{
+  if (capacity_ == 0 || commit_period_ <= 0.0) {
+    throw std::invalid_argument("LapJournal: capacity and commit period must be positive.");
+  }
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    throw std::runtime_error(
+            "LapJournal: failed to open " + path_ + ": " + std::strerror(errno));
+  }
+  struct stat journal_stat;
+  if (fstat(fd_, &journal_stat) != 0) {
+    close(fd_);
+    throw std::runtime_error(
+            "LapJournal: failed to open " + path_ + ": " + std::strerror(errno));
+  }
+  const auto size = static_cast<uint64_t>(journal_stat.st_size);
+  FileHeader header {kMagic, static_cast<uint32_t>(nx_), static_cast<uint32_t>(nu_)};
+  if (size == 0) {
+    if (!write_all(fd_, reinterpret_cast<const char *>(&header), sizeof(header)) ||
+      fdatasync(fd_) != 0)
+    {
+      close(fd_);
+      throw std::runtime_error(
+              "LapJournal: failed to write " + path_ + ": " + std::strerror(errno));
+    }
+    file_size_ = sizeof(header);
+  } else {
+    FileHeader existing {};
+    if (pread(fd_, &existing, sizeof(existing), 0) != sizeof(existing) ||
+      existing.magic != kMagic || existing.nx != header.nx || existing.nu != header.nu)
+    {
+      close(fd_);
+      throw std::runtime_error(
+              "LapJournal: " + path_ + " is not a journal of " + std::to_string(nx_) +
+              " states and " + std::to_string(nu_) + " controls.");
+    }
+    // a record torn by a crash would misalign the records appended after it
+    file_size_ = sizeof(header) + (size - sizeof(header)) / record_size_ * record_size_;
+    if (file_size_ != size && ftruncate(fd_, static_cast<off_t>(file_size_)) != 0) {
+      close(fd_);
+      throw std::runtime_error(
+              "LapJournal: failed to truncate " + path_ + ": " + std::strerror(errno));
+    }
+  }
+  writer_ = std::thread(&LapJournal::write_records, this);
+}
+
+LapJournal::~LapJournal()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  writer_cv_.notify_one();
+  writer_.join();
+  close(fd_);
+}
+
+bool LapJournal::append_step(
+  const uint32_t & lap, const int32_t & partition, const double * x, const double * u,
+  const double & k, const double & t)
+{
+  auto record = claim(JournalRecordType::STEP, lap, partition);
+  if (!record) {
+    return false;
+  }
+  auto payload = record + kPayloadOffset;
+  std::memcpy(payload, &t, sizeof(double));
+  std::memcpy(payload + sizeof(double), &k, sizeof(double));
+  std::memcpy(payload + 2 * sizeof(double), x, nx_ * sizeof(double));
+  std::memcpy(payload + (2 + nx_) * sizeof(double), u, nu_ * sizeof(double));
+  head_.fetch_add(1, std::memory_order_release);
+  return true;
+}
+
+bool LapJournal::append_marker(
+  const JournalRecordType & type, const uint32_t & lap, const int32_t & partition)
+{
+  auto record = claim(type, lap, partition);
+  if (!record) {
+    return false;
+  }
+  std::memset(record + kPayloadOffset, 0, record_size_ - kPayloadOffset);
+  head_.fetch_add(1, std::memory_order_release);
+  return true;
+}
+
+void LapJournal::flush()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  const auto target = head_.load(std::memory_order_acquire);
+  flush_target_ = std::max(flush_target_, target);
+  writer_cv_.notify_one();
+  flush_cv_.wait(
+    lock, [this, target]() {
+      return tail_.load(std::memory_order_acquire) >= target;
+    });
+}
+
+size_t LapJournal::nx() const
+{
+  return nx_;
+}
+
+size_t LapJournal::nu() const
+{
+  return nu_;
+}
+
+uint64_t LapJournal::num_committed() const
+{
+  return tail_.load(std::memory_order_acquire);
+}
+
+uint64_t LapJournal::num_dropped() const
+{
+  return num_dropped_.load(std::memory_order_relaxed);
+}
+
+std::vector<JournalLap> LapJournal::recover(const std::string & path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file || file.peek() == std::ifstream::traits_type::eof()) {
+    return {};
+  }
+  FileHeader header {};
+  if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != kMagic) {
+    throw std::runtime_error("LapJournal: " + path + " is not a journal.");
+  }
+
+  struct Steps
+  {
+    JournalLap lap;
+    std::vector<double> x, u, k, t;
+  };
+  std::map<uint32_t, Steps> laps;
+  const auto size = record_size(header.nx, header.nu);
+  std::vector<char> record(size);
+  while (file.read(record.data(), static_cast<std::streamsize>(size))) {
+    RecordHeader record_header;
+    std::memcpy(&record_header, record.data(), sizeof(record_header));
+    if (record_header.checksum != checksum(record.data(), size) ||
+      record_header.type < static_cast<uint32_t>(JournalRecordType::STEP) ||
+      record_header.type > static_cast<uint32_t>(JournalRecordType::DISCARD))
+    {
+      std::cerr << "LapJournal: ignored the torn records at the end of " << path << "." <<
+        std::endl;
+      break;
+    }
+    auto & steps = laps[record_header.lap];
+    steps.lap.lap = record_header.lap;
+    steps.lap.partition = record_header.partition;
+    switch (static_cast<JournalRecordType>(record_header.type)) {
+      case JournalRecordType::STEP:
+        {
+          const auto payload = reinterpret_cast<const double *>(record.data() + kPayloadOffset);
+          steps.t.push_back(payload[0]);
+          steps.k.push_back(payload[1]);
+          steps.x.insert(steps.x.end(), payload + 2, payload + 2 + header.nx);
+          const auto u = payload + 2 + header.nx;
+          steps.u.insert(steps.u.end(), u, u + header.nu);
+          break;
+        }
+      case JournalRecordType::LAP_START:
+        steps.lap.started = true;
+        break;
+      case JournalRecordType::LAP_END:
+        steps.lap.completed = true;
+        break;
+      case JournalRecordType::DISCARD:
+        laps.erase(record_header.lap);
+        break;
+    }
+  }
+
+  // the completed laps, and the last lap if it is in progress
+  std::vector<JournalLap> recovered;
+  for (auto it = laps.begin(); it != laps.end(); it++) {
+    auto & steps = it->second;
+    if (steps.t.empty() || (!steps.lap.completed && std::next(it) != laps.end())) {
+      continue;
+    }
+    const auto n = static_cast<casadi_int>(steps.t.size());
+    auto & lap = recovered.emplace_back(steps.lap);
+    lap.x = casadi::DM::reshape(casadi::DM(steps.x), header.nx, n);
+    lap.u = casadi::DM::reshape(casadi::DM(steps.u), header.nu, n);
+    lap.k = casadi::DM(steps.k).T();
+    lap.t = casadi::DM(steps.t).T();
+  }
+  return recovered;
+}
+
+void LapJournal::compact(
+  const std::string & path, const size_t & nx, const size_t & nu,
+  const std::vector<JournalLap> & laps)
+{
+  const auto size = record_size(nx, nu);
+  std::vector<char> data(sizeof(FileHeader));
+  const FileHeader header {kMagic, static_cast<uint32_t>(nx), static_cast<uint32_t>(nu)};
+  std::memcpy(data.data(), &header, sizeof(header));
+  auto add_record = [&](
+    const JournalRecordType & type, const JournalLap & lap, const casadi_int & i) {
+      auto record = data.insert(data.end(), size, 0);
+      const RecordHeader record_header {
+        static_cast<uint32_t>(type), lap.lap, lap.partition, 0, 0};
+      std::memcpy(&*record, &record_header, sizeof(record_header));
+      if (type == JournalRecordType::STEP) {
+        auto payload = reinterpret_cast<double *>(&*record + kPayloadOffset);
+        payload[0] = lap.t.nonzeros().at(i);
+        payload[1] = lap.k.nonzeros().at(i);
+        std::copy_n(lap.x.nonzeros().begin() + i * nx, nx, payload + 2);
+        std::copy_n(lap.u.nonzeros().begin() + i * nu, nu, payload + 2 + nx);
+      }
+      seal(&*record, size);
+    };
+  for (const auto & lap : laps) {
+    if (lap.x.size1() != static_cast<casadi_int>(nx) ||
+      lap.u.size1() != static_cast<casadi_int>(nu))
+    {
+      throw std::invalid_argument("LapJournal: the laps must have nx states and nu controls.");
+    }
+    if (lap.started) {
+      add_record(JournalRecordType::LAP_START, lap, 0);
+    }
+    for (casadi_int i = 0; i < lap.t.numel(); i++) {
+      add_record(JournalRecordType::STEP, lap, i);
+    }
+    if (lap.completed) {
+      add_record(JournalRecordType::LAP_END, lap, 0);
+    }
+  }
+
+  // the journal is replaced only once the compacted one is on disk
+  const auto tmp_path = path + ".tmp";
+  const auto fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error(
+            "LapJournal: failed to open " + tmp_path + ": " + std::strerror(errno));
+  }
+  const auto written = write_all(fd, data.data(), data.size());
+  const auto error = errno;
+  close(fd);
+  if (!written) {
+    std::remove(tmp_path.c_str());
+    throw std::runtime_error(
+            "LapJournal: failed to compact " + path + ": " + std::strerror(error));
+  }
+  durable_rename(tmp_path, path);
+}
+
+char * LapJournal::claim(
+  const JournalRecordType & type, const uint32_t & lap, const int32_t & partition)
+{
+  const auto head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) >= capacity_) {
+    num_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  auto record = buffer_.data() + (head % capacity_) * record_size_;
+  const RecordHeader record_header {static_cast<uint32_t>(type), lap, partition, 0, 0};
+  std::memcpy(record, &record_header, sizeof(record_header));
+  return record;
+}
+
+void LapJournal::commit()
+{
+  const auto tail = tail_.load(std::memory_order_relaxed);
+  const auto head = head_.load(std::memory_order_acquire);
+  if (head == tail) {
+    return;
+  }
+  for (auto i = tail; i < head; i++) {
+    seal(buffer_.data() + (i % capacity_) * record_size_, record_size_);
+  }
+  // the buffered records are contiguous, except where they wrap around the ring
+  const auto begin = static_cast<size_t>(tail % capacity_);
+  const auto count = static_cast<size_t>(head - tail);
+  const auto first = std::min(count, capacity_ - begin);
+  const auto written =
+    write_all(fd_, buffer_.data() + begin * record_size_, first * record_size_) &&
+    write_all(fd_, buffer_.data(), (count - first) * record_size_) &&
+    fdatasync(fd_) == 0;
+  if (written) {
+    file_size_ += count * record_size_;
+  } else {
+    // drop the batch rather than leave a partial record in the journal
+    std::cerr << "LapJournal: failed to write " << path_ << ": " << std::strerror(errno) <<
+      std::endl;
+    num_dropped_.fetch_add(count, std::memory_order_relaxed);
+    if (ftruncate(fd_, static_cast<off_t>(file_size_)) != 0) {
+      std::cerr << "LapJournal: failed to truncate " << path_ << ": " <<
+        std::strerror(errno) << std::endl;
+    }
+  }
+  tail_.store(head, std::memory_order_release);
+}
+
+void LapJournal::write_records()
+{
+  const auto period = std::chrono::duration<double>(commit_period_);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    writer_cv_.wait_for(
+      lock, period, [this]() {
+        return stop_ || flush_target_ > tail_.load(std::memory_order_relaxed);
+      });
+    const auto stop = stop_;
+    lock.unlock();
+    commit();
+    lock.lock();
+    flush_cv_.notify_all();
+    if (stop) {
+      return;
+    }
+  }
+}
+
+void durable_rename(const std::string & from, const std::string & to)
+{
+  auto fail = [&from](const std::string & step) {
+      const auto error = errno;
+      std::remove(from.c_str());
+      throw std::runtime_error(
+              "durable_rename: failed to " + step + ": " + std::strerror(error));
+    };
+  const auto fd = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fail("open " + from);
+  }
+  const auto synced = fsync(fd) == 0;
+  const auto error = errno;
+  close(fd);
+  if (!synced) {
+    errno = error;
+    fail("sync " + from);
+  }
+  if (std::rename(from.c_str(), to.c_str()) != 0) {
+    fail("rename " + from + " to " + to);
+  }
+  // the rename is only durable once the directory entry is synced
+  auto directory = std::filesystem::path(to).parent_path();
+  if (directory.empty()) {
+    directory = ".";
+  }
+  const auto dir_fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0 || fsync(dir_fd) != 0) {
+    const auto dir_error = errno;
+    if (dir_fd >= 0) {
+      close(dir_fd);
+    }
+    throw std::runtime_error(
+            "durable_rename: failed to sync " + directory.string() + ": " +
+            std::strerror(dir_error));
+  }
+  close(dir_fd);
+}
+}  // namespace racing_trajectory
+}  // namespace vehicle_model
+}  // namespace lmpc
@@ -13,6 +13,9 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <cmath>
+
 #include "racing_trajectory/racing_trajectory.hpp"
 #include "lmpc_utils/utils.hpp"
 
@@ -22,6 +25,29 @@ namespace vehicle_model
 {
 namespace racing_trajectory
 {
+namespace
+{
+// number of poses of a mapped batch conversion, so that one function serves any number of poses
+constexpr casadi_int kBatchSize = 64;
+
+// evaluate a function mapped over kBatchSize columns. the last batch is padded with the last
+// column
+casadi::DM evaluate_batches(const casadi::Function & f, const casadi::DM & in)
+{
+  using casadi::Slice;
+  const auto n = in.size2();
+  auto out = casadi::DM::zeros(f.size1_out(0), n);
+  for (casadi_int begin = 0; begin < n; begin += kBatchSize) {
+    const auto end = std::min(begin + kBatchSize, n);
+    auto batch = casadi::DM::repmat(in(Slice(), end - 1), 1, kBatchSize);
+    batch(Slice(), Slice(0, end - begin)) = in(Slice(), Slice(begin, end));
+    const auto res = f(batch)[0];
+    out(Slice(), Slice(begin, end)) = res(Slice(), Slice(0, end - begin));
+  }
+  return out;
+}
+}  // namespace
+
 RacingTrajectory::RacingTrajectory(const casadi::DM & traj)
 : traj_(traj),
   abscissa_(traj_(TrajectoryIndex::DIST_TO_SF_BWD, casadi::Slice())),
@@ -206,24 +232,9 @@ void RacingTrajectory::global_to_frenet(
   const bool & initialize_with_previous
 )
 {
-  FrenetPose2D p0 = {0.0, 0.0, 0.0};
-  if (initialize_with_previous) {
-    p0 = frenet_pose;
-  } else {
-    // initialize with the closest point on the trajectory
-    const size_t idx = kd_tree_.find_closest_waypoint_index(
-      global_pose.position.x,
-      global_pose.position.y);
-    p0.position.s = static_cast<double>(abscissa_(idx));
-
-    Pose2D p0_g;
-    kd_tree_.get_waypoint(idx, p0_g.position.x, p0_g.position.y);
-    p0_g.yaw = static_cast<double>(yaw_intp_(casadi::DM(p0.position.s))[0]);
-    p0.position.t =
-      static_cast<double>(distance(global_pose.position, p0_g.position)) * lateral_sign(
-      global_pose.position, p0_g);
-    p0.yaw = utils::align_yaw(global_pose.yaw, p0_g.yaw);
-  }
+  // initialize with the previous pose or the closest point on the trajectory
+  const FrenetPose2D p0 = initialize_with_previous ? frenet_pose : initial_frenet_guess(
+    global_pose);
 
   const auto out = global_to_frenet_(
     casadi::DM{
@@ -235,6 +246,70 @@ void RacingTrajectory::global_to_frenet(
   frenet_pose.yaw = out[2];
 }
 
+casadi::DM RacingTrajectory::global_to_frenet(
+  const casadi::DM & global_poses, const casadi_int & num_threads)
+{
+  const auto num_poses = global_poses.size2();
+  const auto poses = casadi::DM::densify(global_poses);
+  auto in = casadi::DM::vertcat({poses, casadi::DM::zeros(2, num_poses)});
+  auto & in_nz = in.nonzeros();
+  const auto & poses_nz = poses.nonzeros();
+  for (casadi_int i = 0; i < num_poses; i++) {
+    const Pose2D global_pose{{poses_nz[3 * i], poses_nz[3 * i + 1]}, poses_nz[3 * i + 2]};
+    const auto p0 = initial_frenet_guess(global_pose);
+    in_nz[5 * i + 3] = p0.position.s;
+    in_nz[5 * i + 4] = p0.position.t;
+  }
+  build_batch_conversions(num_threads);
+  std::unique_lock<std::mutex> lock(batch_mutex_);
+  const auto g2f = global_to_frenet_batches_.at(std::max<casadi_int>(num_threads, 1));
+  lock.unlock();
+  return evaluate_batches(g2f, in);
+}
+
+casadi::DM RacingTrajectory::frenet_to_global(const casadi::DM & frenet_poses)
+{
+  build_batch_conversions(1);
+  std::unique_lock<std::mutex> lock(batch_mutex_);
+  const auto f2g = frenet_to_global_batch_;
+  lock.unlock();
+  return evaluate_batches(f2g, casadi::DM::densify(frenet_poses));
+}
+
+void RacingTrajectory::build_batch_conversions(const casadi_int & num_threads)
+{
+  std::lock_guard<std::mutex> lock(batch_mutex_);
+  const auto threads = std::max<casadi_int>(num_threads, 1);
+  if (!frenet_to_global_batch_.is_null() && global_to_frenet_batches_.count(threads)) {
+    return;
+  }
+  std::lock_guard<std::mutex> construction_lock(utils::casadi_construction_mutex());
+  if (frenet_to_global_batch_.is_null()) {
+    frenet_to_global_batch_ = frenet_to_global_.map(kBatchSize);
+  }
+  if (!global_to_frenet_batches_.count(threads)) {
+    global_to_frenet_batches_[threads] = global_to_frenet_.map(kBatchSize, "thread", threads);
+  }
+}
+
+FrenetPose2D RacingTrajectory::initial_frenet_guess(const Pose2D & global_pose) const
+{
+  FrenetPose2D p0 = {0.0, 0.0, 0.0};
+  const size_t idx = kd_tree_.find_closest_waypoint_index(
+    global_pose.position.x,
+    global_pose.position.y);
+  p0.position.s = abscissa_.nonzeros()[idx];
+
+  Pose2D p0_g;
+  kd_tree_.get_waypoint(idx, p0_g.position.x, p0_g.position.y);
+  p0_g.yaw = static_cast<double>(yaw_intp_(casadi::DM(p0.position.s))[0]);
+  p0.position.t =
+    static_cast<double>(distance(global_pose.position, p0_g.position)) * lateral_sign(
+    global_pose.position, p0_g);
+  p0.yaw = utils::align_yaw(global_pose.yaw, p0_g.yaw);
+  return p0;
+}
+
 casadi::Function & RacingTrajectory::frenet_to_global_function()
 {
   return frenet_to_global_;
@@ -284,6 +359,30 @@ const double & RacingTrajectory::total_length() const
 {
   return total_length_;
 }
+
+double RacingTrajectory::max_speed() const
+{
+  return static_cast<double>(casadi::DM::mmax(traj_(TrajectoryIndex::SPEED, casadi::Slice())));
+}
+
+int RacingTrajectory::region(const double & abscissa) const
+{
+  auto s = std::fmod(abscissa, total_length_);
+  if (s < 0.0) {
+    s += total_length_;
+  }
+  // the abscissa is sorted, so the waypoint is found by binary search
+  const auto & abscissa_elements = abscissa_.nonzeros();
+  const auto it = std::upper_bound(abscissa_elements.begin(), abscissa_elements.end(), s);
+  const auto idx = it == abscissa_elements.begin() ? 0 : it - abscissa_elements.begin() - 1;
+  return static_cast<int>(static_cast<double>(traj_(TrajectoryIndex::REGION, idx)));
+}
+
+int RacingTrajectory::num_regions() const
+{
+  const auto regions = traj_(TrajectoryIndex::REGION, casadi::Slice());
+  return static_cast<int>(static_cast<double>(casadi::DM::mmax(regions))) + 1;
+}
 }  // namespace racing_trajectory
 }  // namespace vehicle_model
 }  // namespace lmpc
@@ -13,10 +13,22 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
 #include <regex>
+#include <stdexcept>
 #include <string>
 #include <filesystem>
+#include <vector>
 
+#include <lmpc_utils/utils.hpp>
 #include <racing_trajectory/racing_trajectory_map.hpp>
 
 namespace lmpc
@@ -26,37 +38,234 @@ namespace vehicle_model
 namespace racing_trajectory
 {
 
-RacingTrajectoryMap::RacingTrajectoryMap(const std::string & directory_path)
+RacingTrajectoryMap::RacingTrajectoryMap(const std::string & directory_path, const bool & watch)
+: directory_path_(directory_path)
 {
-  std::regex pattern(R"((\d+)_.*\.txt)");
+  if (watch) {
+    // watch before the scan, so that no file written in between is missed
+    inotify_fd_ = inotify_init1(IN_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (inotify_fd_ < 0 || stop_fd_ < 0 ||
+      inotify_add_watch(
+        inotify_fd_, directory_path_.c_str(),
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM) < 0)
+    {
+      const auto message = "RacingTrajectoryMap: failed to watch " + directory_path_ + ": " +
+        std::strerror(errno);
+      close(inotify_fd_);
+      close(stop_fd_);
+      throw std::runtime_error(message);
+    }
+  }
 
   for (const auto & entry : std::filesystem::directory_iterator(directory_path)) {
-    std::smatch match;
     std::string file_name = entry.path().filename().string();
-
-    if (!std::regex_match(file_name, match, pattern)) {
+    int number = 0;
+    if (!parse_file_name(file_name, number)) {
       throw std::runtime_error(
               "File does not conform to the required format [number_name.txt]: " + file_name);
     }
 
-    int number = std::stoi(match[1]);
     if (trajectories_.find(number) != trajectories_.end()) {
       throw std::runtime_error("Duplicate trajectory number found: " + std::to_string(number));
     }
     const auto traj_path = entry.path().string();
     trajectories_[number] = std::make_shared<RacingTrajectory>(traj_path);
+    file_names_[number] = file_name;
     std::cout << "Loaded trajectory " << number << " from " << traj_path << ". ";
     std::cout << "Length: " << trajectories_[number]->total_length() << " m." << std::endl;
   }
+
+  if (watch) {
+    watcher_ = std::thread(&RacingTrajectoryMap::watch_folder, this);
+  }
+}
+
+RacingTrajectoryMap::~RacingTrajectoryMap()
+{
+  if (watcher_.joinable()) {
+    const uint64_t stop = 1;
+    if (::write(stop_fd_, &stop, sizeof(stop)) != sizeof(stop)) {
+      std::cerr << "RacingTrajectoryMap: failed to stop the watcher: " << std::strerror(errno) <<
+        std::endl;
+    }
+    watcher_.join();
+  }
+  if (inotify_fd_ >= 0) {
+    close(inotify_fd_);
+    close(stop_fd_);
+  }
 }
 
 RacingTrajectory::SharedPtr RacingTrajectoryMap::get_trajectory(const int & index)
 {
-  if (trajectories_.find(index) == trajectories_.end()) {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  const auto it = trajectories_.find(index);
+  if (it == trajectories_.end()) {
     std::cerr << "Trajectory number " << index << " not found." << std::endl;
     return nullptr;
   }
-  return trajectories_[index];
+  return it->second;
+}
+
+std::vector<int> RacingTrajectoryMap::indices() const
+{
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::vector<int> indices;
+  indices.reserve(trajectories_.size());
+  for (const auto & [number, trajectory] : trajectories_) {
+    indices.push_back(number);
+  }
+  return indices;
+}
+
+uint64_t RacingTrajectoryMap::revision() const
+{
+  return revision_.load();
+}
+
+bool RacingTrajectoryMap::is_watching() const
+{
+  return watcher_.joinable();
+}
+
+void RacingTrajectoryMap::set_update_callback(const UpdateCallback & callback)
+{
+  std::lock_guard<std::mutex> lock(callback_mutex_);
+  update_callback_ = callback;
+}
+
+bool RacingTrajectoryMap::parse_file_name(const std::string & file_name, int & number)
+{
+  static const std::regex pattern(R"((\d+)_.*\.txt)");
+  std::smatch match;
+  if (!std::regex_match(file_name, match, pattern)) {
+    return false;
+  }
+  try {
+    number = std::stoi(match[1]);
+  } catch (const std::out_of_range &) {
+    return false;
+  }
+  return true;
+}
+
+void RacingTrajectoryMap::on_file_written(const std::string & file_name)
+{
+  // other files, such as the temporary files of an editor, are ignored
+  int number = 0;
+  if (!parse_file_name(file_name, number)) {
+    return;
+  }
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const auto it = file_names_.find(number);
+    if (it != file_names_.end() && it->second != file_name) {
+      std::cerr << "Duplicate trajectory number found: " << number << ". Ignored " <<
+        file_name << "." << std::endl;
+      return;
+    }
+  }
+
+  // build all interpolants and the projection without holding the lock, but not while
+  // another thread builds CasADi functions
+  const auto traj_path = (std::filesystem::path(directory_path_) / file_name).string();
+  RacingTrajectory::SharedPtr trajectory;
+  try {
+    std::lock_guard<std::mutex> construction_lock(utils::casadi_construction_mutex());
+    trajectory = std::make_shared<RacingTrajectory>(traj_path);
+  } catch (const std::exception & e) {
+    std::cerr << "Failed to load trajectory " << number << " from " << traj_path << ": " <<
+      e.what() << std::endl;
+    return;
+  }
+  std::cout << "Reloaded trajectory " << number << " from " << traj_path << ". ";
+  std::cout << "Length: " << trajectory->total_length() << " m." << std::endl;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    file_names_[number] = file_name;
+  }
+  publish(number, trajectory);
+}
+
+void RacingTrajectoryMap::on_file_removed(const std::string & file_name)
+{
+  int number = 0;
+  if (!parse_file_name(file_name, number)) {
+    return;
+  }
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    const auto it = file_names_.find(number);
+    if (it == file_names_.end() || it->second != file_name) {
+      return;
+    }
+    file_names_.erase(it);
+  }
+  std::cout << "Removed trajectory " << number << "." << std::endl;
+  publish(number, nullptr);
+}
+
+void RacingTrajectoryMap::publish(const int & number, RacingTrajectory::SharedPtr trajectory)
+{
+  RacingTrajectory::SharedPtr previous;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    const auto it = trajectories_.find(number);
+    if (it != trajectories_.end()) {
+      previous = it->second;
+    }
+    if (trajectory) {
+      trajectories_[number] = trajectory;
+    } else {
+      trajectories_.erase(number);
+    }
+  }
+  revision_++;
+  // outside of mutex_, the callback may read this map
+  std::lock_guard<std::mutex> lock(callback_mutex_);
+  if (update_callback_) {
+    update_callback_(number, previous, trajectory);
+  }
+}
+
+void RacingTrajectoryMap::watch_folder()
+{
+  alignas(inotify_event) char buffer[4096];
+  while (true) {
+    pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "RacingTrajectoryMap: stopped watching " << directory_path_ << ": " <<
+        std::strerror(errno) << std::endl;
+      return;
+    }
+    if (fds[1].revents & POLLIN) {
+      return;
+    }
+    const auto length = read(inotify_fd_, buffer, sizeof(buffer));
+    if (length <= 0) {
+      continue;
+    }
+    for (char * it = buffer; it < buffer + length; ) {
+      const auto * event = reinterpret_cast<const inotify_event *>(it);
+      it += sizeof(inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        std::cerr << "RacingTrajectoryMap: events of " << directory_path_ << " were lost." <<
+          std::endl;
+      }
+      if (event->len == 0 || (event->mask & IN_ISDIR)) {
+        continue;
+      }
+      if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        on_file_written(event->name);
+      } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        on_file_removed(event->name);
+      }
+    }
+  }
 }
 }  // namespace racing_trajectory
 }  // namespace vehicle_model
@@ -18,7 +18,14 @@
 #include <memory>
 #include <vector>
 #include <algorithm>
+#include <chrono>
 #include <execution>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
 
 #include <casadi/casadi.hpp>
 
@@ -113,6 +120,25 @@ std::vector<RegResult> SSTrajectory::query(const RegQuery & query) const
   return results;
 }
 
+const SSTrajectoryData & SSTrajectory::data() const
+{
+  return lap_;
+}
+
+SSTrajectory::SharedPtr SSTrajectory::reproject(
+  RacingTrajectory & from, RacingTrajectory & to,
+  const casadi_int & num_threads) const
+{
+  using casadi::Slice;
+  const auto poses = lap_.x(Slice(0, 3), Slice());
+  const auto global_poses = from.frenet_to_global(poses);
+  const auto frenet_poses = to.global_to_frenet(global_poses, num_threads);
+  auto x = lap_.x;
+  x(Slice(0, 3), Slice()) = frenet_poses;
+  const auto k = to.curvature_interpolation_function()(frenet_poses(0, Slice()))[0];
+  return std::make_shared<SSTrajectory>(x, lap_.u, k, lap_.t, to.total_length());
+}
+
 SSTrajectoryData SSTrajectory::process_lap_data(
   const casadi::DM & x, const casadi::DM & u,
   const casadi::DM & k, const casadi::DM & t,
@@ -127,6 +153,7 @@ SSTrajectoryData SSTrajectory::process_lap_data(
   data.k = k;
   data.J = casadi::DM::horzcat({J + x.size2() - 1, J, J - x.size2() + 1});
   data.x = x;
+  data.t = t;
   data.dt =
     t(casadi::Slice(), casadi::Slice(0, -1)) - t(
     casadi::Slice(), casadi::Slice(
@@ -137,29 +164,216 @@ SSTrajectoryData SSTrajectory::process_lap_data(
 }
 
 SafeSetManager::SafeSetManager(const size_t & max_lap_stored)
-: laps_(max_lap_stored)
+: max_lap_stored_(max_lap_stored)
 {
+  get_partition(active_partition_);
+}
+
+SafeSetManager::~SafeSetManager()
+{
+  std::lock_guard<std::mutex> lock(reprojections_mutex_);
+  for (auto & reprojection : reprojections_) {
+    reprojection.wait();
+  }
 }
 
 void SafeSetManager::add_lap(
   const casadi::DM & x, const casadi::DM & u, const casadi::DM & k,
   const casadi::DM & t, const double & total_length)
 {
-  auto traj = std::make_unique<SSTrajectory>(x, u, k, t, total_length);
+  auto traj = std::make_shared<SSTrajectory>(x, u, k, t, total_length);
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  get_partition(active_partition_).laps.push_back(std::move(traj));
+  revision_++;
+  update_active_laps();
+}
+
+void SafeSetManager::set_active_partition(const int & partition)
+{
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  active_partition_ = partition;
+  update_active_laps();
+}
+
+int SafeSetManager::active_partition()
+{
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return active_partition_;
+}
+
+size_t SafeSetManager::num_laps(const int & partition)
+{
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  const auto it = partitions_.find(partition);
+  if (it == partitions_.end()) {
+    return 0;
+  }
+  size_t num_laps = it->second.laps.size();
+  for (const auto & [source, laps] : it->second.reprojected_laps) {
+    num_laps += laps.size();
+  }
+  return num_laps;
+}
+
+std::map<int, std::vector<SSTrajectory::SharedPtr>> SafeSetManager::recorded_laps()
+{
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::map<int, std::vector<SSTrajectory::SharedPtr>> laps;
+  for (const auto & [index, partition] : partitions_) {
+    if (!partition.laps.empty()) {
+      laps[index].assign(partition.laps.begin(), partition.laps.end());
+    }
+  }
+  return laps;
+}
+
+void SafeSetManager::set_recorded_laps(
+  const int & partition, const std::vector<SSTrajectory::SharedPtr> & laps)
+{
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  auto & recorded_laps = get_partition(partition).laps;
+  recorded_laps.clear();
+  for (const auto & lap : laps) {
+    recorded_laps.push_back(lap);
+  }
+  revision_++;
+  update_active_laps();
+}
+
+uint64_t SafeSetManager::revision()
+{
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return revision_;
+}
+
+std::shared_future<void> SafeSetManager::reproject(
+  const int & from_partition, RacingTrajectory::SharedPtr from,
+  const int & to_partition, RacingTrajectory::SharedPtr to)
+{
+  // the laps are shared, so the copy stays valid while new laps are recorded
+  std::vector<SSTrajectory::SharedPtr> laps;
+  const bool same_partition = from_partition == to_partition;
+  uint64_t frame = 0;
+  {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (same_partition) {
+      // the laps in the old frame are not queried while they are reprojected
+      laps = replace_frame(from_partition);
+    } else {
+      const auto & laps_from = get_partition(from_partition).laps;
+      laps.assign(laps_from.begin(), laps_from.end());
+    }
+    frame = get_partition(to_partition).frame;
+  }
+
+  // CasADi functions must not be built concurrently, so the worker only evaluates them
+  const auto num_threads = static_cast<casadi_int>(std::thread::hardware_concurrency());
+  from->build_batch_conversions(num_threads);
+  to->build_batch_conversions(num_threads);
+  ErrorCallback error_callback;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    error_callback = error_callback_;
+  }
+
+  auto reprojection = std::async(
+    std::launch::async,
+    [this, laps, from, to, from_partition, to_partition, same_partition, frame, num_threads,
+    error_callback]() {
+      std::vector<SSTrajectory::SharedPtr> reprojected_laps;
+      reprojected_laps.reserve(laps.size());
+      for (const auto & lap : laps) {
+        try {
+          reprojected_laps.push_back(lap->reproject(*from, *to, num_threads));
+        } catch (const std::exception & e) {
+          if (error_callback) {
+            error_callback(from_partition, to_partition, e.what());
+          }
+        }
+      }
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+      auto & partition = get_partition(to_partition);
+      if (partition.frame != frame) {
+        // the target frame was replaced meanwhile
+        return;
+      }
+      if (same_partition) {
+        // the laps recorded meanwhile are newer, and already in the new frame
+        for (auto it = reprojected_laps.rbegin(); it != reprojected_laps.rend(); ++it) {
+          if (partition.laps.full()) {
+            break;
+          }
+          partition.laps.push_front(*it);
+        }
+        revision_++;
+      } else {
+        partition.reprojected_laps[from_partition] = std::move(reprojected_laps);
+      }
+      update_active_laps();
+    }).share();
+
+  std::lock_guard<std::mutex> lock(reprojections_mutex_);
+  reprojections_.erase(
+    std::remove_if(
+      reprojections_.begin(), reprojections_.end(),
+      [](const auto & f) {
+        return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+      }),
+    reprojections_.end());
+  reprojections_.push_back(reprojection);
+  return reprojection;
+}
+
+void SafeSetManager::clear_partition(const int & partition)
+{
   std::unique_lock<std::shared_mutex> lock(mutex_);
-  laps_.push_back(std::move(traj));
+  replace_frame(partition);
+}
+
+std::vector<SSTrajectory::SharedPtr> SafeSetManager::replace_frame(const int & partition)
+{
+  auto & replaced = get_partition(partition);
+  std::vector<SSTrajectory::SharedPtr> laps(replaced.laps.begin(), replaced.laps.end());
+  replaced.laps.clear();
+  replaced.reprojected_laps.clear();
+  replaced.frame++;
+  revision_++;
+  update_active_laps();
+  return laps;
+}
+
+SafeSetManager::Partition & SafeSetManager::get_partition(const int & partition)
+{
+  auto it = partitions_.find(partition);
+  if (it == partitions_.end()) {
+    it = partitions_.emplace(partition, Partition()).first;
+    it->second.laps.set_capacity(max_lap_stored_);
+  }
+  return it->second;
+}
+
+void SafeSetManager::update_active_laps()
+{
+  const auto & partition = get_partition(active_partition_);
+  laps_.clear();
+  for (const auto & [source, laps] : partition.reprojected_laps) {
+    laps_.insert(laps_.end(), laps.begin(), laps.end());
+  }
+  laps_.insert(laps_.end(), partition.laps.begin(), partition.laps.end());
 }
 
 SSResult SafeSetManager::query(const SSQuery & query)
 {
+  lmpc::utils::ScopedPerfSample perf_sample(perf_profiler_.get());
   SSResult result;
   casadi::DMVector x;
   casadi::DMVector J;
+  // a finished reprojection may replace the laps, so they are sized under the lock
+  std::shared_lock<std::shared_mutex> lock(mutex_);
   x.reserve(laps_.size());
   J.reserve(laps_.size());
 
   casadi_int num_total = 0;
-  std::shared_lock<std::shared_mutex> lock(mutex_);
   // iterate from the last lap to the first lap
   for (auto it = laps_.rbegin(); num_total < query.max_num_total && it != laps_.rend(); ++it) {
     const auto result_lap = (*it)->query(query);
@@ -181,9 +395,11 @@ SSResult SafeSetManager::query(const SSQuery & query)
 
 RegResult SafeSetManager::query(const RegQuery & query)
 {
+  // only counts the calling thread, not the parallel workers
+  lmpc::utils::ScopedPerfSample perf_sample(perf_profiler_.get());
   // parallelly query all the laps
-  std::vector<std::vector<RegResult>> results(laps_.size());
   std::shared_lock<std::shared_mutex> lock(mutex_);
+  std::vector<std::vector<RegResult>> results(laps_.size());
   std::transform(
     std::execution::par_unseq,
     laps_.begin(), laps_.end(), results.begin(),
@@ -244,6 +460,17 @@ RegResult SafeSetManager::query(const RegQuery & query)
   return result;
 }
 
+void SafeSetManager::set_error_callback(ErrorCallback callback)
+{
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  error_callback_ = callback;
+}
+
+void SafeSetManager::set_perf_profiler(lmpc::utils::PerfProfiler::SharedPtr profiler)
+{
+  perf_profiler_ = profiler;
+}
+
 SafeSetRecorder::SafeSetRecorder(
   SafeSetManager & manager,
   const bool & to_file,
@@ -275,10 +502,151 @@ void SafeSetRecorder::load(const std::vector<std::string> & from_files, const do
   }
 }
 
+void SafeSetRecorder::discard_lap()
+{
+  if (journal_ && initialized_) {
+    journal_->append_marker(
+      JournalRecordType::DISCARD, static_cast<uint32_t>(lap_count_),
+      manager_.active_partition());
+  }
+  last_x_valid_ = false;
+  initialized_ = false;
+}
+
+void SafeSetRecorder::open_journal(
+  const std::string & path, const size_t & nx, const size_t & nu,
+  const double & commit_period, const double & resume_timeout)
+{
+  resume_timeout_ = resume_timeout;
+  std::vector<JournalLap> kept_laps;
+  for (auto & lap : LapJournal::recover(path)) {
+    if (lap.x.size1() != static_cast<casadi_int>(nx) ||
+      lap.u.size1() != static_cast<casadi_int>(nu))
+    {
+      std::cout << "Dropped lap " << lap.lap << " of " << path << ": its dimensions differ." <<
+        std::endl;
+      continue;
+    }
+    std::cout << "Recovered " << (lap.completed ? "lap " : "lap in progress ") << lap.lap <<
+      " from " << path << "." << std::endl;
+    // the completed laps move to the lap files, if any, once all of them are on disk
+    bool saved = false;
+    if (lap.completed && to_file_) {
+      const auto filename = file_prefix_ + "lap_" + std::to_string(lap.lap);
+      try {
+        if (!lap_saved(filename)) {
+          std::cout << "Saving lap to " << filename << std::endl;
+          save_lap(filename, lap.x, lap.u, lap.k, lap.t);
+        }
+        saved = true;
+      } catch (const std::exception & e) {
+        std::cout << "Failed to save lap " << lap.lap << " to " << filename << ": " <<
+          e.what() << ". It stays in the journal." << std::endl;
+      }
+    }
+    if (!saved) {
+      kept_laps.push_back(lap);
+    }
+    recovered_laps_.push_back(lap);
+  }
+  LapJournal::compact(path, nx, nu, kept_laps);
+  journal_ = std::make_unique<LapJournal>(path, nx, nu, 4096, commit_period);
+}
+
+const LapJournal * SafeSetRecorder::journal() const
+{
+  return journal_.get();
+}
+
+void SafeSetRecorder::restore_journal(
+  const casadi::DM & x, const casadi::DM & t,
+  const double & total_length)
+{
+  const auto partition = manager_.active_partition();
+  for (const auto & lap : recovered_laps_) {
+    lap_count_ = std::max(lap_count_, static_cast<size_t>(lap.lap) + 1);
+    if (lap.completed) {
+      if (lap.partition == partition) {
+        manager_.add_lap(lap.x, lap.u, lap.k, lap.t, total_length);
+      } else {
+        std::cout << "Lap " << lap.lap << " of the journal is in partition " << lap.partition <<
+          ". Not added to the safe set." << std::endl;
+      }
+      continue;
+    }
+    // the lap in progress resumes if the vehicle has not crossed the start/finish line since
+    const auto downtime = static_cast<double>(t) - static_cast<double>(lap.t(-1));
+    const auto px_last = static_cast<double>(lap.x(0, -1));
+    if (lap.started && lap.partition == partition && downtime > 0.0 &&
+      downtime <= resume_timeout_ && px_last - static_cast<double>(x(0)) <= 0.5 * total_length)
+    {
+      std::cout << "Resuming recording lap " << lap.lap << " after " << downtime << " s." <<
+        std::endl;
+      last_x_ = lap.x;
+      last_u_ = lap.u;
+      last_k_ = lap.k;
+      last_t_ = lap.t;
+      last_x_valid_ = true;
+      initialized_ = true;
+      lap_count_ = lap.lap;
+    } else {
+      std::cout << "Discarding the lap in progress " << lap.lap << " of the journal." <<
+        std::endl;
+      journal_->append_marker(JournalRecordType::DISCARD, lap.lap, lap.partition);
+    }
+  }
+  recovered_laps_.clear();
+}
+
+void SafeSetRecorder::save_lap(
+  const std::string & filename, const casadi::DM & x, const casadi::DM & u,
+  const casadi::DM & k, const casadi::DM & t)
+{
+  // each file is complete once it has its name, so that a crash never leaves a partial lap
+  const std::vector<std::pair<std::string, const casadi::DM *>> files {
+    {"_x.txt", &x}, {"_u.txt", &u}, {"_t.txt", &t}, {"_k.txt", &k}};
+  for (const auto & [suffix, data] : files) {
+    const auto path = filename + suffix;
+    data->T().to_file(path + ".tmp", "txt");
+    durable_rename(path + ".tmp", path);
+  }
+}
+
+bool SafeSetRecorder::lap_saved(const std::string & filename)
+{
+  for (const auto & suffix : {"_x.txt", "_u.txt", "_t.txt", "_k.txt"}) {
+    if (!std::filesystem::exists(filename + suffix)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void SafeSetRecorder::step(
   const casadi::DM & x, const casadi::DM & u, const casadi::DM & k, const casadi::DM & t,
   const double & total_length)
 {
+  if (!recovered_laps_.empty()) {
+    restore_journal(x, t, total_length);
+  }
+  // copies the step into the journal buffer, which is written in the background
+  auto journal_step = [&]() {
+      if (!journal_ || !initialized_) {
+        return;
+      }
+      if (static_cast<size_t>(x.numel()) != journal_->nx() ||
+        static_cast<size_t>(u.numel()) != journal_->nu())
+      {
+        throw std::invalid_argument("SafeSetRecorder: the step does not match the journal.");
+      }
+      const auto x_dense = x.is_dense() ? x : casadi::DM::densify(x);
+      const auto u_dense = u.is_dense() ? u : casadi::DM::densify(u);
+      journal_->append_step(
+        static_cast<uint32_t>(lap_count_), manager_.active_partition(),
+        x_dense.nonzeros().data(), u_dense.nonzeros().data(), static_cast<double>(k),
+        static_cast<double>(t));
+    };
+
   if (!last_x_valid_) {
     last_x_ = x;
     last_x_valid_ = true;
@@ -295,13 +663,24 @@ void SafeSetRecorder::step(
         static_cast<double>(total_length / (t - last_t_(0))) << " m/s, time: " <<
         (t - last_t_(0)) << " s." << std::endl;
       manager_.add_lap(last_x_, last_u_, last_k_, last_t_, total_length);
+      if (journal_) {
+        journal_->append_marker(
+          JournalRecordType::LAP_END, static_cast<uint32_t>(lap_count_),
+          manager_.active_partition());
+      }
       if (to_file_) {
         const auto filename = file_prefix_ + "lap_" + std::to_string(lap_count_);
         std::cout << "Saving lap to " << filename << std::endl;
-        last_x_.T().to_file(filename + "_x.txt", "txt");
-        last_u_.T().to_file(filename + "_u.txt", "txt");
-        last_t_.T().to_file(filename + "_t.txt", "txt");
-        last_k_.T().to_file(filename + "_k.txt", "txt");
+        // the files are written in the background, not on the control thread
+        lap_writes_.erase(
+          std::remove_if(
+            lap_writes_.begin(), lap_writes_.end(), [](const std::future<void> & write) {
+              return write.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            }), lap_writes_.end());
+        lap_writes_.push_back(
+          std::async(
+            std::launch::async, &SafeSetRecorder::save_lap, filename, last_x_, last_u_,
+            last_k_, last_t_));
       }
       std::cout << "------------------------------------------------------------" << std::endl;
     } else {
@@ -313,11 +692,18 @@ void SafeSetRecorder::step(
     last_u_ = u;
     last_t_ = t;
     last_k_ = k;
+    if (journal_) {
+      journal_->append_marker(
+        JournalRecordType::LAP_START, static_cast<uint32_t>(lap_count_),
+        manager_.active_partition());
+    }
+    journal_step();
   } else {
     last_x_ = casadi::DM::horzcat({last_x_, x});
     last_u_ = casadi::DM::horzcat({last_u_, u});
     last_t_ = casadi::DM::horzcat({last_t_, t});
     last_k_ = casadi::DM::horzcat({last_k_, k});
+    journal_step();
   }
 }
 
@@ -0,0 +1,227 @@
+// Copyright 2023 Haoru Xue
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "racing_trajectory/racing_trajectory.hpp"
+#include "racing_trajectory/synthetic_track.hpp"
+
+namespace lmpc
+{
+namespace vehicle_model
+{
+namespace racing_trajectory
+{
+constexpr casadi_int kNumTrajectoryRows = TrajectoryIndex::TIME + 1;
+
+casadi::DM generate_synthetic_track(const SyntheticTrackConfig & config)
+{
+  if (config.length <= 0.0 || config.num_points < 4 || config.shape_amplitude < 0.0 ||
+    config.shape_amplitude >= 1.0 || config.track_width <= 0.0 || config.max_speed <= 0.0 ||
+    config.max_lat_acc <= 0.0 || config.max_lon_acc <= 0.0 || config.num_regions < 1)
+  {
+    throw std::invalid_argument("generate_synthetic_track: invalid config.");
+  }
+  const auto n = config.num_points;
+
+  // harmonics 2, 3, ... with amplitudes decaying with the square of the order,
+  // so higher harmonics add corners without making them too tight
+  std::mt19937 gen(config.seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::vector<double> amplitudes(config.num_harmonics), phases(config.num_harmonics);
+  double amplitude_sum = 0.0;
+  for (size_t i = 0; i < config.num_harmonics; i++) {
+    amplitudes[i] = (0.5 + 0.5 * unit(gen)) / std::pow(i + 2.0, 2);
+    phases[i] = 2.0 * M_PI * unit(gen);
+    amplitude_sum += amplitudes[i];
+  }
+  for (auto & amplitude : amplitudes) {
+    amplitude *= config.shape_amplitude / amplitude_sum;
+  }
+  // r(theta) and its derivatives of the unit radius shape
+  auto shape = [&amplitudes, &phases](
+    const double & theta, double & r, double & dr, double & ddr) {
+      r = 1.0;
+      dr = 0.0;
+      ddr = 0.0;
+      for (size_t i = 0; i < amplitudes.size(); i++) {
+        const auto order = i + 2.0;
+        const auto angle = order * theta + phases[i];
+        r += amplitudes[i] * std::cos(angle);
+        dr -= amplitudes[i] * order * std::sin(angle);
+        ddr -= amplitudes[i] * order * order * std::cos(angle);
+      }
+    };
+
+  // arc length on a finer grid, inverted to resample the curve at equal arc length
+  const auto m = std::max<size_t>(4 * n, 4096);
+  std::vector<double> arc(m + 1, 0.0);
+  double r, dr, ddr;
+  shape(0.0, r, dr, ddr);
+  auto last_speed = std::hypot(r, dr);
+  for (size_t j = 1; j <= m; j++) {
+    shape(2.0 * M_PI * j / m, r, dr, ddr);
+    const auto speed = std::hypot(r, dr);
+    arc[j] = arc[j - 1] + 0.5 * (last_speed + speed) * 2.0 * M_PI / m;
+    last_speed = speed;
+  }
+  const auto r0 = config.length / arc[m];
+  const auto ds = config.length / n;
+  const auto half_width = config.track_width / 2.0;
+
+  auto traj = casadi::DM::zeros(kNumTrajectoryRows, n);
+  auto & data = traj.nonzeros();
+  std::vector<double> speeds(n), curvatures(n);
+  size_t j = 0;
+  for (size_t i = 0; i < n; i++) {
+    const auto target = arc[m] * i / n;
+    while (arc[j + 1] < target) {
+      j++;
+    }
+    const auto theta = 2.0 * M_PI * (j + (target - arc[j]) / (arc[j + 1] - arc[j])) / m;
+    shape(theta, r, dr, ddr);
+    const auto dx = dr * std::cos(theta) - r * std::sin(theta);
+    const auto dy = dr * std::sin(theta) + r * std::cos(theta);
+    const auto yaw = std::atan2(dy, dx);
+    const auto curvature =
+      (r * r + 2.0 * dr * dr - r * ddr) / (r0 * std::pow(r * r + dr * dr, 1.5));
+    if (std::abs(curvature) * half_width >= 1.0) {
+      throw std::invalid_argument(
+              "generate_synthetic_track: a corner is tighter than half the track width. "
+              "Use a longer track, a narrower track or a smaller shape amplitude.");
+    }
+    curvatures[i] = curvature;
+    speeds[i] = std::min(config.max_speed, std::sqrt(config.max_lat_acc / std::abs(curvature)));
+
+    auto * col = &data[i * kNumTrajectoryRows];
+    col[TrajectoryIndex::PX] = r0 * r * std::cos(theta);
+    col[TrajectoryIndex::PY] = r0 * r * std::sin(theta);
+    col[TrajectoryIndex::YAW] = yaw;
+    col[TrajectoryIndex::CURVATURE] = curvature;
+    col[TrajectoryIndex::DIST_TO_SF_BWD] = ds * i;
+    col[TrajectoryIndex::DIST_TO_SF_FWD] = config.length - ds * i;
+    col[TrajectoryIndex::REGION] = static_cast<double>(i * config.num_regions / n);
+    col[TrajectoryIndex::LEFT_BOUND_X] = col[TrajectoryIndex::PX] - half_width * std::sin(yaw);
+    col[TrajectoryIndex::LEFT_BOUND_Y] = col[TrajectoryIndex::PY] + half_width * std::cos(yaw);
+    col[TrajectoryIndex::RIGHT_BOUND_X] = col[TrajectoryIndex::PX] + half_width * std::sin(yaw);
+    col[TrajectoryIndex::RIGHT_BOUND_Y] = col[TrajectoryIndex::PY] - half_width * std::cos(yaw);
+  }
+
+  // limit the acceleration and braking. going around twice settles the closed loop.
+  const auto dv2 = 2.0 * config.max_lon_acc * ds;
+  for (size_t i = 1; i < 2 * n; i++) {
+    const auto & v_last = speeds[(i - 1) % n];
+    speeds[i % n] = std::min(speeds[i % n], std::sqrt(v_last * v_last + dv2));
+  }
+  for (size_t i = 2 * n - 1; i-- > 0; ) {
+    const auto & v_next = speeds[(i + 1) % n];
+    speeds[i % n] = std::min(speeds[i % n], std::sqrt(v_next * v_next + dv2));
+  }
+  for (size_t i = 0; i < n; i++) {
+    const auto & v = speeds[i];
+    const auto & v_next = speeds[(i + 1) % n];
+    auto * col = &data[i * kNumTrajectoryRows];
+    col[TrajectoryIndex::SPEED] = v;
+    col[TrajectoryIndex::LON_ACC] = (v_next * v_next - v * v) / (2.0 * ds);
+    col[TrajectoryIndex::LAT_ACC] = v * v * curvatures[i];
+    col[TrajectoryIndex::TIME] = 2.0 * ds / (v + v_next);
+  }
+  return traj;
+}
+
+SyntheticLap generate_synthetic_lap(const casadi::DM & traj, const SyntheticLapConfig & config)
+{
+  if (traj.size1() != kNumTrajectoryRows || traj.size2() < 2 || config.num_points < 2 ||
+    config.nu < 1 || config.lateral_amplitude < 0.0 || config.speed_scale <= 0.0 ||
+    config.speed_noise < 0.0 || config.speed_noise >= 1.0)
+  {
+    throw std::invalid_argument("generate_synthetic_lap: invalid track or config.");
+  }
+  const auto num_waypoints = static_cast<size_t>(traj.size2());
+  const auto & data = traj.nonzeros();
+  auto at = [&data](const size_t & i, const TrajectoryIndex & row) {
+      return data[i * kNumTrajectoryRows + row];
+    };
+  const auto total_length = at(0, TrajectoryIndex::DIST_TO_SF_FWD);
+
+  std::mt19937 gen(config.seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  const auto waves = 2.0 + std::floor(5.0 * unit(gen));
+  const auto phase = 2.0 * M_PI * unit(gen);
+  const auto wave_number = 2.0 * M_PI * waves / total_length;
+
+  const auto n = static_cast<casadi_int>(config.num_points);
+  const auto ds = total_length / n;
+  SyntheticLap lap;
+  lap.x = casadi::DM::zeros(6, n);
+  lap.u = casadi::DM::zeros(static_cast<casadi_int>(config.nu), n);
+  lap.k = casadi::DM::zeros(1, n);
+  lap.t = casadi::DM::zeros(1, n);
+  lap.total_length = total_length;
+  auto & x = lap.x.nonzeros();
+  auto & u = lap.u.nonzeros();
+  auto & k = lap.k.nonzeros();
+  auto & t = lap.t.nonzeros();
+
+  size_t j = 0;
+  for (casadi_int i = 0; i < n; i++) {
+    // linear interpolation between waypoint j and the next one, wrapping around the start line
+    const auto s = ds * i;
+    while (j + 1 < num_waypoints && at(j + 1, TrajectoryIndex::DIST_TO_SF_BWD) <= s) {
+      j++;
+    }
+    const auto j_next = (j + 1) % num_waypoints;
+    const auto s_j = at(j, TrajectoryIndex::DIST_TO_SF_BWD);
+    const auto s_next = j_next == 0 ? total_length : at(j_next, TrajectoryIndex::DIST_TO_SF_BWD);
+    const auto w = (s - s_j) / (s_next - s_j);
+    auto interpolate = [&](const TrajectoryIndex & row) {
+        return (1.0 - w) * at(j, row) + w * at(j_next, row);
+      };
+    auto bound_distance = [&](const TrajectoryIndex & bound_x, const TrajectoryIndex & bound_y) {
+        return std::hypot(
+          interpolate(bound_x) - interpolate(TrajectoryIndex::PX),
+          interpolate(bound_y) - interpolate(TrajectoryIndex::PY));
+      };
+    const auto left = bound_distance(TrajectoryIndex::LEFT_BOUND_X, TrajectoryIndex::LEFT_BOUND_Y);
+    const auto right = bound_distance(
+      TrajectoryIndex::RIGHT_BOUND_X, TrajectoryIndex::RIGHT_BOUND_Y);
+    const auto curvature = interpolate(TrajectoryIndex::CURVATURE);
+    const auto speed = config.speed_scale * interpolate(TrajectoryIndex::SPEED) *
+      (1.0 + config.speed_noise * (2.0 * unit(gen) - 1.0));
+
+    auto * xi = &x[i * 6];
+    xi[0] = s;
+    xi[1] = std::clamp(
+      config.lateral_amplitude * std::sin(wave_number * s + phase), -0.8 * right, 0.8 * left);
+    xi[2] = std::atan(config.lateral_amplitude * wave_number * std::cos(wave_number * s + phase));
+    xi[3] = speed;
+    xi[5] = speed * curvature;
+    k[i] = curvature;
+    if (i > 0) {
+      t[i] = t[i - 1] + 2.0 * ds / (x[(i - 1) * 6 + 3] + speed);
+      u[(i - 1) * config.nu] = (speed - x[(i - 1) * 6 + 3]) / (t[i] - t[i - 1]);
+    }
+  }
+  u[(n - 1) * config.nu] = u[(n - 2) * config.nu];
+  return lap;
+}
+}  // namespace racing_trajectory
+}  // namespace vehicle_model
+}  // namespace lmpc
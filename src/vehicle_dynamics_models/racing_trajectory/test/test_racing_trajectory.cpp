@@ -14,13 +14,25 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <gtest/gtest.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <rclcpp/rclcpp.hpp>
 #include <ament_index_cpp/get_package_share_directory.hpp>
 
+#include "racing_trajectory/lap_journal.hpp"
 #include "racing_trajectory/racing_trajectory.hpp"
+#include "racing_trajectory/racing_trajectory_map.hpp"
+#include "racing_trajectory/safe_set.hpp"
+#include "racing_trajectory/synthetic_track.hpp"
+#include "racing_trajectory/trajectory_kd_tree.hpp"
 
 TEST(RacingTrajectoryTest, TestGlobalToFrenetUninitialized) {
   const auto share_dir = ament_index_cpp::get_package_share_directory("racing_trajectory");
@@ -69,3 +81,448 @@ TEST(RacingTrajectoryTest, TestGlobalToFrenetInitialized) {
     test_global_pose_moved.position.y += 0.5;
   }
 }
+
+TEST(RacingTrajectoryTest, TestSafeSetReprojection) {
+  using casadi::DM;
+  using casadi::Slice;
+  using lmpc::vehicle_model::racing_trajectory::RacingTrajectory;
+  using lmpc::vehicle_model::racing_trajectory::SafeSetManager;
+  using lmpc::vehicle_model::racing_trajectory::SSTrajectory;
+  const auto share_dir = ament_index_cpp::get_package_share_directory("racing_trajectory");
+  auto optm = std::make_shared<RacingTrajectory>(share_dir + "/test_data/mgkt_optm.txt");
+  auto center = std::make_shared<RacingTrajectory>(share_dir + "/test_data/mgkt_center.txt");
+
+  // a lap along the optimal line, 0.2 m to the left of it
+  const casadi_int n = 200;
+  auto x = DM::zeros(6, n);
+  x(0, Slice()) = DM::linspace(0.0, optm->total_length() * (n - 1) / n, n).T();
+  x(1, Slice()) = 0.2;
+  x(3, Slice()) = 5.0;
+  const auto u = DM::zeros(2, n);
+  const auto k = optm->curvature_interpolation_function()(x(0, Slice()))[0];
+  const auto t = DM::linspace(0.0, optm->total_length() / 5.0, n).T();
+
+  // the batched conversion is the same as the single pose conversion
+  const auto global_poses = optm->frenet_to_global_function().map(n)(x(Slice(0, 3), Slice()))[0];
+  const auto frenet_poses = center->global_to_frenet(global_poses, 4);
+  // the padded batches are the same as one map over all the poses
+  EXPECT_NEAR(
+    static_cast<double>(
+      DM::norm_inf(optm->frenet_to_global(x(Slice(0, 3), Slice())) - global_poses)), 0.0, 1e-12);
+  for (casadi_int i = 0; i < n; i += 50) {
+    const auto pose = global_poses(Slice(), i).get_elements();
+    auto frenet_pose = lmpc::FrenetPose2D();
+    center->global_to_frenet(lmpc::Pose2D{{pose[0], pose[1]}, pose[2]}, frenet_pose);
+    EXPECT_NEAR(frenet_pose.position.s, static_cast<double>(frenet_poses(0, i)), 1e-6);
+    EXPECT_NEAR(frenet_pose.position.t, static_cast<double>(frenet_poses(1, i)), 1e-6);
+  }
+
+  // the reprojected lap describes the same global poses
+  const auto lap = SSTrajectory(x, u, k, t, optm->total_length());
+  const auto reprojected = lap.reproject(*optm, *center, 4);
+  const auto reprojected_global = center->frenet_to_global_function().map(n)(
+    reprojected->data().x(Slice(0, 3), Slice()))[0];
+  EXPECT_LT(
+    static_cast<double>(DM::mmax(DM::abs(reprojected_global(Slice(0, 2), Slice()) -
+    global_poses(Slice(0, 2), Slice())))), 1e-3);
+  EXPECT_EQ(reprojected->data().u.size2(), n);
+
+  // the laps are partitioned by trajectory and reprojected in the background
+  SafeSetManager manager(5);
+  manager.set_active_partition(0);
+  manager.add_lap(x, u, k, t, optm->total_length());
+  EXPECT_EQ(manager.num_laps(0), 1u);
+  EXPECT_EQ(manager.num_laps(1), 0u);
+  manager.set_active_partition(1);
+  manager.reproject(0, optm, 1, center).wait();
+  EXPECT_EQ(manager.num_laps(1), 1u);
+  // reprojecting again replaces the earlier reprojection
+  manager.reproject(0, optm, 1, center).wait();
+  EXPECT_EQ(manager.num_laps(1), 1u);
+  EXPECT_EQ(manager.active_partition(), 1);
+
+  // the recorded laps are exported without the reprojections, and replaced as a whole
+  const auto revision = manager.revision();
+  const auto recorded = manager.recorded_laps();
+  ASSERT_EQ(recorded.size(), 1u);
+  ASSERT_EQ(recorded.at(0).size(), 1u);
+  SafeSetManager mirror(5);
+  mirror.set_recorded_laps(0, std::vector<SSTrajectory::SharedPtr>(7, recorded.at(0).front()));
+  EXPECT_EQ(mirror.num_laps(0), 5u);
+  mirror.set_recorded_laps(0, recorded.at(0));
+  EXPECT_EQ(mirror.num_laps(0), 1u);
+  EXPECT_EQ(mirror.revision(), 2u);
+  EXPECT_EQ(manager.revision(), revision);
+
+  // replacing the trajectory of a partition reprojects the laps recorded in it into the new
+  // frame, and drops the laps reprojected into its old frame
+  manager.reproject(0, optm, 0, center).wait();
+  EXPECT_EQ(manager.num_laps(0), 1u);
+  const auto reframed = manager.recorded_laps().at(0).front();
+  EXPECT_NE(reframed, recorded.at(0).front());
+  EXPECT_NEAR(
+    static_cast<double>(DM::norm_inf(reframed->data().x - reprojected->data().x)), 0.0, 1e-9);
+  manager.reproject(1, center, 1, optm).wait();
+  EXPECT_EQ(manager.num_laps(1), 0u);
+  EXPECT_GT(manager.revision(), revision);
+  manager.clear_partition(0);
+  EXPECT_EQ(manager.num_laps(0), 0u);
+}
+
+TEST(RacingTrajectoryTest, TestSyntheticTrack) {
+  using casadi::DM;
+  using casadi::Slice;
+  using lmpc::vehicle_model::racing_trajectory::RacingTrajectory;
+  using lmpc::vehicle_model::racing_trajectory::SafeSetManager;
+  using lmpc::vehicle_model::racing_trajectory::SyntheticLapConfig;
+  using lmpc::vehicle_model::racing_trajectory::SyntheticTrackConfig;
+  using lmpc::vehicle_model::racing_trajectory::TrajectoryIndex;
+  using lmpc::vehicle_model::racing_trajectory::generate_synthetic_lap;
+  using lmpc::vehicle_model::racing_trajectory::generate_synthetic_track;
+
+  SyntheticTrackConfig track_config;
+  track_config.length = 1500.0;
+  track_config.num_points = 1500;
+  track_config.num_regions = 3;
+  const auto table = generate_synthetic_track(track_config);
+  ASSERT_EQ(table.size1(), TrajectoryIndex::TIME + 1);
+  ASSERT_EQ(table.size2(), 1500);
+  // the waypoints are evenly spaced and close the loop
+  const auto next = DM::horzcat({table(Slice(0, 2), Slice(1, 1500)), table(Slice(0, 2), 0)});
+  const auto gaps = DM::sqrt(DM::sum1(DM::sq(next - table(Slice(0, 2), Slice()))));
+  EXPECT_NEAR(static_cast<double>(DM::mmin(gaps)), 1.0, 1e-3);
+  EXPECT_NEAR(static_cast<double>(DM::mmax(gaps)), 1.0, 1e-3);
+  EXPECT_LE(static_cast<double>(DM::mmax(table(TrajectoryIndex::SPEED, Slice()))), 50.0);
+  EXPECT_LE(
+    static_cast<double>(DM::mmax(DM::abs(table(TrajectoryIndex::LAT_ACC, Slice())))), 15.0);
+  EXPECT_EQ(static_cast<double>(table(TrajectoryIndex::REGION, 1499)), 2.0);
+  EXPECT_THROW(
+    generate_synthetic_track(SyntheticTrackConfig{100.0, 100, 6, 0.9, 40.0}),
+    std::invalid_argument);
+
+  auto traj = RacingTrajectory(table);
+  EXPECT_DOUBLE_EQ(traj.total_length(), 1500.0);
+  EXPECT_EQ(traj.num_regions(), 3);
+
+  // the laps stay on the track and are accepted by the safe set
+  SafeSetManager manager(5);
+  for (uint32_t seed = 0; seed < 5; seed++) {
+    SyntheticLapConfig lap_config;
+    lap_config.seed = seed;
+    const auto lap = generate_synthetic_lap(table, lap_config);
+    EXPECT_LE(static_cast<double>(DM::mmax(DM::abs(lap.x(1, Slice())))), 1.0);
+    EXPECT_GT(static_cast<double>(lap.t(lap.t.numel() - 1)), 0.0);
+    manager.add_lap(lap.x, lap.u, lap.k, lap.t, lap.total_length);
+  }
+  EXPECT_EQ(manager.num_laps(0), 5u);
+}
+
+TEST(RacingTrajectoryTest, TestSyntheticTrackScaling) {
+  using casadi::DM;
+  using casadi::Slice;
+  using lmpc::vehicle_model::racing_trajectory::RacingTrajectory;
+  using lmpc::vehicle_model::racing_trajectory::SafeSetManager;
+  using lmpc::vehicle_model::racing_trajectory::SSQuery;
+  using lmpc::vehicle_model::racing_trajectory::SyntheticLapConfig;
+  using lmpc::vehicle_model::racing_trajectory::SyntheticTrackConfig;
+  using lmpc::vehicle_model::racing_trajectory::TrajectoryIndex;
+  using lmpc::vehicle_model::racing_trajectory::TrajectoryKDTree;
+  using lmpc::vehicle_model::racing_trajectory::generate_synthetic_lap;
+  using lmpc::vehicle_model::racing_trajectory::generate_synthetic_track;
+  auto elapsed = [](const std::chrono::high_resolution_clock::time_point & start) {
+      return std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+  // track construction and lookup against the number of waypoints
+  for (const size_t num_points : {1000, 10000, 100000}) {
+    SyntheticTrackConfig track_config;
+    track_config.length = 5000.0;
+    track_config.num_points = num_points;
+    auto start = std::chrono::high_resolution_clock::now();
+    const auto table = generate_synthetic_track(track_config);
+    const auto generate_time = elapsed(start);
+    start = std::chrono::high_resolution_clock::now();
+    auto traj = RacingTrajectory(table);
+    const auto construct_time = elapsed(start);
+    start = std::chrono::high_resolution_clock::now();
+    const auto tree = TrajectoryKDTree(
+      table(TrajectoryIndex::PX, Slice()).get_elements(),
+      table(TrajectoryIndex::PY, Slice()).get_elements());
+    const auto tree_time = elapsed(start);
+
+    // poses 0.5 m off the center line
+    const casadi_int num_poses = 200;
+    auto frenet_poses = DM::zeros(3, num_poses);
+    frenet_poses(0, Slice()) = DM::linspace(0.0, 4900.0, num_poses).T();
+    frenet_poses(1, Slice()) = 0.5;
+    const auto global_poses =
+      traj.frenet_to_global_function().map(num_poses)(frenet_poses)[0];
+    start = std::chrono::high_resolution_clock::now();
+    const auto projected = traj.global_to_frenet(global_poses, 4);
+    const auto projection_time = elapsed(start);
+    EXPECT_LT(
+      static_cast<double>(DM::mmax(DM::abs(projected(1, Slice()) - frenet_poses(1, Slice())))),
+      1e-2);
+    start = std::chrono::high_resolution_clock::now();
+    for (casadi_int i = 0; i < num_poses; i++) {
+      tree.find_closest_waypoint_index(
+        static_cast<double>(global_poses(0, i)), static_cast<double>(global_poses(1, i)));
+    }
+    const auto lookup_time = elapsed(start) / num_poses;
+    std::cout << "[Synthetic Track " << num_points << " points] generate: " << generate_time <<
+      "ms, construct: " << construct_time << "ms, kd tree: " << tree_time <<
+      "ms, lookup: " << lookup_time * 1e3 << "us, global to frenet (" << num_poses <<
+      " poses): " << projection_time << "ms" << std::endl;
+  }
+
+  // safe set queries against the number of laps
+  SyntheticTrackConfig track_config;
+  track_config.length = 5000.0;
+  track_config.num_points = 5000;
+  const auto table = generate_synthetic_track(track_config);
+  for (const size_t num_laps : {1, 10, 50}) {
+    SafeSetManager manager(num_laps);
+    SyntheticLapConfig lap_config;
+    lap_config.num_points = 2000;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < num_laps; i++) {
+      lap_config.seed = static_cast<uint32_t>(i);
+      const auto lap = generate_synthetic_lap(table, lap_config);
+      manager.add_lap(lap.x, lap.u, lap.k, lap.t, lap.total_length);
+    }
+    const auto add_time = elapsed(start) / num_laps;
+    SSQuery query{DM{2500.0, 0.0, 0.0, 40.0, 0.0, 0.0}, DM::inf(6, 1), 1000, 10};
+    const int num_queries = 100;
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_queries; i++) {
+      manager.query(query);
+    }
+    const auto query_time = elapsed(start) / num_queries;
+    EXPECT_EQ(
+      manager.query(query).x.size2(),
+      static_cast<casadi_int>(std::min<size_t>(num_laps * 10, 1000)));
+    std::cout << "[Synthetic Safe Set " << num_laps << " laps] add lap: " << add_time <<
+      "ms, query: " << query_time << "ms" << std::endl;
+  }
+}
+
+TEST(RacingTrajectoryTest, TestTrajectoryMapHotReload) {
+  using lmpc::vehicle_model::racing_trajectory::RacingTrajectory;
+  using lmpc::vehicle_model::racing_trajectory::RacingTrajectoryMap;
+  namespace fs = std::filesystem;
+
+  const auto barc_dir = fs::path(
+    ament_index_cpp::get_package_share_directory("racing_trajectory")) / "test_data" / "barc";
+  const auto folder = fs::temp_directory_path() /
+    ("test_trajectory_map_" + std::to_string(getpid()));
+  fs::remove_all(folder);
+  fs::create_directories(folder);
+  fs::copy_file(barc_dir / "02_barc_center.txt", folder / "2_center.txt");
+
+  std::atomic<int> last_update {-1};
+  RacingTrajectory::SharedPtr last_previous;
+  std::mutex last_previous_mutex;
+  auto map = RacingTrajectoryMap(folder.string(), true);
+  ASSERT_TRUE(map.is_watching());
+  EXPECT_EQ(map.indices(), std::vector<int>{2});
+  map.set_update_callback(
+    [&](const int & number, RacingTrajectory::SharedPtr previous, RacingTrajectory::SharedPtr) {
+      std::lock_guard<std::mutex> lock(last_previous_mutex);
+      last_previous = previous;
+      last_update = number;
+    });
+  auto get_last_previous = [&]() {
+      std::lock_guard<std::mutex> lock(last_previous_mutex);
+      return last_previous;
+    };
+  auto wait_for_revision = [&map](const uint64_t & revision) {
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+      while (map.revision() < revision && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      return map.revision() >= revision;
+    };
+
+  // a new line is written under another name and moved in, as the offline optimizer does
+  fs::copy_file(barc_dir / "15_barc_optm.txt", folder / "15_optm.txt.tmp");
+  fs::rename(folder / "15_optm.txt.tmp", folder / "15_optm.txt");
+  ASSERT_TRUE(wait_for_revision(1));
+  const auto optm = map.get_trajectory(15);
+  ASSERT_TRUE(optm);
+  EXPECT_EQ(last_update, 15);
+  EXPECT_EQ(get_last_previous(), nullptr);
+  EXPECT_EQ(map.indices(), (std::vector<int>{2, 15}));
+
+  // a trajectory in use stays valid when its file is replaced
+  const auto center = map.get_trajectory(2);
+  fs::copy_file(
+    barc_dir / "15_barc_optm.txt", folder / "2_center.txt",
+    fs::copy_options::overwrite_existing);
+  ASSERT_TRUE(wait_for_revision(2));
+  EXPECT_NE(map.get_trajectory(2), center);
+  // the frame the laps of partition 2 were recorded in is handed to the callback
+  EXPECT_EQ(get_last_previous(), center);
+  EXPECT_DOUBLE_EQ(map.get_trajectory(2)->total_length(), optm->total_length());
+  EXPECT_GT(center->total_length(), 0.0);
+
+  // a malformed file keeps the previous trajectory, and a removed file removes it
+  std::ofstream(folder / "15_optm.txt") << "1 2 3" << std::endl;
+  fs::remove(folder / "2_center.txt");
+  ASSERT_TRUE(wait_for_revision(3));
+  EXPECT_EQ(map.get_trajectory(15), optm);
+  EXPECT_EQ(map.get_trajectory(2), nullptr);
+  EXPECT_EQ(last_update, 2);
+  fs::remove_all(folder);
+}
+
+TEST(RacingTrajectoryTest, TestLapJournal) {
+  using lmpc::vehicle_model::racing_trajectory::JournalRecordType;
+  using lmpc::vehicle_model::racing_trajectory::LapJournal;
+  namespace fs = std::filesystem;
+
+  const auto path = (fs::temp_directory_path() /
+    ("test_lap_journal_" + std::to_string(getpid()))).string();
+  fs::remove(path);
+  std::vector<double> x(6), u(2);
+  {
+    // the writer only commits on flush, so that the buffer fills up
+    auto journal = LapJournal(path, 6, 2, 8, 100.0);
+    ASSERT_TRUE(journal.append_marker(JournalRecordType::LAP_START, 1, 4));
+    for (int i = 0; i < 20; i++) {
+      x[0] = i;
+      u[1] = -i;
+      ASSERT_TRUE(journal.append_step(1, 4, x.data(), u.data(), 0.1 * i, 0.01 * i));
+      if (i % 7 == 6) {
+        journal.flush();
+      }
+    }
+    journal.flush();
+    EXPECT_EQ(journal.num_committed(), 21u);
+    EXPECT_EQ(journal.num_dropped(), 0u);
+    ASSERT_TRUE(journal.append_marker(JournalRecordType::LAP_END, 1, 4));
+    ASSERT_TRUE(journal.append_marker(JournalRecordType::LAP_START, 2, 4));
+    for (int i = 0; i < 6; i++) {
+      ASSERT_TRUE(journal.append_step(2, 4, x.data(), u.data(), 0.0, 1.0 + i));
+    }
+    // the step is dropped rather than waiting for the writer
+    EXPECT_FALSE(journal.append_step(2, 4, x.data(), u.data(), 0.0, 7.0));
+    EXPECT_EQ(journal.num_dropped(), 1u);
+  }
+
+  // the record torn by a crash is ignored
+  std::ofstream(path, std::ios::binary | std::ios::app) << "torn";
+  auto laps = LapJournal::recover(path);
+  ASSERT_EQ(laps.size(), 2u);
+  EXPECT_TRUE(laps[0].started);
+  EXPECT_TRUE(laps[0].completed);
+  EXPECT_EQ(laps[0].partition, 4);
+  ASSERT_EQ(laps[0].x.size2(), 20);
+  EXPECT_DOUBLE_EQ(static_cast<double>(laps[0].x(0, 19)), 19.0);
+  EXPECT_DOUBLE_EQ(static_cast<double>(laps[0].u(1, 19)), -19.0);
+  EXPECT_DOUBLE_EQ(static_cast<double>(laps[0].k(19)), 1.9);
+  EXPECT_FALSE(laps[1].completed);
+  EXPECT_EQ(laps[1].t.numel(), 6);
+
+  // compacted to the lap in progress, which is then discarded
+  LapJournal::compact(path, 6, 2, {laps[1]});
+  EXPECT_THROW(LapJournal(path, 5, 2), std::runtime_error);
+  {
+    auto journal = LapJournal(path, 6, 2);
+    journal.append_marker(JournalRecordType::DISCARD, 2, 4);
+  }
+  EXPECT_TRUE(LapJournal::recover(path).empty());
+  fs::remove(path);
+}
+
+TEST(RacingTrajectoryTest, TestSafeSetRecorderJournal) {
+  using casadi::Slice;
+  using lmpc::vehicle_model::racing_trajectory::SafeSetManager;
+  using lmpc::vehicle_model::racing_trajectory::SafeSetRecorder;
+  using lmpc::vehicle_model::racing_trajectory::SyntheticLapConfig;
+  using lmpc::vehicle_model::racing_trajectory::SyntheticTrackConfig;
+  using lmpc::vehicle_model::racing_trajectory::generate_synthetic_lap;
+  using lmpc::vehicle_model::racing_trajectory::generate_synthetic_track;
+  namespace fs = std::filesystem;
+
+  SyntheticTrackConfig track_config;
+  track_config.length = 500.0;
+  track_config.num_points = 500;
+  SyntheticLapConfig lap_config;
+  lap_config.num_points = 200;
+  const auto lap = generate_synthetic_lap(generate_synthetic_track(track_config), lap_config);
+  const auto n = lap.x.size2();
+  const auto lap_time = static_cast<double>(lap.t(n - 1)) + 0.1;
+  auto step = [&lap, &lap_time](
+    SafeSetRecorder & recorder, const int & pass, const casadi_int & i) {
+      recorder.step(
+        lap.x(Slice(), i), lap.u(Slice(), i), lap.k(i), lap.t(i) + pass * lap_time,
+        lap.total_length);
+    };
+
+  const auto path = (fs::temp_directory_path() /
+    ("test_safe_set_journal_" + std::to_string(getpid()))).string();
+  fs::remove(path);
+  {
+    // an out lap, a complete lap and half a lap before the crash
+    SafeSetManager manager(5);
+    SafeSetRecorder recorder(manager, false, "");
+    recorder.open_journal(path, 6, 2, 0.01, 1.0);
+    for (int pass = 0; pass < 2; pass++) {
+      for (casadi_int i = 0; i < n; i++) {
+        step(recorder, pass, i);
+      }
+    }
+    for (casadi_int i = 0; i < n / 2; i++) {
+      step(recorder, 2, i);
+    }
+    EXPECT_EQ(manager.num_laps(0), 1u);
+  }
+
+  // the complete lap is restored, and the lap in progress resumes to complete
+  SafeSetManager manager(5);
+  SafeSetRecorder recorder(manager, false, "");
+  recorder.open_journal(path, 6, 2, 0.01, 1.0);
+  step(recorder, 2, n / 2);
+  EXPECT_EQ(manager.num_laps(0), 1u);
+  for (casadi_int i = n / 2 + 1; i < n; i++) {
+    step(recorder, 2, i);
+  }
+  step(recorder, 3, 0);
+  ASSERT_EQ(manager.num_laps(0), 2u);
+  EXPECT_EQ(manager.recorded_laps().at(0).back()->data().x.size2(), n);
+  EXPECT_EQ(recorder.journal()->num_dropped(), 0u);
+  fs::remove(path);
+
+  // a completed lap leaves the journal only once all of its files are saved
+  using lmpc::vehicle_model::racing_trajectory::JournalLap;
+  using lmpc::vehicle_model::racing_trajectory::LapJournal;
+  const auto folder = fs::temp_directory_path() /
+    ("test_safe_set_files_" + std::to_string(getpid()));
+  fs::remove_all(folder);
+  fs::create_directories(folder);
+  JournalLap completed;
+  completed.lap = 1;
+  completed.started = true;
+  completed.completed = true;
+  completed.x = lap.x;
+  completed.u = lap.u;
+  completed.k = lap.k;
+  completed.t = lap.t;
+  LapJournal::compact(path, 6, 2, {completed});
+  // a crash left only the states of the lap
+  lap.x.T().to_file((folder / "lap_1_x.txt").string(), "txt");
+  {
+    SafeSetManager file_manager(5);
+    SafeSetRecorder file_recorder(file_manager, true, (folder / "").string());
+    file_recorder.open_journal(path, 6, 2, 0.01, 1.0);
+  }
+  for (const auto & suffix : {"_x.txt", "_u.txt", "_t.txt", "_k.txt"}) {
+    EXPECT_TRUE(fs::exists(folder / (std::string("lap_1") + suffix)));
+    EXPECT_FALSE(fs::exists(folder / (std::string("lap_1") + suffix + ".tmp")));
+  }
+  EXPECT_EQ(casadi::DM::from_file((folder / "lap_1_k.txt").string(), "txt").numel(), n);
+  EXPECT_TRUE(LapJournal::recover(path).empty());
+  fs::remove(path);
+  fs::remove_all(folder);
+}
@@ -13,7 +13,10 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
+#include <vector>
+
 #include "single_track_planar_model/single_track_planar_model.hpp"
+#include "base_vehicle_model/tyre_approximation.hpp"
 #include "lmpc_utils/utils.hpp"
 #define GRAVITY 9.8
 
@@ -296,8 +299,12 @@ void SingleTrackPlanarModel::compile_dynamics()
   // const auto Fy_fl = mu * Fz_fl * sin(Cf * atan(Ef * atan(Bf * a_fl)));
   // const auto Fy_rl = mu * Fz_rl * sin(Cr * atan(Er * atan(Br * a_rl)));
   // simplification - version B
-  const auto Fy_fl = mu * Fz_fl * sin(Cf * atan(Bf * a_fl));
-  const auto Fy_rl = mu * Fz_rl * sin(Cr * atan(Br * a_rl));
+  // the normalized lateral forces are symbols here, substituted by the magic formula
+  // for the dynamics and by its approximation for the fast dynamics
+  const auto Fy_norm = SX::sym("Fy_norm", 2);
+  const auto Fy_fl = mu * Fz_fl * Fy_norm(0);
+  const auto Fy_rl = mu * Fz_rl * Fy_norm(1);
+  const auto Fy_norm_exact = vertcat(sin(Cf * atan(Bf * a_fl)), sin(Cr * atan(Br * a_rl)));
 
   // dynamics (eq. 3a, 3b, 3c)
   // const auto v_dot = 1.0 / m *
@@ -329,10 +336,12 @@ void SingleTrackPlanarModel::compile_dynamics()
     phi_dot -= k * px_dot;
   }
 
-  const auto x_dot = vertcat(px_dot, py_dot, phi_dot, vx_dot, vy_dot, omega_dot);
+  const auto x_dot_sym = vertcat(px_dot, py_dot, phi_dot, vx_dot, vy_dot, omega_dot);
   const auto Fx_ij = vertcat(Fx_fl, Fx_rl);
-  const auto Fy_ij = vertcat(Fy_fl, Fy_rl);
+  const auto Fy_ij_sym = vertcat(Fy_fl, Fy_rl);
   const auto Fz_ij = vertcat(Fz_fl, Fz_rl);
+  const auto x_dot = SX::substitute(x_dot_sym, Fy_norm, Fy_norm_exact);
+  const auto Fy_ij = SX::substitute(Fy_ij_sym, Fy_norm, Fy_norm_exact);
 
   dynamics_ = casadi::Function(
     "single_track_planar_model_dynamics",
@@ -353,16 +362,20 @@ void SingleTrackPlanarModel::compile_dynamics()
   );
 
   // discretize dynamics
+  // the discrete jacobians are propagated through the integrator stages
   SX xip1;
+  casadi::Function discrete_jacobian;
   const auto & integrator_type = get_base_config().modeling_config->integrator_type;
   if (integrator_type == base_vehicle_model::IntegratorType::RK4) {
     xip1 = utils::rk4_function(nx(), nu(), dynamics_)(
       casadi::SXDict{{"x", x}, {"u", u}, {"k", k}, {"dt", dt}}
     ).at("xip1");
+    discrete_jacobian = utils::rk4_jacobian_function(nx(), nu(), dynamics_, dynamics_jacobian_);
   } else if (integrator_type == base_vehicle_model::IntegratorType::EULER) {
     xip1 = utils::euler_function(nx(), nu(), dynamics_)(
       casadi::SXDict{{"x", x}, {"u", u}, {"k", k}, {"dt", dt}}
     ).at("xip1");
+    discrete_jacobian = utils::euler_jacobian_function(nx(), nu(), dynamics_, dynamics_jacobian_);
   } else {
     throw std::runtime_error("unsupported integrator type");
   }
@@ -374,18 +387,35 @@ void SingleTrackPlanarModel::compile_dynamics()
     {"x", "u", "k", "dt"},
     {"xip1", "Fx_ij", "Fy_ij", "Fz_ij"});
 
-  const auto Ad = SX::jacobian(xip1, x);
-  const auto Bd = SX::jacobian(xip1, u);
-  const auto gd = xip1 - (SX::mtimes(Ad, x) + SX::mtimes(Bd, u));
-
   discrete_dynamics_jacobian_ = casadi::Function(
     "single_track_planar_model_discrete_dynamics_jacobian",
     {x, u, k, dt},
-    {Ad, Bd, gd},
+    discrete_jacobian(std::vector<SX>{x, u, k, dt}),
     {"x", "u", "k", "dt"},
     {"A", "B", "g"}
   );
 
+  // replace the magic formula with its approximation in the fast dynamics
+  const auto & modeling_config = *get_base_config().modeling_config;
+  if (modeling_config.tyre_approximation_tol > 0.0) {
+    const auto front = base_vehicle_model::TyreApproximation(
+      Bf, Cf, 0.0, modeling_config.tyre_approximation_max_slip,
+      modeling_config.tyre_approximation_tol);
+    const auto rear = base_vehicle_model::TyreApproximation(
+      Br, Cr, 0.0, modeling_config.tyre_approximation_max_slip,
+      modeling_config.tyre_approximation_tol);
+    const auto Fy_norm_fast = vertcat(front.evaluate(a_fl), rear.evaluate(a_rl));
+    set_fast_dynamics(
+      casadi::Function(
+        "single_track_planar_model_fast_dynamics",
+        {x, u, k},
+        SX::substitute(
+          std::vector<SX>{x_dot_sym, Fx_ij, Fy_ij_sym, Fz_ij}, std::vector<SX>{Fy_norm},
+          std::vector<SX>{Fy_norm_fast}),
+        {"x", "u", "k"},
+        {"x_dot", "Fx_ij", "Fy_ij", "Fz_ij"}));
+  }
+
   // convert to base state and control
   if (config_->simplify_lon_control) {
     const auto x_sym = SX::sym("x", nx());
@@ -15,13 +15,16 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <iostream>
 #include <rclcpp/rclcpp.hpp>
 #include <ament_index_cpp/get_package_share_directory.hpp>
 
 #include "base_vehicle_model/ros_param_loader.hpp"
+#include "lmpc_utils/casadi_evaluator.hpp"
 #include "single_track_planar_model/ros_param_loader.hpp"
 #include "single_track_planar_model/single_track_planar_model.hpp"
+#include "single_track_planar_model/single_track_planar_model_types.hpp"
 
 TEST(SingleTrackPlanarModelTest, TestSingleTrackPlanarModel) {
   rclcpp::init(0, nullptr);
@@ -81,3 +84,181 @@ TEST(SingleTrackPlanarModelTest, TestSingleTrackDynamics) {
   rclcpp::shutdown();
   SUCCEED();
 }
+
+TEST(SingleTrackPlanarModelTest, TestSingleTrackFastDynamics) {
+  rclcpp::init(0, nullptr);
+  const auto base_share_dir = ament_index_cpp::get_package_share_directory("base_vehicle_model");
+  const auto share_dir = ament_index_cpp::get_package_share_directory("single_track_planar_model");
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle.param.yaml",
+    "--params-file", share_dir + "/param/sample_vehicle.param.yaml",
+  });
+  auto test_node = rclcpp::Node("test_single_track_planar_model_node", options);
+
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(&test_node);
+  auto config = lmpc::vehicle_model::single_track_planar_model::load_parameters(&test_node);
+  const double tol = 1e-3;
+  base_config->modeling_config->tyre_approximation_tol = tol;
+  auto model = lmpc::vehicle_model::single_track_planar_model::SingleTrackPlanarModel(
+    base_config,
+    config);
+
+  auto exact = lmpc::utils::CasadiEvaluator(model.dynamics());
+  auto fast = lmpc::utils::CasadiEvaluator(model.fast_dynamics());
+  for (auto * eval : {&exact, &fast}) {
+    eval->input("x") = casadi::DM{0.0, 0.5, 0.05, 30.0, 0.5, 0.2};
+    eval->input("u") = casadi::DM{0.5, 0.05};
+    eval->input("k") = 0.01;
+    eval->evaluate();
+  }
+  // the lateral force error is bounded by the normalized error times mu * Fz
+  const auto & Fz = exact.output("Fz_ij").nonzeros();
+  for (size_t i = 0; i < Fz.size(); i++) {
+    EXPECT_NEAR(
+      exact.output("Fy_ij").nonzeros()[i], fast.output("Fy_ij").nonzeros()[i],
+      tol * config->mu * Fz[i] * 1.01);
+  }
+  EXPECT_TRUE(
+    static_cast<double>(casadi::DM::norm_inf(exact.output("x_dot") - fast.output("x_dot"))) <
+    1e-1);
+
+  const int num_eval = 100000;
+  for (auto * eval : {&exact, &fast}) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_eval; i++) {
+      eval->evaluate();
+    }
+    const auto duration = std::chrono::duration<double, std::nano>(
+      std::chrono::high_resolution_clock::now() - start).count() / num_eval;
+    std::cout << eval->function().name() << ": " << duration << "ns" << std::endl;
+  }
+
+  rclcpp::shutdown();
+  SUCCEED();
+}
+
+TEST(SingleTrackPlanarModelTest, TestSingleTrackTypedDynamics) {
+  rclcpp::init(0, nullptr);
+  const auto base_share_dir = ament_index_cpp::get_package_share_directory("base_vehicle_model");
+  const auto share_dir = ament_index_cpp::get_package_share_directory("single_track_planar_model");
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle.param.yaml",
+    "--params-file", share_dir + "/param/sample_vehicle.param.yaml",
+  });
+  auto test_node = rclcpp::Node("test_single_track_planar_model_node", options);
+
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(&test_node);
+  auto config = lmpc::vehicle_model::single_track_planar_model::load_parameters(&test_node);
+  auto model = lmpc::vehicle_model::single_track_planar_model::SingleTrackPlanarModel(
+    base_config,
+    config);
+  using lmpc::vehicle_model::single_track_planar_model::SingleTrackTypes;
+  using lmpc::vehicle_model::base_vehicle_model::from_dm;
+
+  const auto x_dm = casadi::DM{0.0, 0.5, 0.05, 30.0, 0.5, 0.2};
+  const auto u_dm = casadi::DM::ones(model.nu()) * 0.05;
+  SingleTrackTypes::State x;
+  SingleTrackTypes::Control u;
+  from_dm(x_dm, x);
+  from_dm(u_dm, u);
+
+  auto typed = lmpc::vehicle_model::base_vehicle_model::TypedDiscreteDynamics<SingleTrackTypes>(
+    model.discrete_dynamics());
+  const auto & x_next = typed(x, u, 0.01, 0.05);
+  const auto expected = model.discrete_dynamics()(
+    casadi::DMDict{{"x", x_dm}, {"u", u_dm}, {"k", 0.01}, {"dt", 0.05}}).at("xip1");
+  for (int i = 0; i < SingleTrackTypes::NX; i++) {
+    EXPECT_NEAR(x_next(i), expected.nonzeros()[i], 1e-9);
+  }
+
+  const int num_eval = 100000;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_eval; i++) {
+    model.discrete_dynamics()(
+      casadi::DMDict{{"x", x_dm}, {"u", u_dm}, {"k", 0.01}, {"dt", 0.05}});
+  }
+  const auto dm_time = std::chrono::duration<double, std::nano>(
+    std::chrono::high_resolution_clock::now() - start).count() / num_eval;
+  start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < num_eval; i++) {
+    typed(x, u, 0.01, 0.05);
+  }
+  const auto typed_time = std::chrono::duration<double, std::nano>(
+    std::chrono::high_resolution_clock::now() - start).count() / num_eval;
+  std::cout << "DM: " << dm_time << "ns, Typed: " << typed_time << "ns" << std::endl;
+
+  rclcpp::shutdown();
+  SUCCEED();
+}
+
+TEST(SingleTrackPlanarModelTest, TestSingleTrackDiscreteJacobian) {
+  rclcpp::init(0, nullptr);
+  const auto base_share_dir = ament_index_cpp::get_package_share_directory("base_vehicle_model");
+  const auto share_dir = ament_index_cpp::get_package_share_directory("single_track_planar_model");
+  rclcpp::NodeOptions options;
+  options.arguments(
+  {
+    "--ros-args",
+    "--params-file", base_share_dir + "/param/sample_vehicle.param.yaml",
+    "--params-file", share_dir + "/param/sample_vehicle.param.yaml",
+  });
+  auto test_node = rclcpp::Node("test_single_track_planar_model_node", options);
+
+  auto base_config = lmpc::vehicle_model::base_vehicle_model::load_parameters(&test_node);
+  auto config = lmpc::vehicle_model::single_track_planar_model::load_parameters(&test_node);
+  auto model = lmpc::vehicle_model::single_track_planar_model::SingleTrackPlanarModel(
+    base_config,
+    config);
+
+  // the symbolic jacobian of the unrolled integrator step
+  using casadi::SX;
+  const auto x = SX::sym("x", model.nx());
+  const auto u = SX::sym("u", model.nu());
+  const auto k = SX::sym("k", 1);
+  const auto dt = SX::sym("dt", 1);
+  const auto xip1 = model.discrete_dynamics()(
+    casadi::SXDict{{"x", x}, {"u", u}, {"k", k}, {"dt", dt}}).at("xip1");
+  const auto Ad = SX::jacobian(xip1, x);
+  const auto Bd = SX::jacobian(xip1, u);
+  const auto unrolled = casadi::Function(
+    "unrolled_discrete_dynamics_jacobian", {x, u, k, dt},
+    {Ad, Bd, xip1 - (SX::mtimes(Ad, x) + SX::mtimes(Bd, u))}, {"x", "u", "k", "dt"},
+    {"A", "B", "g"});
+
+  auto structured = lmpc::utils::CasadiEvaluator(model.discrete_dynamics_jacobian());
+  auto reference = lmpc::utils::CasadiEvaluator(unrolled);
+  for (auto * eval : {&structured, &reference}) {
+    eval->input("x") = casadi::DM{10.0, 0.5, 0.05, 30.0, 0.5, 0.2};
+    eval->input("u") = casadi::DM::ones(model.nu()) * 0.05;
+    eval->input("k") = 0.01;
+    eval->input("dt") = 0.1;
+    eval->evaluate();
+  }
+  for (const auto & name : {"A", "B", "g"}) {
+    const auto & expected = reference.output(name);
+    EXPECT_LE(
+      static_cast<double>(casadi::DM::norm_inf(structured.output(name) - expected)),
+      1e-10 * (1.0 + static_cast<double>(casadi::DM::norm_inf(expected)))) << name;
+  }
+
+  const int num_eval = 100000;
+  for (auto * eval : {&structured, &reference}) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_eval; i++) {
+      eval->evaluate();
+    }
+    const auto duration = std::chrono::duration<double, std::nano>(
+      std::chrono::high_resolution_clock::now() - start).count() / num_eval;
+    std::cout << eval->function().name() << ": " << eval->function().n_nodes() << " nodes, " <<
+      duration << "ns per stage" << std::endl;
+  }
+
+  rclcpp::shutdown();
+  SUCCEED();
+}